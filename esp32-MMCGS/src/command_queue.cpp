@@ -0,0 +1,94 @@
+// command_queue.cpp
+// 定长命令队列实现
+
+#include "command_queue.h"
+
+CommandQueue::CommandQueue() : _size(0), _freeCount(COMMAND_QUEUE_CAPACITY), _nextSeq(0) {
+    for (uint8_t i = 0; i < COMMAND_QUEUE_CAPACITY; i++) {
+        _free[i] = COMMAND_QUEUE_CAPACITY - 1 - i;
+    }
+}
+
+bool CommandQueue::before(uint8_t a, uint8_t b) const {
+    if (_pool[a].targetTime != _pool[b].targetTime) {
+        return _pool[a].targetTime < _pool[b].targetTime;
+    }
+    return (int32_t)(_seq[a] - _seq[b]) < 0;
+}
+
+void CommandQueue::place(uint8_t pos, uint8_t node) {
+    _heap[pos] = node;
+}
+
+void CommandQueue::siftUp(uint8_t pos) {
+    uint8_t node = _heap[pos];
+    while (pos > 0) {
+        uint8_t parent = (pos - 1) / 2;
+        if (!before(node, _heap[parent])) {
+            break;
+        }
+        place(pos, _heap[parent]);
+        pos = parent;
+    }
+    place(pos, node);
+}
+
+void CommandQueue::siftDown(uint8_t pos) {
+    uint8_t node = _heap[pos];
+    while (true) {
+        uint8_t child = pos * 2 + 1;
+        if (child >= _size) {
+            break;
+        }
+        if (child + 1 < _size && before(_heap[child + 1], _heap[child])) {
+            child++;
+        }
+        if (!before(_heap[child], node)) {
+            break;
+        }
+        place(pos, _heap[child]);
+        pos = child;
+    }
+    place(pos, node);
+}
+
+void CommandQueue::removeTop() {
+    _free[_freeCount++] = _heap[0];
+    _size--;
+    if (_size == 0) {
+        return;
+    }
+    // 用最后一个元素填补堆顶，再下沉
+    place(0, _heap[_size]);
+    siftDown(0);
+}
+
+bool CommandQueue::push(const PendingCommand& cmd) {
+    if (_freeCount == 0) {
+        return false;
+    }
+    uint8_t node = _free[--_freeCount];
+    _pool[node] = cmd;
+    _seq[node] = _nextSeq++;
+    place(_size, node);
+    _size++;
+    siftUp(_size - 1);
+    return true;
+}
+
+bool CommandQueue::popDue(time_t now, PendingCommand& out) {
+    if (_size == 0 || _pool[_heap[0]].targetTime > now) {
+        return false;
+    }
+    out = _pool[_heap[0]];
+    removeTop();
+    return true;
+}
+
+bool CommandQueue::peekDue(time_t& due) const {
+    if (_size == 0) {
+        return false;
+    }
+    due = _pool[_heap[0]].targetTime;
+    return true;
+}
@@ -0,0 +1,63 @@
+// command_queue.h
+// 定长命令队列
+// 功能：按 targetTime 排序的最小堆，同一时间按入队顺序执行。
+// 命令存放在固定大小的静态池里，命令名和动作也是定长字段，堆里只排池下标，
+// 入队不申请内存，入队 / 取出都是 O(log n)。
+// 本身不加锁，调用方持有 g_cmdMutex。
+
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+static constexpr uint8_t COMMAND_QUEUE_CAPACITY = 50;
+static constexpr size_t COMMAND_NAME_MAX = 16;     // 含结尾 '\0'，放不下的命令名入队前拒绝
+static constexpr size_t COMMAND_ACTION_MAX = 8;
+
+struct PendingCommand {
+    char cmd[COMMAND_NAME_MAX];
+    char action[COMMAND_ACTION_MAX];
+    unsigned long duration;
+    time_t targetTime;
+};
+
+class CommandQueue {
+public:
+    CommandQueue();
+
+    /**
+     * @brief 加入一条命令
+     * @return 队列已满返回 false
+     */
+    bool push(const PendingCommand& cmd);
+
+    /**
+     * @brief 最早的命令在 now 时已到期则取出
+     */
+    bool popDue(time_t now, PendingCommand& out);
+
+    /**
+     * @brief 最早一条命令的 targetTime，队列为空返回 false
+     */
+    bool peekDue(time_t& due) const;
+
+    size_t size() const { return _size; }
+
+private:
+    bool before(uint8_t a, uint8_t b) const;
+    void place(uint8_t pos, uint8_t node);
+    void siftUp(uint8_t pos);
+    void siftDown(uint8_t pos);
+    void removeTop();
+
+    PendingCommand _pool[COMMAND_QUEUE_CAPACITY];
+    uint32_t _seq[COMMAND_QUEUE_CAPACITY];       // 入队序号，同一时间先入先出
+    uint8_t _heap[COMMAND_QUEUE_CAPACITY];       // 池下标组成的最小堆
+    uint8_t _free[COMMAND_QUEUE_CAPACITY];       // 空闲池下标栈
+    uint8_t _size;
+    uint8_t _freeCount;
+    uint32_t _nextSeq;
+};
+
+#endif
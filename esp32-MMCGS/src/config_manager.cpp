@@ -56,6 +56,11 @@ bool loadConfigFromSPIFFS(const char* path) {
 		appConfig.staticMeasureTime = 30000;
 		appConfig.purgePumpTime = 15000;
 		appConfig.readInterval = 60000;
+		appConfig.cacheUploadBatch = 10;
+		appConfig.cacheUploadQos = 0;
+		appConfig.cacheInflight = 8;
+		appConfig.heapReportInterval = 3600000;
+		appConfig.diagInterval = 0;
 		ensurePointDeviceCodes();
 
 		return true;
@@ -114,6 +119,13 @@ bool loadConfigFromSPIFFS(const char* path) {
 	appConfig.staticMeasureTime = doc["static_measure_time"] | 30000;
 	appConfig.purgePumpTime = doc["purge_pump_time"] | 15000;
 	appConfig.readInterval = doc["read_interval"] | 600000;
+	appConfig.cacheUploadBatch = doc["cache_upload_batch"] | 10;
+	if (appConfig.cacheUploadBatch < 1) appConfig.cacheUploadBatch = 1;
+	appConfig.cacheUploadQos = (doc["cache_upload_qos"] | 0) >= 1 ? 1 : 0;
+	appConfig.cacheInflight = doc["cache_inflight"] | 8;
+	if (appConfig.cacheInflight < 1) appConfig.cacheInflight = 1;
+	appConfig.heapReportInterval = doc["heap_report_interval"] | 3600000;
+	appConfig.diagInterval = doc["diag_interval"] | 0;
 	ensurePointDeviceCodes();
 
 	return true;
@@ -148,6 +160,11 @@ bool saveConfigToSPIFFS(const char* path) {
 	doc["static_measure_time"] = appConfig.staticMeasureTime;
 	doc["purge_pump_time"] = appConfig.purgePumpTime;
 	doc["read_interval"] = appConfig.readInterval;
+	doc["cache_upload_batch"] = appConfig.cacheUploadBatch;
+	doc["cache_upload_qos"] = appConfig.cacheUploadQos;
+	doc["cache_inflight"] = appConfig.cacheInflight;
+	doc["heap_report_interval"] = appConfig.heapReportInterval;
+	doc["diag_interval"] = appConfig.diagInterval;
 
 	// 写回文件
 	File file = SPIFFS.open(path, FILE_WRITE);
@@ -30,6 +30,9 @@ struct AppConfig {
 	String mqttResponseTopic() const {
 		return "compostlab/v2/" + deviceCode + "/response";
 	}
+	String mqttDiagTopic() const {
+		return "compostlab/v2/" + deviceCode + "/diag";
+	}
 
 	std::vector<String> ntpServers;
 
@@ -41,6 +44,16 @@ struct AppConfig {
 	uint32_t purgePumpTime;
 	// 整轮巡检的启动周期（毫秒）。
 	uint32_t readInterval;
+	// 断网缓存补传时每批连续发布的条数（1 表示逐条补传）。
+	uint16_t cacheUploadBatch;
+	// 断网缓存补传的 QoS：0 为发布即确认，1 为收到 PUBACK 后才确认缓存记录。
+	uint8_t cacheUploadQos;
+	// QoS1 补传时最多同时在途（已发布、未收到 PUBACK）的条数。
+	uint8_t cacheInflight;
+	// 堆/栈健康通道附加到遥测的间隔（毫秒，0 表示不附加）。
+	uint32_t heapReportInterval;
+	// 周期发布诊断报文的间隔（毫秒，0 表示只在收到 diag 命令时发布）。
+	uint32_t diagInterval;
 };
 
 extern AppConfig appConfig;
@@ -1,13 +1,22 @@
 // data_buffer.cpp
 // 断网数据缓存模块实现
-// 使用单个JSON文件存储所有缓存数据
+// 使用追加写的分段日志存储缓存数据：
+// - 数据段 /dcache_NNNNNN.seg：每段最多 CACHE_SEGMENT_RECORDS 条记录，只追加不改写
+// - 游标文件 /dcache.cur：记录下一条待上传记录所在的段号和段内偏移
+// 入队只追加一条记录，确认上传只重写几字节的游标，整段确认后直接删除该段。
+// 启动时扫描一次日志，在内存里建立待上传记录索引，之后读写只按索引定位，不再扫描文件。
+// 记录分两种：原样保存的 JSON payload，以及紧凑样本（topic_registry 编号 + 定长通道值），
+// 紧凑样本在补传时才重新渲染成与实时上报一致的 JSON。
 
 #include "data_buffer.h"
 #include <SPIFFS.h>
 #include "config_manager.h"
 #include <vector>
+#include <deque>
 #include <limits.h>
 #include "wifi_ntp_mqtt.h"
+#include "topic_registry.h"
+#include "telemetry_writer.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 
@@ -15,11 +24,49 @@
 
 static int g_maxCacheCount = 100;
 static int g_maxCacheDays = 7;
-static const char* CACHE_FILE = "/data_cache.json";
-static const char* CACHE_TEMP_FILE = "/data_cache.tmp";
-static const char* CACHE_BACKUP_FILE = "/data_cache.bak";
+static const char* CACHE_SEGMENT_PREFIX = "dcache_";
+static const char* CACHE_SEGMENT_SUFFIX = ".seg";
+static const char* CACHE_CURSOR_FILE = "/dcache.cur";
+// 旧版单文件 JSON 缓存，启动时导入日志后删除
+static const char* LEGACY_CACHE_FILE = "/data_cache.json";
+static const char* LEGACY_CACHE_TEMP_FILE = "/data_cache.tmp";
+static const char* LEGACY_CACHE_BACKUP_FILE = "/data_cache.bak";
 static SemaphoreHandle_t g_cacheMutex = nullptr;
 
+// 每段记录数：段越小回收越及时，段越大文件数越少
+static const int CACHE_SEGMENT_RECORDS = 32;
+static const uint16_t CACHE_RECORD_MAGIC = 0xDCA1;
+static const uint32_t CACHE_CURSOR_MAGIC = 0xDCC00001UL;
+// 单个字段长度上限，超出视为记录损坏
+static const uint16_t CACHE_MAX_FIELD_LEN = 4096;
+
+// 记录类型
+static const uint8_t RECORD_KIND_JSON = 0;     // topic / timestamp / payload 原样保存
+static const uint8_t RECORD_KIND_SAMPLE = 1;   // 紧凑样本，payload 字段存放编码后的样本
+// 紧凑样本：样本头 8 字节 + 每通道 6 字节
+// 采样时间单独存在样本头里，延后重发改写记录头 epoch 时不影响 payload 中的 ts
+static const uint16_t SAMPLE_HEAD_LEN = 8;
+static const uint16_t SAMPLE_CHANNEL_LEN = 6;
+static const uint8_t SAMPLE_FLAG_CONTROLLER_CODE = 0x01;
+
+// 通道表：编号与 data_buffer.h 中的 CacheChannelId 一一对应
+struct ChannelDef {
+    const char* code;
+    const char* unit;
+    uint8_t decimals;
+};
+static const ChannelDef CHANNEL_DEFS[CACHE_CH_COUNT] = {
+    { "CO2", "%VOL", 2 },
+    { "CO", "ppm", 1 },
+    { "H2S", "ppm", 1 },
+    { "O2", "%VOL", 2 },
+    { "CH4", "%LEL", 1 },
+    { "AirTemp", "℃", 1 },
+    { "AirHumidity", "%RH", 1 },
+    { "RoomTemp", "℃", 1 },
+};
+static const char* QUALITY_NAMES[] = { "OK", "ERR", "UNSTABLE" };
+
 class CacheLock {
 public:
     CacheLock() {
@@ -36,22 +83,70 @@ public:
 
 // ========== 内部结构 ==========
 
+// 记录头，后面紧跟 topic / timestamp / payload 三段原始字节
+struct RecordHeader {
+    uint16_t magic;
+    uint8_t retryCount;
+    uint8_t kind;
+    uint32_t epoch;
+    uint16_t topicLen;
+    uint16_t tsLen;
+    uint16_t payloadLen;
+    uint16_t reserved2;
+    uint32_t checksum;
+};
+static_assert(sizeof(RecordHeader) == 20, "RecordHeader layout must stay stable on flash");
+
+// 游标文件内容
+struct CursorState {
+    uint32_t magic;
+    uint32_t headSeg;
+    uint32_t headOffset;
+    uint32_t check;
+};
+
 struct CacheItem {
     String topic;
     String payload;
     String timestamp;
     unsigned long epoch;
-    bool uploaded;
     uint8_t retryCount;
+    uint8_t kind = 0;
+    std::vector<char> raw;  // 紧凑样本的原始编码
+};
+
+// 内存索引项：只保存定位与淘汰需要的字段，payload 等仍留在 flash 上
+struct CacheIndexEntry {
+    uint32_t epoch;
+    uint32_t seg;
+    uint32_t offset;
+    uint16_t length;     // 整条记录（含记录头）字节数
+    uint8_t retryCount;
+    uint8_t reserved;
 };
+static_assert(sizeof(CacheIndexEntry) == 16, "CacheIndexEntry should stay compact");
+
+// ========== 日志状态（受 g_cacheMutex 保护） ==========
+
+static bool g_logReady = false;
+static uint32_t g_firstSeg = 0;      // 最旧的未回收段
+static uint32_t g_headSeg = 0;       // 下一条待上传记录所在段
+static uint32_t g_headOffset = 0;    // 下一条待上传记录的段内偏移
+static uint32_t g_tailSeg = 0;       // 当前追加段
+static uint32_t g_tailOffset = 0;    // 当前追加段的写入位置
+static int g_tailRecords = 0;        // 当前追加段已有记录数
+static int g_recycledRecords = 0;    // 自上次 cleanUploadedData 以来随段回收的已上传记录数
+static int g_headSegAcked = 0;       // 当前读取段内已确认的记录数
+// 待上传记录索引，按写入顺序排列，队首即下一条待上传记录
+static std::deque<CacheIndexEntry> g_index;
 
 // ========== 内部工具函数 ==========
 
 /**
- * @brief 获取缓存文件路径
+ * @brief 获取缓存文件路径（游标文件）
  */
 const char* getCacheFilePath() {
-    return CACHE_FILE;
+    return CACHE_CURSOR_FILE;
 }
 
 /**
@@ -62,172 +157,537 @@ static bool isCacheFull(int currentCount) {
 }
 
 /**
- * @brief 从时间字符串解析为epoch
+ * @brief 获取当前缓存用 epoch（未同步时回退到 millis）
  */
-static time_t parseTimestampToEpoch(const String& ts) {
-    // 格式: "YYYY-MM-DD HH:MM:SS"
-    struct tm tm {};
-    if (strptime(ts.c_str(), "%Y-%m-%d %H:%M:%S", &tm)) {
-        return mktime(&tm);
+static unsigned long getCacheEpoch() {
+    time_t nowEpoch = time(nullptr);
+    return (nowEpoch > 0) ? (unsigned long)nowEpoch : millis();
+}
+
+static String segmentPath(uint32_t seg) {
+    char path[32];
+    snprintf(path, sizeof(path), "/%s%06lu%s", CACHE_SEGMENT_PREFIX, (unsigned long)seg, CACHE_SEGMENT_SUFFIX);
+    return String(path);
+}
+
+static uint32_t fnv1a(uint32_t hash, const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619UL;
     }
-    return 0;
+    return hash;
+}
+
+static uint32_t recordChecksum(const RecordHeader& hdr, const char* topic, const char* ts, const char* payload) {
+    uint32_t hash = 2166136261UL;
+    hash = fnv1a(hash, (const uint8_t*)&hdr.epoch, sizeof(hdr.epoch));
+    hash = fnv1a(hash, &hdr.retryCount, sizeof(hdr.retryCount));
+    hash = fnv1a(hash, &hdr.kind, sizeof(hdr.kind));
+    hash = fnv1a(hash, (const uint8_t*)topic, hdr.topicLen);
+    hash = fnv1a(hash, (const uint8_t*)ts, hdr.tsLen);
+    hash = fnv1a(hash, (const uint8_t*)payload, hdr.payloadLen);
+    return hash;
+}
+
+static uint32_t cursorCheck(const CursorState& c) {
+    return (c.magic ^ (c.headSeg * 2654435761UL) ^ (c.headOffset + 0x9E3779B9UL));
+}
+
+static uint32_t recordSize(const RecordHeader& hdr) {
+    return sizeof(RecordHeader) + hdr.topicLen + hdr.tsLen + hdr.payloadLen;
 }
 
+static bool isHeaderSane(const RecordHeader& hdr) {
+    if (hdr.magic != CACHE_RECORD_MAGIC || hdr.payloadLen > CACHE_MAX_FIELD_LEN) {
+        return false;
+    }
+    if (hdr.kind == RECORD_KIND_SAMPLE) {
+        return hdr.topicLen == 0 && hdr.tsLen == 0 && hdr.payloadLen >= SAMPLE_HEAD_LEN;
+    }
+    return hdr.kind == RECORD_KIND_JSON &&
+        hdr.topicLen > 0 && hdr.topicLen <= CACHE_MAX_FIELD_LEN &&
+        hdr.tsLen <= CACHE_MAX_FIELD_LEN;
+}
+
+// ========== 紧凑样本 ==========
+
 /**
- * @brief 获取当前缓存用 epoch（未同步时回退到 millis）
+ * @brief 把 epoch 格式化成与 getTimeString() 相同的时间字符串
  */
-static unsigned long getCacheEpoch() {
-    time_t nowEpoch = time(nullptr);
-    return (nowEpoch > 0) ? (unsigned long)nowEpoch : millis();
+static void formatSampleTime(uint32_t epoch, char* buf, size_t size) {
+    time_t t = (time_t)epoch;
+    struct tm tinfo;
+    localtime_r(&t, &tinfo);
+    if (tinfo.tm_year < 120) {  // 2020年以前认为未同步
+        strlcpy(buf, "1970-01-01 00:00:00", size);
+        return;
+    }
+    strftime(buf, size, "%Y-%m-%d %H:%M:%S", &tinfo);
 }
 
 /**
- * @brief 选择并删除一条最旧的缓存数据（优先已上传）
+ * @brief 按实时上报的格式渲染样本 payload
+ * @return 渲染结果，缓冲区不足时返回空串
  */
-static bool evictOldestItem(std::vector<CacheItem>& items) {
-    if (items.empty()) {
+static String renderSamplePayload(const char* ts, uint8_t pointId, uint8_t flags,
+    const uint8_t* channels, uint8_t channelCount) {
+    char buf[TELEMETRY_PAYLOAD_MAX];
+    TelemetryWriter writer(buf, sizeof(buf));
+    writer.begin(ts);
+    if (pointId > 0) {
+        writer.pointId(pointId);
+    }
+    if (flags & SAMPLE_FLAG_CONTROLLER_CODE) {
+        writer.controllerCode(appConfig.deviceCode.c_str());
+    }
+    writer.beginChannels();
+    for (uint8_t i = 0; i < channelCount; i++) {
+        const uint8_t* ch = channels + i * SAMPLE_CHANNEL_LEN;
+        const ChannelDef& def = CHANNEL_DEFS[ch[0]];
+        float value;
+        memcpy(&value, ch + 2, sizeof(value));
+        writer.channel(def.code, value, def.decimals, def.unit, QUALITY_NAMES[ch[1]]);
+    }
+    if (!writer.end()) {
+        return String();
+    }
+    return String(buf);
+}
+
+/**
+ * @brief 解码紧凑样本，还原 topic / timestamp / payload
+ */
+static bool decodeSampleRecord(const RecordHeader& hdr, const uint8_t* body, CacheItem& item) {
+    uint8_t topicId = body[0];
+    uint8_t pointId = body[1];
+    uint8_t flags = body[2];
+    uint8_t channelCount = body[3];
+    uint32_t sampleEpoch;
+    memcpy(&sampleEpoch, body + 4, sizeof(sampleEpoch));
+    const String& topic = topicById(topicId);
+    if (topic.length() == 0 ||
+        hdr.payloadLen != SAMPLE_HEAD_LEN + channelCount * SAMPLE_CHANNEL_LEN) {
         return false;
     }
-
-    int oldestUploadedIndex = -1;
-    unsigned long oldestUploadedEpoch = ULONG_MAX;
-    for (int i = 0; i < (int)items.size(); i++) {
-        if (!items[i].uploaded) continue;
-        if (items[i].epoch < oldestUploadedEpoch) {
-            oldestUploadedEpoch = items[i].epoch;
-            oldestUploadedIndex = i;
+    const uint8_t* channels = body + SAMPLE_HEAD_LEN;
+    for (uint8_t i = 0; i < channelCount; i++) {
+        const uint8_t* ch = channels + i * SAMPLE_CHANNEL_LEN;
+        if (ch[0] >= CACHE_CH_COUNT || ch[1] >= sizeof(QUALITY_NAMES) / sizeof(QUALITY_NAMES[0])) {
+            return false;
         }
     }
 
-    if (oldestUploadedIndex >= 0) {
-        items.erase(items.begin() + oldestUploadedIndex);
-        Serial.println("[Cache] Evicted oldest uploaded item");
-        return true;
-    }
+    char ts[20];
+    formatSampleTime(sampleEpoch, ts, sizeof(ts));
+    item.topic = topic;
+    item.timestamp = ts;
+    item.payload = renderSamplePayload(ts, pointId, flags, channels, channelCount);
+    return item.payload.length() > 0;
+}
 
-    int oldestIndex = 0;
-    unsigned long oldestEpoch = items[0].epoch;
-    for (int i = 1; i < (int)items.size(); i++) {
-        if (items[i].epoch < oldestEpoch) {
-            oldestEpoch = items[i].epoch;
-            oldestIndex = i;
+/**
+ * @brief 顺序扫描一个段里的有效记录
+ * @param offset 起始偏移
+ * @param collect 为 true 时把扫描到的记录加入内存索引
+ * @param records 输出：扫描到的记录条数
+ * @param fileSize 输出：段文件大小
+ * @return 最后一条有效记录之后的偏移
+ */
+static uint32_t scanSegment(uint32_t seg, uint32_t offset, bool collect, int& records, size_t& fileSize) {
+    records = 0;
+    fileSize = 0;
+    File file = SPIFFS.open(segmentPath(seg), FILE_READ);
+    if (!file) {
+        return offset;
+    }
+    fileSize = file.size();
+
+    RecordHeader hdr;
+    while (offset + sizeof(RecordHeader) <= fileSize &&
+        file.seek(offset) &&
+        file.read((uint8_t*)&hdr, sizeof(hdr)) == sizeof(hdr) &&
+        isHeaderSane(hdr) &&
+        offset + recordSize(hdr) <= fileSize) {
+        if (collect) {
+            CacheIndexEntry entry {};
+            entry.epoch = hdr.epoch;
+            entry.seg = seg;
+            entry.offset = offset;
+            entry.length = (uint16_t)recordSize(hdr);
+            entry.retryCount = hdr.retryCount;
+            g_index.push_back(entry);
         }
+        offset += recordSize(hdr);
+        records++;
     }
-    items.erase(items.begin() + oldestIndex);
-    Serial.println("[Cache] Evicted oldest pending item (cache full)");
+    file.close();
+    return offset;
+}
+
+static bool readField(File& file, uint16_t len, std::vector<char>& buf) {
+    buf.resize((size_t)len + 1);
+    if (len > 0 && file.read((uint8_t*)buf.data(), len) != len) {
+        return false;
+    }
+    buf[len] = '\0';
     return true;
 }
 
 /**
- * @brief 加载缓存文件到内存
+ * @brief 从已打开的段文件中按索引项读取完整记录并校验
  */
-static bool loadCacheFromFile(std::vector<CacheItem>& items) {
-    if (!SPIFFS.exists(CACHE_FILE)) {
-        return true;  // 文件不存在，视为空缓存
+static bool readRecordFrom(File& file, const CacheIndexEntry& entry, CacheItem& item) {
+    RecordHeader hdr;
+    if (!file.seek(entry.offset) || file.read((uint8_t*)&hdr, sizeof(hdr)) != sizeof(hdr) ||
+        !isHeaderSane(hdr) || recordSize(hdr) != entry.length) {
+        return false;
     }
 
-    File file = SPIFFS.open(CACHE_FILE, FILE_READ);
-    if (!file) {
-        Serial.println("[Cache] Failed to open cache file for reading");
+    std::vector<char> topic, ts, payload;
+    bool ok = readField(file, hdr.topicLen, topic) &&
+        readField(file, hdr.tsLen, ts) &&
+        readField(file, hdr.payloadLen, payload);
+    if (!ok || recordChecksum(hdr, topic.data(), ts.data(), payload.data()) != hdr.checksum) {
         return false;
     }
 
-    JsonDocument doc;
-    DeserializationError err = deserializeJson(doc, file);
-    file.close();
+    item.epoch = hdr.epoch;
+    item.retryCount = hdr.retryCount;
+    item.kind = hdr.kind;
+    item.raw.clear();
+    if (hdr.kind == RECORD_KIND_SAMPLE) {
+        // 延后重发时原样追加，避免重新编码
+        item.raw.assign(payload.begin(), payload.begin() + hdr.payloadLen);
+        return decodeSampleRecord(hdr, (const uint8_t*)payload.data(), item);
+    }
+    item.topic = topic.data();
+    item.timestamp = ts.data();
+    item.payload = payload.data();
+    return true;
+}
 
-    if (err) {
-        Serial.printf("[Cache] JSON parse error: %s\n", err.c_str());
-        if (SPIFFS.exists(CACHE_FILE)) {
-            String badPath = String(CACHE_FILE) + ".corrupt";
-            if (SPIFFS.exists(badPath)) {
-                SPIFFS.remove(badPath);
-            }
-            if (!SPIFFS.rename(CACHE_FILE, badPath)) {
-                Serial.println("[Cache] Failed to backup corrupt cache file");
-            }
-            else {
-                Serial.println("[Cache] Corrupt cache file moved aside");
-            }
-        }
-        items.clear();
-        return true;
+/**
+ * @brief 按索引项读取完整记录并校验
+ */
+static bool readRecord(const CacheIndexEntry& entry, CacheItem& item) {
+    File file = SPIFFS.open(segmentPath(entry.seg), FILE_READ);
+    if (!file) {
+        return false;
     }
+    bool ok = readRecordFrom(file, entry, item);
+    file.close();
+    return ok;
+}
 
-    // 解析数组
-    if (!doc["data"].is<JsonArray>()) {
-        Serial.println("[Cache] Invalid cache file format");
+static bool writeCursor() {
+    CursorState c;
+    c.magic = CACHE_CURSOR_MAGIC;
+    c.headSeg = g_headSeg;
+    c.headOffset = g_headOffset;
+    c.check = cursorCheck(c);
+
+    File file = SPIFFS.open(CACHE_CURSOR_FILE, FILE_WRITE);
+    if (!file) {
+        Serial.println("[Cache] Failed to open cursor file for writing");
         return false;
     }
+    bool ok = file.write((const uint8_t*)&c, sizeof(c)) == sizeof(c);
+    file.close();
+    if (!ok) {
+        Serial.println("[Cache] Failed to write cursor file");
+    }
+    return ok;
+}
 
-    JsonArray arr = doc["data"].as<JsonArray>();
-    items.clear();
-    items.reserve(arr.size());
+static bool readCursor(CursorState& c) {
+    File file = SPIFFS.open(CACHE_CURSOR_FILE, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    bool ok = file.read((uint8_t*)&c, sizeof(c)) == sizeof(c);
+    file.close();
+    return ok && c.magic == CACHE_CURSOR_MAGIC && c.check == cursorCheck(c);
+}
 
-    for (JsonObject item : arr) {
-        CacheItem cacheItem;
-        cacheItem.topic = item["topic"].as<String>();
-        cacheItem.payload = item["payload"].as<String>();
-        cacheItem.timestamp = item["timestamp"].as<String>();
-        cacheItem.epoch = item["epoch"].as<unsigned long>();
-        cacheItem.uploaded = item["uploaded"] | false;
-        cacheItem.retryCount = item["retryCount"] | 0;
-        items.push_back(cacheItem);
+/**
+ * @brief 删除读取游标之前、已全部确认的段
+ */
+static void recycleAckedSegments() {
+    while (g_firstSeg < g_headSeg) {
+        SPIFFS.remove(segmentPath(g_firstSeg));
+        g_firstSeg++;
     }
+}
 
-    Serial.printf("[Cache] Loaded %d items from file\n", items.size());
+/**
+ * @brief 根据索引队首重新定位读取游标
+ * 索引为空时游标指向追加位置；游标换段时累计上一段的确认条数
+ * @return 游标是否发生变化
+ */
+static bool syncHeadWithIndex() {
+    uint32_t seg = g_index.empty() ? g_tailSeg : g_index.front().seg;
+    uint32_t offset = g_index.empty() ? g_tailOffset : g_index.front().offset;
+    if (seg == g_headSeg && offset == g_headOffset) {
+        return false;
+    }
+    if (seg != g_headSeg) {
+        g_recycledRecords += g_headSegAcked;
+        g_headSegAcked = 0;
+    }
+    g_headSeg = seg;
+    g_headOffset = offset;
     return true;
 }
 
 /**
- * @brief 保存内存中的缓存到文件
+ * @brief 确认（移除）索引队首记录，不落盘
  */
-static bool saveCacheToFile(const std::vector<CacheItem>& items) {
-    File file = SPIFFS.open(CACHE_TEMP_FILE, FILE_WRITE);
+static void dropHeadEntry() {
+    g_index.pop_front();
+    g_headSegAcked++;
+    syncHeadWithIndex();
+}
+
+/**
+ * @brief 持久化读取游标并回收已确认的段
+ */
+static bool commitHead() {
+    bool ok = writeCursor();
+    recycleAckedSegments();
+    return ok;
+}
+
+/**
+ * @brief 追加一条记录到当前段，段满时切换到新段
+ */
+static bool appendRawRecord(uint8_t kind, const char* topic, size_t topicLen, const char* ts, size_t tsLen,
+    const char* payload, size_t payloadLen, unsigned long epoch, uint8_t retryCount) {
+    if (topicLen > CACHE_MAX_FIELD_LEN || tsLen > CACHE_MAX_FIELD_LEN || payloadLen > CACHE_MAX_FIELD_LEN) {
+        Serial.println("[Cache] Record too large, skip caching");
+        return false;
+    }
+
+    if (g_tailRecords >= CACHE_SEGMENT_RECORDS) {
+        g_tailSeg++;
+        g_tailOffset = 0;
+        g_tailRecords = 0;
+    }
+
+    RecordHeader hdr {};
+    hdr.magic = CACHE_RECORD_MAGIC;
+    hdr.retryCount = retryCount;
+    hdr.kind = kind;
+    hdr.epoch = (uint32_t)epoch;
+    hdr.topicLen = (uint16_t)topicLen;
+    hdr.tsLen = (uint16_t)tsLen;
+    hdr.payloadLen = (uint16_t)payloadLen;
+    hdr.checksum = recordChecksum(hdr, topic, ts, payload);
+
+    File file = SPIFFS.open(segmentPath(g_tailSeg), FILE_APPEND);
     if (!file) {
-        Serial.println("[Cache] Failed to open cache file for writing");
+        Serial.println("[Cache] Failed to open segment for append");
+        return false;
+    }
+    size_t expected = recordSize(hdr);
+    size_t written = file.write((const uint8_t*)&hdr, sizeof(hdr));
+    if (hdr.topicLen > 0) written += file.write((const uint8_t*)topic, hdr.topicLen);
+    if (hdr.tsLen > 0) written += file.write((const uint8_t*)ts, hdr.tsLen);
+    if (hdr.payloadLen > 0) written += file.write((const uint8_t*)payload, hdr.payloadLen);
+    file.close();
+
+    if (written != expected) {
+        // 写了一半的记录留在段尾，后续追加换新段，读取时会把它当作段末尾跳过
+        Serial.printf("[Cache] Short write (%u/%u bytes), sealing segment %lu\n",
+            (unsigned)written, (unsigned)expected, (unsigned long)g_tailSeg);
+        g_tailRecords = CACHE_SEGMENT_RECORDS;
         return false;
     }
 
-    JsonDocument doc;
-    JsonArray arr = doc["data"].to<JsonArray>();
+    CacheIndexEntry entry {};
+    entry.epoch = hdr.epoch;
+    entry.seg = g_tailSeg;
+    entry.offset = g_tailOffset;
+    entry.length = (uint16_t)expected;
+    entry.retryCount = retryCount;
+    g_index.push_back(entry);
 
-    for (const auto& item : items) {
-        JsonObject obj = arr.add<JsonObject>();
-        obj["topic"] = item.topic;
-        obj["payload"] = item.payload;
-        obj["timestamp"] = item.timestamp;
-        obj["epoch"] = item.epoch;
-        obj["uploaded"] = item.uploaded;
-        obj["retryCount"] = item.retryCount;
+    g_tailOffset += expected;
+    g_tailRecords++;
+
+    // 原先队列为空时读取游标停在旧的追加位置，随新记录一起前移
+    if (g_index.size() == 1 && syncHeadWithIndex()) {
+        commitHead();
     }
+    return true;
+}
 
-    if (serializeJson(doc, file) == 0) {
-        Serial.println("[Cache] Failed to write cache file");
-        file.close();
+static bool appendRecord(const String& topic, const String& ts, const String& payload, unsigned long epoch, uint8_t retryCount) {
+    if (topic.length() == 0) {
         return false;
     }
+    return appendRawRecord(RECORD_KIND_JSON, topic.c_str(), topic.length(), ts.c_str(), ts.length(),
+        payload.c_str(), payload.length(), epoch, retryCount);
+}
 
-    file.close();
-    if (SPIFFS.exists(CACHE_BACKUP_FILE)) {
-        SPIFFS.remove(CACHE_BACKUP_FILE);
+static bool appendSampleRecord(const std::vector<char>& body, unsigned long epoch, uint8_t retryCount) {
+    return appendRawRecord(RECORD_KIND_SAMPLE, "", 0, "", 0, body.data(), body.size(), epoch, retryCount);
+}
+
+/**
+ * @brief 追加一条记录（按原记录类型），用于延后重发
+ */
+static bool reappendRecord(const CacheItem& item, unsigned long epoch, uint8_t retryCount) {
+    if (item.kind == RECORD_KIND_SAMPLE) {
+        return appendSampleRecord(item.raw, epoch, retryCount);
+    }
+    return appendRecord(item.topic, item.timestamp, item.payload, epoch, retryCount);
+}
+
+/**
+ * @brief 扫描 SPIFFS 根目录，找到现存段号范围
+ */
+static bool findSegmentRange(uint32_t& minSeg, uint32_t& maxSeg) {
+    bool found = false;
+    File root = SPIFFS.open("/");
+    if (!root) {
+        return false;
     }
-    if (SPIFFS.exists(CACHE_FILE)) {
-        if (!SPIFFS.rename(CACHE_FILE, CACHE_BACKUP_FILE)) {
-            Serial.println("[Cache] Failed to backup old cache file");
+    File entry = root.openNextFile();
+    while (entry) {
+        const char* name = entry.name();
+        if (name[0] == '/') {
+            name++;
+        }
+        size_t prefixLen = strlen(CACHE_SEGMENT_PREFIX);
+        if (strncmp(name, CACHE_SEGMENT_PREFIX, prefixLen) == 0) {
+            char* end = nullptr;
+            unsigned long seg = strtoul(name + prefixLen, &end, 10);
+            if (end && strcmp(end, CACHE_SEGMENT_SUFFIX) == 0) {
+                if (!found || seg < minSeg) minSeg = seg;
+                if (!found || seg > maxSeg) maxSeg = seg;
+                found = true;
+            }
         }
+        entry.close();
+        entry = root.openNextFile();
+    }
+    root.close();
+    return found;
+}
+
+/**
+ * @brief 启动时重建日志状态：定位游标、建立内存索引、找到追加位置
+ * 这是唯一一次顺序扫描日志，之后所有操作都只按索引定位
+ */
+static void openLog() {
+    g_firstSeg = g_headSeg = g_tailSeg = 0;
+    g_headOffset = g_tailOffset = 0;
+    g_tailRecords = 0;
+    g_headSegAcked = 0;
+    g_index.clear();
+
+    uint32_t minSeg = 0;
+    uint32_t maxSeg = 0;
+    if (!findSegmentRange(minSeg, maxSeg)) {
+        g_logReady = true;
+        Serial.println("[Cache] Log empty");
+        return;
+    }
+
+    g_firstSeg = minSeg;
+    g_tailSeg = maxSeg;
+
+    CursorState c;
+    if (readCursor(c) && c.headSeg >= minSeg && c.headSeg <= maxSeg) {
+        g_headSeg = c.headSeg;
+        g_headOffset = c.headOffset;
     }
-    if (!SPIFFS.rename(CACHE_TEMP_FILE, CACHE_FILE)) {
-        Serial.println("[Cache] Failed to replace cache file");
-        if (SPIFFS.exists(CACHE_BACKUP_FILE)) {
-            SPIFFS.rename(CACHE_BACKUP_FILE, CACHE_FILE);
+    else {
+        // 游标丢失时从最旧段重新开始，宁可重复上传也不丢数据
+        Serial.println("[Cache] Cursor missing or invalid, replaying from oldest segment");
+        g_headSeg = minSeg;
+        g_headOffset = 0;
+    }
+    recycleAckedSegments();
+
+    // 从游标处逐段扫描，建立索引并定位追加位置
+    for (uint32_t seg = g_headSeg; seg <= g_tailSeg; seg++) {
+        int records = 0;
+        size_t fileSize = 0;
+        uint32_t start = (seg == g_headSeg) ? g_headOffset : 0;
+        uint32_t end = scanSegment(seg, start, true, records, fileSize);
+        if (seg == g_tailSeg) {
+            g_tailOffset = end;
+            // 追加段需要完整记录数来判断何时换段
+            g_tailRecords = (start == 0) ? records : 0;
+            if (start > 0) {
+                scanSegment(seg, 0, false, g_tailRecords, fileSize);
+            }
+            if (fileSize > end) {
+                Serial.printf("[Cache] Segment %lu has a torn tail record, sealing it\n", (unsigned long)seg);
+                g_tailRecords = CACHE_SEGMENT_RECORDS;
+            }
         }
-        return false;
     }
-    if (SPIFFS.exists(CACHE_BACKUP_FILE)) {
-        SPIFFS.remove(CACHE_BACKUP_FILE);
+
+    if (syncHeadWithIndex()) {
+        commitHead();
     }
-    return true;
+    g_headSegAcked = 0;
+    g_recycledRecords = 0;
+    g_logReady = true;
+    Serial.printf("[Cache] Log opened: segments %lu..%lu, head=%lu@%lu, pending=%d\n",
+        (unsigned long)g_firstSeg, (unsigned long)g_tailSeg,
+        (unsigned long)g_headSeg, (unsigned long)g_headOffset, (int)g_index.size());
+}
+
+/**
+ * @brief 导入旧版 JSON 缓存文件中未上传的数据
+ */
+static void migrateLegacyCache() {
+    if (!SPIFFS.exists(LEGACY_CACHE_FILE)) {
+        return;
+    }
+
+    File file = SPIFFS.open(LEGACY_CACHE_FILE, FILE_READ);
+    if (file) {
+        JsonDocument doc;
+        DeserializationError err = deserializeJson(doc, file);
+        file.close();
+
+        if (err || !doc["data"].is<JsonArray>()) {
+            Serial.println("[Cache] Legacy cache unreadable, discarding it");
+        }
+        else {
+            std::vector<CacheItem> items;
+            for (JsonObject obj : doc["data"].as<JsonArray>()) {
+                if (obj["uploaded"] | false) continue;
+                CacheItem item;
+                item.topic = obj["topic"].as<String>();
+                item.payload = obj["payload"].as<String>();
+                item.timestamp = obj["timestamp"].as<String>();
+                item.epoch = obj["epoch"].as<unsigned long>();
+                item.retryCount = obj["retryCount"] | 0;
+                items.push_back(item);
+            }
+            std::sort(items.begin(), items.end(),
+                [](const CacheItem& a, const CacheItem& b) {
+                    return a.epoch < b.epoch;
+                });
+
+            int imported = 0;
+            for (const auto& item : items) {
+                if (appendRecord(item.topic, item.timestamp, item.payload, item.epoch, item.retryCount)) {
+                    imported++;
+                }
+            }
+            Serial.printf("[Cache] Migrated %d pending items from legacy cache file\n", imported);
+        }
+    }
+
+    SPIFFS.remove(LEGACY_CACHE_FILE);
+    if (SPIFFS.exists(LEGACY_CACHE_TEMP_FILE)) SPIFFS.remove(LEGACY_CACHE_TEMP_FILE);
+    if (SPIFFS.exists(LEGACY_CACHE_BACKUP_FILE)) SPIFFS.remove(LEGACY_CACHE_BACKUP_FILE);
 }
 
 // ========== 初始化与配置 ==========
@@ -242,7 +702,14 @@ bool initDataBuffer(int maxCacheCount, int maxCacheDays) {
     g_maxCacheCount = maxCacheCount;
     g_maxCacheDays = maxCacheDays;
 
-    Serial.printf("[Cache] Init: maxCount=%d, maxDays=%d\n", g_maxCacheCount, g_maxCacheDays);
+    Serial.printf("[Cache] Init: maxCount=%d, maxDays=%d, segmentRecords=%d\n",
+        g_maxCacheCount, g_maxCacheDays, CACHE_SEGMENT_RECORDS);
+
+    {
+        CacheLock lock;
+        openLog();
+        migrateLegacyCache();
+    }
 
     // 清理过期数据
     cleanExpiredCache();
@@ -254,12 +721,7 @@ void cleanExpiredCache() {
     CacheLock lock;
     Serial.println("[Cache] Checking expired data...");
 
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
-        return;
-    }
-
-    if (items.empty()) {
+    if (!g_logReady || g_index.empty()) {
         Serial.println("[Cache] No data to clean");
         return;
     }
@@ -271,21 +733,21 @@ void cleanExpiredCache() {
     }
 
     unsigned long maxAgeSeconds = g_maxCacheDays * 24 * 3600UL;
-    int originalCount = items.size();
-
-    // 移除过期数据
-    items.erase(
-        std::remove_if(items.begin(), items.end(),
-            [now, maxAgeSeconds](const CacheItem& item) {
-                return (item.epoch > 0 && (now - (time_t)item.epoch) > (long)maxAgeSeconds);
-            }),
-        items.end()
-    );
-
-    int deletedCount = originalCount - items.size();
+    int deletedCount = 0;
+
+    // 日志按写入顺序排列，从最旧处开始丢弃，遇到未过期记录即停止
+    while (!g_index.empty()) {
+        uint32_t epoch = g_index.front().epoch;
+        if (!(epoch > 0 && (now - (time_t)epoch) > (long)maxAgeSeconds)) {
+            break;
+        }
+        dropHeadEntry();
+        deletedCount++;
+    }
+
     if (deletedCount > 0) {
+        commitHead();
         Serial.printf("[Cache] Cleaned %d expired items\n", deletedCount);
-        saveCacheToFile(items);
     }
     else {
         Serial.println("[Cache] No expired data found");
@@ -294,197 +756,244 @@ void cleanExpiredCache() {
 
 // ========== 数据存储 ==========
 
+/**
+ * @brief 缓存已满时丢弃最旧的待上传记录
+ */
+static bool makeRoomForRecord() {
+    if (!isCacheFull((int)g_index.size())) {
+        return true;
+    }
+    if (g_index.empty()) {
+        Serial.println("[Cache] Cache full, cannot evict item");
+        return false;
+    }
+    dropHeadEntry();
+    commitHead();
+    Serial.println("[Cache] Evicted oldest pending item (cache full)");
+    return true;
+}
+
 bool savePendingData(const String& topic, const String& payload, const String& timestamp) {
     CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
+    if (!g_logReady) {
         return false;
     }
 
-    // 检查缓存是否已满
-    if (isCacheFull((int)items.size())) {
-        Serial.println("[Cache] Cache full, trying to evict oldest item");
-        if (!evictOldestItem(items)) {
-            Serial.println("[Cache] Cache full, cannot evict item");
-            return false;
-        }
+    // 检查缓存是否已满：丢弃最旧的待上传记录
+    if (!makeRoomForRecord()) {
+        return false;
     }
 
     // 生成时间戳
     unsigned long fileTime = getCacheEpoch();
     String ts = (timestamp.length() > 0) ? timestamp : getTimeString();
 
-    // 添加新数据
-    CacheItem newItem;
-    newItem.topic = topic;
-    newItem.payload = payload;
-    newItem.timestamp = ts;
-    newItem.epoch = fileTime;
-    newItem.uploaded = false;
-    newItem.retryCount = 0;
-
-    items.push_back(newItem);
-
-    // 保存到文件
-    if (saveCacheToFile(items)) {
-        Serial.printf("[Cache] Saved new data (topic: %s, total: %d)\n", topic.c_str(), items.size());
+    if (appendRecord(topic, ts, payload, fileTime, 0)) {
+        Serial.printf("[Cache] Saved new data (topic: %s, total: %d)\n", topic.c_str(), (int)g_index.size());
         return true;
     }
 
     return false;
 }
 
-// ========== 数据读取与标记 ==========
-
-int getPendingDataCount() {
+bool savePendingSample(uint8_t topicId, const CachedSample& sample) {
     CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
-        return -1;
+    if (!g_logReady || sample.channelCount > CACHE_MAX_CHANNELS) {
+        return false;
+    }
+    if (topicById(topicId).length() == 0) {
+        Serial.println("[Cache] Unknown topic id, sample not cached in compact form");
+        return false;
     }
 
-    // 统计未上传的数据
-    int count = 0;
-    for (const auto& item : items) {
-        if (!item.uploaded) {
-            count++;
+    // 编码：topic 编号、点位号、标志、通道数、采样时间，之后每通道 编号/质量/float 值
+    uint32_t epoch = sample.epoch > 0 ? sample.epoch : (uint32_t)getCacheEpoch();
+    std::vector<char> body(SAMPLE_HEAD_LEN + sample.channelCount * SAMPLE_CHANNEL_LEN);
+    body[0] = (char)topicId;
+    body[1] = (char)sample.pointId;
+    body[2] = (char)(sample.withControllerCode ? SAMPLE_FLAG_CONTROLLER_CODE : 0);
+    body[3] = (char)sample.channelCount;
+    memcpy(body.data() + 4, &epoch, sizeof(epoch));
+    for (uint8_t i = 0; i < sample.channelCount; i++) {
+        const CachedChannel& ch = sample.channels[i];
+        if (ch.id >= CACHE_CH_COUNT || ch.quality > CACHE_QUALITY_UNSTABLE) {
+            return false;
         }
+        char* out = body.data() + SAMPLE_HEAD_LEN + i * SAMPLE_CHANNEL_LEN;
+        out[0] = (char)ch.id;
+        out[1] = (char)ch.quality;
+        memcpy(out + 2, &ch.value, sizeof(ch.value));
     }
-    return count;
-}
 
-bool getFirstPendingData(String& outTopic, String& outPayload, String& outTimestamp) {
-    CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
+    if (!makeRoomForRecord()) {
         return false;
     }
 
-    // 按epoch排序（最旧的在前）
-    std::sort(items.begin(), items.end(),
-        [](const CacheItem& a, const CacheItem& b) {
-            return a.epoch < b.epoch;
-        });
-
-    // 查找第一个未上传的数据
-    for (const auto& item : items) {
-        if (!item.uploaded) {
-            outTopic = item.topic;
-            outPayload = item.payload;
-            outTimestamp = item.timestamp;
-            return true;
-        }
+    if (appendSampleRecord(body, epoch, 0)) {
+        Serial.printf("[Cache] Saved compact sample (topic #%d, %u bytes, total: %d)\n",
+            (int)topicId, (unsigned)(sizeof(RecordHeader) + body.size()), (int)g_index.size());
+        return true;
     }
-
     return false;
 }
 
-bool markFirstDataAsUploaded() {
+// ========== 数据读取与标记 ==========
+
+int getPendingDataCount() {
     CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
-        return false;
+    if (!g_logReady) {
+        return -1;
     }
+    return (int)g_index.size();
+}
 
-    // 按epoch排序（最旧的在前）
-    std::sort(items.begin(), items.end(),
-        [](const CacheItem& a, const CacheItem& b) {
-            return a.epoch < b.epoch;
-        });
+bool getFirstPendingData(String& outTopic, String& outPayload, String& outTimestamp) {
+    CacheLock lock;
+    if (!g_logReady || g_index.empty()) {
+        return false;
+    }
 
-    // 查找第一个未上传的数据并标记
-    for (auto& item : items) {
-        if (!item.uploaded) {
-            item.uploaded = true;
-            Serial.printf("[Cache] Marked data as uploaded (timestamp: %s)\n", item.timestamp.c_str());
-            return saveCacheToFile(items);
-        }
+    CacheItem item;
+    if (!readRecord(g_index.front(), item)) {
+        Serial.println("[Cache] Failed to read pending record");
+        return false;
     }
 
-    Serial.println("[Cache] No pending data to mark");
-    return false;
+    outTopic = item.topic;
+    outPayload = item.payload;
+    outTimestamp = item.timestamp;
+    return true;
 }
 
-bool deferFirstPendingDataAfterFailure() {
+static bool isPosAfter(const CacheIndexEntry& entry, const CacheRecordPos& pos) {
+    return entry.seg > pos.seg || (entry.seg == pos.seg && entry.offset > pos.offset);
+}
+
+int getPendingDataBatch(std::vector<PendingData>& out, int maxCount, const CacheRecordPos* after) {
     CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
-        return false;
+    out.clear();
+    if (!g_logReady || g_index.empty() || maxCount <= 0) {
+        return 0;
     }
 
-    // 按epoch排序（最旧的在前）
-    std::sort(items.begin(), items.end(),
-        [](const CacheItem& a, const CacheItem& b) {
-            return a.epoch < b.epoch;
-        });
+    // 跳过已发出的记录；它们都在队首附近，线性查找很快
+    size_t first = 0;
+    if (after) {
+        while (first < g_index.size() && !isPosAfter(g_index[first], *after)) {
+            first++;
+        }
+    }
+    int count = min(maxCount, (int)(g_index.size() - first));
+    if (count <= 0) {
+        return 0;
+    }
+    out.reserve(count);
+
+    // 批内记录通常连续落在一两个段里，同一段只打开一次
+    File file;
+    uint32_t openSeg = 0;
+    for (int i = 0; i < count; i++) {
+        const CacheIndexEntry& entry = g_index[first + i];
+        if (!file || openSeg != entry.seg) {
+            if (file) file.close();
+            file = SPIFFS.open(segmentPath(entry.seg), FILE_READ);
+            openSeg = entry.seg;
+            if (!file) break;
+        }
 
-    // 查找第一个未上传的数据并延后
-    for (auto& item : items) {
-        if (!item.uploaded) {
-            if (item.retryCount < 255) {
-                item.retryCount++;
-            }
-            item.epoch = getCacheEpoch();  // 延后到当前时间，避免卡住队列
-            Serial.printf("[Cache] Deferred data after failure (retry=%u)\n", item.retryCount);
-            return saveCacheToFile(items);
+        CacheItem item;
+        if (!readRecordFrom(file, entry, item)) {
+            // 读不出来的记录留给 deferFirstPendingDataAfterFailure 跳过
+            Serial.printf("[Cache] Failed to read pending record #%d in batch\n", i);
+            break;
         }
+        out.push_back({ item.topic, item.payload, item.timestamp, { entry.seg, entry.offset } });
     }
+    if (file) file.close();
 
-    Serial.println("[Cache] No pending data to defer");
-    return false;
+    return (int)out.size();
 }
 
-int cleanUploadedData(int keepCount) {
+int markPendingDataAsUploadedThrough(const CacheRecordPos& pos) {
     CacheLock lock;
-    std::vector<CacheItem> items;
-    if (!loadCacheFromFile(items)) {
+    if (!g_logReady) {
         return 0;
     }
 
-    if (items.empty()) {
-        return 0;
+    int marked = 0;
+    while (!g_index.empty() && !isPosAfter(g_index.front(), pos)) {
+        dropHeadEntry();
+        marked++;
     }
-
-    // 统计已上传数据
-    std::vector<int> uploadedIndices;
-    for (int i = 0; i < (int)items.size(); i++) {
-        if (items[i].uploaded) {
-            uploadedIndices.push_back(i);
-        }
+    if (marked > 0) {
+        commitHead();
+        Serial.printf("[Cache] Marked %d items as uploaded (acknowledged)\n", marked);
     }
+    return marked;
+}
 
-    if ((int)uploadedIndices.size() <= keepCount) {
-        return 0;  // 没有需要清理的
+bool markFirstDataAsUploaded() {
+    CacheLock lock;
+    if (!g_logReady || g_index.empty()) {
+        Serial.println("[Cache] No pending data to mark");
+        return false;
     }
 
-    // 按epoch排序已上传数据（最新的在后面）
-    std::sort(uploadedIndices.begin(), uploadedIndices.end(),
-        [&items](int a, int b) {
-            return items[a].epoch < items[b].epoch;
-        });
+    Serial.printf("[Cache] Marked data as uploaded (epoch: %lu)\n", (unsigned long)g_index.front().epoch);
+    dropHeadEntry();
+    return commitHead();
+}
 
-    // 删除最旧的已上传数据，保留最近keepCount条
-    int toDelete = uploadedIndices.size() - keepCount;
+bool deferFirstPendingDataAfterFailure() {
+    CacheLock lock;
+    if (!g_logReady || g_index.empty()) {
+        Serial.println("[Cache] No pending data to defer");
+        return false;
+    }
 
-    // 注意：从后往前删除，避免索引偏移
-    for (int i = toDelete - 1; i >= 0; i--) {
-        items.erase(items.begin() + uploadedIndices[i]);
+    CacheItem item;
+    if (!readRecord(g_index.front(), item)) {
+        // 读不出来的记录直接跳过，避免卡住队列
+        Serial.println("[Cache] Pending record unreadable, skipping it");
+        dropHeadEntry();
+        return commitHead();
     }
 
-    int deletedCount = toDelete;
-    if (deletedCount > 0) {
-        Serial.printf("[Cache] Cleaned %d old uploaded items (kept %d)\n", deletedCount, keepCount);
-        saveCacheToFile(items);
+    // 延后 = 追加到队尾（epoch 改为当前时间）再确认原记录，避免卡住队列
+    uint8_t retry = (item.retryCount < 255) ? item.retryCount + 1 : 255;
+    if (!reappendRecord(item, getCacheEpoch(), retry)) {
+        return false;
     }
+    Serial.printf("[Cache] Deferred data after failure (retry=%u)\n", retry);
+    dropHeadEntry();
+    return commitHead();
+}
 
-    return deletedCount;
+int cleanUploadedData(int keepCount) {
+    // 已上传记录不再逐条保留，所在段整体确认后即被回收；
+    // 这里只汇报回收条数，keepCount 保留以兼容旧调用。
+    (void)keepCount;
+    CacheLock lock;
+    recycleAckedSegments();
+    int recycled = g_recycledRecords;
+    g_recycledRecords = 0;
+    if (recycled > 0) {
+        Serial.printf("[Cache] Recycled %d uploaded items with their segments\n", recycled);
+    }
+    return recycled;
 }
 
 bool clearAllPendingData() {
     CacheLock lock;
-    if (SPIFFS.remove(CACHE_FILE)) {
-        Serial.println("[Cache] Cleared all cache");
-        return true;
+    uint32_t minSeg = 0;
+    uint32_t maxSeg = 0;
+    if (findSegmentRange(minSeg, maxSeg)) {
+        for (uint32_t seg = minSeg; seg <= maxSeg; seg++) {
+            SPIFFS.remove(segmentPath(seg));
+        }
     }
-    return false;
+    SPIFFS.remove(CACHE_CURSOR_FILE);
+    openLog();
+    Serial.println("[Cache] Cleared all cache");
+    return true;
 }
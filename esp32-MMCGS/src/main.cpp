@@ -9,6 +9,7 @@
 #include <WiFi.h>
 #include <Preferences.h>
 #include <time.h>
+#include <sys/time.h>
 #include <vector>
 #include <algorithm>
 #include <ArduinoJson.h>
@@ -19,6 +20,13 @@
 #include "wifi_ntp_mqtt.h"
 #include "sensor.h"
 #include "data_buffer.h"
+#include "topic_registry.h"
+#include "telemetry_writer.h"
+#include "command_filter.h"
+#include "heap_monitor.h"
+#include "phase_timer.h"
+#include "task_wake.h"
+#include "command_queue.h"
 
 // ======================= 持久化 =======================
 // NVS 用来保存“上一轮巡检进行到哪里了”，这样设备意外重启后还能续跑。
@@ -69,9 +77,10 @@ static constexpr size_t TOTAL_PUMP_COUNT = POINT_COUNT + 1;
 static const uint8_t PUMP_PINS[TOTAL_PUMP_COUNT] = { 13, 14, 25, 26, 27, 32, 33 };
 
 // MQTT 命令队列和采样流程用到的运行参数。
-static constexpr int MAX_PENDING_COMMANDS = 50;
 // 长时间泵控命令分片执行，避免一次 delay 太久完全不让出 CPU。
 static constexpr unsigned long COMMAND_SLICE_MS = 5000;
+// 命令任务没有待执行命令时的最长休眠，新命令入队会立即唤醒它。
+static constexpr unsigned long COMMAND_MAX_SLEEP_MS = 60000;
 // 主循环尝试上传离线缓存数据的周期。
 static constexpr unsigned long CACHE_UPLOAD_INTERVAL_MS = 30000;
 
@@ -102,19 +111,25 @@ static constexpr float O2_STABILITY_REFERENCE_MIN_PERCENT = 5.0f;
 // 5. 稳态样本最终用抗异常值统计，而不是简单求平均。
 
 // ======================= 命令队列 =======================
-struct PendingCommand {
-  String cmd;
-  String action;
-  unsigned long duration;
-  time_t targetTime;
-};
-std::vector<PendingCommand> pendingCommands;
+static CommandQueue g_commandQueue;   // 由 g_cmdMutex 保护
 static SemaphoreHandle_t g_cmdMutex = nullptr;
+static TaskHandle_t g_commandTask = nullptr;   // 命令入队后用 wakeTask() 唤醒
 static volatile bool g_pendingRestart = false;
 static unsigned long g_restartAtMs = 0;
 // 自动巡检进行中时，禁止远程手动泵控，避免打乱当前气路。
 static volatile bool g_measurementInProgress = false;
 
+// ======================= 诊断 =======================
+// 单个点位各阶段的计时编号，setup 中登记。
+static uint8_t g_phasePoint = PHASE_ID_INVALID;    // 单点全程（抽气到吹扫结束）
+static uint8_t g_phaseIntake = PHASE_ID_INVALID;   // 取样抽气
+static uint8_t g_phaseStatic = PHASE_ID_INVALID;   // 静态检测窗口
+static uint8_t g_phaseSensors = PHASE_ID_INVALID;  // 静态窗口内单次读三路传感器
+static uint8_t g_phasePublish = PHASE_ID_INVALID;  // 组包与发布/缓存
+static uint8_t g_phasePurge = PHASE_ID_INVALID;    // 吹扫
+// diag 命令只置标记，由 loop 发布，避免在 MQTT 回调里复用收包缓冲区。
+static volatile bool g_diagRequested = false;
+
 // =====================================================
 // 工具：从 JsonVariant 读 String（空则返回 defaultVal）
 // =====================================================
@@ -129,24 +144,47 @@ static const char* qualityOf(float value) {
 }
 
 static void appendChannel(
-  String& payload,
-  bool& firstChannel,
+  TelemetryWriter& payload,
   const char* code,
   float value,
-  int decimals,
+  uint8_t decimals,
   const char* unit,
   const char* qualityOverride = nullptr) {
-  if (!firstChannel) {
-    payload += ",";
+  payload.channel(code, value, decimals, unit, qualityOverride ? qualityOverride : qualityOf(value));
+}
+
+// 到达 heap_report_interval 时附加堆/栈健康通道（仅实时上报，不进紧凑缓存）
+static void appendHeapChannels(TelemetryWriter& payload) {
+  HeapStats heap;
+  if (!takeHeapStatsIfDue(appConfig.heapReportInterval, heap)) {
+    return;
   }
-  firstChannel = false;
+  payload.channel("HeapFree", heap.freeHeap, 0, "B", "OK");
+  payload.channel("HeapMaxBlock", heap.largestBlock, 0, "B", "OK");
+  payload.channel("HeapMinFree", heap.minFreeHeap, 0, "B", "OK");
+  payload.channel("HeapFrag", heap.fragmentation, 0, "%", "OK");
+  payload.channel("StackMeasure", heap.measureStack, 0, "B", "OK");
+  payload.channel("StackCommand", heap.commandStack, 0, "B", "OK");
+}
 
-  payload += "{";
-  payload += "\"code\":\"" + String(code) + "\",";
-  payload += "\"value\":" + String(value, decimals) + ",";
-  payload += "\"unit\":\"" + String(unit) + "\",";
-  payload += "\"quality\":\"" + String(qualityOverride ? qualityOverride : qualityOf(value)) + "\"";
-  payload += "}";
+// 与 appendChannel 对应的紧凑缓存通道，断网时按此格式落盘。
+static void addCachedChannel(
+  CachedSample& sample,
+  uint8_t channelId,
+  float value,
+  const char* qualityOverride = nullptr) {
+  if (sample.channelCount >= CACHE_MAX_CHANNELS) {
+    return;
+  }
+  CachedChannel& ch = sample.channels[sample.channelCount++];
+  ch.id = channelId;
+  ch.value = value;
+  if (qualityOverride && strcmp(qualityOverride, "UNSTABLE") == 0) {
+    ch.quality = CACHE_QUALITY_UNSTABLE;
+  }
+  else {
+    ch.quality = value < 0 ? CACHE_QUALITY_ERR : CACHE_QUALITY_OK;
+  }
 }
 
 static void runPumpForDuration(size_t pumpIndex, unsigned long durationMs) {
@@ -181,12 +219,12 @@ static time_t parseScheduleOrNow(const String& schedule) {
   return target;
 }
 
-static int pumpIndexFromCommand(const String& cmd) {
-  if (cmd == "purge") {
+static int pumpIndexFromCommand(const char* cmd) {
+  if (strcmp(cmd, "purge") == 0) {
     return (int)PURGE_PUMP_INDEX;
   }
-  if (cmd.startsWith("point")) {
-    int pointNo = cmd.substring(5).toInt();
+  if (strncmp(cmd, "point", 5) == 0) {
+    int pointNo = atoi(cmd + 5);
     if (pointNo >= 1 && pointNo <= (int)POINT_COUNT) {
         return pointNo - 1;
       }
@@ -395,7 +433,7 @@ static void clearPointCompletion() {
 
 // =====================================================
 // 生成"完整当前配置"的 JSON（用于上线/回执）
-// 格式：{ "wifi": {...}, "mqtt": {...}, "ntp_servers": [...], "sample_time": ..., "static_measure_time": ..., "purge_pump_time": ..., "read_interval": ... }
+// 格式：{ "wifi": {...}, "mqtt": {...}, "ntp_servers": [...], "sample_time": ..., "static_measure_time": ..., "purge_pump_time": ..., "read_interval": ..., "cache_upload_batch": ..., "cache_upload_qos": ..., "cache_inflight": ..., "heap_report_interval": ..., "diag_interval": ... }
 // =====================================================
 static void fillConfigJson(JsonObject cfg) {
   // WiFi
@@ -422,6 +460,11 @@ static void fillConfigJson(JsonObject cfg) {
   cfg["static_measure_time"] = appConfig.staticMeasureTime;
   cfg["purge_pump_time"] = appConfig.purgePumpTime;
   cfg["read_interval"] = appConfig.readInterval;
+  cfg["cache_upload_batch"] = appConfig.cacheUploadBatch;
+  cfg["cache_upload_qos"] = appConfig.cacheUploadQos;
+  cfg["cache_inflight"] = appConfig.cacheInflight;
+  cfg["heap_report_interval"] = appConfig.heapReportInterval;
+  cfg["diag_interval"] = appConfig.diagInterval;
 }
 
 // =====================================================
@@ -446,6 +489,12 @@ static void publishOnlineWithConfig() {
   JsonObject cfg = doc["config"].to<JsonObject>();
   fillConfigJson(cfg);
 
+  // 离线缓存积压与补传计数；运行中由诊断快照定期上报
+  JsonObject cache = doc["cache"].to<JsonObject>();
+  cache["pending"] = getPendingDataCount();
+  cache["uploaded_total"] = getCacheUploadTotal();
+  cache["upload_rate"] = getCacheUploadRate();
+
   String out;
   serializeJson(doc, out);
   Serial.printf("[Register] Payload size: %d bytes\n", out.length());
@@ -463,6 +512,99 @@ static void publishOnlineWithConfig() {
   }
 }
 
+// =====================================================
+// 发布诊断快照
+// topic: compostlab/v2/{device_code}/diag
+// 收到 diag 命令，或 diag_interval > 0 且到期时发布
+// =====================================================
+static void publishDiagnosticsIfNeeded() {
+  static unsigned long lastDiagMs = 0;
+  unsigned long now = millis();
+  const char* reason = nullptr;
+  if (g_diagRequested) {
+    reason = "command";
+  }
+  else if (appConfig.diagInterval > 0 && now - lastDiagMs >= appConfig.diagInterval) {
+    reason = "periodic";
+  }
+  if (!reason || !getMQTTClient().connected()) {
+    return;
+  }
+  g_diagRequested = false;
+  lastDiagMs = now;
+
+  JsonDocument doc;
+  doc["schema_version"] = 2;
+  doc["ts"] = getTimeString();
+  doc["uptime_ms"] = now;
+  doc["reason"] = reason;
+  doc["measuring"] = (bool)g_measurementInProgress;
+
+  PhaseStats stats[PHASE_TIMER_MAX_PHASES];
+  size_t phaseCount = snapshotPhaseStats(stats, PHASE_TIMER_MAX_PHASES);
+  JsonArray phases = doc["phases"].to<JsonArray>();
+  for (size_t i = 0; i < phaseCount; i++) {
+    JsonObject p = phases.add<JsonObject>();
+    p["name"] = stats[i].name;
+    p["count"] = stats[i].count;
+    p["last_us"] = stats[i].lastUs;
+    p["min_us"] = stats[i].minUs;
+    p["avg_us"] = stats[i].avgUs();
+    p["max_us"] = stats[i].maxUs;
+  }
+
+  PhaseSample samples[PHASE_TIMER_RING_SIZE];
+  size_t sampleCount = snapshotPhaseSamples(samples, PHASE_TIMER_RING_SIZE);
+  JsonArray recent = doc["recent"].to<JsonArray>();
+  for (size_t i = 0; i < sampleCount; i++) {
+    JsonObject r = recent.add<JsonObject>();
+    r["phase"] = phaseName(samples[i].phase);
+    r["us"] = samples[i].us;
+  }
+
+#if HEAP_MONITOR_ENABLED
+  HeapStats heapStats;
+  sampleHeapStats(heapStats);
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  heap["free"] = heapStats.freeHeap;
+  heap["max_block"] = heapStats.largestBlock;
+  heap["min_free"] = heapStats.minFreeHeap;
+  heap["frag"] = heapStats.fragmentation;
+  heap["stack_measure"] = heapStats.measureStack;
+  heap["stack_command"] = heapStats.commandStack;
+#endif
+
+  JsonObject cache = doc["cache"].to<JsonObject>();
+  cache["pending"] = getPendingDataCount();
+  cache["uploaded_total"] = getCacheUploadTotal();
+  cache["upload_rate"] = getCacheUploadRate();
+
+  // 整条快照要放进 MQTT 缓冲区：放不下时从最旧的 recent 样本开始丢
+  const String diagTopic = appConfig.mqttDiagTopic();
+  const size_t limit = mqttPayloadLimit(diagTopic);
+  size_t dropped = 0;
+  while (measureJson(doc) > limit && recent.size() > 0) {
+    recent.remove(0);
+    dropped++;
+  }
+  if (dropped > 0) {
+    Serial.printf("[Diag] Dropped %u oldest recent samples to fit %u bytes\n",
+      (unsigned)dropped, (unsigned)limit);
+  }
+  size_t size = measureJson(doc);
+  if (size > limit) {
+    Serial.printf("[Diag] Diagnostics (%s, %u bytes) exceed %u bytes, not published\n",
+      reason, (unsigned)size, (unsigned)limit);
+    return;
+  }
+
+  String out;
+  serializeJson(doc, out);
+  bool ok = publishData(diagTopic, out, 5000);
+  Serial.printf("[Diag] Diagnostics (%s, %u bytes) %s\n",
+    reason, (unsigned)out.length(), ok ? "published" : "publish failed");
+}
+
 // =====================================================
 // 远程配置更新：只更新指令里出现的字段，其它保持原状
 // 与 config_manager.cpp 存储结构保持一致（/config.json）
@@ -491,6 +633,33 @@ static bool updateAppConfigFromJson(JsonObject cfg) {
     Serial.printf("[CFG] read_interval = %u\n", (unsigned)appConfig.readInterval);
   }
 
+  if (cfg["cache_upload_batch"].is<uint16_t>()) {
+    uint16_t batch = cfg["cache_upload_batch"].as<uint16_t>();
+    appConfig.cacheUploadBatch = batch > 0 ? batch : 1;
+    Serial.printf("[CFG] cache_upload_batch = %u\n", (unsigned)appConfig.cacheUploadBatch);
+  }
+
+  if (cfg["cache_upload_qos"].is<uint8_t>()) {
+    appConfig.cacheUploadQos = cfg["cache_upload_qos"].as<uint8_t>() >= 1 ? 1 : 0;
+    Serial.printf("[CFG] cache_upload_qos = %u\n", (unsigned)appConfig.cacheUploadQos);
+  }
+
+  if (cfg["cache_inflight"].is<uint8_t>()) {
+    uint8_t window = cfg["cache_inflight"].as<uint8_t>();
+    appConfig.cacheInflight = window > 0 ? window : 1;
+    Serial.printf("[CFG] cache_inflight = %u\n", (unsigned)appConfig.cacheInflight);
+  }
+
+  if (cfg["heap_report_interval"].is<uint32_t>()) {
+    appConfig.heapReportInterval = cfg["heap_report_interval"].as<uint32_t>();
+    Serial.printf("[CFG] heap_report_interval = %u\n", (unsigned)appConfig.heapReportInterval);
+  }
+
+  if (cfg["diag_interval"].is<uint32_t>()) {
+    appConfig.diagInterval = cfg["diag_interval"].as<uint32_t>();
+    Serial.printf("[CFG] diag_interval = %u\n", (unsigned)appConfig.diagInterval);
+  }
+
   // -------- WiFi --------
   if (cfg["wifi"].is<JsonObject>()) {
     JsonObject wifi = cfg["wifi"].as<JsonObject>();
@@ -566,10 +735,10 @@ static bool updateAppConfigFromJson(JsonObject cfg) {
 // =====================================================
 static void executeCommand(const PendingCommand& pcmd) {
   Serial.printf("[CMD] Executing command: %s %s (duration=%lu ms, targetEpoch=%lu)\n",
-    pcmd.cmd.c_str(), pcmd.action.c_str(), pcmd.duration, (unsigned long)pcmd.targetTime);
+    pcmd.cmd, pcmd.action, pcmd.duration, (unsigned long)pcmd.targetTime);
 
   // ---- 重启 ----
-  if (pcmd.cmd == "restart") {
+  if (strcmp(pcmd.cmd, "restart") == 0) {
     Serial.println("[CMD] Remote restart requested");
     delay(300);
     ESP.restart();
@@ -580,11 +749,11 @@ static void executeCommand(const PendingCommand& pcmd) {
   if (pumpIndex >= 0) {
     if (g_measurementInProgress) {
       Serial.printf("[CMD] Ignored manual pump command during measurement cycle: %s %s\n",
-        pcmd.cmd.c_str(), pcmd.action.c_str());
+        pcmd.cmd, pcmd.action);
       return;
     }
     Serial.printf("[CMD] Pump command mapped to index=%d\n", pumpIndex);
-    if (pcmd.action == "on") {
+    if (strcmp(pcmd.action, "on") == 0) {
       runPumpForDuration((size_t)pumpIndex, pcmd.duration);
     }
     else {
@@ -593,19 +762,20 @@ static void executeCommand(const PendingCommand& pcmd) {
     return;
   }
 
-  Serial.println("[CMD] Unknown command: " + pcmd.cmd);
+  Serial.printf("[CMD] Unknown command: %s\n", pcmd.cmd);
 }
 
 // =====================================================
 // MQTT 回调：统一解析 commands
 //  - config_update/update_config：立即更新->保存->重启
+//  - diag：置标记，由 loop 发布诊断快照
 //  - restart/pump：进入队列，支持 schedule/duration
 // =====================================================
 static void mqttCallback(char* topic, byte* payload, unsigned int length) {
   Serial.printf("[MQTT] Message received on topic=%s, payloadLength=%u\n", topic, length);
-
+  // 只保留用到的字段（见 shared/CommandFilter）
   JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, payload, length);
+  DeserializationError err = parseCommandPayload(doc, payload, length);
   if (err) {
     Serial.print("[MQTT] JSON parse failed: ");
     Serial.println(err.c_str());
@@ -662,6 +832,12 @@ static void mqttCallback(char* topic, byte* payload, unsigned int length) {
       return;
     }
 
+    if (cmd == "diag") {
+      Serial.println("[Diag] Diagnostics requested");
+      g_diagRequested = true;
+      continue;
+    }
+
     // 普通控制命令：action/duration/schedule
     String action = readStr(obj["action"], "");
     unsigned long dur = 0;
@@ -677,23 +853,34 @@ static void mqttCallback(char* topic, byte* payload, unsigned int length) {
       schedule.length() ? schedule.c_str() : "<now>",
       (unsigned long)target);
 
+    // 命令名和动作按定长字段入队，放不下的一定不是已知命令，直接拒绝
+    PendingCommand pending {};
+    if (cmd.length() >= sizeof(pending.cmd) || action.length() >= sizeof(pending.action)) {
+      Serial.println("[CMD] Command or action name too long, ignoring request");
+      continue;
+    }
+    strlcpy(pending.cmd, cmd.c_str(), sizeof(pending.cmd));
+    strlcpy(pending.action, action.c_str(), sizeof(pending.action));
+    pending.duration = dur;
+    pending.targetTime = target;
+
     if (g_cmdMutex) {
       xSemaphoreTake(g_cmdMutex, portMAX_DELAY);
     }
-    // 检查队列是否已满
-    if ((int)pendingCommands.size() >= MAX_PENDING_COMMANDS) {
+    // 队列满时拒绝
+    if (!g_commandQueue.push(pending)) {
       Serial.printf("[CMD] Command queue full (%u items), ignoring request\n",
-        (unsigned)pendingCommands.size());
+        (unsigned)g_commandQueue.size());
       if (g_cmdMutex) {
         xSemaphoreGive(g_cmdMutex);
       }
       continue;
     }
-    pendingCommands.push_back({ cmd, action, dur, target });
-    Serial.printf("[CMD] Command queued successfully, queueSize=%u\n", (unsigned)pendingCommands.size());
+    Serial.printf("[CMD] Command queued successfully, queueSize=%u\n", (unsigned)g_commandQueue.size());
     if (g_cmdMutex) {
       xSemaphoreGive(g_cmdMutex);
     }
+    wakeTask(g_commandTask);
   }
 }
 
@@ -731,6 +918,7 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
   clearPointCompletion();
 
   for (size_t pointIndex = startPointIndex; pointIndex < POINT_COUNT; ++pointIndex) {
+    ScopedPhaseTimer pointTimer(g_phasePoint);
     String pointCode = appConfig.pointDeviceCodes[pointIndex];
     if (pointCode.length() == 0) {
       pointCode = appConfig.deviceCode + "-P" + String(pointIndex + 1);
@@ -748,9 +936,12 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
       allPumpsOff();
       Serial.printf("[Measure] Point pump ON for intake %lu ms to pull limited gas into sensor chamber\n",
         sampleIntakeMs);
-      pumpOn(pointIndex);
-      delay(sampleIntakeMs);
-      pumpOff(pointIndex);
+      {
+        ScopedPhaseTimer intakeTimer(g_phaseIntake);
+        pumpOn(pointIndex);
+        delay(sampleIntakeMs);
+        pumpOff(pointIndex);
+      }
       Serial.printf("[Measure] Point pump OFF, start static measure window %lu ms (minimum observe=%lu ms)\n",
         staticMeasureWindowMs,
         sampleStabilizationMs);
@@ -772,8 +963,10 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
       bool latestCo2Stable = false;
       bool latestO2Stable = false;
       bool lastEnoughObserveTime = false;
+      ScopedPhaseTimer staticTimer(g_phaseStatic);
       while ((millis() - staticStartMs) < staticMeasureWindowMs) {
         sampleNo++;
+        ScopedPhaseTimer sensorsTimer(g_phaseSensors);
         int co2ppmRaw = readMHZ16();
 
         ZCE04BGasData gasData{};
@@ -787,6 +980,7 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
         bool shtOk = readSHT30(shtData);
         float t_air = shtOk ? shtData.temperature : -1.0f;
         float h_air = shtOk ? shtData.humidity : -1.0f;
+        sensorsTimer.stop();
 
         unsigned long elapsedMs = millis() - staticStartMs;
         if (co2ppmRaw > 0) {
@@ -865,6 +1059,8 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
         unsigned long remainingMs = staticMeasureWindowMs - elapsedMs;
         delay(min(sampleIntervalMs, remainingMs));
       }
+      staticTimer.stop();
+      ScopedPhaseTimer publishTimer(g_phasePublish);
 
       // 优先使用正式稳态结果；如果本轮一直没判稳，则回退到 fallback，
       // 但只给参与判稳的通道标记 UNSTABLE，其它通道仍按自身值判断质量。
@@ -892,6 +1088,7 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
       float h_air = resultSet.airHumidity.robustAverageOr();
 
       String ts = getTimeString();
+      time_t sampleEpoch = time(nullptr);
       Serial.printf("[Measure] Point %u robust-stable timestamp=%s, usedCounts(CO2=%u CO=%u H2S=%u O2=%u CH4=%u Temp=%u RH=%u), finalDualStable=%s, co2Stable=%s, o2Stable=%s, CO2=%.2f %%VOL, CO=%.1f, H2S=%.1f, O2=%.2f, CH4=%.1f, Temp=%.1f, RH=%.1f\n",
         (unsigned)(pointIndex + 1),
         ts.c_str(),
@@ -913,35 +1110,68 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
         t_air,
         h_air);
 
-      String payload = "{";
-      payload += "\"schema_version\":2,";
-      payload += "\"ts\":\"" + ts + "\",";
-      payload += "\"point_id\":" + String((unsigned)(pointIndex + 1)) + ",";
-      payload += "\"controller_device_code\":\"" + appConfig.deviceCode + "\",";
-      payload += "\"channels\":[";
-      bool firstChannel = true;
-      appendChannel(payload, firstChannel, "CO2", co2pct, 2, "%VOL", co2Quality);
-      appendChannel(payload, firstChannel, "CO", co, 1, "ppm");
-      appendChannel(payload, firstChannel, "H2S", h2s, 1, "ppm");
-      appendChannel(payload, firstChannel, "O2", o2, 2, "%VOL", o2Quality);
-      appendChannel(payload, firstChannel, "CH4", ch4, 1, "%LEL");
-      appendChannel(payload, firstChannel, "AirTemp", t_air, 1, "℃");
-      appendChannel(payload, firstChannel, "AirHumidity", h_air, 1, "%RH");
-      payload += "]}";
-
-      String postTopic = appConfig.mqttPostTopic(pointCode);
+      // payload 直接写进栈上的固定缓冲区，避免逐段 String 拼接反复申请堆内存
+      char payloadBuf[TELEMETRY_PAYLOAD_MAX];
+      TelemetryWriter payload(payloadBuf, sizeof(payloadBuf));
+      payload.begin(ts.c_str());
+      payload.pointId((unsigned)(pointIndex + 1));
+      payload.controllerCode(appConfig.deviceCode.c_str());
+      payload.beginChannels();
+      appendChannel(payload, "CO2", co2pct, 2, "%VOL", co2Quality);
+      appendChannel(payload, "CO", co, 1, "ppm");
+      appendChannel(payload, "H2S", h2s, 1, "ppm");
+      appendChannel(payload, "O2", o2, 2, "%VOL", o2Quality);
+      appendChannel(payload, "CH4", ch4, 1, "%LEL");
+      appendChannel(payload, "AirTemp", t_air, 1, "℃");
+      appendChannel(payload, "AirHumidity", h_air, 1, "%RH");
+      appendHeapChannels(payload);
+      bool payloadOk = payload.end();
+
+      // 同一份结果的紧凑表示，发布失败时用它缓存，补传时渲染回相同格式
+      CachedSample sample;
+      sample.epoch = (uint32_t)sampleEpoch;
+      sample.pointId = (uint8_t)(pointIndex + 1);
+      sample.withControllerCode = true;
+      addCachedChannel(sample, CACHE_CH_CO2, co2pct, co2Quality);
+      addCachedChannel(sample, CACHE_CH_CO, co);
+      addCachedChannel(sample, CACHE_CH_H2S, h2s);
+      addCachedChannel(sample, CACHE_CH_O2, o2, o2Quality);
+      addCachedChannel(sample, CACHE_CH_CH4, ch4);
+      addCachedChannel(sample, CACHE_CH_AIR_TEMP, t_air);
+      addCachedChannel(sample, CACHE_CH_AIR_HUMIDITY, h_air);
+
+      // topic 启动时已注册，这里只取编号；注册失败时才临时拼接
+      uint8_t topicId = telemetryTopicId(pointIndex);
+      String fallbackTopic;
+      if (topicId == TOPIC_ID_INVALID) {
+        fallbackTopic = appConfig.mqttPostTopic(pointCode);
+      }
+      const String& postTopic = topicId == TOPIC_ID_INVALID ? fallbackTopic : topicById(topicId);
       Serial.printf("[Measure] Point %u payload size=%u bytes, topic=%s\n",
         (unsigned)(pointIndex + 1),
         (unsigned)payload.length(),
         postTopic.c_str());
 
-      if (!publishDataOrCache(postTopic, payload, ts, 10000)) {
+      bool published = false;
+      if (!payloadOk) {
+        Serial.printf("[Measure] Point %u payload exceeds %u bytes, not published\n",
+          (unsigned)(pointIndex + 1),
+          (unsigned)TELEMETRY_PAYLOAD_MAX);
+      }
+      else if (topicId == TOPIC_ID_INVALID) {
+        published = publishDataOrCache(postTopic, String(payload.c_str()), ts, 10000);
+      }
+      else {
+        published = publishDataOrCache(topicId, payload.c_str(), sample, ts, 10000);
+      }
+      if (!published) {
         cycleOk = false;
         Serial.printf("[Measure] Point %u publish failed, data was cached locally\n", (unsigned)(pointIndex + 1));
       }
       else {
         Serial.printf("[Measure] Point %u publish completed successfully\n", (unsigned)(pointIndex + 1));
       }
+      publishTimer.stop();
       savePointCompletion(cycleStartEpoch, pointIndex);
     }
     else {
@@ -952,9 +1182,12 @@ static bool doMeasurementAndSave(size_t startPointIndex = 0, ResumePhase startPh
     saveResumeState(true, pointIndex, ResumePhase::PurgePump);
     allPumpsOff();
     Serial.printf("[Measure] Purge pump ON for %lu ms\n", appConfig.purgePumpTime);
-    pumpOn(PURGE_PUMP_INDEX);
-    delay(appConfig.purgePumpTime);
-    pumpOff(PURGE_PUMP_INDEX);
+    {
+      ScopedPhaseTimer purgeTimer(g_phasePurge);
+      pumpOn(PURGE_PUMP_INDEX);
+      delay(appConfig.purgePumpTime);
+      pumpOff(PURGE_PUMP_INDEX);
+    }
     Serial.println("[Measure] Purge pump OFF");
   }
 
@@ -1022,28 +1255,37 @@ static void measurementTask(void*) {
 // =====================================================
 // 任务：执行队列命令
 // =====================================================
+// 休眠到最早的 targetTime，新命令入队时由 mqttCallback 唤醒，
+// 立即执行的命令不再等待 1 s 轮询。
 static void commandTask(void*) {
+  PendingCommand cmd;
   while (true) {
-    time_t now = time(nullptr);
-    std::vector<PendingCommand> dueCommands;
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    time_t now = tv.tv_sec;
+    NextWake next(millis(), COMMAND_MAX_SLEEP_MS);
     if (g_cmdMutex) {
       xSemaphoreTake(g_cmdMutex, portMAX_DELAY);
     }
-    for (int i = 0; i < (int)pendingCommands.size();) {
-      if (now >= pendingCommands[i].targetTime) {
-        dueCommands.push_back(pendingCommands[i]);
-        pendingCommands.erase(pendingCommands.begin() + i);
-        continue;
+    // 每次只取一条到期命令，在锁外执行
+    bool due = g_commandQueue.popDue(now, cmd);
+    time_t target = 0;
+    if (!due && g_commandQueue.peekDue(target)) {
+      // targetTime 是秒级 epoch，按当前时间的毫秒部分换算成延迟，避免差一秒空转一轮；
+      // 超过最长休眠的远期命令交给下一轮再算，避免乘法溢出
+      time_t leftSec = target - now;
+      if (leftSec <= (time_t)(COMMAND_MAX_SLEEP_MS / 1000)) {
+        next.in((unsigned long)leftSec * 1000UL - tv.tv_usec / 1000);
       }
-      i++;
     }
     if (g_cmdMutex) {
       xSemaphoreGive(g_cmdMutex);
     }
-    for (auto& cmd : dueCommands) {
+    if (due) {
       executeCommand(cmd);
+      continue;   // 执行耗时可能较长，重新取时间再算下一次
     }
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    sleepUntilWake(next);
   }
 }
 
@@ -1075,14 +1317,24 @@ void setup() {
     appConfig.purgePumpTime);
   logCycleBudget("[System]");
 
-  // 2) 初始化数据缓存模块
-  if (!initDataBuffer(200, 7)) {
+  // 2) 注册遥测 topic（断网缓存按编号引用，需在缓存模块之前）
+  if (!initTopicRegistry()) {
+    Serial.println("[System] Topic registry incomplete, unregistered points fall back to full topic");
+  }
+
+  // 初始化数据缓存模块
+  if (!initDataBuffer(1000, 7)) {
     Serial.println("[System] Data buffer initialization failed, continuing without full cache support");
   }
   else {
     Serial.println("[System] Data buffer initialized successfully");
   }
 
+  // 缓存为空时没有记录引用旧编号，顺带清掉注册表里不再使用的 topic
+  if (getPendingDataCount() == 0 && !compactTopicRegistry()) {
+    Serial.println("[System] Topic registry rebuild incomplete, unregistered points fall back to full topic");
+  }
+
   // 3) WiFi + NTP
   if (!connectToWiFi(20000) || !multiNTPSetup(20000)) {
     Serial.println("[System] WiFi or NTP setup failed, restarting");
@@ -1214,9 +1466,18 @@ void setup() {
     Serial.println("[State] Resume handling is active, first cycle will continue from saved state");
   }
 
-  // 9) 启动任务
-  xTaskCreatePinnedToCore(measurementTask, "Measure", 16384, NULL, 1, NULL, 1);
-  xTaskCreatePinnedToCore(commandTask, "Command", 8192, NULL, 1, NULL, 1);
+  // 9) 登记计时阶段并启动任务
+  g_phasePoint = registerPhase("point");
+  g_phaseIntake = registerPhase("intake");
+  g_phaseStatic = registerPhase("static");
+  g_phaseSensors = registerPhase("sensors");
+  g_phasePublish = registerPhase("publish");
+  g_phasePurge = registerPhase("purge");
+
+  TaskHandle_t measureHandle = nullptr;
+  xTaskCreatePinnedToCore(measurementTask, "Measure", 16384, NULL, 1, &measureHandle, 1);
+  xTaskCreatePinnedToCore(commandTask, "Command", 8192, NULL, 1, &g_commandTask, 1);
+  heapMonitorSetTasks(measureHandle, g_commandTask);
 
   Serial.println("[System] Initialization complete");
 }
@@ -1233,10 +1494,11 @@ void loop() {
   unsigned long now = millis();
   if (now - lastCacheUploadMs >= CACHE_UPLOAD_INTERVAL_MS) {
     lastCacheUploadMs = now;
-    int uploaded = uploadCachedData(10);
+    int uploaded = uploadCachedData(60);
     if (uploaded > 0) {
       Serial.printf("[Loop] Uploaded %d cached data items\n", uploaded);
     }
   }
+  publishDiagnosticsIfNeeded();
   delay(100);
 }
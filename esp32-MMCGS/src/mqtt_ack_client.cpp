@@ -0,0 +1,252 @@
+// mqtt_ack_client.cpp
+// QoS1 发布与 PUBACK 跟踪实现
+
+#include "mqtt_ack_client.h"
+
+static constexpr uint8_t MQTT_TYPE_PUBACK = 4;
+static constexpr uint8_t MQTT_PUBLISH_QOS1 = 0x32;   // PUBLISH，QoS1，不保留
+static constexpr size_t MQTT_QOS1_TOPIC_MAX = 128;
+// 报文标识符只用高半区，和 PubSubClient 自己给 SUBSCRIBE 用的小编号错开
+static constexpr uint16_t QOS1_ID_FIRST = 0x8000;
+static constexpr uint8_t MQTT_LENGTH_BYTES_MAX = 4;   // 剩余长度最多 4 字节
+
+AckTrackingClient::AckTrackingClient(WiFiClient& inner)
+    : _inner(inner), _head(0), _count(0), _nextId(QOS1_ID_FIRST), _generation(0) {
+    resetParser();
+}
+
+// ========== Client 接口 ==========
+
+int AckTrackingClient::connect(IPAddress ip, uint16_t port) {
+    resetParser();
+    resetInflight();
+    return _inner.connect(ip, port);
+}
+
+int AckTrackingClient::connect(const char* host, uint16_t port) {
+    resetParser();
+    resetInflight();
+    return _inner.connect(host, port);
+}
+
+int AckTrackingClient::connect(IPAddress ip, uint16_t port, int32_t timeout) {
+    resetParser();
+    resetInflight();
+    return _inner.connect(ip, port, timeout);
+}
+
+int AckTrackingClient::connect(const char* host, uint16_t port, int32_t timeout) {
+    resetParser();
+    resetInflight();
+    return _inner.connect(host, port, timeout);
+}
+
+size_t AckTrackingClient::write(uint8_t b) {
+    return _inner.write(b);
+}
+
+size_t AckTrackingClient::write(const uint8_t* buf, size_t size) {
+    return _inner.write(buf, size);
+}
+
+int AckTrackingClient::available() {
+    return _inner.available();
+}
+
+int AckTrackingClient::read() {
+    int b = _inner.read();
+    if (b >= 0) {
+        feed((uint8_t)b);
+    }
+    return b;
+}
+
+int AckTrackingClient::read(uint8_t* buf, size_t size) {
+    int n = _inner.read(buf, size);
+    for (int i = 0; i < n; i++) {
+        feed(buf[i]);
+    }
+    return n;
+}
+
+int AckTrackingClient::peek() {
+    return _inner.peek();
+}
+
+void AckTrackingClient::flush() {
+    _inner.flush();
+}
+
+void AckTrackingClient::stop() {
+    _inner.stop();
+    resetParser();
+    resetInflight();
+}
+
+uint8_t AckTrackingClient::connected() {
+    return _inner.connected();
+}
+
+AckTrackingClient::operator bool() {
+    return (bool)_inner;
+}
+
+// ========== 入站报文解析 ==========
+
+void AckTrackingClient::resetParser() {
+    _state = PARSE_HEADER;
+    _packetType = 0;
+    _remaining = 0;
+    _lengthMultiplier = 1;
+    _lengthBytes = 0;
+    _ackId = 0;
+}
+
+void AckTrackingClient::feed(uint8_t b) {
+    switch (_state) {
+    case PARSE_HEADER:
+        _packetType = b >> 4;
+        _remaining = 0;
+        _lengthMultiplier = 1;
+        _lengthBytes = 0;
+        _state = PARSE_LENGTH;
+        break;
+
+    case PARSE_LENGTH:
+        // 剩余长度为 1~4 字节的变长编码
+        _remaining += (uint32_t)(b & 0x7F) * _lengthMultiplier;
+        _lengthMultiplier *= 128;
+        _lengthBytes++;
+        if (b & 0x80) {
+            if (_lengthBytes >= MQTT_LENGTH_BYTES_MAX) {
+                resetParser();   // 第 5 个长度字节，编码非法，从下一个字节重新对齐
+            }
+            break;
+        }
+        if (_remaining == 0) {
+            _state = PARSE_HEADER;
+        } else if (_packetType == MQTT_TYPE_PUBACK && _remaining == 2) {
+            _ackId = 0;
+            _state = PARSE_ACK_ID;
+        } else {
+            _state = PARSE_SKIP;
+        }
+        break;
+
+    case PARSE_ACK_ID:
+        _ackId = (uint16_t)((_ackId << 8) | b);
+        if (--_remaining == 0) {
+            onPubAck(_ackId);
+            _state = PARSE_HEADER;
+        }
+        break;
+
+    case PARSE_SKIP:
+        if (--_remaining == 0) {
+            _state = PARSE_HEADER;
+        }
+        break;
+    }
+}
+
+void AckTrackingClient::onPubAck(uint16_t packetId) {
+    portENTER_CRITICAL(&_mux);
+    for (uint8_t i = 0; i < _count; i++) {
+        InflightEntry& e = _window[(_head + i) % MQTT_QOS1_MAX_INFLIGHT];
+        if (e.packetId == packetId) {
+            e.acked = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+// ========== QoS1 发布 ==========
+
+uint16_t AckTrackingClient::publishQos1(Print& out, const char* topic, const uint8_t* payload, size_t length) {
+    size_t topicLen = strlen(topic);
+    if (topicLen == 0 || topicLen > MQTT_QOS1_TOPIC_MAX) {
+        return 0;
+    }
+
+    portENTER_CRITICAL(&_mux);
+    bool full = _count >= MQTT_QOS1_MAX_INFLIGHT;
+    uint16_t id = _nextId;
+    if (!full) {
+        _nextId = (_nextId == 0xFFFF) ? QOS1_ID_FIRST : _nextId + 1;
+    }
+    portEXIT_CRITICAL(&_mux);
+    if (full) {
+        return 0;
+    }
+
+    // 固定头 + 变长剩余长度 + topic + 报文标识符；payload 单独写出，不再拷贝
+    uint8_t head[1 + 4 + 2 + MQTT_QOS1_TOPIC_MAX + 2];
+    size_t n = 0;
+    head[n++] = MQTT_PUBLISH_QOS1;
+    uint32_t remaining = 2 + topicLen + 2 + length;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        if (remaining > 0) {
+            digit |= 0x80;
+        }
+        head[n++] = digit;
+    } while (remaining > 0 && n < 5);
+    head[n++] = (uint8_t)(topicLen >> 8);
+    head[n++] = (uint8_t)(topicLen & 0xFF);
+    memcpy(head + n, topic, topicLen);
+    n += topicLen;
+    head[n++] = (uint8_t)(id >> 8);
+    head[n++] = (uint8_t)(id & 0xFF);
+
+    if (out.write(head, n) != n || (length > 0 && out.write(payload, length) != length)) {
+        // 半条 PUBLISH 已经写进连接，后续报文会接在它后面被错误解析：断开，由重连换一条新连接
+        stop();
+        return 0;
+    }
+
+    portENTER_CRITICAL(&_mux);
+    if (_count < MQTT_QOS1_MAX_INFLIGHT) {
+        InflightEntry& e = _window[(_head + _count) % MQTT_QOS1_MAX_INFLIGHT];
+        e.packetId = id;
+        e.acked = false;
+        _count++;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return id;
+}
+
+uint8_t AckTrackingClient::takeAcked() {
+    uint8_t taken = 0;
+    portENTER_CRITICAL(&_mux);
+    while (_count > 0 && _window[_head].acked) {
+        _head = (_head + 1) % MQTT_QOS1_MAX_INFLIGHT;
+        _count--;
+        taken++;
+    }
+    portEXIT_CRITICAL(&_mux);
+    return taken;
+}
+
+uint8_t AckTrackingClient::inflight() const {
+    portENTER_CRITICAL(&_mux);
+    uint8_t count = _count;
+    portEXIT_CRITICAL(&_mux);
+    return count;
+}
+
+void AckTrackingClient::resetInflight() {
+    portENTER_CRITICAL(&_mux);
+    _head = 0;
+    _count = 0;
+    _generation++;
+    portEXIT_CRITICAL(&_mux);
+}
+
+uint32_t AckTrackingClient::generation() const {
+    portENTER_CRITICAL(&_mux);
+    uint32_t gen = _generation;
+    portEXIT_CRITICAL(&_mux);
+    return gen;
+}
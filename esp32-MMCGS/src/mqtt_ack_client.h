@@ -0,0 +1,96 @@
+// mqtt_ack_client.h
+// QoS1 发布与 PUBACK 跟踪
+// 功能：PubSubClient 只能发布 QoS0，也不把 PUBACK 交给上层。这里用 AckTrackingClient
+// 包一层 WiFiClient 交给 PubSubClient 使用：
+// - 发送：QoS1 PUBLISH 报文由本模块编码，经 PubSubClient 的 write() 写到同一条连接上；
+// - 接收：PubSubClient 读取的字节流先经过这里，按 MQTT 固定头切分报文，识别出 PUBACK，
+//   在在途窗口里标记对应报文标识符。其余报文原样交给 PubSubClient 处理。
+// 在途窗口按发送顺序排列，调用方只取走队首连续已确认的条数，保证按顺序确认缓存记录。
+// 连接重建时窗口清空、代数加一：未确认的记录仍留在缓存里，下次补传重发（至少一次送达）。
+
+#ifndef MQTT_ACK_CLIENT_H
+#define MQTT_ACK_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <freertos/FreeRTOS.h>
+
+static constexpr uint8_t MQTT_QOS1_MAX_INFLIGHT = 16;
+
+class AckTrackingClient : public Client {
+public:
+    explicit AckTrackingClient(WiFiClient& inner);
+
+    // ===== Client 接口：转发给内部 WiFiClient，读出的字节顺便解析 =====
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char* host, uint16_t port, int32_t timeout);
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override;
+
+    // ===== QoS1 =====
+
+    /**
+     * @brief 编码并写出一条 QoS1 PUBLISH，登记到在途窗口
+     * @param out 写出通道，传 PubSubClient 以便它记录发送时间、维持心跳
+     * @return 报文标识符；窗口已满、topic 过长或写失败时返回 0
+     */
+    uint16_t publishQos1(Print& out, const char* topic, const uint8_t* payload, size_t length);
+
+    /**
+     * @brief 取走窗口队首连续已收到 PUBACK 的条数
+     */
+    uint8_t takeAcked();
+
+    uint8_t inflight() const;
+
+    /**
+     * @brief 清空在途窗口（新连接、或放弃本轮未确认的发布时调用）
+     */
+    void resetInflight();
+
+    /**
+     * @brief 在途窗口的代数，每次 resetInflight 加一
+     * 调用方发布前记下，之后不一致说明期间重连或窗口被清空，手里的在途记录已作废
+     */
+    uint32_t generation() const;
+
+private:
+    void feed(uint8_t b);
+    void onPubAck(uint16_t packetId);
+    void resetParser();
+
+    // 入站报文解析状态
+    enum ParseState : uint8_t { PARSE_HEADER, PARSE_LENGTH, PARSE_ACK_ID, PARSE_SKIP };
+
+    struct InflightEntry {
+        uint16_t packetId;
+        bool acked;
+    };
+
+    WiFiClient& _inner;
+    ParseState _state;
+    uint8_t _packetType;
+    uint32_t _remaining;
+    uint32_t _lengthMultiplier;
+    uint8_t _lengthBytes;
+    uint16_t _ackId;
+
+    mutable portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+    InflightEntry _window[MQTT_QOS1_MAX_INFLIGHT];
+    uint8_t _head;
+    uint8_t _count;
+    uint16_t _nextId;
+    uint32_t _generation;
+};
+
+#endif
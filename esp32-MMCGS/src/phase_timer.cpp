@@ -0,0 +1,90 @@
+// phase_timer.cpp
+// 采样周期分阶段计时实现
+
+#include "phase_timer.h"
+
+#if PHASE_TIMER_ENABLED
+
+#include <freertos/FreeRTOS.h>
+
+static portMUX_TYPE g_phaseMux = portMUX_INITIALIZER_UNLOCKED;
+static PhaseStats g_phases[PHASE_TIMER_MAX_PHASES];
+static uint8_t g_phaseCount = 0;
+static PhaseSample g_ring[PHASE_TIMER_RING_SIZE];
+static uint8_t g_ringHead = 0;   // 下一个写入位置
+static uint8_t g_ringFill = 0;
+
+uint8_t registerPhase(const char* name) {
+    uint8_t id = PHASE_ID_INVALID;
+    portENTER_CRITICAL(&g_phaseMux);
+    for (uint8_t i = 0; i < g_phaseCount; i++) {
+        if (strcmp(g_phases[i].name, name) == 0) {
+            id = i;
+            break;
+        }
+    }
+    if (id == PHASE_ID_INVALID && g_phaseCount < PHASE_TIMER_MAX_PHASES) {
+        id = g_phaseCount++;
+        g_phases[id] = PhaseStats();
+        g_phases[id].name = name;
+    }
+    portEXIT_CRITICAL(&g_phaseMux);
+
+    if (id == PHASE_ID_INVALID) {
+        Serial.printf("[Diag] Phase table full, '%s' not timed\n", name);
+    }
+    return id;
+}
+
+void recordPhase(uint8_t phase, uint32_t us) {
+    portENTER_CRITICAL(&g_phaseMux);
+    if (phase < g_phaseCount) {
+        PhaseStats& s = g_phases[phase];
+        if (s.count == 0 || us < s.minUs) {
+            s.minUs = us;
+        }
+        if (us > s.maxUs) {
+            s.maxUs = us;
+        }
+        s.lastUs = us;
+        s.totalUs += us;
+        s.count++;
+
+        g_ring[g_ringHead].phase = phase;
+        g_ring[g_ringHead].us = us;
+        g_ringHead = (g_ringHead + 1) % PHASE_TIMER_RING_SIZE;
+        if (g_ringFill < PHASE_TIMER_RING_SIZE) {
+            g_ringFill++;
+        }
+    }
+    portEXIT_CRITICAL(&g_phaseMux);
+}
+
+size_t snapshotPhaseStats(PhaseStats* out, size_t maxCount) {
+    portENTER_CRITICAL(&g_phaseMux);
+    size_t n = g_phaseCount < maxCount ? g_phaseCount : maxCount;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = g_phases[i];
+    }
+    portEXIT_CRITICAL(&g_phaseMux);
+    return n;
+}
+
+size_t snapshotPhaseSamples(PhaseSample* out, size_t maxCount) {
+    portENTER_CRITICAL(&g_phaseMux);
+    size_t n = g_ringFill < maxCount ? g_ringFill : maxCount;
+    // 请求条数少于已存条数时跳过最旧的部分
+    size_t start = (g_ringHead + PHASE_TIMER_RING_SIZE - n) % PHASE_TIMER_RING_SIZE;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = g_ring[(start + i) % PHASE_TIMER_RING_SIZE];
+    }
+    portEXIT_CRITICAL(&g_phaseMux);
+    return n;
+}
+
+const char* phaseName(uint8_t phase) {
+    // 阶段只追加、名字不变，这里不需要加锁
+    return phase < g_phaseCount ? g_phases[phase].name : "";
+}
+
+#endif
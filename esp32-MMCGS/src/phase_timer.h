@@ -0,0 +1,105 @@
+// phase_timer.h
+// 采样周期分阶段计时
+// 功能：按阶段记录微秒级耗时（次数 / 最近 / 最小 / 最大 / 累计），
+// 并在固定大小的环形缓冲区里保留所有阶段最近的若干次耗时，供 diag 诊断报文使用。
+// 记录时只在自旋锁里更新几个计数，任意任务都可以调用。
+// 编译时加 -DPHASE_TIMER_ENABLED=0 可整体去掉。
+
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <Arduino.h>
+
+#ifndef PHASE_TIMER_ENABLED
+#define PHASE_TIMER_ENABLED 1
+#endif
+
+static const uint8_t PHASE_TIMER_MAX_PHASES = 8;
+static const uint8_t PHASE_TIMER_RING_SIZE = 32;
+static const uint8_t PHASE_ID_INVALID = 0xFF;
+
+struct PhaseStats {
+    const char* name = nullptr;
+    uint32_t count = 0;      // 记录次数
+    uint32_t lastUs = 0;     // 最近一次耗时（微秒）
+    uint32_t minUs = 0;      // 最小耗时（微秒）
+    uint32_t maxUs = 0;      // 最大耗时（微秒）
+    uint64_t totalUs = 0;    // 累计耗时（微秒）
+
+    uint32_t avgUs() const { return count ? (uint32_t)(totalUs / count) : 0; }
+};
+
+struct PhaseSample {
+    uint8_t phase = PHASE_ID_INVALID;
+    uint32_t us = 0;
+};
+
+#if PHASE_TIMER_ENABLED
+
+/**
+ * @brief 登记一个阶段
+ * @param name 阶段名，需在整个运行期有效（通常是字符串字面量）
+ * @return 阶段编号，同名重复登记返回同一编号；表满时返回 PHASE_ID_INVALID
+ */
+uint8_t registerPhase(const char* name);
+
+/**
+ * @brief 记录一次阶段耗时
+ */
+void recordPhase(uint8_t phase, uint32_t us);
+
+/**
+ * @brief 按登记顺序拷贝各阶段统计
+ * @return 实际拷贝条数
+ */
+size_t snapshotPhaseStats(PhaseStats* out, size_t maxCount);
+
+/**
+ * @brief 按时间从旧到新拷贝环形缓冲区
+ * @return 实际拷贝条数
+ */
+size_t snapshotPhaseSamples(PhaseSample* out, size_t maxCount);
+
+const char* phaseName(uint8_t phase);
+
+/**
+ * @brief 作用域计时器：构造时开始，stop() 或析构时记录一次
+ */
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(uint8_t phase) : _phase(phase), _startUs(micros()) {}
+    ~ScopedPhaseTimer() { stop(); }
+
+    void stop() {
+        if (_phase == PHASE_ID_INVALID) {
+            return;
+        }
+        recordPhase(_phase, (uint32_t)(micros() - _startUs));
+        _phase = PHASE_ID_INVALID;
+    }
+
+private:
+    ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+    ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+    uint8_t _phase;
+    unsigned long _startUs;
+};
+
+#else
+
+inline uint8_t registerPhase(const char*) { return PHASE_ID_INVALID; }
+inline void recordPhase(uint8_t, uint32_t) {}
+inline size_t snapshotPhaseStats(PhaseStats*, size_t) { return 0; }
+inline size_t snapshotPhaseSamples(PhaseSample*, size_t) { return 0; }
+inline const char* phaseName(uint8_t) { return ""; }
+
+class ScopedPhaseTimer {
+public:
+    explicit ScopedPhaseTimer(uint8_t) {}
+    void stop() {}
+};
+
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+// task_wake.h
+// 按截止时间休眠的任务唤醒
+// 功能：任务把关心的到期时间交给 NextWake，取最早的一个，
+// 然后阻塞在自己的任务通知上直到到期；其他任务加入可能更早到期的工作
+// （例如新命令入队）后调用 wakeTask() 提前唤醒，不再需要固定周期轮询。
+
+#ifndef TASK_WAKE_H
+#define TASK_WAKE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+class NextWake {
+public:
+    /**
+     * @param nowMs 当前 millis()
+     * @param maxSleepMs 没有更近的截止时间时最长休眠多久
+     */
+    NextWake(unsigned long nowMs, unsigned long maxSleepMs) : _nowMs(nowMs), _sleepMs(maxSleepMs) {}
+
+    /**
+     * @brief 加入一个截止时间（millis()），处理回绕；已过期的视为立即到期
+     */
+    void at(unsigned long dueMs) {
+        unsigned long left = dueMs - _nowMs;
+        if (left >= 0x80000000UL) {
+            left = 0;
+        }
+        if (left < _sleepMs) {
+            _sleepMs = left;
+        }
+    }
+
+    /**
+     * @brief 加入一个相对当前时刻的延迟
+     */
+    void in(unsigned long delayMs) {
+        if (delayMs < _sleepMs) {
+            _sleepMs = delayMs;
+        }
+    }
+
+    unsigned long sleepMs() const { return _sleepMs; }
+
+private:
+    unsigned long _nowMs;
+    unsigned long _sleepMs;
+};
+
+/**
+ * @brief 休眠到最早的截止时间或被 wakeTask() 唤醒，至少让出一个 tick
+ * @return 被提前唤醒返回 true
+ */
+bool sleepUntilWake(const NextWake& next);
+
+/**
+ * @brief 唤醒阻塞在 sleepUntilWake() 里的任务，句柄为空时什么都不做
+ * 任务忙时收到的通知会让它下一次休眠立即返回，不会丢失。
+ */
+void wakeTask(TaskHandle_t task);
+
+#endif
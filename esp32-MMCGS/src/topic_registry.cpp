@@ -0,0 +1,186 @@
+// topic_registry.cpp
+// MQTT topic 注册表实现
+// 持久化文件每行一个 topic，行号即编号。平时只追加不改写，离线缓存为空时启动阶段整体重建。
+
+#include "topic_registry.h"
+#include "config_manager.h"
+#include <SPIFFS.h>
+#include <deque>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// ========== 全局变量 ==========
+
+static const char* TOPIC_REGISTRY_FILE = "/topics.txt";
+static const size_t TOPIC_REGISTRY_MAX = 255;
+
+// deque 追加时不会使已有元素的引用失效，topicById 可以直接返回引用
+static std::deque<String> g_topics;
+static uint8_t g_telemetryIds[AppConfig::kPointCount];
+static bool g_registryReady = false;
+static bool g_appendBlocked = false;     // 半行没能补上换行时不再追加
+static SemaphoreHandle_t g_topicMutex = nullptr;
+static const String EMPTY_TOPIC;
+
+class TopicLock {
+public:
+    TopicLock() {
+        if (g_topicMutex) {
+            xSemaphoreTake(g_topicMutex, portMAX_DELAY);
+        }
+    }
+    ~TopicLock() {
+        if (g_topicMutex) {
+            xSemaphoreGive(g_topicMutex);
+        }
+    }
+};
+
+// ========== 内部工具函数 ==========
+
+static void loadTopics() {
+    g_topics.clear();
+    File file = SPIFFS.open(TOPIC_REGISTRY_FILE, FILE_READ);
+    if (!file) {
+        return;
+    }
+    // 追加时掉电会留下没有换行的半行
+    bool torn = false;
+    size_t size = file.size();
+    if (size > 0 && file.seek(size - 1)) {
+        torn = file.read() != '\n';
+        file.seek(0);
+    }
+    while (file.available() && g_topics.size() < TOPIC_REGISTRY_MAX) {
+        String line = file.readStringUntil('\n');
+        // 半行没有记录引用过，占住编号但不再使用
+        g_topics.push_back(torn && !file.available() ? String() : line);
+    }
+    file.close();
+
+    if (torn) {
+        // 补上换行，否则下一次追加会接在半行后面，之后的编号整体错位
+        File append = SPIFFS.open(TOPIC_REGISTRY_FILE, FILE_APPEND);
+        g_appendBlocked = !append || append.write((const uint8_t*)"\n", 1) != 1;
+        if (append) {
+            append.close();
+        }
+        Serial.printf("[Topic] Dropped torn last line of registry%s\n",
+            g_appendBlocked ? ", failed to terminate it, new topics disabled" : "");
+    }
+}
+
+static uint8_t findOrAppendTopic(const String& topic) {
+    for (size_t i = 0; i < g_topics.size(); i++) {
+        if (g_topics[i] == topic) {
+            return (uint8_t)i;
+        }
+    }
+    if (g_appendBlocked || g_topics.size() >= TOPIC_REGISTRY_MAX || topic.length() == 0 || topic.indexOf('\n') >= 0) {
+        return TOPIC_ID_INVALID;
+    }
+
+    File file = SPIFFS.open(TOPIC_REGISTRY_FILE, FILE_APPEND);
+    if (!file) {
+        Serial.println("[Topic] Failed to open registry for append");
+        return TOPIC_ID_INVALID;
+    }
+    String line = topic + "\n";
+    bool ok = file.write((const uint8_t*)line.c_str(), line.length()) == line.length();
+    file.close();
+    if (!ok) {
+        Serial.println("[Topic] Failed to persist topic");
+        return TOPIC_ID_INVALID;
+    }
+
+    g_topics.push_back(topic);
+    Serial.printf("[Topic] Registered #%u %s\n", (unsigned)(g_topics.size() - 1), topic.c_str());
+    return (uint8_t)(g_topics.size() - 1);
+}
+
+static bool registerTelemetryTopics() {
+    bool ok = true;
+    for (size_t i = 0; i < AppConfig::kPointCount; i++) {
+        String code = i < appConfig.pointDeviceCodes.size() ? appConfig.pointDeviceCodes[i] : String();
+        if (code.length() == 0) {
+            code = appConfig.deviceCode + "-P" + String(i + 1);
+        }
+        g_telemetryIds[i] = findOrAppendTopic(appConfig.mqttPostTopic(code));
+        if (g_telemetryIds[i] == TOPIC_ID_INVALID) {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 当前配置实际引用的编号个数
+static size_t countTelemetryTopics() {
+    bool used[TOPIC_REGISTRY_MAX] = {};
+    size_t count = 0;
+    for (size_t i = 0; i < AppConfig::kPointCount; i++) {
+        uint8_t id = g_telemetryIds[i];
+        if (id < TOPIC_REGISTRY_MAX && !used[id]) {
+            used[id] = true;
+            count++;
+        }
+    }
+    return count;
+}
+
+// ========== 对外接口 ==========
+
+bool initTopicRegistry() {
+    if (!g_topicMutex) {
+        g_topicMutex = xSemaphoreCreateMutex();
+        if (!g_topicMutex) {
+            Serial.println("[Topic] Failed to create topic mutex");
+        }
+    }
+
+    TopicLock lock;
+    loadTopics();
+
+    // point_device_codes 变化时这里会追加新 topic，旧编号保留给尚未补传的缓存
+    bool ok = registerTelemetryTopics();
+
+    g_registryReady = true;
+    Serial.printf("[Topic] Registry ready: %u topics\n", (unsigned)g_topics.size());
+    return ok;
+}
+
+bool compactTopicRegistry() {
+    TopicLock lock;
+    if (!g_registryReady) {
+        return false;
+    }
+    size_t before = g_topics.size();
+    if (countTelemetryTopics() == before) {
+        return true;
+    }
+
+    // 没有缓存记录引用旧编号，直接按当前配置重建
+    SPIFFS.remove(TOPIC_REGISTRY_FILE);
+    g_topics.clear();
+    g_appendBlocked = false;
+    bool ok = registerTelemetryTopics();
+    Serial.printf("[Topic] Compacted registry: %u -> %u topics\n",
+        (unsigned)before, (unsigned)g_topics.size());
+    return ok;
+}
+
+uint8_t registerTopic(const String& topic) {
+    TopicLock lock;
+    return findOrAppendTopic(topic);
+}
+
+const String& topicById(uint8_t id) {
+    TopicLock lock;
+    return id < g_topics.size() ? g_topics[id] : EMPTY_TOPIC;
+}
+
+uint8_t telemetryTopicId(size_t pointIndex) {
+    if (!g_registryReady || pointIndex >= AppConfig::kPointCount) {
+        return TOPIC_ID_INVALID;
+    }
+    return g_telemetryIds[pointIndex];
+}
@@ -0,0 +1,46 @@
+// topic_registry.h
+// MQTT topic 注册表
+// 功能：启动时按当前配置生成一次所有遥测 topic，分配 1 字节编号并持久化到 SPIFFS。
+// 发布路径与断网缓存共用同一套编号，缓存记录只保存编号。
+
+#ifndef TOPIC_REGISTRY_H
+#define TOPIC_REGISTRY_H
+
+#include <Arduino.h>
+
+static const uint8_t TOPIC_ID_INVALID = 0xFF;
+
+/**
+ * @brief 初始化 topic 注册表
+ * 载入已持久化的编号，再按当前 point_device_codes 注册遥测 topic。
+ * 已有 topic 的编号保持不变（缓存记录依赖它），新 topic 追加到表尾。
+ * @return true 成功 false 失败
+ */
+bool initTopicRegistry();
+
+/**
+ * @brief 按当前配置重建注册表，去掉不再使用的 topic 与掉电留下的半行
+ * 会重新分配编号，只能在离线缓存为空、其它任务尚未启动时调用（setup 中）；
+ * 表里没有多余条目时不写文件。
+ * @return true 当前遥测 topic 都已注册 false 写入失败
+ */
+bool compactTopicRegistry();
+
+/**
+ * @brief 查找 topic 编号，不存在时追加注册并持久化
+ * @return 编号，表满或写入失败时返回 TOPIC_ID_INVALID
+ */
+uint8_t registerTopic(const String& topic);
+
+/**
+ * @brief 按编号取 topic
+ * @return topic 引用，未知编号返回空串
+ */
+const String& topicById(uint8_t id);
+
+/**
+ * @brief 点位遥测 topic 编号（pointIndex 从 0 开始）
+ */
+uint8_t telemetryTopicId(size_t pointIndex);
+
+#endif
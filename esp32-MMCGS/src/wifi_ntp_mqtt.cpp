@@ -4,10 +4,33 @@
 #include <WiFi.h>
 #include <time.h>
 #include <HTTPClient.h>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include "data_buffer.h"
+#include "telemetry_writer.h"
+#include "topic_registry.h"
+#include "mqtt_ack_client.h"
 
 // 全局 WiFiClient 与 MQTT 客户端
+// PubSubClient 经 ackClient 读写连接，以便 QoS1 补传识别 PUBACK
 static WiFiClient espClient;
-PubSubClient mqttClient(espClient);
+static AckTrackingClient ackClient(espClient);
+PubSubClient mqttClient(ackClient);
+
+// PubSubClient 不是线程安全的：MeasureTask 发布数据的同时 loop() 在跑
+// mqttClient.loop() 和缓存补传，两边还共用 ackClient 的 PUBACK 解析，
+// 所有 MQTT 调用都经这把锁串行
+static SemaphoreHandle_t g_mqttMutex = nullptr;
+
+static void ensureMqttMutex() {
+	if (!g_mqttMutex) {
+		g_mqttMutex = xSemaphoreCreateMutex();
+	}
+}
+
+// QoS1 补传：这么久没有新的 PUBACK 就结束本轮，未确认的记录留待下次重发
+static const unsigned long QOS1_ACK_TIMEOUT_MS = 5000;
 
 // WiFi 保活状态
 static unsigned long lastWiFiCheck = 0;
@@ -244,7 +267,7 @@ String getTimeString() {
  */
 bool connectToMQTT(unsigned long timeoutMs) {
 	mqttClient.setServer(appConfig.mqttServer.c_str(), appConfig.mqttPort);
-	mqttClient.setBufferSize(1024);
+	mqttClient.setBufferSize(TELEMETRY_MQTT_BUFFER_SIZE);
 	const String effectiveClientId = buildEffectiveMqttClientId();
 
 	unsigned long start = millis();
@@ -345,25 +368,61 @@ void maintainMQTT(unsigned long timeoutMs) {
 	// 检测网络连通性
 	maintainNetwork();
 
+	ensureMqttMutex();
+	// 不在锁上阻塞 loop()：publishData 可能持锁数秒
+	if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(120)) != pdTRUE) {
+		return;
+	}
 	if (!mqttClient.connected()) {
 		Serial.printf("[MQTT] Not connected, state=%d, reconnecting...\n", mqttClient.state());
 		connectToMQTT(timeoutMs);
 	}
 	mqttClient.loop();
+	xSemaphoreGive(g_mqttMutex);
 }
 
 /**
  * @brief 通过 MQTT 发布数据
  */
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs) {
+	return publishData(topic, payload.c_str(), timeoutMs);
+}
+
+/**
+ * @brief topic 上一条 PUBLISH 能带的最大 payload 字节数
+ */
+size_t mqttPayloadLimit(const String& topic) {
+	size_t overhead = TELEMETRY_MQTT_HEADER_MAX + topic.length();
+	return overhead < TELEMETRY_MQTT_BUFFER_SIZE ? TELEMETRY_MQTT_BUFFER_SIZE - overhead : 0;
+}
+
+/**
+ * @brief 发布固定缓冲区里的数据（带超时保护），不为 payload 申请堆内存
+ * 放不进 MQTT 缓冲区的报文 PubSubClient 只会返回失败，这里先报告并直接放弃，不再重试到超时
+ */
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs) {
+	size_t payloadLen = strlen(payload);
+	if (payloadLen > mqttPayloadLimit(topic)) {
+		Serial.printf("[MQTT] publishData: %u-byte payload exceeds the %u-byte MQTT buffer on %s\n",
+			(unsigned)payloadLen, (unsigned)TELEMETRY_MQTT_BUFFER_SIZE, topic.c_str());
+		return false;
+	}
+
+	ensureMqttMutex();
 	unsigned long start = millis();
 
 	// 先确保 WiFi 在线
 	maintainWiFi();
 
+	if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+		Serial.printf("[MQTT] publishData: mutex timeout >%lu ms\n", timeoutMs);
+		return false;
+	}
+
 	while (!mqttClient.connected()) {
 		if (millis() - start > timeoutMs) {
 			Serial.printf("[MQTT] publishData: connect timeout >%lu ms\n", timeoutMs);
+			xSemaphoreGive(g_mqttMutex);
 			return false;
 		}
 		maintainWiFi();
@@ -371,9 +430,10 @@ bool publishData(const String& topic, const String& payload, unsigned long timeo
 	}
 
 	while (millis() - start < timeoutMs) {
-		if (mqttClient.publish(topic.c_str(), payload.c_str())) {
+		if (mqttClient.publish(topic.c_str(), payload)) {
 			Serial.println("[MQTT] Publish success:");
 			Serial.println(payload);
+			xSemaphoreGive(g_mqttMutex);
 			return true;
 		}
 		else {
@@ -389,6 +449,7 @@ bool publishData(const String& topic, const String& payload, unsigned long timeo
 	}
 
 	Serial.printf("[MQTT] publishData: overall timeout >%lu ms\n", timeoutMs);
+	xSemaphoreGive(g_mqttMutex);
 	return false;
 }
 
@@ -408,7 +469,6 @@ bool publishDataOrCache(const String& topic, const String& payload, const String
 
 	// 上传失败，尝试缓存到本地
 	Serial.println("[MQTT] Publish failed, caching locally...");
-	extern bool savePendingData(const String&, const String&, const String&);
 
 	if (savePendingData(topic, payload, timestamp)) {
 		Serial.println("[MQTT] Data cached successfully");
@@ -419,67 +479,292 @@ bool publishDataOrCache(const String& topic, const String& payload, const String
 	}
 }
 
+/**
+ * @brief 按 topic 编号发布一次采样，失败时以紧凑格式缓存到本地
+ * topic 取自注册表，不再逐次拼接；紧凑缓存失败时退回缓存完整 payload
+ * @param topicId topic 编号（见 topic_registry.h）
+ * @param payload 实时上报用的 payload
+ * @param sample 同一次采样的紧凑表示
+ * @param timestamp 时间戳（用于退回缓存）
+ * @param timeoutMs 超时时间
+ * @return true 成功上传 false 失败并缓存
+ */
+bool publishDataOrCache(uint8_t topicId, const char* payload, const CachedSample& sample, const String& timestamp, unsigned long timeoutMs) {
+	const String& topic = topicById(topicId);
+	if (topic.length() == 0) {
+		Serial.printf("[MQTT] Unknown topic id %u, data dropped\n", (unsigned)topicId);
+		return false;
+	}
+	if (publishData(topic, payload, timeoutMs)) {
+		return true;
+	}
+
+	Serial.println("[MQTT] Publish failed, caching sample locally...");
+	if (savePendingSample(topicId, sample) || savePendingData(topic, payload, timestamp)) {
+		Serial.println("[MQTT] Data cached successfully");
+	}
+	else {
+		Serial.println("[MQTT] Failed to cache data");
+	}
+	return false;
+}
+
+// 缓存补传统计
+static uint32_t g_cacheUploadTotal = 0;
+static float g_cacheUploadRate = 0.0f;
+
+uint32_t getCacheUploadTotal() {
+	return g_cacheUploadTotal;
+}
+
+float getCacheUploadRate() {
+	return g_cacheUploadRate;
+}
+
+/**
+ * @brief 连续发布一批缓存数据，中途不再逐条等待
+ * @param batch 待发布数据（按缓存顺序）
+ * @param timeoutMs 等待 MQTT 连接的超时时间
+ * @return 从头开始连续发布成功的条数
+ */
+static int publishBatch(const std::vector<PendingData>& batch, unsigned long timeoutMs) {
+	ensureMqttMutex();
+	unsigned long start = millis();
+
+	// 整批只检查一次连接、只取一次锁
+	maintainWiFi();
+	if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+		Serial.printf("[MQTT] publishBatch: mutex timeout >%lu ms\n", timeoutMs);
+		return 0;
+	}
+	while (!mqttClient.connected()) {
+		if (millis() - start > timeoutMs) {
+			Serial.printf("[MQTT] publishBatch: connect timeout >%lu ms\n", timeoutMs);
+			xSemaphoreGive(g_mqttMutex);
+			return 0;
+		}
+		maintainWiFi();
+		connectToMQTT(timeoutMs - (millis() - start));
+	}
+	mqttClient.loop();
+
+	int sent = 0;
+	for (const auto& item : batch) {
+		if (!mqttClient.publish(item.topic.c_str(), item.payload.c_str())) {
+			Serial.printf("[MQTT] Batch publish stopped at #%d, state=%d\n", sent, mqttClient.state());
+			break;
+		}
+		sent++;
+	}
+	xSemaphoreGive(g_mqttMutex);
+	return sent;
+}
+
+/**
+ * @brief 以 QoS1 补传缓存，收到 PUBACK 后才确认对应记录
+ * 最多 appConfig.cacheInflight 条同时在途：窗口有空位就从已发出记录之后继续读、继续发，
+ * 收到队首连续的 PUBACK 后按位置一次确认。断线或超时未确认的记录留在缓存里下次重发。
+ * 每一步发送 / loop 单独持 MQTT 锁，等 PUBACK 期间 MeasureTask 仍可发布；读写缓存不持锁。
+ * @param maxUpload 本轮最多发出的条数
+ * @return 收到 PUBACK 并确认的条数
+ */
+static int uploadCachedDataQos1(int maxUpload) {
+	ensureMqttMutex();
+	unsigned long start = millis();
+	maintainWiFi();
+	if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(5000)) != pdTRUE) {
+		Serial.println("[MQTT] QoS1 upload: mutex timeout");
+		return 0;
+	}
+	while (!mqttClient.connected()) {
+		if (millis() - start > 5000) {
+			Serial.println("[MQTT] QoS1 upload: connect timeout");
+			xSemaphoreGive(g_mqttMutex);
+			return 0;
+		}
+		maintainWiFi();
+		connectToMQTT(5000 - (millis() - start));
+	}
+	ackClient.resetInflight();
+	// 释放锁的间隙里 MeasureTask 的 publishData 可能重连、清空窗口；
+	// 每次取锁都核对代数，不一致时本地在途记录全部作废
+	const uint32_t session = ackClient.generation();
+	xSemaphoreGive(g_mqttMutex);
+
+	int window = min((int)appConfig.cacheInflight, (int)MQTT_QOS1_MAX_INFLIGHT);
+	if (window < 1) window = 1;
+
+	// 本地在途位置与 ackClient 的窗口一一对应，按发送顺序排列
+	CacheRecordPos inflightPos[MQTT_QOS1_MAX_INFLIGHT];
+	uint8_t head = 0;
+	uint8_t count = 0;
+	CacheRecordPos lastSent;
+	bool haveLastSent = false;
+	int sent = 0;
+	int acked = 0;
+	unsigned long lastProgressMs = millis();
+	std::vector<PendingData> batch;
+
+	while (true) {
+		// 补满窗口：先不持锁读出记录，再持锁连续发出
+		batch.clear();
+		if (count < window && sent < maxUpload) {
+			int want = min(window - count, maxUpload - sent);
+			getPendingDataBatch(batch, want, haveLastSent ? &lastSent : nullptr);
+			if (batch.empty() && count == 0 && !haveLastSent && getPendingDataCount() > 0) {
+				// 队首记录读不出来，交给延后逻辑跳过
+				deferFirstPendingDataAfterFailure();
+				break;
+			}
+		}
+
+		if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(QOS1_ACK_TIMEOUT_MS)) != pdTRUE) {
+			Serial.println("[MQTT] QoS1 upload: mutex timeout");
+			break;
+		}
+		if (!mqttClient.connected()) {
+			xSemaphoreGive(g_mqttMutex);
+			break;
+		}
+		if (ackClient.generation() != session) {
+			// 之后的 PUBACK 与这里记下的在途位置对不上，结束本轮，下次从缓存队首重发
+			xSemaphoreGive(g_mqttMutex);
+			Serial.printf("[MQTT] QoS1 upload: connection reset, %u items left unacknowledged\n",
+				(unsigned)count);
+			break;
+		}
+		for (const auto& item : batch) {
+			if (ackClient.publishQos1(mqttClient, item.topic.c_str(),
+				(const uint8_t*)item.payload.c_str(), item.payload.length()) == 0) {
+				Serial.printf("[MQTT] QoS1 publish stopped after %d items\n", sent);
+				break;
+			}
+			inflightPos[(head + count) % MQTT_QOS1_MAX_INFLIGHT] = item.pos;
+			count++;
+			sent++;
+			lastSent = item.pos;
+			haveLastSent = true;
+		}
+		if (count == 0) {
+			xSemaphoreGive(g_mqttMutex);
+			break;
+		}
+
+		// 收 PUBACK，按位置确认队首连续已送达的记录
+		mqttClient.loop();
+		uint8_t done = ackClient.generation() == session ? ackClient.takeAcked() : 0;
+		xSemaphoreGive(g_mqttMutex);
+		if (done > 0) {
+			CacheRecordPos through = inflightPos[(head + done - 1) % MQTT_QOS1_MAX_INFLIGHT];
+			head = (head + done) % MQTT_QOS1_MAX_INFLIGHT;
+			count -= done;
+			acked += markPendingDataAsUploadedThrough(through);
+			lastProgressMs = millis();
+			continue;
+		}
+		if (millis() - lastProgressMs > QOS1_ACK_TIMEOUT_MS) {
+			Serial.printf("[MQTT] QoS1 upload: no PUBACK for %lu ms, %u items left unacknowledged\n",
+				QOS1_ACK_TIMEOUT_MS, (unsigned)count);
+			break;
+		}
+		delay(5);
+	}
+
+	// 未确认的在途记录作废，下一轮从缓存队首重发
+	if (xSemaphoreTake(g_mqttMutex, portMAX_DELAY) == pdTRUE) {
+		ackClient.resetInflight();
+		xSemaphoreGive(g_mqttMutex);
+	}
+	return acked;
+}
+
 /**
  * @brief 尝试上传缓存数据（每次成功上传新数据后调用）
+ * 按 appConfig.cacheUploadBatch 分批：一次读出一批、连续发布、一次写入确认
+ * cache_upload_qos 为 1 时改走 uploadCachedDataQos1，收到 PUBACK 才确认
  * @param maxUpload 最大上传条数（默认10）
  * @return 实际上传成功的条数
  */
 int uploadCachedData(int maxUpload) {
-	extern int getPendingDataCount();
-	extern bool getFirstPendingData(String&, String&, String&);
-	extern bool markFirstDataAsUploaded();
-    extern bool deferFirstPendingDataAfterFailure();
-	extern int cleanUploadedData(int keepCount);
-
 	int pendingCount = getPendingDataCount();
 	if (pendingCount <= 0) {
 		return 0;
 	}
 
-	Serial.printf("[Cache] Found %d pending data items, uploading up to %d...\n", pendingCount, maxUpload);
-
-    const int maxFailuresPerRun = 2;
-    int uploadedCount = 0;
-    int failureCount = 0;
-    for (int i = 0; i < maxUpload; i++) {
-		String topic, payload, timestamp;
+	if (appConfig.cacheUploadQos >= 1) {
+		unsigned long startMs = millis();
+		int uploadedCount = uploadCachedDataQos1(maxUpload);
+		if (uploadedCount > 0) {
+			unsigned long elapsedMs = millis() - startMs;
+			g_cacheUploadTotal += uploadedCount;
+			g_cacheUploadRate = uploadedCount * 1000.0f / (float)(elapsedMs > 0 ? elapsedMs : 1);
+			Serial.printf("[Cache] Uploaded %d cached data items with QoS1 in %lu ms (%.1f items/s)\n",
+				uploadedCount, elapsedMs, g_cacheUploadRate);
+			int cleaned = cleanUploadedData(1);
+			if (cleaned > 0) {
+				Serial.printf("[Cache] Recycled %d uploaded items\n", cleaned);
+			}
+		}
+		return uploadedCount;
+	}
 
-		if (!getFirstPendingData(topic, payload, timestamp)) {
+	int batchSize = appConfig.cacheUploadBatch > 0 ? appConfig.cacheUploadBatch : 1;
+	Serial.printf("[Cache] Found %d pending data items, uploading up to %d (batch %d)...\n",
+		pendingCount, maxUpload, batchSize);
+
+	const int maxFailuresPerRun = 2;
+	int uploadedCount = 0;
+	int failureCount = 0;
+	unsigned long startMs = millis();
+	std::vector<PendingData> batch;
+
+	while (uploadedCount < maxUpload) {
+		int want = min(batchSize, maxUpload - uploadedCount);
+		if (getPendingDataBatch(batch, want) <= 0) {
+			// 队首记录读不出来时交给延后逻辑跳过
+			if (getPendingDataCount() > 0) {
+				deferFirstPendingDataAfterFailure();
+				failureCount++;
+				if (failureCount >= maxFailuresPerRun) break;
+				continue;
+			}
 			Serial.println("[Cache] No more pending data");
 			break;
 		}
 
-		Serial.printf("[Cache] Uploading cached data (timestamp: %s)...\n", timestamp.c_str());
-
 		// 尝试上传（使用较短超时，避免阻塞太久）
-        if (publishData(topic, payload, 5000)) {
-			Serial.println("[Cache] Cached data uploaded successfully");
-			// 标记为已上传
-			markFirstDataAsUploaded();
-			uploadedCount++;
-            failureCount = 0;
-			// 每次上传后稍作延迟
-			delay(200);
-		} else {
+		int sent = publishBatch(batch, 5000);
+		if (sent > 0) {
+			// 整批确认只写一次游标；按位置确认，发布期间 MeasureTask 淘汰队首记录时不会误删未发出的记录
+			markPendingDataAsUploadedThrough(batch[sent - 1].pos);
+			uploadedCount += sent;
+			failureCount = 0;
+		}
+
+		if (sent < (int)batch.size()) {
 			Serial.println("[Cache] Upload failed, keeping cached data for next retry");
-            // 上传失败，延后该条数据，避免卡住队列
-            deferFirstPendingDataAfterFailure();
-            failureCount++;
-            if (failureCount >= maxFailuresPerRun) {
-                Serial.println("[Cache] Too many failures in this run, stop uploading");
-                break;
-            }
-            delay(200);
+			// 上传失败，延后该条数据，避免卡住队列
+			deferFirstPendingDataAfterFailure();
+			failureCount++;
+			if (failureCount >= maxFailuresPerRun) {
+				Serial.println("[Cache] Too many failures in this run, stop uploading");
+				break;
+			}
+			delay(200);
 		}
 	}
 
 	if (uploadedCount > 0) {
-		Serial.printf("[Cache] Uploaded %d cached data items\n", uploadedCount);
+		unsigned long elapsedMs = millis() - startMs;
+		g_cacheUploadTotal += uploadedCount;
+		g_cacheUploadRate = uploadedCount * 1000.0f / (float)(elapsedMs > 0 ? elapsedMs : 1);
+		Serial.printf("[Cache] Uploaded %d cached data items in %lu ms (%.1f items/s)\n",
+			uploadedCount, elapsedMs, g_cacheUploadRate);
 
-		// 清理旧的已上传数据（只保留最近1条）
+		// 汇报随段回收的已上传数据
 		int cleaned = cleanUploadedData(1);
 		if (cleaned > 0) {
-			Serial.printf("[Cache] Cleaned %d old uploaded items (kept latest 1)\n", cleaned);
+			Serial.printf("[Cache] Recycled %d uploaded items\n", cleaned);
 		}
 	} else {
 		Serial.println("[Cache] No cached data uploaded");
@@ -5,6 +5,8 @@
 #include <Arduino.h>
 #include <PubSubClient.h>
 
+struct CachedSample;
+
 // ========== MQTT 客户端访问 ==========
 PubSubClient& getMQTTClient();  // 获取 MQTT 客户端引用（可用于设置回调）
 
@@ -19,8 +21,16 @@ String getPublicIP();  // 通过外部服务获取公网 IP
 // ========== MQTT 核心操作 ==========
 bool connectToMQTT(unsigned long timeoutMs);
 void maintainMQTT(unsigned long timeoutMs);
+// topic 上一条 PUBLISH 能带的最大 payload 字节数（MQTT 缓冲区扣除报文头与 topic）
+size_t mqttPayloadLimit(const String& topic);
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs);
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs);
 bool publishDataOrCache(const String& topic, const String& payload, const String& timestamp, unsigned long timeoutMs);
+bool publishDataOrCache(uint8_t topicId, const char* payload, const CachedSample& sample, const String& timestamp, unsigned long timeoutMs);
 int uploadCachedData(int maxUpload = 10);
 
+// ========== 缓存补传统计 ==========
+uint32_t getCacheUploadTotal();  // 启动以来补传成功的缓存条数
+float getCacheUploadRate();      // 最近一次补传的吞吐（条/秒）
+
 #endif
\ No newline at end of file
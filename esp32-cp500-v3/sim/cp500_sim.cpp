@@ -0,0 +1,589 @@
+// Host-side closed-loop simulator for the cp500-v3 bath control. Builds the
+// firmware's control_logic.cpp (n-curve, setpoint, PID and autotune, MPC,
+// tank safety, heater guard times) and slow_pwm.cpp unchanged and runs them
+// against a heated tank -> pipe loop -> bath plant around a compost core, with
+// noisy quantized DS18B20 probes that occasionally drop out and relays that
+// switch the way actuator.cpp switches them. Days of plant time take seconds.
+//
+//   g++ -std=c++17 -O2 -I../src cp500_sim.cpp ../src/control_logic.cpp ../src/slow_pwm.cpp
+//     ../src/pid_controller.cpp ../src/thermal_model.cpp ../src/mpc_planner.cpp -o cp500_sim
+//   ./cp500_sim [key=value ...]     e.g. ./cp500_sim mode=pid autotune=1 days=3 dropout=0.02
+//   ./cp500_sim help                lists every key with its default
+
+#include "control_logic.h"
+#include "slow_pwm.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <string>
+#include <vector>
+
+static const float WATER_KJ_PER_L = 4.186f;            // kJ/(L*K)
+static const unsigned long PLANT_STEP_MS = 1000;       // Plant integration step
+static const uint32_t PUMP_MIN_SWITCH_MS = 5000;       // As in actuator.h
+static const float MS_PER_DAY = 86400000.0f;
+
+// Everything the command line can change. Plant in SI units; control
+// defaults follow data/config.json and the AppConfig defaults, except a bath
+// target below temp_limitout_max.
+struct SimConfig {
+  // Plant
+  float heaterW = 1500.0f;       // Heater power into the tank (W)
+  float tankL = 40.0f;           // Water volumes (L)
+  float loopL = 4.0f;
+  float bathL = 80.0f;
+  float coreKJ = 300.0f;         // Compost heat capacity (kJ/K)
+  float pumpLpm = 6.0f;          // Loop flow at 100 % pump (L/min)
+  float uaTank = 3.0f;           // Losses to ambient (W/K)
+  float uaLoop = 1.5f;
+  float uaBath = 10.0f;
+  float uaCore = 12.0f;          // Bath <-> compost core (W/K)
+  float uaCoreAmb = 2.0f;
+  float coreW = 40.0f;           // Compost self-heating (W)
+  float ambient = 20.0f;         // Mean ambient (C)
+  float ambientSwing = 4.0f;     // Daily ambient amplitude (C)
+  float startTemp = 25.0f;       // Initial tank, loop and bath (C)
+  float startCore = 35.0f;
+
+  // Probes
+  float noise = 0.05f;           // Gaussian noise sigma (C)
+  float quant = 0.0625f;         // DS18B20 12-bit step (C)
+  float dropout = 0.002f;        // Probability a single read returns NAN
+  float probeSpread = 0.1f;      // Sigma of the fixed offset of each bath probe (C)
+  float outProbes = 3.0f;
+
+  // Firmware
+  float postIntervalMs = 60000.0f;
+  float target = 55.0f;
+  float hyst = 0.8f;
+  float outMax = 65.0f;
+  float inMax = 70.0f;
+  float inMin = 25.0f;
+  float tempMaxDiff = 13.0f;
+  float tankMax = 90.0f;
+  float heaterMinOnMs = 30000.0f;
+  float heaterMinOffMs = 30000.0f;
+  float heaterWindowMs = 120000.0f;
+  float pumpWindowMs = 60000.0f;
+  float deltaOnMin = 6.0f;
+  float deltaOnMax = 25.0f;
+  float hystNom = 3.0f;
+  float pumpGamma = 1.3f;
+  float learnUp = 0.5f;
+  float learnDown = 0.2f;
+  float learnMax = 10.0f;
+  float progressMin = 0.05f;
+  float inDiffGamma = 2.0f;
+  float kp = 60.0f;
+  float ki = 0.02f;
+  float kd = 0.0f;
+  float kff = 2.0f;
+  float autotuneHyst = 0.3f;
+  float horizonS = 1800.0f;
+  float energyWeight = 0.002f;
+  float overshootWeight = 10.0f;
+
+  // Run
+  float days = 2.0f;
+  float seed = 1.0f;
+  float band = 1.0f;             // Settling band around the target (C)
+  float autotune = 0.0f;         // 1: request relay autotune at start (pid mode)
+  float trace = 0.0f;            // N > 0: print every Nth control cycle
+  float log = 0.0f;              // 1: print the control's log lines
+  std::string mode = "all";
+};
+
+struct ConfigKey {
+  const char* name;
+  float SimConfig::* field;
+  const char* help;
+};
+
+static const ConfigKey CONFIG_KEYS[] = {
+  { "heater_w", &SimConfig::heaterW, "heater power (W)" },
+  { "tank_l", &SimConfig::tankL, "tank volume (L)" },
+  { "loop_l", &SimConfig::loopL, "pipe loop volume (L)" },
+  { "bath_l", &SimConfig::bathL, "bath volume (L)" },
+  { "core_kj", &SimConfig::coreKJ, "compost heat capacity (kJ/K)" },
+  { "pump_lpm", &SimConfig::pumpLpm, "loop flow at full pump (L/min)" },
+  { "ua_tank", &SimConfig::uaTank, "tank loss to ambient (W/K)" },
+  { "ua_loop", &SimConfig::uaLoop, "loop loss to ambient (W/K)" },
+  { "ua_bath", &SimConfig::uaBath, "bath loss to ambient (W/K)" },
+  { "ua_core", &SimConfig::uaCore, "bath <-> core coupling (W/K)" },
+  { "ua_core_amb", &SimConfig::uaCoreAmb, "core loss to ambient (W/K)" },
+  { "core_w", &SimConfig::coreW, "compost self-heating (W)" },
+  { "ambient", &SimConfig::ambient, "mean ambient (C)" },
+  { "ambient_swing", &SimConfig::ambientSwing, "daily ambient amplitude (C)" },
+  { "start_temp", &SimConfig::startTemp, "initial tank/loop/bath (C)" },
+  { "start_core", &SimConfig::startCore, "initial core (C)" },
+  { "noise", &SimConfig::noise, "probe noise sigma (C)" },
+  { "quant", &SimConfig::quant, "probe quantization (C), 0 = off" },
+  { "dropout", &SimConfig::dropout, "probability of a NAN read per probe" },
+  { "probe_spread", &SimConfig::probeSpread, "sigma of bath probe offsets (C)" },
+  { "out_probes", &SimConfig::outProbes, "bath probes, 1..3" },
+  { "post_interval", &SimConfig::postIntervalMs, "control cycle (ms)" },
+  { "target", &SimConfig::target, "bath_setpoint.target (C)" },
+  { "hyst", &SimConfig::hyst, "bath_setpoint.hyst (C)" },
+  { "out_max", &SimConfig::outMax, "temp_limitout_max (C)" },
+  { "in_max", &SimConfig::inMax, "temp_limitin_max (C)" },
+  { "in_min", &SimConfig::inMin, "temp_limitin_min (C)" },
+  { "temp_maxdif", &SimConfig::tempMaxDiff, "temp_maxdif (C)" },
+  { "tank_max", &SimConfig::tankMax, "safety.tank_temp_max (C)" },
+  { "min_on_ms", &SimConfig::heaterMinOnMs, "heater_guard.min_on_ms" },
+  { "min_off_ms", &SimConfig::heaterMinOffMs, "heater_guard.min_off_ms" },
+  { "heater_window_ms", &SimConfig::heaterWindowMs, "heater_guard.window_ms, 0 = on/off" },
+  { "pump_window_ms", &SimConfig::pumpWindowMs, "pump_pwm.window_ms, 0 = on/off" },
+  { "delta_on_min", &SimConfig::deltaOnMin, "pump_adaptive.delta_on_min" },
+  { "delta_on_max", &SimConfig::deltaOnMax, "pump_adaptive.delta_on_max" },
+  { "hyst_nom", &SimConfig::hystNom, "pump_adaptive.hyst_nom" },
+  { "ncurve_gamma", &SimConfig::pumpGamma, "pump_adaptive.ncurve_gamma" },
+  { "step_up", &SimConfig::learnUp, "pump_learning.step_up" },
+  { "step_down", &SimConfig::learnDown, "pump_learning.step_down" },
+  { "learn_max", &SimConfig::learnMax, "pump_learning.max" },
+  { "progress_min", &SimConfig::progressMin, "pump_learning.progress_min" },
+  { "in_diff_gamma", &SimConfig::inDiffGamma, "curves.in_diff_ncurve_gamma" },
+  { "kp", &SimConfig::kp, "pid.kp" },
+  { "ki", &SimConfig::ki, "pid.ki" },
+  { "kd", &SimConfig::kd, "pid.kd" },
+  { "kff", &SimConfig::kff, "pid.kff" },
+  { "autotune_hyst", &SimConfig::autotuneHyst, "pid.autotune_hyst (C)" },
+  { "horizon_s", &SimConfig::horizonS, "mpc.horizon_s" },
+  { "energy_weight", &SimConfig::energyWeight, "mpc.energy_weight" },
+  { "overshoot_weight", &SimConfig::overshootWeight, "mpc.overshoot_weight" },
+  { "days", &SimConfig::days, "simulated days" },
+  { "seed", &SimConfig::seed, "random seed" },
+  { "band", &SimConfig::band, "settling band around the target (C)" },
+  { "autotune", &SimConfig::autotune, "1 = relay autotune first (pid mode)" },
+  { "trace", &SimConfig::trace, "print every Nth control cycle, 0 = off" },
+  { "log", &SimConfig::log, "1 = print control log lines" },
+};
+
+static void printHelp() {
+  printf("usage: cp500_sim [mode=all|ncurve|setpoint|pid|mpc] [key=value ...]\n");
+  SimConfig defaults;
+  for (const ConfigKey& k : CONFIG_KEYS) {
+    printf("  %-18s %10g  %s\n", k.name, defaults.*k.field, k.help);
+  }
+}
+
+static bool parseArgs(int argc, char** argv, SimConfig& cfg) {
+  for (int i = 1; i < argc; i++) {
+    const char* eq = strchr(argv[i], '=');
+    if (!eq) return false;
+    std::string key(argv[i], eq - argv[i]);
+    if (key == "mode") {
+      cfg.mode = eq + 1;
+      continue;
+    }
+    bool known = false;
+    for (const ConfigKey& k : CONFIG_KEYS) {
+      if (key == k.name) {
+        cfg.*k.field = strtof(eq + 1, nullptr);
+        known = true;
+        break;
+      }
+    }
+    if (!known) {
+      fprintf(stderr, "unknown key: %s\n", key.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static ControlParams controlParams(const SimConfig& c, ControlMode mode) {
+  ControlParams p;
+  p.mode = mode;
+  p.postInterval = (uint32_t)c.postIntervalMs;
+  p.tempMaxDiff = c.tempMaxDiff;
+  p.tempLimitOutMax = c.outMax;
+  p.tempLimitInMax = c.inMax;
+  p.tempLimitInMin = c.inMin;
+  p.tankTempMax = c.tankMax;
+  p.heaterMinOnMs = (uint32_t)c.heaterMinOnMs;
+  p.heaterMinOffMs = (uint32_t)c.heaterMinOffMs;
+  p.pumpDeltaOnMin = c.deltaOnMin;
+  p.pumpDeltaOnMax = c.deltaOnMax;
+  p.pumpHystNom = c.hystNom;
+  p.pumpNCurveGamma = c.pumpGamma;
+  p.pumpLearnStepUp = c.learnUp;
+  p.pumpLearnStepDown = c.learnDown;
+  p.pumpLearnMax = c.learnMax;
+  p.pumpProgressMin = c.progressMin;
+  p.inDiffNCurveGamma = c.inDiffGamma;
+  p.bathSetTarget = c.target;
+  p.bathSetHyst = c.hyst;
+  p.pid = { c.kp, c.ki, c.kd, c.kff };
+  p.autotuneHyst = c.autotuneHyst;
+  p.mpcHorizonS = (uint32_t)c.horizonS;
+  p.mpcEnergyWeight = c.energyWeight;
+  p.mpcOvershootWeight = c.overshootWeight;
+  return p;
+}
+
+// ========================= Plant =========================
+// Four lumped nodes. The pump circulates tank -> loop -> bath -> tank, so heat
+// reaches the bath through the loop's lag; the compost core only exchanges
+// heat with the bath and ambient. The firmware's thermal model does not know
+// about the loop or the ambient swing, as on the real device.
+struct Plant {
+  float tank, loop, bath, core;
+  float cTank, cLoop, cBath, cCore;   // J/K
+  const SimConfig& cfg;
+
+  explicit Plant(const SimConfig& c) : cfg(c) {
+    tank = loop = bath = c.startTemp;
+    core = c.startCore;
+    cTank = c.tankL * WATER_KJ_PER_L * 1000.0f;
+    cLoop = c.loopL * WATER_KJ_PER_L * 1000.0f;
+    cBath = c.bathL * WATER_KJ_PER_L * 1000.0f;
+    cCore = c.coreKJ * 1000.0f;
+  }
+
+  float ambientAt(double tMs) const {
+    return cfg.ambient + cfg.ambientSwing * sinf((float)(2.0 * M_PI * tMs / MS_PER_DAY));
+  }
+
+  // heater and pump are the on-fractions of the step (0..1).
+  void step(float heater, float pump, float dtSec, double tMs) {
+    float amb = ambientAt(tMs);
+    float flow = pump * cfg.pumpLpm / 60.0f * WATER_KJ_PER_L * 1000.0f;   // W/K
+    float qTank = cfg.heaterW * heater + flow * (bath - tank) - cfg.uaTank * (tank - amb);
+    float qLoop = flow * (tank - loop) - cfg.uaLoop * (loop - amb);
+    float qBath = flow * (loop - bath) - cfg.uaBath * (bath - amb) - cfg.uaCore * (bath - core);
+    float qCore = cfg.uaCore * (bath - core) + cfg.coreW - cfg.uaCoreAmb * (core - amb);
+    tank += dtSec * qTank / cTank;
+    loop += dtSec * qLoop / cLoop;
+    bath += dtSec * qBath / cBath;
+    core += dtSec * qCore / cCore;
+  }
+};
+
+struct Probes {
+  std::mt19937 rng;
+  std::normal_distribution<float> noise;
+  std::uniform_real_distribution<float> uniform{ 0.0f, 1.0f };
+  std::vector<float> outOffset;
+  const SimConfig& cfg;
+  uint32_t dropped = 0;
+
+  Probes(const SimConfig& c, unsigned seed) : rng(seed), noise(0.0f, c.noise > 0.0f ? c.noise : 1e-9f), cfg(c) {
+    std::normal_distribution<float> spread(0.0f, c.probeSpread > 0.0f ? c.probeSpread : 1e-9f);
+    int n = (int)c.outProbes;
+    if (n < 1) n = 1;
+    if (n > 3) n = 3;
+    for (int i = 0; i < n; i++) outOffset.push_back(spread(rng));
+  }
+
+  float read(float t) {
+    if (uniform(rng) < cfg.dropout) {
+      dropped++;
+      return NAN;
+    }
+    float v = t + noise(rng);
+    return cfg.quant > 0.0f ? roundf(v / cfg.quant) * cfg.quant : v;
+  }
+};
+
+// ========================= Relays =========================
+// actuator.cpp's SlowPwm without FreeRTOS: the same window decisions through
+// slowPwmSlice(), edges kept as due times instead of esp_timer one-shots.
+struct SimRelay {
+  float duty = 0.0f;
+  uint32_t windowMs = 0;
+  uint32_t minOnMs = 0;
+  uint32_t minOffMs = 0;
+  bool outputOn = false;
+  double lastSwitchMs = -1e12;
+  double windowStartMs = 0.0;
+  float carryMs = 0.0f;
+  bool armed = false;
+  double edgeMs = 0.0;
+  uint32_t toggles = 0;
+  double onMs = 0.0;
+
+  bool cycling() const { return duty > 0.0f && duty < 100.0f && windowMs > 0; }
+
+  void switchTo(bool on, double nowMs) {
+    if (outputOn == on) return;
+    outputOn = on;
+    lastSwitchMs = nowMs;
+    toggles++;
+  }
+
+  // End of the guard that blocks switching to `on`; <= nowMs when it may switch.
+  double guardEnd(bool on) const {
+    if (outputOn == on) return -1e12;
+    return lastSwitchMs + (outputOn ? minOnMs : minOffMs);
+  }
+
+  void holdFixed(double nowMs) {
+    bool on = duty >= 100.0f;
+    armed = guardEnd(on) > nowMs;
+    if (armed) edgeMs = guardEnd(on);
+    else switchTo(on, nowMs);
+  }
+
+  void startWindow(double nowMs) {
+    SlowPwmSlice slice = slowPwmSlice(duty, carryMs, windowMs, minOnMs, minOffMs);
+    if (guardEnd(slice.onMs > 0) > nowMs) {
+      armed = true;
+      edgeMs = guardEnd(slice.onMs > 0);
+      return;
+    }
+    windowStartMs = nowMs;
+    carryMs = slice.carryMs;
+    switchTo(slice.onMs > 0, nowMs);
+    armed = true;
+    edgeMs = nowMs + (slice.onMs > 0 && slice.onMs < windowMs ? slice.onMs : windowMs);
+  }
+
+  void fire(double nowMs) {
+    armed = false;
+    if (!cycling()) {
+      holdFixed(nowMs);
+      return;
+    }
+    double inWindow = nowMs - windowStartMs;
+    if (outputOn && inWindow < windowMs) {
+      switchTo(false, nowMs);
+      armed = true;
+      edgeMs = windowStartMs + windowMs;
+    }
+    else {
+      startWindow(nowMs);
+    }
+  }
+
+  void setDuty(float d, double nowMs) {
+    if (windowMs == 0 && d > 0.0f && d < 100.0f) d = d >= 50.0f ? 100.0f : 0.0f;
+    bool wasCycling = cycling();
+    duty = d;
+    if (d <= 0.0f || d >= 100.0f) {
+      carryMs = 0.0f;
+      holdFixed(nowMs);
+      return;
+    }
+    if (!wasCycling) startWindow(nowMs);
+  }
+
+  // actuatorCutNow(): off now, past the min on-time.
+  void cut(double nowMs) {
+    armed = false;
+    duty = 0.0f;
+    carryMs = 0.0f;
+    switchTo(false, nowMs);
+  }
+
+  // On-fraction over [fromMs, toMs), processing the edges inside it.
+  float advance(double fromMs, double toMs) {
+    double on = 0.0;
+    double t = fromMs;
+    while (armed && edgeMs < toMs) {
+      double e = edgeMs > t ? edgeMs : t;
+      if (outputOn) on += e - t;
+      t = e;
+      fire(e);
+    }
+    if (outputOn) on += toMs - t;
+    onMs += on;
+    return (float)(on / (toMs - fromMs));
+  }
+};
+
+// ========================= Metrics =========================
+struct Metrics {
+  double simMs = 0.0;
+  float bathPeak = -INFINITY;
+  float tankPeak = -INFINITY;
+  float bathOverCore = -INFINITY;   // n-curve: bath above the compost core
+  double reachedMs = -1.0;          // First time the bath entered the band
+  float overshoot = 0.0f;           // Peak above target after that
+  double settledMs = -1.0;          // Last entry into the band, -1 while outside
+  double sqErr = 0.0;
+  double inBand = 0.0;
+  uint32_t errSamples = 0;
+  uint32_t safeOffCycles = 0;
+  double modelReadyMs = -1.0;
+};
+
+static void printRow(const char* name, const Metrics& m, const SimRelay& heater, const SimRelay& pump,
+  const SimConfig& cfg, bool hasTarget) {
+  float days = (float)(m.simMs / MS_PER_DAY);
+  char settle[16] = "-";
+  char overshoot[16] = "-";
+  char rms[16] = "-";
+  char band[16] = "-";
+  if (hasTarget) {
+    if (m.settledMs >= 0.0) snprintf(settle, sizeof(settle), "%.0f", m.settledMs / 60000.0);
+    if (m.reachedMs >= 0.0) snprintf(overshoot, sizeof(overshoot), "%.2f", m.overshoot);
+    if (m.errSamples) {
+      snprintf(rms, sizeof(rms), "%.2f", sqrt(m.sqErr / m.errSamples));
+      snprintf(band, sizeof(band), "%.1f", 100.0 * m.inBand / m.errSamples);
+    }
+  }
+  else {
+    snprintf(overshoot, sizeof(overshoot), "%.2f*", m.bathOverCore);
+  }
+  printf("%-9s %8s %9s %6s %6s %7.1f %7.2f %8.0f %8.0f %6.1f %6.1f %5u\n",
+    name, settle, overshoot, rms, band,
+    100.0 * heater.onMs / m.simMs,
+    heater.onMs / 3.6e6 * cfg.heaterW / 1000.0,
+    heater.toggles / days, pump.toggles / days,
+    m.bathPeak, m.tankPeak, (unsigned)m.safeOffCycles);
+}
+
+static const SimConfig* gLogCfg = nullptr;
+static double gLogNowMs = 0.0;
+
+static void logLine(const char* line) {
+  if (gLogCfg && gLogCfg->log > 0.0f) {
+    printf("  %7.1f min  %s\n", gLogNowMs / 60000.0, line);
+  }
+}
+
+// ========================= One closed-loop run =========================
+static void runMode(const SimConfig& cfg, ControlMode mode, const char* name) {
+  ControlParams params = controlParams(cfg, mode);
+  ControlState st;
+  Plant plant(cfg);
+  Probes probes(cfg, (unsigned)cfg.seed);
+  SimRelay heater;
+  SimRelay pump;
+  heater.windowMs = (uint32_t)cfg.heaterWindowMs;
+  heater.minOnMs = (uint32_t)cfg.heaterMinOnMs;
+  heater.minOffMs = (uint32_t)cfg.heaterMinOffMs;
+  pump.windowMs = (uint32_t)cfg.pumpWindowMs;
+  pump.minOnMs = PUMP_MIN_SWITCH_MS;
+  pump.minOffMs = PUMP_MIN_SWITCH_MS;
+
+  const bool hasTarget = mode != CONTROL_MODE_NCURVE;
+  const float target = fminf(cfg.target, cfg.outMax - 0.2f);   // As control_logic.cpp caps it
+  const double endMs = cfg.days * MS_PER_DAY;
+  const unsigned long interval = params.postInterval > 0 ? params.postInterval : 60000;
+  AutotuneRequest request = cfg.autotune > 0.0f ? AUTOTUNE_REQUEST_START : AUTOTUNE_REQUEST_NONE;
+  Metrics m;
+  unsigned long cycle = 0;
+  gLogCfg = &cfg;
+
+  for (double t = 0.0; t < endMs; t += interval) {
+    // The control runs on the sampled probes, like doMeasurementAndSave().
+    gLogNowMs = t;
+    std::vector<float> t_outs;
+    for (float offset : probes.outOffset) t_outs.push_back(probes.read(plant.bath + offset));
+    float t_in = probes.read(plant.core);
+    float t_tank = probes.read(plant.tank);
+    float med_out = median(t_outs, -20.0f, 100.0f, 5.0f);
+    unsigned long nowMs = (unsigned long)t;
+
+    ControlResult result;
+    result.reason[0] = '\0';
+    result.modeTag = "SafeOff";
+    if (isnan(med_out)) {
+      controlSafeOff(st, nowMs);
+      m.safeOffCycles++;
+    }
+    else {
+      runControlCycle(params, st, { t_in, t_tank, med_out, nowMs }, request, result);
+      request = AUTOTUNE_REQUEST_NONE;
+      if (result.gainsTuned) {
+        params.pid = result.tunedGains;
+        printf("  %s: autotune Ku=%.2f Pu=%.0f s -> kp=%.3f ki=%.5f kd=%.1f at %.0f min\n", name,
+          st.autotune.ultimateGain(), st.autotune.ultimatePeriodSec(),
+          params.pid.kp, params.pid.ki, params.pid.kd, t / 60000.0);
+      }
+    }
+    // As applyControlOutputs() in main.cpp.
+    if (st.heaterCut) heater.cut(t);
+    else if (heater.duty != st.heaterDuty) heater.setDuty(st.heaterDuty, t);
+    if (st.pumpCut) pump.cut(t);
+    else if (pump.duty != st.pumpDuty) pump.setDuty(st.pumpDuty, t);
+    st.heaterCut = false;
+    st.pumpCut = false;
+    if (m.modelReadyMs < 0.0 && st.model.ready()) m.modelReadyMs = t;
+
+    if (cfg.trace > 0.0f && cycle % (unsigned long)cfg.trace == 0) {
+      printf("  %7.1f min bath %6.2f tank %6.2f core %6.2f heater %5.1f%% pump %5.1f%% %-8s %s\n",
+        t / 60000.0, plant.bath, plant.tank, plant.core, st.heaterDuty, st.pumpDuty,
+        result.modeTag, result.reason);
+    }
+    cycle++;
+
+    // Plant between cycles, relays switching inside the interval.
+    double stop = t + interval < endMs ? t + interval : endMs;
+    for (double s = t; s < stop; s += PLANT_STEP_MS) {
+      double e = s + PLANT_STEP_MS < stop ? s + PLANT_STEP_MS : stop;
+      float h = heater.advance(s, e);
+      float p = pump.advance(s, e);
+      plant.step(h, p, (float)((e - s) / 1000.0), s);
+
+      m.bathPeak = fmaxf(m.bathPeak, plant.bath);
+      m.tankPeak = fmaxf(m.tankPeak, plant.tank);
+      m.bathOverCore = fmaxf(m.bathOverCore, plant.bath - plant.core);
+      if (!hasTarget) continue;
+      float err = plant.bath - target;
+      bool within = fabsf(err) <= cfg.band;
+      if (m.reachedMs < 0.0 && within) m.reachedMs = e;
+      if (!within) m.settledMs = -1.0;
+      else if (m.settledMs < 0.0) m.settledMs = e;
+      if (m.reachedMs >= 0.0) {
+        m.overshoot = fmaxf(m.overshoot, err);
+        m.sqErr += err * err;
+        if (within) m.inBand += 1.0;
+        m.errSamples++;
+      }
+    }
+  }
+  m.simMs = endMs;
+
+  printRow(name, m, heater, pump, cfg, hasTarget);
+  if (mode == CONTROL_MODE_MPC) {
+    printf("          model ready after %.0f min (%u samples), %u probe reads dropped\n",
+      m.modelReadyMs / 60000.0, (unsigned)st.model.samples(), (unsigned)probes.dropped);
+  }
+}
+
+int main(int argc, char** argv) {
+  SimConfig cfg;
+  if (argc > 1 && (strcmp(argv[1], "help") == 0 || strcmp(argv[1], "--help") == 0)) {
+    printHelp();
+    return 0;
+  }
+  if (!parseArgs(argc, argv, cfg)) {
+    printHelp();
+    return 1;
+  }
+  setControlLogger(logLine);
+
+  struct { const char* name; ControlMode mode; } modes[] = {
+    { "ncurve", CONTROL_MODE_NCURVE },
+    { "setpoint", CONTROL_MODE_SETPOINT },
+    { "pid", CONTROL_MODE_PID },
+    { "mpc", CONTROL_MODE_MPC },
+  };
+
+  printf("%.1f days, target %.1f C +/- %.1f band, cycle %.0f s, noise %.2f C, dropout %.3f, seed %u\n",
+    cfg.days, fminf(cfg.target, cfg.outMax - 0.2f), cfg.band, cfg.postIntervalMs / 1000.0f,
+    cfg.noise, cfg.dropout, (unsigned)cfg.seed);
+  printf("%-9s %8s %9s %6s %6s %7s %7s %8s %8s %6s %6s %5s\n",
+    "mode", "settle", "overshoot", "rms", "band", "heater", "energy", "heater", "pump",
+    "bath", "tank", "safe");
+  printf("%-9s %8s %9s %6s %6s %7s %7s %8s %8s %6s %6s %5s\n",
+    "", "min", "C", "C", "%", "duty %", "kWh", "sw/day", "sw/day", "max C", "max C", "off");
+  bool any = false;
+  for (auto& m : modes) {
+    if (cfg.mode != "all" && cfg.mode != m.name) continue;
+    runMode(cfg, m.mode, m.name);
+    any = true;
+  }
+  if (!any) {
+    fprintf(stderr, "unknown mode: %s\n", cfg.mode.c_str());
+    return 1;
+  }
+  if (cfg.mode == "all" || cfg.mode == "ncurve") {
+    printf("* n-curve has no bath target: overshoot is the bath's peak above the compost core\n");
+  }
+  return 0;
+}
@@ -0,0 +1,276 @@
+#include "actuator.h"
+#include "sensor.h"
+#include "slow_pwm.h"
+#include <math.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const uint64_t ACTUATOR_RETRY_US = 10000;   // Timer callback found the lock busy
+
+// One time-proportional relay. Edges are scheduled with a one-shot esp_timer;
+// all state is guarded by gActuatorMutex.
+struct SlowPwm {
+  const char* name;
+  void (*on)();
+  void (*off)();
+  float duty = 0.0f;
+  uint32_t windowMs = 0;
+  uint32_t minOnMs = 0;
+  uint32_t minOffMs = 0;
+  bool outputOn = false;
+  unsigned long lastSwitchMs = 0;
+  unsigned long windowStartMs = 0;
+  float carryMs = 0.0f;            // On-time owed (+) or overpaid (-) by skipped slices
+  esp_timer_handle_t timer = nullptr;
+  bool timerArmed = false;
+};
+
+static SemaphoreHandle_t gActuatorMutex = nullptr;
+// Indexed by ActuatorId; usable as plain on/off before initActuators().
+static SlowPwm gRelays[2] = {
+  { "heater", heaterOn, heaterOff },
+  { "pump", pumpOn, pumpOff },
+};
+static float gAerationDuty = 0.0f;
+
+static SlowPwm* relayFor(ActuatorId id) {
+  return id < 2 ? &gRelays[id] : nullptr;
+}
+
+static void switchRelayLocked(SlowPwm& r, bool on) {
+  if (r.outputOn == on) return;
+  if (on) r.on(); else r.off();
+  r.outputOn = on;
+  r.lastSwitchMs = millis();
+}
+
+// Stop unconditionally: the callback may have queued a retry without the lock.
+static void armLocked(SlowPwm& r, uint64_t delayUs) {
+  if (!r.timer) return;
+  esp_timer_stop(r.timer);
+  r.timerArmed = esp_timer_start_once(r.timer, delayUs) == ESP_OK;
+}
+
+static void disarmLocked(SlowPwm& r) {
+  if (!r.timer) return;
+  esp_timer_stop(r.timer);
+  r.timerArmed = false;
+}
+
+// Time left before the relay may switch to `on`: the min on-time after an on
+// edge, the min off-time after an off edge. 0 when it may switch now.
+static uint32_t guardLeftLocked(const SlowPwm& r, bool on, unsigned long nowMs) {
+  if (r.outputOn == on) return 0;
+  uint32_t guardMs = r.outputOn ? r.minOnMs : r.minOffMs;
+  unsigned long sinceMs = nowMs - r.lastSwitchMs;
+  return sinceMs < guardMs ? guardMs - sinceMs : 0;
+}
+
+// Starts a window: decides this window's on-slice and schedules the next edge.
+static void startWindowLocked(SlowPwm& r) {
+  unsigned long nowMs = millis();
+  SlowPwmSlice slice = slowPwmSlice(r.duty, r.carryMs, r.windowMs, r.minOnMs, r.minOffMs);
+  uint32_t onMs = slice.onMs;
+
+  uint32_t waitMs = guardLeftLocked(r, onMs > 0, nowMs);
+  if (waitMs > 0) {
+    // Still inside the previous edge's guard; start the window once it ends.
+    armLocked(r, (uint64_t)waitMs * 1000ULL);
+    return;
+  }
+
+  r.windowStartMs = nowMs;
+  r.carryMs = slice.carryMs;
+
+  switchRelayLocked(r, onMs > 0);
+  if (onMs > 0 && onMs < r.windowMs) {
+    // Off edge first; the timer then opens the next window after the off-slice.
+    armLocked(r, (uint64_t)onMs * 1000ULL);
+  } else {
+    armLocked(r, (uint64_t)r.windowMs * 1000ULL);
+  }
+}
+
+// Duty 0 % or 100 %: switches now if the guard allows it, otherwise when it ends.
+static void holdFixedLocked(SlowPwm& r) {
+  bool on = r.duty >= 100.0f;
+  uint32_t waitMs = guardLeftLocked(r, on, millis());
+  if (waitMs > 0 && r.timer) {
+    armLocked(r, (uint64_t)waitMs * 1000ULL);
+    return;
+  }
+  disarmLocked(r);
+  switchRelayLocked(r, on);
+}
+
+static void relayTimerFired(void* arg) {
+  SlowPwm& r = *static_cast<SlowPwm*>(arg);
+  if (xSemaphoreTake(gActuatorMutex, 0) != pdTRUE) {
+    // timerArmed belongs to the lock holder. If it re-arms meanwhile, this
+    // start fails or gets replaced; if it disarms, the retry is ignored below.
+    esp_timer_start_once(r.timer, ACTUATOR_RETRY_US);
+    return;
+  }
+  if (!r.timerArmed) {
+    // Retry of a firing that was disarmed while the lock was busy.
+    xSemaphoreGive(gActuatorMutex);
+    return;
+  }
+  r.timerArmed = false;
+  if (r.duty > 0.0f && r.duty < 100.0f && r.windowMs > 0) {
+    unsigned long inWindow = millis() - r.windowStartMs;
+    if (r.outputOn && inWindow < r.windowMs) {
+      // End of the on-slice: off for the rest of the window.
+      switchRelayLocked(r, false);
+      armLocked(r, (uint64_t)(r.windowMs - inWindow) * 1000ULL);
+    } else {
+      startWindowLocked(r);
+    }
+  } else {
+    holdFixedLocked(r);
+  }
+  xSemaphoreGive(gActuatorMutex);
+}
+
+static void setRelayDutyLocked(SlowPwm& r, float duty) {
+  if (r.windowMs == 0 && duty > 0.0f && duty < 100.0f) {
+    duty = duty >= 50.0f ? 100.0f : 0.0f;
+  }
+  bool wasCycling = r.duty > 0.0f && r.duty < 100.0f && r.windowMs > 0;
+  r.duty = duty;
+
+  if (duty <= 0.0f || duty >= 100.0f) {
+    r.carryMs = 0.0f;
+    holdFixedLocked(r);
+    return;
+  }
+  if (!wasCycling) {
+    startWindowLocked(r);
+  }
+}
+
+// Off regardless of the guard times; the next on still waits for min off.
+static void cutRelayLocked(SlowPwm& r) {
+  disarmLocked(r);
+  r.duty = 0.0f;
+  r.carryMs = 0.0f;
+  r.off();
+  if (r.outputOn) {
+    r.outputOn = false;
+    r.lastSwitchMs = millis();
+  }
+}
+
+static bool lockActuators() {
+  return gActuatorMutex && xSemaphoreTake(gActuatorMutex, portMAX_DELAY) == pdTRUE;
+}
+
+void initActuators() {
+  if (gActuatorMutex == nullptr) {
+    gActuatorMutex = xSemaphoreCreateMutex();
+  }
+  for (SlowPwm& r : gRelays) {
+    if (r.timer == nullptr) {
+      esp_timer_create_args_t args = {};
+      args.callback = relayTimerFired;
+      args.arg = &r;
+      args.name = r.name;
+      if (esp_timer_create(&args, &r.timer) != ESP_OK) {
+        r.timer = nullptr;
+        r.windowMs = 0;
+        Serial.printf("[Actuator] %s timer unavailable, on/off only\n", r.name);
+      }
+    }
+    // Relays are initialized off by initSensors().
+    r.outputOn = false;
+    r.lastSwitchMs = millis();
+  }
+}
+
+void actuatorConfigure(ActuatorId id, uint32_t windowMs, uint32_t minOnMs, uint32_t minOffMs) {
+  SlowPwm* r = relayFor(id);
+  if (!r) return;
+  bool locked = lockActuators();
+  disarmLocked(*r);
+  r->windowMs = r->timer ? windowMs : 0;
+  r->minOnMs = minOnMs;
+  r->minOffMs = minOffMs;
+  // Re-apply the current duty under the new window.
+  float duty = r->duty;
+  r->duty = 0.0f;
+  setRelayDutyLocked(*r, duty);
+  if (locked) xSemaphoreGive(gActuatorMutex);
+  Serial.printf("[Actuator] %s window=%lums min_on=%lums min_off=%lums\n",
+    r->name, (unsigned long)r->windowMs, (unsigned long)minOnMs, (unsigned long)minOffMs);
+}
+
+void actuatorSetDuty(ActuatorId id, float dutyPct) {
+  if (isnan(dutyPct) || dutyPct < 0.0f) dutyPct = 0.0f;
+  if (dutyPct > 100.0f) dutyPct = 100.0f;
+
+  if (id == ACTUATOR_AERATION) {
+    gAerationDuty = dutyPct;
+    if (dutyPct <= 0.0f) {
+      aerationOff();
+    } else {
+      aerationSetMaxDutyPct((int)(dutyPct + 0.5f));
+      aerationOn();
+    }
+    return;
+  }
+
+  SlowPwm* r = relayFor(id);
+  if (!r) return;
+  if (!lockActuators()) {
+    // Before initActuators(): plain on/off.
+    r->duty = dutyPct >= 50.0f ? 100.0f : 0.0f;
+    if (r->duty > 0.0f) r->on(); else r->off();
+    r->outputOn = r->duty > 0.0f;
+    return;
+  }
+  setRelayDutyLocked(*r, dutyPct);
+  xSemaphoreGive(gActuatorMutex);
+}
+
+float actuatorDuty(ActuatorId id) {
+  if (id == ACTUATOR_AERATION) return gAerationDuty;
+  SlowPwm* r = relayFor(id);
+  return r ? r->duty : 0.0f;
+}
+
+bool actuatorOutputOn(ActuatorId id) {
+  if (id == ACTUATOR_AERATION) return aerationIsActive();
+  SlowPwm* r = relayFor(id);
+  return r ? r->outputOn : false;
+}
+
+void actuatorCutNow(ActuatorId id) {
+  SlowPwm* r = relayFor(id);
+  if (!r) {
+    actuatorSetDuty(id, 0.0f);
+    return;
+  }
+  bool locked = lockActuators();
+  cutRelayLocked(*r);
+  if (locked) xSemaphoreGive(gActuatorMutex);
+}
+
+void actuatorStopAll() {
+  bool locked = lockActuators();
+  for (SlowPwm& r : gRelays) {
+    cutRelayLocked(r);
+  }
+  if (locked) xSemaphoreGive(gActuatorMutex);
+  gAerationDuty = 0.0f;
+  aerationStopNow();
+}
+
+const char* actuatorName(ActuatorId id) {
+  switch (id) {
+    case ACTUATOR_HEATER:   return "heater";
+    case ACTUATOR_PUMP:     return "pump";
+    case ACTUATOR_AERATION: return "aeration";
+    default:                return "unknown";
+  }
+}
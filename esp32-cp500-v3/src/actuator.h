@@ -0,0 +1,49 @@
+#ifndef ACTUATOR_H
+#define ACTUATOR_H
+
+#include <Arduino.h>
+
+// Duty-cycle actuator layer on top of the raw outputs in sensor.cpp.
+// Every actuator takes a commanded duty of 0..100 %:
+// - Heater and pump are relays, driven time-proportionally (slow PWM): in
+//   each window the relay is on for duty * window. On and off slices shorter
+//   than the relay's minimum are not switched; the shortfall is carried into
+//   the next window so the average duty still matches. 0 % and 100 % stop the
+//   cycle and switch at once, or when the min on/off time since the last edge
+//   has passed. A new duty takes effect at the next window. Safety shutoffs
+//   use actuatorCutNow() instead, which does not wait for the min on-time.
+// - Aeration is LEDC PWM; the duty becomes the soft-start target and the
+//   aeration ramp engine fades to it.
+// Control code and safety paths go through this layer instead of calling
+// heaterOn()/pumpOn() directly, so a running cycle cannot re-energize a relay
+// a safety rule just turned off.
+enum ActuatorId : uint8_t {
+  ACTUATOR_HEATER = 0,
+  ACTUATOR_PUMP,
+  ACTUATOR_AERATION,
+  ACTUATOR_COUNT
+};
+
+static const uint32_t PUMP_MIN_SWITCH_MS = 5000;   // Shortest pump on/off slice
+
+// Call after initSensors() and loadConfigFromSPIFFS().
+void initActuators();
+
+// windowMs == 0 restricts the relay to on/off (duty rounded at 50 %).
+void actuatorConfigure(ActuatorId id, uint32_t windowMs, uint32_t minOnMs, uint32_t minOffMs);
+
+void actuatorSetDuty(ActuatorId id, float dutyPct);
+float actuatorDuty(ActuatorId id);       // Commanded duty (%)
+bool actuatorOutputOn(ActuatorId id);    // Relay energized / aeration PWM above 0 right now
+
+// Relay off now, past its min on-time (duty 0, cycle cancelled); for the
+// safety shutoffs, whose decisions control_logic.cpp already timed.
+void actuatorCutNow(ActuatorId id);
+
+// Everything off at once, cycles and ramps cancelled, min on-times ignored;
+// for the emergency stop.
+void actuatorStopAll();
+
+const char* actuatorName(ActuatorId id);
+
+#endif
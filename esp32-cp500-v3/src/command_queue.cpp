@@ -0,0 +1,152 @@
+#include "command_queue.h"
+
+static const uint8_t NO_NODE = 0xFF;
+
+struct CommandName {
+  const char* name;
+  CommandKind kind;
+  CommandDevice device;
+};
+
+static constexpr CommandName COMMAND_NAMES[] = {
+  { "heater", COMMAND_KIND_DEVICE, COMMAND_DEVICE_HEATER },
+  { "pump", COMMAND_KIND_DEVICE, COMMAND_DEVICE_PUMP },
+  { "aeration", COMMAND_KIND_DEVICE, COMMAND_DEVICE_AERATION },
+  { "fan", COMMAND_KIND_DEVICE, COMMAND_DEVICE_AERATION },
+  { "emergency", COMMAND_KIND_EMERGENCY, COMMAND_DEVICE_NONE },
+  { "diag", COMMAND_KIND_DIAG, COMMAND_DEVICE_NONE },
+  { "config_update", COMMAND_KIND_CONFIG_UPDATE, COMMAND_DEVICE_NONE },
+  { "probe_reset", COMMAND_KIND_PROBE_RESET, COMMAND_DEVICE_NONE },
+  { "autotune", COMMAND_KIND_AUTOTUNE, COMMAND_DEVICE_NONE },
+};
+
+// Indexed by CommandDevice / CommandAction.
+static constexpr const char* DEVICE_NAMES[COMMAND_DEVICE_COUNT] = { "heater", "pump", "aeration" };
+static constexpr const char* ACTION_NAMES[COMMAND_ACTION_UNKNOWN] = { "on", "off", "auto" };
+
+CommandKind parseCommandName(const char* name, CommandDevice& device) {
+  device = COMMAND_DEVICE_NONE;
+  if (!name) return COMMAND_KIND_UNKNOWN;
+  for (const CommandName& entry : COMMAND_NAMES) {
+    if (strcmp(entry.name, name) == 0) {
+      device = entry.device;
+      return entry.kind;
+    }
+  }
+  return COMMAND_KIND_UNKNOWN;
+}
+
+CommandAction parseCommandAction(const char* name) {
+  if (!name) return COMMAND_ACTION_UNKNOWN;
+  for (uint8_t i = 0; i < COMMAND_ACTION_UNKNOWN; ++i) {
+    if (strcmp(ACTION_NAMES[i], name) == 0) return (CommandAction)i;
+  }
+  return COMMAND_ACTION_UNKNOWN;
+}
+
+const char* commandDeviceName(CommandDevice device) {
+  return device < COMMAND_DEVICE_COUNT ? DEVICE_NAMES[device] : "?";
+}
+
+const char* commandActionName(CommandAction action) {
+  return action < COMMAND_ACTION_UNKNOWN ? ACTION_NAMES[action] : "?";
+}
+
+CommandQueue::CommandQueue() : _size(0), _freeCount(COMMAND_QUEUE_CAPACITY), _nextSeq(0) {
+  for (uint8_t i = 0; i < COMMAND_QUEUE_CAPACITY; ++i) {
+    _free[i] = COMMAND_QUEUE_CAPACITY - 1 - i;
+  }
+  for (uint8_t d = 0; d < COMMAND_DEVICE_COUNT; ++d) {
+    _deviceNode[d] = NO_NODE;
+  }
+}
+
+bool CommandQueue::before(uint8_t a, uint8_t b) const {
+  long diff = (long)(_pool[a].targetTimeMs - _pool[b].targetTimeMs);
+  if (diff != 0) return diff < 0;
+  return (int32_t)(_seq[a] - _seq[b]) < 0;
+}
+
+void CommandQueue::place(uint8_t pos, uint8_t node) {
+  _heap[pos] = node;
+  _heapPos[node] = pos;
+}
+
+void CommandQueue::siftUp(uint8_t pos) {
+  uint8_t node = _heap[pos];
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (!before(node, _heap[parent])) break;
+    place(pos, _heap[parent]);
+    pos = parent;
+  }
+  place(pos, node);
+}
+
+void CommandQueue::siftDown(uint8_t pos) {
+  uint8_t node = _heap[pos];
+  while (true) {
+    uint8_t child = pos * 2 + 1;
+    if (child >= _size) break;
+    if (child + 1 < _size && before(_heap[child + 1], _heap[child])) child++;
+    if (!before(_heap[child], node)) break;
+    place(pos, _heap[child]);
+    pos = child;
+  }
+  place(pos, node);
+}
+
+void CommandQueue::removeAt(uint8_t pos) {
+  uint8_t node = _heap[pos];
+  if (_pool[node].device < COMMAND_DEVICE_COUNT) {
+    _deviceNode[_pool[node].device] = NO_NODE;
+  }
+  _free[_freeCount++] = node;
+
+  _size--;
+  if (pos == _size) return;
+  // Refill the hole with the last entry and restore order in whichever
+  // direction it violates.
+  uint8_t moved = _heap[_size];
+  place(pos, moved);
+  siftUp(pos);
+  if (_heapPos[moved] == pos) siftDown(pos);
+}
+
+bool CommandQueue::push(const PendingCommand& cmd) {
+  cancelDevice(cmd.device);
+  if (_freeCount == 0) return false;
+
+  uint8_t node = _free[--_freeCount];
+  _pool[node] = cmd;
+  _seq[node] = _nextSeq++;
+  if (cmd.device < COMMAND_DEVICE_COUNT) {
+    _deviceNode[cmd.device] = node;
+  }
+  place(_size, node);
+  _size++;
+  siftUp(_size - 1);
+  return true;
+}
+
+bool CommandQueue::popDue(unsigned long nowMs, PendingCommand& out) {
+  if (_size == 0) return false;
+  uint8_t node = _heap[0];
+  if ((nowMs - _pool[node].targetTimeMs) >= 0x80000000UL) return false;
+  out = _pool[node];
+  removeAt(0);
+  return true;
+}
+
+bool CommandQueue::peekDue(unsigned long& dueMs) const {
+  if (_size == 0) return false;
+  dueMs = _pool[_heap[0]].targetTimeMs;
+  return true;
+}
+
+void CommandQueue::cancelDevice(CommandDevice device) {
+  if (device >= COMMAND_DEVICE_COUNT) return;
+  uint8_t node = _deviceNode[device];
+  if (node == NO_NODE) return;
+  removeAt(_heapPos[node]);
+}
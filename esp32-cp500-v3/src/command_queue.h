@@ -0,0 +1,90 @@
+#ifndef COMMAND_QUEUE_H
+#define COMMAND_QUEUE_H
+
+#include <Arduino.h>
+
+static const uint8_t COMMAND_QUEUE_CAPACITY = 16;
+
+// Devices with at most one pending command each; queuing a new command for a
+// device replaces the pending one (e.g. a fresh "on" drops the old timed "off").
+enum CommandDevice : uint8_t {
+  COMMAND_DEVICE_HEATER = 0,
+  COMMAND_DEVICE_PUMP,
+  COMMAND_DEVICE_AERATION,
+  COMMAND_DEVICE_COUNT,
+  COMMAND_DEVICE_NONE = 0xFF
+};
+
+enum CommandAction : uint8_t {
+  COMMAND_ACTION_ON = 0,
+  COMMAND_ACTION_OFF,
+  COMMAND_ACTION_AUTO,
+  COMMAND_ACTION_UNKNOWN
+};
+
+// What a "command" name means; device commands also carry a CommandDevice.
+enum CommandKind : uint8_t {
+  COMMAND_KIND_DEVICE = 0,
+  COMMAND_KIND_EMERGENCY,
+  COMMAND_KIND_DIAG,
+  COMMAND_KIND_CONFIG_UPDATE,
+  COMMAND_KIND_PROBE_RESET,
+  COMMAND_KIND_AUTOTUNE,
+  COMMAND_KIND_UNKNOWN
+};
+
+// Commands are parsed into enums once at the MQTT boundary, so the queue
+// holds plain 12-byte values and dispatch is a switch.
+struct PendingCommand {
+  CommandDevice device;
+  CommandAction action;
+  unsigned long duration;     // Requested duration in ms, 0 means no auto-off
+  unsigned long targetTimeMs; // Scheduled execution time in millis()
+};
+
+// Looks a "command" name up in the static name table ("fan" is an alias of
+// "aeration"); device is set for COMMAND_KIND_DEVICE, NONE otherwise.
+CommandKind parseCommandName(const char* name, CommandDevice& device);
+CommandAction parseCommandAction(const char* name);
+const char* commandDeviceName(CommandDevice device);
+const char* commandActionName(CommandAction action);
+
+// Fixed-capacity min-heap of pending commands keyed by targetTimeMs
+// (rollover-safe), FIFO among equal times. Commands live in a static pool
+// and the heap orders pool indexes, so queuing never allocates or moves a
+// command; each entry knows its heap position, so a device's command is
+// found in O(1) and removed in O(log n). Not locked; callers hold gCmdMutex.
+class CommandQueue {
+public:
+  CommandQueue();
+
+  // Queues cmd, replacing the pending command of the same device.
+  // Returns false when the queue is full.
+  bool push(const PendingCommand& cmd);
+  // Pops the earliest command if it is due at nowMs.
+  bool popDue(unsigned long nowMs, PendingCommand& out);
+  // Due time of the earliest command; false when empty.
+  bool peekDue(unsigned long& dueMs) const;
+  void cancelDevice(CommandDevice device);
+
+  size_t size() const { return _size; }
+
+private:
+  bool before(uint8_t a, uint8_t b) const;
+  void place(uint8_t pos, uint8_t node);
+  void siftUp(uint8_t pos);
+  void siftDown(uint8_t pos);
+  void removeAt(uint8_t pos);
+
+  PendingCommand _pool[COMMAND_QUEUE_CAPACITY];
+  uint32_t _seq[COMMAND_QUEUE_CAPACITY];          // Insertion order, breaks ties
+  uint8_t _heapPos[COMMAND_QUEUE_CAPACITY];
+  uint8_t _heap[COMMAND_QUEUE_CAPACITY];          // Pool indexes, min-heap by time
+  uint8_t _free[COMMAND_QUEUE_CAPACITY];          // Stack of unused pool indexes
+  uint8_t _deviceNode[COMMAND_DEVICE_COUNT];
+  uint8_t _size;
+  uint8_t _freeCount;
+  uint32_t _nextSeq;
+};
+
+#endif
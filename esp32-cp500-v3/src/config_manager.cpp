@@ -39,6 +39,35 @@ static void fillDefaultsIfNeeded(AppConfig& c) {
 	c.bathSetEnabled = c.bathSetEnabled ? true : false;
 	if (c.bathSetTarget <= 0) c.bathSetTarget = 45.0f;
 	if (c.bathSetHyst <= 0) c.bathSetHyst = 0.8f;
+
+	if (c.pidKp < 0) c.pidKp = 0.0f;
+	if (c.pidKi < 0) c.pidKi = 0.0f;
+	if (c.pidKd < 0) c.pidKd = 0.0f;
+	if (c.pidKff < 0) c.pidKff = 0.0f;
+	if (c.pidAutotuneHyst <= 0) c.pidAutotuneHyst = 0.3f;
+
+	if (c.mpcHorizonS == 0) c.mpcHorizonS = 1800;
+	if (c.mpcEnergyWeight < 0) c.mpcEnergyWeight = 0.0f;
+	if (c.mpcOvershootWeight < 0) c.mpcOvershootWeight = 0.0f;
+}
+
+bool parseControlMode(const char* name, ControlMode& mode) {
+	if (!name) return false;
+	if (strcmp(name, "ncurve") == 0 || strcmp(name, "n-curve") == 0) mode = CONTROL_MODE_NCURVE;
+	else if (strcmp(name, "setpoint") == 0) mode = CONTROL_MODE_SETPOINT;
+	else if (strcmp(name, "pid") == 0) mode = CONTROL_MODE_PID;
+	else if (strcmp(name, "mpc") == 0) mode = CONTROL_MODE_MPC;
+	else return false;
+	return true;
+}
+
+const char* controlModeName(ControlMode mode) {
+	switch (mode) {
+	case CONTROL_MODE_SETPOINT: return "setpoint";
+	case CONTROL_MODE_PID:      return "pid";
+	case CONTROL_MODE_MPC:      return "mpc";
+	default:                    return "ncurve";
+	}
 }
 
 bool initSPIFFS() {
@@ -109,6 +138,9 @@ bool loadConfigFromSPIFFS(const char* path) {
 	appConfig.tempLimitInMax = doc["temp_limitin_max"] | 70;
 	appConfig.tempLimitOutMin = doc["temp_limitout_min"] | 25;
 	appConfig.tempLimitInMin = doc["temp_limitin_min"] | 25;
+	appConfig.heapReportInterval = doc["heap_report_interval"] | 3600000;
+	appConfig.diagInterval = doc["diag_interval"] | 0;
+	appConfig.telemetryBatch = doc["telemetry_batch"] | 1;
 
 	{
 		JsonObject aero = doc["aeration_timer"];
@@ -123,11 +155,16 @@ bool loadConfigFromSPIFFS(const char* path) {
 	JsonObject pumpLearning = doc["pump_learning"];
 	JsonObject curves = doc["curves"];
 	JsonObject bathSet = doc["bath_setpoint"];
+	JsonObject pumpPwm = doc["pump_pwm"];
+	JsonObject pid = doc["pid"];
+	JsonObject mpc = doc["mpc"];
 
 	appConfig.tankTempMax = readF(safety, "tank_temp_max", appConfig.tankTempMax);
 
 	appConfig.heaterMinOnMs = readU(heaterGuard, "min_on_ms", appConfig.heaterMinOnMs);
 	appConfig.heaterMinOffMs = readU(heaterGuard, "min_off_ms", appConfig.heaterMinOffMs);
+	appConfig.heaterWindowMs = readU(heaterGuard, "window_ms", appConfig.heaterWindowMs);
+	appConfig.pumpWindowMs = readU(pumpPwm, "window_ms", appConfig.pumpWindowMs);
 
 	appConfig.pumpDeltaOnMin = readF(pumpAdaptive, "delta_on_min", appConfig.pumpDeltaOnMin);
 	appConfig.pumpDeltaOnMax = readF(pumpAdaptive, "delta_on_max", appConfig.pumpDeltaOnMax);
@@ -145,6 +182,21 @@ bool loadConfigFromSPIFFS(const char* path) {
 	appConfig.bathSetTarget = readF(bathSet, "target", appConfig.bathSetTarget);
 	appConfig.bathSetHyst = readF(bathSet, "hyst", appConfig.bathSetHyst);
 
+	if (!parseControlMode(doc["control_mode"] | "", appConfig.controlMode)) {
+		appConfig.controlMode = appConfig.bathSetEnabled ? CONTROL_MODE_SETPOINT : CONTROL_MODE_NCURVE;
+	}
+	appConfig.bathSetEnabled = appConfig.controlMode == CONTROL_MODE_SETPOINT;
+
+	appConfig.pidKp = readF(pid, "kp", appConfig.pidKp);
+	appConfig.pidKi = readF(pid, "ki", appConfig.pidKi);
+	appConfig.pidKd = readF(pid, "kd", appConfig.pidKd);
+	appConfig.pidKff = readF(pid, "kff", appConfig.pidKff);
+	appConfig.pidAutotuneHyst = readF(pid, "autotune_hyst", appConfig.pidAutotuneHyst);
+
+	appConfig.mpcHorizonS = readU(mpc, "horizon_s", appConfig.mpcHorizonS);
+	appConfig.mpcEnergyWeight = readF(mpc, "energy_weight", appConfig.mpcEnergyWeight);
+	appConfig.mpcOvershootWeight = readF(mpc, "overshoot_weight", appConfig.mpcOvershootWeight);
+
 	fillDefaultsIfNeeded(appConfig);
 	return true;
 }
@@ -186,6 +238,10 @@ void printConfig(const AppConfig& cfg) {
 	Serial.println("Heater Guard:");
 	Serial.printf("  min_on_ms            : %lu ms\n", cfg.heaterMinOnMs);
 	Serial.printf("  min_off_ms           : %lu ms\n", cfg.heaterMinOffMs);
+	Serial.printf("  window_ms            : %lu ms\n", cfg.heaterWindowMs);
+
+	Serial.println("Pump PWM:");
+	Serial.printf("  window_ms            : %lu ms\n", cfg.pumpWindowMs);
 
 	Serial.println("Pump Adaptive:");
 	Serial.printf("  delta_on_min         : %.2f C\n", cfg.pumpDeltaOnMin);
@@ -207,9 +263,27 @@ void printConfig(const AppConfig& cfg) {
 	Serial.printf("  target               : %.2f C\n", cfg.bathSetTarget);
 	Serial.printf("  hyst                 : %.2f C\n", cfg.bathSetHyst);
 
+	Serial.printf("Control mode: %s\n", controlModeName(cfg.controlMode));
+	Serial.println("PID:");
+	Serial.printf("  kp                   : %.3f %%/C\n", cfg.pidKp);
+	Serial.printf("  ki                   : %.5f %%/(C*s)\n", cfg.pidKi);
+	Serial.printf("  kd                   : %.1f %%*s/C\n", cfg.pidKd);
+	Serial.printf("  kff                  : %.2f %%/C\n", cfg.pidKff);
+	Serial.printf("  autotune_hyst        : %.2f C\n", cfg.pidAutotuneHyst);
+	Serial.println("MPC:");
+	Serial.printf("  horizon_s            : %lu s\n", (unsigned long)cfg.mpcHorizonS);
+	Serial.printf("  energy_weight        : %.4f\n", cfg.mpcEnergyWeight);
+	Serial.printf("  overshoot_weight     : %.2f\n", cfg.mpcOvershootWeight);
+
+	Serial.printf("Heap report interval: %lu ms\n", (unsigned long)cfg.heapReportInterval);
+	Serial.printf("Diag interval       : %lu ms\n", (unsigned long)cfg.diagInterval);
+	Serial.printf("Telemetry batch     : %u samples\n", (unsigned)cfg.telemetryBatch);
+
 	Serial.println("MQTT Topics:");
 	Serial.printf("  telemetry            : %s\n", getTelemetryTopic().c_str());
+	Serial.printf("  telemetry batch      : %s\n", getTelemetryBatchTopic().c_str());
 	Serial.printf("  response             : %s\n", getResponseTopic().c_str());
+	Serial.printf("  diag                 : %s\n", getDiagTopic().c_str());
 
 	Serial.println("---------------------");
 }
@@ -218,6 +292,10 @@ String getTelemetryTopic() {
 	return String("compostlab/v2/") + appConfig.mqttDeviceCode + "/telemetry";
 }
 
+String getTelemetryBatchTopic() {
+	return getTelemetryTopic() + "/batch";
+}
+
 String getResponseTopic() {
 	return String("compostlab/v2/") + appConfig.mqttDeviceCode + "/response";
 }
@@ -226,6 +304,10 @@ String getRegisterTopic() {
 	return String("compostlab/v2/") + appConfig.mqttDeviceCode + "/register";
 }
 
+String getDiagTopic() {
+	return String("compostlab/v2/") + appConfig.mqttDeviceCode + "/diag";
+}
+
 bool saveConfigToSPIFFS(const char* path) {
 	File file = SPIFFS.open(path, "w");
 	if (!file) {
@@ -255,6 +337,9 @@ bool saveConfigToSPIFFS(const char* path) {
 	doc["temp_limitin_max"] = appConfig.tempLimitInMax;
 	doc["temp_limitout_min"] = appConfig.tempLimitOutMin;
 	doc["temp_limitin_min"] = appConfig.tempLimitInMin;
+	doc["heap_report_interval"] = appConfig.heapReportInterval;
+	doc["diag_interval"] = appConfig.diagInterval;
+	doc["telemetry_batch"] = appConfig.telemetryBatch;
 
 	doc["aeration_timer"]["enabled"] = appConfig.aerationTimerEnabled;
 	doc["aeration_timer"]["interval"] = appConfig.aerationInterval;
@@ -263,6 +348,8 @@ bool saveConfigToSPIFFS(const char* path) {
 	doc["safety"]["tank_temp_max"] = appConfig.tankTempMax;
 	doc["heater_guard"]["min_on_ms"] = appConfig.heaterMinOnMs;
 	doc["heater_guard"]["min_off_ms"] = appConfig.heaterMinOffMs;
+	doc["heater_guard"]["window_ms"] = appConfig.heaterWindowMs;
+	doc["pump_pwm"]["window_ms"] = appConfig.pumpWindowMs;
 
 	doc["pump_adaptive"]["delta_on_min"] = appConfig.pumpDeltaOnMin;
 	doc["pump_adaptive"]["delta_on_max"] = appConfig.pumpDeltaOnMax;
@@ -280,6 +367,16 @@ bool saveConfigToSPIFFS(const char* path) {
 	doc["bath_setpoint"]["target"] = appConfig.bathSetTarget;
 	doc["bath_setpoint"]["hyst"] = appConfig.bathSetHyst;
 
+	doc["control_mode"] = controlModeName(appConfig.controlMode);
+	doc["pid"]["kp"] = appConfig.pidKp;
+	doc["pid"]["ki"] = appConfig.pidKi;
+	doc["pid"]["kd"] = appConfig.pidKd;
+	doc["pid"]["kff"] = appConfig.pidKff;
+	doc["pid"]["autotune_hyst"] = appConfig.pidAutotuneHyst;
+	doc["mpc"]["horizon_s"] = appConfig.mpcHorizonS;
+	doc["mpc"]["energy_weight"] = appConfig.mpcEnergyWeight;
+	doc["mpc"]["overshoot_weight"] = appConfig.mpcOvershootWeight;
+
 	if (serializeJsonPretty(doc, file) == 0) {
 		file.close();
 		Serial.println("[Config] Failed to write config JSON!");
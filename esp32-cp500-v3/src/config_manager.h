@@ -3,6 +3,7 @@
 
 #include <Arduino.h>
 #include <vector>
+#include "control_logic.h"   // ControlMode
 
 struct AppConfig {
 	// Network / MQTT / NTP
@@ -38,6 +39,10 @@ struct AppConfig {
 	// Heater guard
 	uint32_t heaterMinOnMs;
 	uint32_t heaterMinOffMs;
+	uint32_t heaterWindowMs = 120000;   // Time-proportional window (ms), 0 = on/off only
+
+	// Pump time-proportional output
+	uint32_t pumpWindowMs = 60000;      // Time-proportional window (ms), 0 = on/off only
 
 	// Pump adaptive thresholds
 	float pumpDeltaOnMin;
@@ -58,6 +63,26 @@ struct AppConfig {
 	bool  bathSetEnabled;
 	float bathSetTarget;
 	float bathSetHyst;
+
+	// Control mode and PID gains (pid mode uses bath_setpoint.target)
+	ControlMode controlMode = CONTROL_MODE_NCURVE;
+	float pidKp = 60.0f;    // % per C
+	float pidKi = 0.02f;    // % per C*s
+	float pidKd = 0.0f;     // % per C/s
+	float pidKff = 2.0f;    // Heater % removed per C of tank surplus
+	float pidAutotuneHyst = 0.3f;   // Autotune relay hysteresis (C)
+
+	// Model-predictive mode (uses bath_setpoint.target)
+	uint32_t mpcHorizonS = 1800;        // Prediction horizon (s)
+	float mpcEnergyWeight = 0.002f;     // Cost per % heater duty per step (C^2)
+	float mpcOvershootWeight = 10.0f;   // Extra weight on squared error above target
+
+	// Diagnostics
+	uint32_t heapReportInterval = 3600000;  // Heap/stack telemetry channels interval (ms), 0 = off
+	uint32_t diagInterval = 0;              // Periodic diag payload interval (ms), 0 = only on diag command
+
+	// Telemetry
+	uint8_t telemetryBatch = 1;             // Samples per telemetry/batch message, 0/1 = one message per sample
 };
 
 extern AppConfig appConfig;
@@ -67,9 +92,15 @@ bool loadConfigFromSPIFFS(const char* path);
 bool saveConfigToSPIFFS(const char* path);
 void printConfig(const AppConfig& cfg);
 
+// "ncurve" / "setpoint" / "pid" / "mpc"; false for an unknown name
+bool parseControlMode(const char* name, ControlMode& mode);
+const char* controlModeName(ControlMode mode);
+
 // MQTT topics built from mqtt.device_code
 String getTelemetryTopic();   // compostlab/v2/{device_code}/telemetry
 String getResponseTopic();    // compostlab/v2/{device_code}/response
 String getRegisterTopic();    // compostlab/v2/{device_code}/register
+String getDiagTopic();        // compostlab/v2/{device_code}/diag
+String getTelemetryBatchTopic();  // compostlab/v2/{device_code}/telemetry/batch
 
 #endif
@@ -0,0 +1,717 @@
+#include "control_logic.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+static ControlLogFn gControlLog = nullptr;
+
+void setControlLogger(ControlLogFn fn) {
+  gControlLog = fn;
+}
+
+static void controlLog(const char* fmt, ...) {
+  if (!gControlLog) return;
+  char line[160];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(line, sizeof(line), fmt, args);
+  va_end(args);
+  gControlLog(line);
+}
+
+// reason is only for diagnostics; a truncated tail is acceptable.
+static void reasonSet(ControlResult& out, const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(out.reason, sizeof(out.reason), fmt, args);
+  va_end(args);
+}
+
+static void reasonAdd(ControlResult& out, const char* fmt, ...) {
+  size_t used = strlen(out.reason);
+  if (used + 1 >= sizeof(out.reason)) return;
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(out.reason + used, sizeof(out.reason) - used, fmt, args);
+  va_end(args);
+}
+
+static inline float lerp_f(float a, float b, float t) { return a + (b - a) * t; }
+
+// ========================= Utility: median with filtering =========================
+float median(const std::vector<float>& values, float minValid, float maxValid, float outlierThreshold) {
+  // Step 1: discard invalid samples.
+  std::vector<float> filtered = values;
+  filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](float v) {
+    return isnan(v) || v < minValid || v > maxValid;
+    }), filtered.end());
+
+  if (filtered.empty()) return NAN;
+
+  // Step 2: optionally remove outliers around the first median estimate.
+  if (outlierThreshold > 0) {
+    std::sort(filtered.begin(), filtered.end());
+    size_t mid = filtered.size() / 2;
+    float med0 = (filtered.size() % 2 == 0)
+      ? (filtered[mid - 1] + filtered[mid]) / 2.0f
+      : filtered[mid];
+
+    filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](float v) {
+      return fabsf(v - med0) > outlierThreshold;
+      }), filtered.end());
+
+    if (filtered.empty()) return NAN;
+  }
+
+  // Step 3: compute the final median after filtering.
+  std::sort(filtered.begin(), filtered.end());
+  size_t mid = filtered.size() / 2;
+  return (filtered.size() % 2 == 0)
+    ? (filtered[mid - 1] + filtered[mid]) / 2.0f
+    : filtered[mid];
+}
+
+// Returns true while the manual lock is still active.
+// Subtraction is used instead of addition so millis() rollover stays safe.
+bool isManualLockActive(unsigned long lockUntilMs, unsigned long nowMs) {
+  if (lockUntilMs == 0) return false;
+  if (lockUntilMs == MANUAL_LOCK_FOREVER) return true;
+  return (lockUntilMs - nowMs) < 0x80000000UL;
+}
+
+static void setHeater(ControlState& st, float duty, unsigned long nowMs) {
+  bool on = duty > 0.0f;
+  if (on != st.heaterOn) st.heaterToggleMs = nowMs;
+  st.heaterOn = on;
+  st.heaterDuty = duty;
+}
+
+static void setPump(ControlState& st, float duty) {
+  st.pumpOn = duty > 0.0f;
+  st.pumpDuty = duty;
+}
+
+// Tank safety guard for invalid or over-limit readings.
+// If tank temperature is invalid or too high, block heating and force the heater off.
+static bool applyTankSafetyCheck(ControlState& st, bool tankValid, bool tankOver, bool& targetHeat,
+  ControlResult& out, unsigned long nowMs) {
+  bool heatBlocked = false;
+
+  if (!tankValid || tankOver) {
+    if (targetHeat) {
+      reasonAdd(out, " | tank invalid/over-limit: force heater off");
+    }
+    targetHeat = false;
+    heatBlocked = true;
+    st.heaterCut = true;
+
+    if (st.heaterOn) {
+      setHeater(st, 0.0f, nowMs);
+      controlLog("[SAFETY] Tank temperature invalid or over limit, forcing heater off");
+    }
+  }
+
+  return heatBlocked;
+}
+
+// Tank-to-bath delta safety guard.
+// If the delta is too large, stop heating and force circulation.
+static bool applyTankBathDeltaSafety(ControlState& st, bool tankValid, float delta_tank_out,
+  float delta_limit, bool& targetHeat, bool& targetPump, ControlResult& out, unsigned long nowMs) {
+  if (!tankValid) return false;
+  if (delta_tank_out < delta_limit) return false;
+
+  if (targetHeat) {
+    reasonAdd(out, " | tank-bath delta too large: stop heating and force pump");
+  }
+  else {
+    reasonAdd(out, " | tank-bath delta too large: force pump");
+  }
+  targetHeat = false;
+  targetPump = true;
+  st.heaterManualUntilMs = 0;
+  st.heaterCut = true;
+
+  if (st.heaterOn) {
+    setHeater(st, 0.0f, nowMs);
+    controlLog("[SAFETY] Tank-bath delta too large (%.1f >= %.1f), forcing heater off",
+      delta_tank_out, delta_limit);
+  }
+  return true;
+}
+
+void computePumpDeltas(const ControlParams& p, float pumpDeltaBoost, float t_in,
+  float& delta_on, float& delta_off) {
+  auto clamp = [](float v, float lo, float hi) {
+    return v < lo ? lo : (v > hi ? hi : v);
+    };
+  const float in_min = p.tempLimitInMin;
+  const float in_max = p.tempLimitInMax;
+  const float MAX_ALLOWED = p.pumpDeltaOnMax + p.pumpLearnMax;
+
+  // Convert the nominal hysteresis in C into a ratio relative to delta_on.
+  const float mid_on = 0.5f * (p.pumpDeltaOnMin + p.pumpDeltaOnMax);
+  const float hyst_rat = (mid_on > 0.1f) ? (p.pumpHystNom / mid_on) : 0.2f;
+
+  auto dyn_off = [&](float on) {   // Compute adaptive delta_off from delta_on
+    float hyst = hyst_rat * on;    // hysteresis = ratio * delta_on
+    return fmaxf(0.5f, on - hyst); // Keep delta_off above 0.5 C
+    };
+
+  // Fall back when the normalization range is invalid.
+  if (!isfinite(in_min) || !isfinite(in_max) || in_max <= in_min) {
+    delta_on = clamp(p.pumpDeltaOnMin + pumpDeltaBoost, p.pumpDeltaOnMin, MAX_ALLOWED);
+    delta_off = dyn_off(delta_on);
+    return;
+  }
+
+  // Clamp to the low/high edge outside the configured range.
+  if (t_in < in_min) {
+    delta_on = clamp(p.pumpDeltaOnMin + pumpDeltaBoost, p.pumpDeltaOnMin, MAX_ALLOWED);
+    delta_off = dyn_off(delta_on);
+    return;
+  }
+  if (t_in > in_max) {
+    delta_on = clamp(p.pumpDeltaOnMax + pumpDeltaBoost, p.pumpDeltaOnMin, MAX_ALLOWED);
+    delta_off = dyn_off(delta_on);
+    return;
+  }
+
+  // Inside range: smooth n-curve interpolation plus learned compensation.
+  float u = (t_in - in_min) / (in_max - in_min); // 0..1
+  float base_on = lerp_f(p.pumpDeltaOnMin, p.pumpDeltaOnMax, powf(u, p.pumpNCurveGamma));
+
+  delta_on = clamp(base_on + pumpDeltaBoost, p.pumpDeltaOnMin, MAX_ALLOWED);
+  delta_off = dyn_off(delta_on);
+}
+
+// ========================= Apply heater and pump targets =========================
+// Shared on/off application path used by both setpoint and n-curve modes.
+static void applyHeaterPumpTargets(const ControlParams& p, ControlState& st, bool targetHeat,
+  bool targetPump, bool hardCool, ControlResult& out, unsigned long nowMs) {
+  unsigned long elapsed = nowMs - st.heaterToggleMs;
+
+  if (hardCool) {
+    // Bath temperature above hard limit: force everything off and clear locks.
+    setHeater(st, 0.0f, nowMs);
+    setPump(st, 0.0f);
+    st.heaterCut = true;
+    st.pumpCut = true;
+    st.heaterManualUntilMs = 0;
+    st.pumpManualUntilMs = 0;
+    return;
+  }
+
+  // ===== Heater with minimum on/off guard times =====
+  if (targetHeat) {
+    if (!st.heaterOn) {
+      if (elapsed >= p.heaterMinOffMs) {
+        setHeater(st, 100.0f, nowMs);
+      }
+      else {
+        reasonAdd(out, " | heater start suppressed: min off time not reached");
+      }
+    }
+    // If the heater is already on, keep it running unless another safety rule turns it off.
+  }
+  else {
+    if (st.heaterOn) {
+      if (elapsed >= p.heaterMinOnMs) {
+        setHeater(st, 0.0f, nowMs);
+      }
+      else {
+        reasonAdd(out, " | heater stop suppressed: min on time not reached");
+      }
+    }
+  }
+
+  // ===== Pump target application =====
+  if (targetPump) {
+    if (!st.pumpOn) setPump(st, 100.0f);
+  }
+  else {
+    setPump(st, 0.0f);
+  }
+}
+
+// Duty-based counterpart of applyHeaterPumpTargets for PID and MPC. Starting
+// and stopping the heater still honour heater_guard min on/off; while it runs,
+// the duty may change every cycle and the actuator layer spreads it over the window.
+static void applyHeaterPumpDuties(const ControlParams& p, ControlState& st, float heaterDuty,
+  float pumpDuty, ControlResult& out, unsigned long nowMs) {
+  unsigned long elapsed = nowMs - st.heaterToggleMs;
+
+  if (heaterDuty > 0.0f) {
+    if (st.heaterOn || elapsed >= p.heaterMinOffMs) {
+      setHeater(st, heaterDuty, nowMs);
+    }
+    else {
+      reasonAdd(out, " | heater start suppressed: min off time not reached");
+    }
+  }
+  else if (st.heaterOn) {
+    if (elapsed >= p.heaterMinOnMs) {
+      setHeater(st, 0.0f, nowMs);
+    }
+    else {
+      reasonAdd(out, " | heater stop suppressed: min on time not reached");
+    }
+  }
+
+  setPump(st, pumpDuty);
+}
+
+// Duty targets of the PID and MPC modes: manual locks, tank and tank-bath
+// delta safety, then applyHeaterPumpDuties.
+static void applyDutyTargetsWithSafety(const ControlParams& p, ControlState& st, float heaterDuty,
+  float pumpDuty, bool tankValid, bool tankOver, float delta_tank_out, float deltaSafetyLimit,
+  ControlResult& out, unsigned long nowMs) {
+  bool targetHeat = heaterDuty > 0.0f;
+  bool targetPump = pumpDuty > 0.0f;
+
+  if (isManualLockActive(st.heaterManualUntilMs, nowMs)) {
+    targetHeat = st.heaterOn;
+    heaterDuty = st.heaterDuty;
+    reasonAdd(out, " | heater manual lock active");
+  }
+  if (isManualLockActive(st.pumpManualUntilMs, nowMs)) {
+    targetPump = st.pumpOn;
+    pumpDuty = st.pumpDuty;
+    reasonAdd(out, " | pump manual lock active");
+  }
+
+  applyTankSafetyCheck(st, tankValid, tankOver, targetHeat, out, nowMs);
+  applyTankBathDeltaSafety(st, tankValid, delta_tank_out, deltaSafetyLimit,
+    targetHeat, targetPump, out, nowMs);
+  if (!targetHeat) heaterDuty = 0.0f;
+  if (!targetPump) pumpDuty = 0.0f;
+  else if (pumpDuty <= 0.0f) pumpDuty = 100.0f;   // Forced by the delta guard
+
+  applyHeaterPumpDuties(p, st, heaterDuty, pumpDuty, out, nowMs);
+}
+
+// Learns one step of the thermal model: the duties commanded since the
+// previous cycle drove the plant from that sample to this one.
+static void updateThermalModel(const ControlParams& p, ControlState& st, const ControlSample& in,
+  bool tankValid) {
+  bool valid = tankValid && !isnan(in.t_in);
+  ThermalState now = { in.t_tank, in.med_out, in.t_in };
+  if (valid && st.modelPrevMs != 0) {
+    unsigned long dtMs = in.nowMs - st.modelPrevMs;
+    if (dtMs >= p.postInterval / 2 && dtMs <= 3UL * p.postInterval) {
+      ThermalInput u = { st.heaterDuty / 100.0f, st.pumpDuty / 100.0f };
+      st.model.observe(st.modelPrev, u, now, dtMs / 60000.0f);
+    }
+  }
+  st.modelPrev = now;
+  st.modelPrevMs = valid ? in.nowMs : 0;
+}
+
+// Bath target of the setpoint-based modes, kept below temp_limitout_max.
+static float bathTarget(const ControlParams& p) {
+  float tgt = p.bathSetTarget;
+  if (isfinite(p.tempLimitOutMax)) {
+    tgt = fminf(tgt, p.tempLimitOutMax - 0.2f);
+  }
+  return tgt;
+}
+
+// The PID and MPC modes run the pump on/off with hysteresis: on once the bath
+// wants a fair share of heat and the tank holds some, off when either has
+// nearly gone. Following the demand as a duty switched the pump every few minutes.
+static const float PUMP_DEMAND_ON = 20.0f;     // Bath demand (%)
+static const float PUMP_DEMAND_OFF = 5.0f;
+static const float PUMP_SURPLUS_ON = 0.5f;     // Tank above bath (C)
+static const float PUMP_SURPLUS_OFF = 0.2f;
+
+static float pumpDutyWithHysteresis(const ControlState& st, bool tankValid, float bathDemand,
+  float delta_tank_out) {
+  bool wanted = tankValid && (st.pumpOn
+    ? bathDemand > PUMP_DEMAND_OFF && delta_tank_out > PUMP_SURPLUS_OFF
+    : bathDemand >= PUMP_DEMAND_ON && delta_tank_out > PUMP_SURPLUS_ON);
+  return wanted ? 100.0f : 0.0f;
+}
+
+static void runPidCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  float delta_tank_out, bool tankOver, float deltaSafetyLimit, ControlResult& out) {
+  const unsigned long nowMs = in.nowMs;
+
+  // A gap of several intervals (mode entered, probes lost) restarts the PID
+  // instead of integrating over it.
+  float dtSec = 0.0f;
+  if (st.pidLastMs != 0 && nowMs - st.pidLastMs <= 3UL * p.postInterval) {
+    dtSec = (nowMs - st.pidLastMs) / 1000.0f;
+  }
+  else {
+    st.pid.reset();
+  }
+  st.pidLastMs = nowMs;
+
+  float heaterDuty = 0.0f;
+  float bathDemand = 0.0f;
+  out.modeTag = "PID";
+  if (st.autotune.running()) {
+    out.modeTag = "Autotune";
+    heaterDuty = st.autotune.update(in.med_out, nowMs);
+    // Keep circulating through the relay's off half, as the PID does near the
+    // setpoint, so the tank's lag is part of the loop the autotune measures.
+    bathDemand = 100.0f;
+    reasonSet(out, "[Autotune] t_out_med=%.2f relay %s, cycle %u/%u", in.med_out,
+      heaterDuty > 0.0f ? "on" : "off", (unsigned)st.autotune.cycles(), (unsigned)AUTOTUNE_CYCLES);
+
+    if (st.autotune.state() == AUTOTUNE_DONE) {
+      PidGains g = st.autotune.tunedGains(p.pid.kff);
+      out.gainsTuned = true;
+      out.tunedGains = g;
+      st.pid.reset();
+      controlLog("[Autotune] Ku=%.2f %%/C Pu=%.0f s -> kp=%.3f ki=%.5f kd=%.1f",
+        st.autotune.ultimateGain(), st.autotune.ultimatePeriodSec(), g.kp, g.ki, g.kd);
+      reasonAdd(out, " -> done");
+    }
+    else if (st.autotune.state() == AUTOTUNE_FAILED) {
+      controlLog("[Autotune] Failed: %s, gains unchanged", st.autotune.failReason());
+      reasonAdd(out, " -> failed: %s", st.autotune.failReason());
+    }
+  }
+  else if (p.mode == CONTROL_MODE_PID) {
+    heaterDuty = st.pid.update(out.target, in.med_out, delta_tank_out, dtSec, p.pid);
+    bathDemand = st.pid.demand();
+    reasonSet(out, "[PID] t_out_med=%.2f tgt=%.1f P=%.1f I=%.1f D=%.1f FF=%.1f -> heater %.0f%%",
+      in.med_out, out.target, st.pid.p(), st.pid.i(), st.pid.d(), st.pid.ff(), heaterDuty);
+  }
+
+  // Circulate while the bath wants heat and the tank holds some to give.
+  float pumpDuty = pumpDutyWithHysteresis(st, out.tankValid, bathDemand, delta_tank_out);
+  applyDutyTargetsWithSafety(p, st, heaterDuty, pumpDuty, out.tankValid, tankOver,
+    delta_tank_out, deltaSafetyLimit, out, nowMs);
+
+  // Only the 0/100 % limits inside update() may stop the integral; a heater
+  // held off or on by a safety rule, lock or guard time freezes it instead.
+  if (!st.autotune.running() && st.heaterDuty != heaterDuty) {
+    st.pid.holdIntegral();
+    reasonAdd(out, " | integral held");
+  }
+}
+
+static void runMpcCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  float delta_tank_out, bool tankOver, float deltaSafetyLimit, ControlResult& out) {
+  MpcConfig cfg;
+  cfg.target = out.target;
+  cfg.bathMax = p.tempLimitOutMax;
+  cfg.tankMax = p.tankTempMax;
+  cfg.energyWeight = p.mpcEnergyWeight;
+  cfg.overshootWeight = p.mpcOvershootWeight;
+  cfg.stepMin = p.postInterval / 60000.0f;
+  uint32_t steps = p.mpcHorizonS * 1000UL / p.postInterval;
+  cfg.steps = (uint8_t)(steps > MPC_MAX_STEPS ? MPC_MAX_STEPS : steps);   // Planner raises 0 to 1
+
+  ThermalState now = { in.t_tank, in.med_out, in.t_in };
+  MpcPlan plan = planHeaterPump(st.model, now, cfg);
+  st.lastPlan = plan;
+  st.planValid = true;
+
+  float heaterDuty = plan.first.heater * 100.0f;
+  // The planned pump duty is the bath's demand for tank heat.
+  float pumpDuty = pumpDutyWithHysteresis(st, out.tankValid, plan.first.pump * 100.0f, delta_tank_out);
+  out.modeTag = "MPC";
+  reasonSet(out, "[MPC] t_out_med=%.2f tgt=%.1f -> heater %.0f%% pump plan %.0f%% -> %s, predicted peak %.2f",
+    in.med_out, out.target, heaterDuty, plan.first.pump * 100.0f, pumpDuty > 0.0f ? "on" : "off",
+    plan.bathPeak);
+  if (!plan.feasible) {
+    reasonAdd(out, " | no plan within tank/bath limits, all off");
+  }
+
+  applyDutyTargetsWithSafety(p, st, heaterDuty, pumpDuty, out.tankValid, tankOver,
+    delta_tank_out, deltaSafetyLimit, out, in.nowMs);
+}
+
+static void runSetpointCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  float t_tank, float delta_tank_out, bool tankOver, float DELTA_ON, float deltaSafetyLimit,
+  ControlResult& out) {
+  const float med_out = in.med_out;
+  const float tgt = out.target;
+  const float hyst = out.hyst;
+  const bool tankValid = out.tankValid;
+  bool targetHeat = false;
+  bool targetPump = false;
+  out.modeTag = "Setpoint";
+
+  bool bathLow = (med_out < tgt - hyst);
+  bool bathHigh = (med_out > tgt + hyst);
+  bool bathOk = (!bathLow && !bathHigh);
+
+  if (bathLow) {
+    if (!tankValid) {
+      targetHeat = false;
+      targetPump = false;
+      reasonSet(out, "[SAFETY] Tank reading unavailable; automatic heating blocked until inspected");
+    }
+    else {
+      if (t_tank < tgt + DELTA_ON) {
+        targetHeat = true;
+        if (delta_tank_out > 0.5f) {
+          targetPump = true;
+          reasonSet(out, "[Setpoint] t_out_med=%.1f < (%.1f-%.1f) -> heat tank and circulate",
+            med_out, tgt, hyst);
+        }
+        else {
+          targetPump = false;
+          reasonSet(out, "[Setpoint] t_out_med=%.1f < (%.1f-%.1f) -> tank cold, heater only",
+            med_out, tgt, hyst);
+        }
+      }
+      else {
+        if (delta_tank_out > DELTA_ON) {
+          targetHeat = true;
+          targetPump = true;
+          reasonSet(out, "[Setpoint] t_out_med=%.1f < (%.1f-%.1f) -> surplus tank heat available, heater + pump",
+            med_out, tgt, hyst);
+        }
+        else {
+          targetHeat = true;
+          targetPump = false;
+          reasonSet(out, "[Setpoint] t_out_med=%.1f < (%.1f-%.1f) -> prioritize heater",
+            med_out, tgt, hyst);
+        }
+      }
+    }
+  }
+  else if (bathHigh) {
+    targetHeat = false;
+    targetPump = false;
+    reasonSet(out, "[Setpoint] t_out_med=%.1f > (%.1f+%.1f) -> cooling down", med_out, tgt, hyst);
+  }
+  else if (bathOk) {
+    targetHeat = false;
+    if (tankValid && (delta_tank_out > DELTA_ON)) {
+      targetPump = true;
+      reasonSet(out, "[Setpoint] |t_out_med-%.1f| <= %.1f and tank is warmer -> gentle pump assist",
+        tgt, hyst);
+    }
+    else {
+      targetPump = false;
+      reasonSet(out, "[Setpoint] |t_out_med-%.1f| <= %.1f -> hold temperature", tgt, hyst);
+    }
+  }
+
+  if (isManualLockActive(st.heaterManualUntilMs, in.nowMs)) {
+    targetHeat = st.heaterOn;
+    reasonAdd(out, " | heater manual lock active");
+  }
+  if (isManualLockActive(st.pumpManualUntilMs, in.nowMs)) {
+    targetPump = st.pumpOn;
+    reasonAdd(out, " | pump manual lock active");
+  }
+
+  applyTankSafetyCheck(st, tankValid, tankOver, targetHeat, out, in.nowMs);
+  applyTankBathDeltaSafety(st, tankValid, delta_tank_out, deltaSafetyLimit,
+    targetHeat, targetPump, out, in.nowMs);
+
+  applyHeaterPumpTargets(p, st, targetHeat, targetPump, false, out, in.nowMs);
+}
+
+// n-curve mode; also the hard over-temperature path, which forces everything off.
+static void runNCurveCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  float delta_tank_out, bool tankOver, float DELTA_ON, float DELTA_OFF, float deltaSafetyLimit,
+  ControlResult& out) {
+  const float t_in = in.t_in;
+  const float in_min = p.tempLimitInMin;
+  const float in_max = p.tempLimitInMax;
+  const bool tankValid = out.tankValid;
+  float diff_now = t_in - in.med_out;
+  bool targetHeat = false;
+  bool targetPump = false;
+  out.modeTag = "n-curve";
+
+  if (!out.hardCool) {
+    bool bathWantHeat = false;
+
+    if (t_in < in_min) {
+      bathWantHeat = true;
+      reasonSet(out, "t_in %.2f < %.2f -> heat demand", t_in, in_min);
+    }
+    else {
+      float u = 0.0f;
+      if (in_max > in_min) {
+        float t_ref = std::min(std::max(t_in, in_min), in_max);
+        u = (t_ref - in_min) / (in_max - in_min);
+      }
+      const float diff_max = p.tempMaxDiff;
+      const float diff_min = std::max(0.1f, diff_max * 0.02f);
+      float DIFF_THR = diff_min + (diff_max - diff_min) * powf(u, p.inDiffNCurveGamma);
+      bathWantHeat = (diff_now > DIFF_THR);
+
+      reasonSet(out, "diff_now=%.2f %s thr %.2f", diff_now, bathWantHeat ? ">" : "<=", DIFF_THR);
+    }
+
+    targetHeat = bathWantHeat;
+    applyTankSafetyCheck(st, tankValid, tankOver, targetHeat, out, in.nowMs);
+
+    if (tankValid && !targetHeat && !tankOver && (delta_tank_out < DELTA_ON)) {
+      targetHeat = true;
+      reasonAdd(out, " | tank delta=%.1f < delta_on=%.1f -> preheat tank", delta_tank_out, DELTA_ON);
+    }
+
+    bool pumpManualActive = isManualLockActive(st.pumpManualUntilMs, in.nowMs);
+    if (isManualLockActive(st.heaterManualUntilMs, in.nowMs)) {
+      targetHeat = st.heaterOn;
+      reasonAdd(out, " | heater manual lock active");
+    }
+
+    if (!pumpManualActive) {
+      targetPump = false;
+    }
+    else {
+      targetPump = st.pumpOn;
+      reasonAdd(out, " | pump manual lock active");
+    }
+
+    if (!pumpManualActive && tankValid && bathWantHeat && !tankOver) {
+      if (delta_tank_out > DELTA_ON) {
+        targetPump = true;
+        targetHeat = true;
+        reasonAdd(out, " | tank delta=%.1f > delta_on=%.1f -> heater + pump", delta_tank_out, DELTA_ON);
+      }
+      else if (delta_tank_out > DELTA_OFF) {
+        targetPump = st.pumpOn;
+        reasonAdd(out, " | tank delta=%.1f within delta_off..delta_on -> keep pump state", delta_tank_out);
+      }
+      else {
+        targetPump = false;
+        reasonAdd(out, " | tank delta=%.1f < delta_off=%.1f -> heater only", delta_tank_out, DELTA_OFF);
+      }
+    }
+  }
+
+  applyTankBathDeltaSafety(st, tankValid, delta_tank_out, deltaSafetyLimit,
+    targetHeat, targetPump, out, in.nowMs);
+
+  if (out.hardCool) {
+    reasonSet(out, "[SAFETY] Bath temperature %.2f >= %.2f; forcing shutdown of heater and pump",
+      in.med_out, p.tempLimitOutMax);
+  }
+  applyHeaterPumpTargets(p, st, targetHeat, targetPump, out.hardCool, out, in.nowMs);
+}
+
+void runControlCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  AutotuneRequest request, ControlResult& out) {
+  const float med_out = in.med_out;
+  const float t_tank = in.t_tank;
+
+  // Capture previous heater/pump state for adaptive learning.
+  bool prevHeaterOn = st.heaterOn;
+  bool prevPumpOn = st.pumpOn;
+
+  // Tank validity and high-limit checks.
+  bool tankValid = !isnan(t_tank) && (t_tank > -10.0f) && (t_tank < 120.0f);
+  bool tankOver = tankValid && (t_tank >= p.tankTempMax);
+  float delta_tank_out = tankValid ? (t_tank - med_out) : 0.0f; // tank minus bath temperature delta
+
+  // Cached tank safety state for both automatic and manual paths.
+  st.lastTankValid = tankValid;
+  st.lastTankOver = tankOver;
+
+  updateThermalModel(p, st, in, tankValid);
+
+  out.modeTag = "n-curve";
+  out.tankValid = tankValid;
+  out.hardCool = med_out >= p.tempLimitOutMax;   // Hard bath over-temperature protection
+  out.target = bathTarget(p);
+  out.hyst = fmaxf(0.1f, p.bathSetHyst);
+  out.gainsTuned = false;
+  out.tunedGains = p.pid;
+  out.reason[0] = '\0';
+
+  // Adaptive learning: update boost only when the previous cycle was pump-only.
+  // Otherwise decay the learned boost slowly back toward zero.
+  if (!isnan(st.lastToutMed)) {
+    float dT_out = med_out - st.lastToutMed;
+    bool pumpOnlyPrev = (prevPumpOn && !prevHeaterOn);
+    if (pumpOnlyPrev && dT_out < p.pumpProgressMin) {
+      st.pumpDeltaBoost = fminf(p.pumpLearnMax, st.pumpDeltaBoost + p.pumpLearnStepUp);
+    }
+    else {
+      st.pumpDeltaBoost = fmaxf(0.0f, st.pumpDeltaBoost - p.pumpLearnStepDown);
+    }
+  }
+  st.lastToutMed = med_out;
+
+  float DELTA_ON = 0.0f;
+  float DELTA_OFF = 0.0f;
+  computePumpDeltas(p, st.pumpDeltaBoost, in.t_in, DELTA_ON, DELTA_OFF);
+  const float deltaSafetyLimit = fmaxf(5.0f, DELTA_ON * 1.6f + p.pumpHystNom);
+
+  // Relay autotune runs in any mode; requests are handled before the mode branch.
+  if (request == AUTOTUNE_REQUEST_CANCEL && st.autotune.running()) {
+    st.autotune.cancel();
+    st.pid.reset();
+    controlLog("[Autotune] Cancelled");
+  }
+  if (out.hardCool && st.autotune.running()) {
+    st.autotune.cancel();
+    controlLog("[Autotune] Cancelled: bath over temperature limit");
+  }
+  if (request == AUTOTUNE_REQUEST_START && !st.autotune.running()) {
+    if (out.hardCool || !tankValid) {
+      controlLog("[Autotune] Not started: bath over limit or tank reading unavailable");
+    }
+    else {
+      st.autotune.start(out.target, p.autotuneHyst, med_out, in.nowMs);
+      controlLog("[Autotune] Started around %.1f +/- %.2f C", out.target, p.autotuneHyst);
+    }
+  }
+
+  if (!out.hardCool && (p.mode == CONTROL_MODE_PID || st.autotune.running())) {
+    runPidCycle(p, st, in, delta_tank_out, tankOver, deltaSafetyLimit, out);
+    return;
+  }
+  st.pidLastMs = 0;
+
+  // MPC runs once the model is identified, setpoint mode until then.
+  const bool mpcMode = p.mode == CONTROL_MODE_MPC;
+  if (!out.hardCool && mpcMode && st.model.ready() && tankValid && !isnan(in.t_in)) {
+    runMpcCycle(p, st, in, delta_tank_out, tankOver, deltaSafetyLimit, out);
+    return;
+  }
+  if (!out.hardCool && mpcMode) {
+    controlLog("[MPC] Thermal model not ready (%u samples), using setpoint mode",
+      (unsigned)st.model.samples());
+  }
+
+  if (!out.hardCool && (p.mode == CONTROL_MODE_SETPOINT || mpcMode)) {
+    runSetpointCycle(p, st, in, t_tank, delta_tank_out, tankOver, DELTA_ON, deltaSafetyLimit, out);
+    return;
+  }
+
+  // No bath target in n-curve mode.
+  out.target = NAN;
+  out.hyst = 0.0f;
+  runNCurveCycle(p, st, in, delta_tank_out, tankOver, DELTA_ON, DELTA_OFF, deltaSafetyLimit, out);
+}
+
+void controlSafeOff(ControlState& st, unsigned long nowMs) {
+  if (st.heaterOn) st.heaterToggleMs = nowMs;
+  st.heaterOn = false;
+  st.heaterDuty = 0.0f;
+  st.pumpOn = false;
+  st.pumpDuty = 0.0f;
+  st.heaterCut = true;
+  st.pumpCut = true;
+  st.heaterManualUntilMs = 0;
+  st.pumpManualUntilMs = 0;
+  st.modelPrevMs = 0;
+}
+
+void controlEmergency(ControlState& st) {
+  st.heaterOn = false;
+  st.heaterDuty = 0.0f;
+  st.pumpOn = false;
+  st.pumpDuty = 0.0f;
+  if (st.autotune.running()) {
+    st.autotune.cancel();
+    controlLog("[Autotune] Cancelled by emergency stop");
+  }
+  st.pidLastMs = 0;
+  st.modelPrevMs = 0;
+}
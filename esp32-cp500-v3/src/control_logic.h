@@ -0,0 +1,143 @@
+#ifndef CONTROL_LOGIC_H
+#define CONTROL_LOGIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+#include "pid_controller.h"
+#include "thermal_model.h"
+#include "mpc_planner.h"
+
+// Hardware-independent bath control: pump deltas, adaptive learning, tank
+// safety guards, the n-curve / setpoint / PID / MPC decisions and the heater
+// guard times. Plain C++ (no Arduino headers): main.cpp feeds it probe
+// readings and applies the resulting duties to the actuator layer, and the
+// host simulator in sim/ runs the same code against a thermal plant model.
+// Time is whatever millisecond clock the caller passes in (millis() on the
+// device), so guard times and manual locks are rollover-safe the same way.
+
+// control_mode; configs without it fall back to bath_setpoint.enabled.
+enum ControlMode : uint8_t {
+  CONTROL_MODE_NCURVE = 0,
+  CONTROL_MODE_SETPOINT,
+  CONTROL_MODE_PID,
+  CONTROL_MODE_MPC
+};
+
+enum AutotuneRequest : uint8_t {
+  AUTOTUNE_REQUEST_NONE = 0,
+  AUTOTUNE_REQUEST_START,
+  AUTOTUNE_REQUEST_CANCEL
+};
+
+static const unsigned long MANUAL_LOCK_FOREVER = 0xFFFFFFFFUL;
+
+// The AppConfig fields the control decisions read.
+struct ControlParams {
+  ControlMode mode;
+  uint32_t postInterval;     // ms
+  float tempMaxDiff;
+  float tempLimitOutMax;
+  float tempLimitInMax;
+  float tempLimitInMin;
+  float tankTempMax;
+  uint32_t heaterMinOnMs;
+  uint32_t heaterMinOffMs;
+  float pumpDeltaOnMin;
+  float pumpDeltaOnMax;
+  float pumpHystNom;
+  float pumpNCurveGamma;
+  float pumpLearnStepUp;
+  float pumpLearnStepDown;
+  float pumpLearnMax;
+  float pumpProgressMin;
+  float inDiffNCurveGamma;
+  float bathSetTarget;
+  float bathSetHyst;
+  PidGains pid;
+  float autotuneHyst;
+  uint32_t mpcHorizonS;
+  float mpcEnergyWeight;
+  float mpcOvershootWeight;
+};
+
+// Everything the control keeps between cycles. heaterDuty / pumpDuty are
+// the commanded outputs (0..100 %); heaterOn / pumpOn mean duty > 0.
+// Manual commands write the on/duty fields and the lock deadlines directly.
+struct ControlState {
+  bool heaterOn = false;
+  bool pumpOn = false;
+  float heaterDuty = 0.0f;
+  float pumpDuty = 0.0f;
+  unsigned long heaterToggleMs = 0;         // Last heater on/off change
+  unsigned long heaterManualUntilMs = 0;    // 0 = no lock
+  unsigned long pumpManualUntilMs = 0;
+  bool heaterCut = false;                   // Safety shutoff: the caller cuts the relay
+  bool pumpCut = false;                     // now, past its min on-time, and clears this
+
+  bool lastTankValid = false;               // Also checked by the manual heater command
+  bool lastTankOver = false;
+
+  float pumpDeltaBoost = 0.0f;              // n-curve learned compensation
+  float lastToutMed = NAN;                  // Previous bath median for learning
+
+  BathPid pid;
+  RelayAutotune autotune;
+  unsigned long pidLastMs = 0;              // Previous PID/autotune sample, 0 = none
+
+  ThermalModel model;                       // Learned every cycle, used by MPC
+  ThermalState modelPrev = {};
+  unsigned long modelPrevMs = 0;            // Previous model sample, 0 = none
+  MpcPlan lastPlan = {};
+  bool planValid = false;
+};
+
+struct ControlSample {
+  float t_in;          // Internal loop probe (NAN if missing)
+  float t_tank;        // Tank probe (NAN if missing)
+  float med_out;       // Filtered bath median, must be valid
+  unsigned long nowMs;
+};
+
+static const size_t CONTROL_REASON_MAX = 192;
+
+struct ControlResult {
+  const char* modeTag;   // "n-curve", "Setpoint", "PID", "Autotune", "MPC"
+  bool tankValid;
+  bool hardCool;         // Bath at temp_limitout_max: everything forced off
+  float target;          // Bath target of the mode, NAN for n-curve
+  float hyst;
+  bool gainsTuned;       // Autotune finished in this cycle; tunedGains are in effect
+  PidGains tunedGains;   // The caller copies them into its config and saves it
+  char reason[CONTROL_REASON_MAX];
+};
+
+// Optional sink for the control's log lines (Serial on the device).
+typedef void (*ControlLogFn)(const char* line);
+void setControlLogger(ControlLogFn fn);
+
+// Bath median with range filtering and optional outlier rejection around a
+// first median estimate; NAN when nothing valid remains.
+float median(const std::vector<float>& values, float minValid, float maxValid, float outlierThreshold);
+
+bool isManualLockActive(unsigned long lockUntilMs, unsigned long nowMs);
+
+// Adaptive pump on/off deltas from t_in within the configured range.
+void computePumpDeltas(const ControlParams& p, float pumpDeltaBoost, float t_in,
+  float& delta_on, float& delta_off);
+
+// One control cycle: learning, mode decision, safety guards, heater guard
+// times. Updates st.heaterDuty / st.pumpDuty for the caller to apply.
+void runControlCycle(const ControlParams& p, ControlState& st, const ControlSample& in,
+  AutotuneRequest request, ControlResult& out);
+
+// Bath probes failed: heater and pump cut, manual locks released, model
+// sample history restarted.
+void controlSafeOff(ControlState& st, unsigned long nowMs);
+
+// Emergency stop: the outputs were already cut by the emergency path; drop
+// the state that must not carry over (autotune, PID and model history).
+void controlEmergency(ControlState& st);
+
+#endif
@@ -1,5 +1,5 @@
 #include "emergency_stop.h"
-#include "sensor.h"
+#include "actuator.h"
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 
@@ -42,13 +42,10 @@ void activateEmergencyStop() {
     if (oldState != EMERGENCY_STATE_STOPPED) {
       Serial.println("[Emergency] Shutting down all actuators...");
 
-      heaterOff();
+      // One call: relay cycles and the aeration ramp are cancelled with the outputs.
+      actuatorStopAll();
       Serial.println("[Emergency]   - Heater off");
-
-      pumpOff();
       Serial.println("[Emergency]   - Pump off");
-
-      aerationOff();
       Serial.println("[Emergency]   - Aeration off");
 
       Serial.println("[Emergency] System locked until resume command");
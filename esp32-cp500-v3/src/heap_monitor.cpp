@@ -0,0 +1,42 @@
+#include "heap_monitor.h"
+
+#if HEAP_MONITOR_ENABLED
+
+static TaskHandle_t gMeasureTask = nullptr;
+static TaskHandle_t gCommandTask = nullptr;
+static bool gHeapReported = false;
+static unsigned long gLastHeapReportMs = 0;
+
+void heapMonitorSetTasks(TaskHandle_t measureTask, TaskHandle_t commandTask) {
+  gMeasureTask = measureTask;
+  gCommandTask = commandTask;
+}
+
+void sampleHeapStats(HeapStats& stats) {
+  stats.freeHeap = ESP.getFreeHeap();
+  stats.largestBlock = ESP.getMaxAllocHeap();
+  stats.minFreeHeap = ESP.getMinFreeHeap();
+  stats.fragmentation = stats.freeHeap > 0
+    ? (uint8_t)(100 - (uint64_t)stats.largestBlock * 100 / stats.freeHeap)
+    : 0;
+  // ESP-IDF reports stack high-water marks in bytes.
+  stats.measureStack = gMeasureTask ? uxTaskGetStackHighWaterMark(gMeasureTask) : 0;
+  stats.commandStack = gCommandTask ? uxTaskGetStackHighWaterMark(gCommandTask) : 0;
+}
+
+bool takeHeapStatsIfDue(uint32_t intervalMs, HeapStats& stats) {
+  if (intervalMs == 0) return false;
+
+  unsigned long nowMs = millis();
+  if (gHeapReported && nowMs - gLastHeapReportMs < intervalMs) return false;
+
+  gHeapReported = true;
+  gLastHeapReportMs = nowMs;
+  sampleHeapStats(stats);
+  Serial.printf("[Heap] free=%u largest=%u min=%u frag=%u%% stack(measure=%u command=%u)\n",
+    (unsigned)stats.freeHeap, (unsigned)stats.largestBlock, (unsigned)stats.minFreeHeap,
+    (unsigned)stats.fragmentation, (unsigned)stats.measureStack, (unsigned)stats.commandStack);
+  return true;
+}
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Heap and task-stack health sampling, appended to telemetry every
+// heap_report_interval ms. Build with -DHEAP_MONITOR_ENABLED=0 to compile it out.
+#ifndef HEAP_MONITOR_ENABLED
+#define HEAP_MONITOR_ENABLED 1
+#endif
+
+struct HeapStats {
+  uint32_t freeHeap = 0;       // Current free heap (bytes)
+  uint32_t largestBlock = 0;   // Largest allocatable block (bytes)
+  uint32_t minFreeHeap = 0;    // Lowest free heap since boot (bytes)
+  uint8_t fragmentation = 0;   // 100 - largest block / free heap (%)
+  uint32_t measureStack = 0;   // MeasureTask stack high-water mark (bytes left)
+  uint32_t commandStack = 0;   // CommandTask stack high-water mark (bytes left)
+};
+
+#if HEAP_MONITOR_ENABLED
+
+void heapMonitorSetTasks(TaskHandle_t measureTask, TaskHandle_t commandTask);
+void sampleHeapStats(HeapStats& stats);
+// Samples and returns true once every intervalMs; intervalMs == 0 disables reporting.
+bool takeHeapStatsIfDue(uint32_t intervalMs, HeapStats& stats);
+
+#else
+
+inline void heapMonitorSetTasks(TaskHandle_t, TaskHandle_t) {}
+inline void sampleHeapStats(HeapStats&) {}
+inline bool takeHeapStatsIfDue(uint32_t, HeapStats&) { return false; }
+
+#endif
+
+#endif
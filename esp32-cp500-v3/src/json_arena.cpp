@@ -0,0 +1,111 @@
+#include "json_arena.h"
+
+// Every block carries an 8-byte header so reallocate() knows the old size
+// and the payload stays 8-byte aligned for double-sized JSON values.
+struct ArenaBlockHeader {
+  uint32_t size;
+  uint32_t reserved;
+};
+
+static inline size_t alignArena(size_t n) {
+  return (n + 7) & ~(size_t)7;
+}
+
+static inline ArenaBlockHeader* headerOf(void* ptr) {
+  return reinterpret_cast<ArenaBlockHeader*>(static_cast<uint8_t*>(ptr) - sizeof(ArenaBlockHeader));
+}
+
+JsonArena::JsonArena(const char* name, uint8_t* buffer, size_t capacity)
+  : _name(name), _buffer(buffer), _capacity(capacity), _top(0), _live(0),
+    _highWater(0), _reportedHighWater(0), _failures(0) {}
+
+void JsonArena::noteUsage() {
+  if (_top <= _highWater) return;
+  _highWater = _top;
+  // Only report growth in 256-byte steps to keep the log quiet.
+  if (_highWater >= _reportedHighWater + 256 || _reportedHighWater == 0) {
+    _reportedHighWater = _highWater;
+    Serial.printf("[JSON] %s arena high-water %u/%u bytes\n",
+      _name, (unsigned)_highWater, (unsigned)_capacity);
+  }
+}
+
+void* JsonArena::allocate(size_t size) {
+  size_t total = sizeof(ArenaBlockHeader) + alignArena(size);
+  if (total > _capacity - _top) {
+    _failures++;
+    Serial.printf("[JSON] %s arena exhausted (%u bytes requested, %u/%u used)\n",
+      _name, (unsigned)size, (unsigned)_top, (unsigned)_capacity);
+    return nullptr;
+  }
+
+  ArenaBlockHeader* hdr = reinterpret_cast<ArenaBlockHeader*>(_buffer + _top);
+  hdr->size = (uint32_t)size;
+  hdr->reserved = 0;
+  _top += total;
+  _live++;
+  noteUsage();
+  return hdr + 1;
+}
+
+void JsonArena::deallocate(void* ptr) {
+  if (!ptr) return;
+
+  ArenaBlockHeader* hdr = headerOf(ptr);
+  size_t start = (uint8_t*)hdr - _buffer;
+  // The most recent block can be given back directly; anything else waits
+  // until the whole document is released.
+  if (start + sizeof(ArenaBlockHeader) + alignArena(hdr->size) == _top) {
+    _top = start;
+  }
+  if (_live > 0) _live--;
+  if (_live == 0) _top = 0;
+}
+
+void* JsonArena::reallocate(void* ptr, size_t newSize) {
+  if (!ptr) return allocate(newSize);
+
+  ArenaBlockHeader* hdr = headerOf(ptr);
+  size_t start = (uint8_t*)hdr - _buffer;
+  size_t oldSize = hdr->size;
+
+  // Last block: grow or shrink in place.
+  if (start + sizeof(ArenaBlockHeader) + alignArena(oldSize) == _top) {
+    size_t total = sizeof(ArenaBlockHeader) + alignArena(newSize);
+    if (total > _capacity - start) {
+      _failures++;
+      Serial.printf("[JSON] %s arena exhausted (%u bytes requested, %u/%u used)\n",
+        _name, (unsigned)newSize, (unsigned)_top, (unsigned)_capacity);
+      return nullptr;
+    }
+    hdr->size = (uint32_t)newSize;
+    _top = start + total;
+    noteUsage();
+    return ptr;
+  }
+
+  // Older block shrinking: keep it where it is.
+  if (newSize <= oldSize) {
+    hdr->size = (uint32_t)newSize;
+    return ptr;
+  }
+
+  void* moved = allocate(newSize);
+  if (!moved) return nullptr;
+  memcpy(moved, ptr, oldSize);
+  deallocate(ptr);
+  return moved;
+}
+
+alignas(8) static uint8_t gTelemetryArenaBuf[JSON_DOC_SIZE];
+alignas(8) static uint8_t gMqttArenaBuf[JSON_DOC_SIZE];
+
+JsonArena& telemetryJsonArena() {
+  static JsonArena arena("telemetry", gTelemetryArenaBuf, sizeof(gTelemetryArenaBuf));
+  return arena;
+}
+
+JsonArena& mqttJsonArena() {
+  static JsonArena arena("mqtt", gMqttArenaBuf, sizeof(gMqttArenaBuf));
+  return arena;
+}
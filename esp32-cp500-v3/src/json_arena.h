@@ -0,0 +1,45 @@
+#ifndef JSON_ARENA_H
+#define JSON_ARENA_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+static const size_t JSON_DOC_SIZE = 3072;      // Per-task JSON arena size (telemetry incl. heap channels)
+
+// Fixed-capacity ArduinoJson allocator backed by a static buffer.
+// Blocks are bumped from the front of the buffer; the arena rewinds to empty
+// once every block has been released, i.e. when the JsonDocument is destroyed.
+// Each arena belongs to exactly one task and is not locked.
+class JsonArena : public ArduinoJson::Allocator {
+public:
+  JsonArena(const char* name, uint8_t* buffer, size_t capacity);
+
+  void* allocate(size_t size) override;
+  void deallocate(void* ptr) override;
+  void* reallocate(void* ptr, size_t newSize) override;
+
+  const char* name() const { return _name; }
+  size_t capacity() const { return _capacity; }
+  size_t used() const { return _top; }
+  size_t highWater() const { return _highWater; }
+  uint32_t failures() const { return _failures; }
+
+private:
+  void noteUsage();
+
+  const char* _name;
+  uint8_t* _buffer;
+  size_t _capacity;
+  size_t _top;
+  size_t _live;
+  size_t _highWater;
+  size_t _reportedHighWater;
+  uint32_t _failures;
+};
+
+// MeasureTask: telemetry document.
+JsonArena& telemetryJsonArena();
+// Arduino loop task: MQTT callback and boot payload (both run there).
+JsonArena& mqttJsonArena();
+
+#endif
@@ -4,7 +4,7 @@
  *
  * High-level behavior:
  * - Read bath outlet, internal loop, and tank temperatures.
- * - Support n-curve and setpoint control modes.
+ * - Support n-curve, setpoint, PID (with relay autotune) and MPC control modes.
  * - Coordinate heater, pump, and aeration with tank safety guards.
  * - Accept MQTT commands, config updates, and emergency-stop input.
  * - Prefer online operation, while keeping local control as the fallback path.
@@ -18,7 +18,17 @@
 #include "config_manager.h"
 #include "wifi_ntp_mqtt.h"
 #include "sensor.h"
+#include "actuator.h"
 #include "emergency_stop.h"
+#include "json_arena.h"
+#include "heap_monitor.h"
+#include "phase_timer.h"
+#include "task_wake.h"
+#include "command_queue.h"
+#include "mqtt_outbox.h"
+#include "telemetry_queue.h"
+#include "telemetry_batch.h"
+#include "control_logic.h"
 #include <ArduinoJson.h>
 #include <vector>
 #include <algorithm>
@@ -27,7 +37,6 @@
 #include "freertos/semphr.h"
 
  // ========================= Constants =========================
-static const size_t JSON_DOC_SIZE = 2048;      // Shared JSON document size
 static const float TEMP_VALID_MIN = -20.0f;    // Lower bound for valid temperatures
 static const float TEMP_VALID_MAX = 100.0f;    // Upper bound for valid temperatures
 static const size_t MAX_OUT_SENSORS = 3;       // Maximum number of bath outlet probes
@@ -41,106 +50,110 @@ static unsigned long prevMeasureMs = 0;                  // Measurement schedule
 static unsigned long preAerationMs = 0;                  // Aeration scheduler baseline (ms)
 
 // ========================= Command and publish queues =========================
-struct PendingCommand {
-  String cmd;                 // "aeration" / "heater" / "pump" / "config_update"
-  String action;              // "on" / "off" / "auto"
-  unsigned long duration;     // Requested duration in ms, 0 means no auto-off
-  unsigned long targetTimeMs; // Scheduled execution time in millis()
-};
-std::vector<PendingCommand> pendingCommands;
-
-struct PendingPublish {
-  String topic;
-  String payload;
-  time_t sampleEpoch;
-};
-static std::vector<PendingPublish> pendingTelemetryPublishes;
-static const size_t MAX_PENDING_TELEMETRY = 12;
+static CommandQueue gCommandQueue;   // Guarded by gCmdMutex
+
+// MeasureTask -> network task. Only the network task (the Arduino loop task)
+// touches the PubSubClient; everything below is owned by it.
+static MqttOutbox gTelemetryOutbox;
+static TelemetryQueue gTelemetryRetry;                  // Failed telemetry, RAM front + flash ring
+static const uint8_t TELEMETRY_FLUSH_PER_PASS = 5;     // Retries published per loop pass
+static time_t gLastSavedMeasEpoch = 0;                 // Newest epoch written to NVS lastMeas
+static TelemetryBatch gTelemetryBatch;                 // Samples awaiting telemetry/batch (MeasureTask only)
 
 // ===== Queue mutexes =====
 SemaphoreHandle_t gCmdMutex = nullptr;
-SemaphoreHandle_t gPublishMutex = nullptr;
+
+// ===== Task handles, for wakeTask() =====
+static TaskHandle_t gMeasureTask = nullptr;
+static TaskHandle_t gCommandTask = nullptr;
+static TaskHandle_t gNetTask = nullptr;                     // Arduino loop task
+static const unsigned long NET_TASK_POLL_MS = 100;          // PubSubClient keepalive and inbound poll
+static const unsigned long TASK_MAX_SLEEP_MS = 60000;      // Longest sleep with nothing due
+static const unsigned long TEMP_PREFETCH_SLACK_MS = 100;   // Extra lead for the DS18B20 prefetch
 static bool gBootPayloadPending = false;
 static String gPendingBootPayload;
 
-// ========================= Debounce and manual locks =========================
-static unsigned long heaterToggleMs = 0;        // Last heater state change time
+// ========================= Manual locks =========================
 static unsigned long aerationManualUntilMs = 0; // Manual aeration lock deadline
-static unsigned long pumpManualUntilMs = 0;     // Manual pump lock deadline
-static unsigned long heaterManualUntilMs = 0;   // Manual heater lock deadline
-static const unsigned long MANUAL_LOCK_FOREVER = 0xFFFFFFFFUL;
+// Heater and pump locks live in gControl.
+
+// ========================= Diagnostics =========================
+static uint8_t gPhaseCycle = PHASE_ID_INVALID;    // Whole doMeasurementAndSave
+static uint8_t gPhaseProbes = PHASE_ID_INVALID;   // OneWire conversion and reads
+static uint8_t gPhaseMedian = PHASE_ID_INVALID;   // Bath outlet median filter
+static uint8_t gPhaseControl = PHASE_ID_INVALID;  // Learning, mode logic, actuator outputs
+static uint8_t gPhasePublish = PHASE_ID_INVALID;  // Telemetry JSON and MQTT publish
+static volatile bool gDiagRequested = false;      // Set by the diag command
+static unsigned long gLastDiagMs = 0;
+static char gDiagPayload[JSON_DOC_SIZE];          // Serialized diag payload (loop task only)
 
 // ========================= Runtime device state =========================
-bool heaterIsOn = false;
-bool pumpIsOn = false;
 bool aerationIsOn = false;
 
-// ========================= Cached tank safety state =========================
-static bool gLastTankValid = false;
-static bool gLastTankOver = false;
-
-// ========================= Utility: median with filtering =========================
-// The input vector is passed by value so filtering and sorting do not affect callers.
-float median(const std::vector<float>& values,
-  float minValid = TEMP_VALID_MIN,
-  float maxValid = TEMP_VALID_MAX,
-  float outlierThreshold = -1.0f) {
-  // Step 1: discard invalid samples.
-  std::vector<float> filtered = values;
-  filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](float v) {
-    return isnan(v) || v < minValid || v > maxValid;
-    }), filtered.end());
-
-  if (filtered.empty()) return NAN;
-
-  // Step 2: optionally remove outliers around the first median estimate.
-  if (outlierThreshold > 0) {
-    std::sort(filtered.begin(), filtered.end());
-    size_t mid = filtered.size() / 2;
-    float med0 = (filtered.size() % 2 == 0)
-      ? (filtered[mid - 1] + filtered[mid]) / 2.0f
-      : filtered[mid];
-
-    filtered.erase(std::remove_if(filtered.begin(), filtered.end(), [&](float v) {
-      return fabsf(v - med0) > outlierThreshold;
-      }), filtered.end());
-
-    if (filtered.empty()) return NAN;
-  }
-
-  // Step 3: compute the final median after filtering.
-  std::sort(filtered.begin(), filtered.end());
-  size_t mid = filtered.size() / 2;
-  return (filtered.size() % 2 == 0)
-    ? (filtered[mid - 1] + filtered[mid]) / 2.0f
-    : filtered[mid];
-}
-
-// ========================= Adaptive pump-only threshold state =========================
-static float gPumpDeltaBoost = 0.0f;  // Learned compensation, clamped by appConfig.pumpLearnMax
-static float gLastToutMed = NAN;      // Previous bath median used by adaptive learning
+// Heater/pump control state: outputs, guard times, manual locks, learning,
+// PID/autotune and the thermal model (control_logic.h). Written by
+// MeasureTask, and by executeCommand for the manual heater/pump commands.
+static ControlState gControl;
+static volatile AutotuneRequest gAutotuneRequest = AUTOTUNE_REQUEST_NONE;   // Set by the autotune command
 
-inline float lerp_f(float a, float b, float t) { return a + (b - a) * t; }
+static void logControlLine(const char* line) {
+  Serial.println(line);
+}
 
-// Returns true while the manual lock is still active.
-// Subtraction is used instead of addition so millis() rollover stays safe.
-static inline bool isManualLockActive(unsigned long lockUntilMs) {
-  if (lockUntilMs == 0) return false;
-  if (lockUntilMs == MANUAL_LOCK_FOREVER) return true;
-  unsigned long nowMs = millis();
-  return (lockUntilMs - nowMs) < 0x80000000UL;
+// The appConfig fields the control logic reads, as one struct per cycle.
+static ControlParams controlParamsFromConfig() {
+  ControlParams p;
+  p.mode = appConfig.controlMode;
+  p.postInterval = appConfig.postInterval;
+  p.tempMaxDiff = (float)appConfig.tempMaxDiff;
+  p.tempLimitOutMax = (float)appConfig.tempLimitOutMax;
+  p.tempLimitInMax = (float)appConfig.tempLimitInMax;
+  p.tempLimitInMin = (float)appConfig.tempLimitInMin;
+  p.tankTempMax = appConfig.tankTempMax;
+  p.heaterMinOnMs = appConfig.heaterMinOnMs;
+  p.heaterMinOffMs = appConfig.heaterMinOffMs;
+  p.pumpDeltaOnMin = appConfig.pumpDeltaOnMin;
+  p.pumpDeltaOnMax = appConfig.pumpDeltaOnMax;
+  p.pumpHystNom = appConfig.pumpHystNom;
+  p.pumpNCurveGamma = appConfig.pumpNCurveGamma;
+  p.pumpLearnStepUp = appConfig.pumpLearnStepUp;
+  p.pumpLearnStepDown = appConfig.pumpLearnStepDown;
+  p.pumpLearnMax = appConfig.pumpLearnMax;
+  p.pumpProgressMin = appConfig.pumpProgressMin;
+  p.inDiffNCurveGamma = appConfig.inDiffNCurveGamma;
+  p.bathSetTarget = appConfig.bathSetTarget;
+  p.bathSetHyst = appConfig.bathSetHyst;
+  p.pid = { appConfig.pidKp, appConfig.pidKi, appConfig.pidKd, appConfig.pidKff };
+  p.autotuneHyst = appConfig.pidAutotuneHyst;
+  p.mpcHorizonS = appConfig.mpcHorizonS;
+  p.mpcEnergyWeight = appConfig.mpcEnergyWeight;
+  p.mpcOvershootWeight = appConfig.mpcOvershootWeight;
+  return p;
 }
 
-static void removePendingCommandsForDeviceLocked(const String& what) {
-  pendingCommands.erase(
-    std::remove_if(pendingCommands.begin(), pendingCommands.end(),
-      [&](const PendingCommand& cmd) { return cmd.cmd == what; }),
-    pendingCommands.end());
+// Hands the duties the control decided to the actuator layer. Unchanged
+// duties are skipped so a running slow-PWM window is left alone; safety
+// shutoffs cut the relay without waiting for its min on-time.
+static void applyControlOutputs() {
+  if (gControl.heaterCut) {
+    actuatorCutNow(ACTUATOR_HEATER);
+    gControl.heaterCut = false;
+  }
+  else if (gControl.heaterDuty != actuatorDuty(ACTUATOR_HEATER)) {
+    actuatorSetDuty(ACTUATOR_HEATER, gControl.heaterDuty);
+  }
+  if (gControl.pumpCut) {
+    actuatorCutNow(ACTUATOR_PUMP);
+    gControl.pumpCut = false;
+  }
+  else if (gControl.pumpDuty != actuatorDuty(ACTUATOR_PUMP)) {
+    actuatorSetDuty(ACTUATOR_PUMP, gControl.pumpDuty);
+  }
 }
 
-static void clearPendingCommandsForDevice(const String& what) {
+static void clearPendingCommandsForDevice(CommandDevice device) {
   if (gCmdMutex && xSemaphoreTake(gCmdMutex, pdMS_TO_TICKS(200))) {
-    removePendingCommandsForDeviceLocked(what);
+    gCommandQueue.cancelDevice(device);
     xSemaphoreGive(gCmdMutex);
   }
 }
@@ -149,10 +162,6 @@ static unsigned long computeManualLockUntil(unsigned long duration) {
   return duration > 0 ? millis() + duration : MANUAL_LOCK_FOREVER;
 }
 
-static bool isSupportedActionForDevice(const String& action) {
-  return action == "on" || action == "off" || action == "auto";
-}
-
 static void publishPendingBootPayloadIfNeeded() {
   if (!gBootPayloadPending || gPendingBootPayload.length() == 0) {
     return;
@@ -163,7 +172,7 @@ static void publishPendingBootPayloadIfNeeded() {
     return;
   }
 
-  bool ok = publishData(getRegisterTopic(), gPendingBootPayload, 5000);
+  bool ok = publishOnce(getRegisterTopic().c_str(), gPendingBootPayload.c_str(), gPendingBootPayload.length());
   if (ok) {
     Serial.println("[MQTT] Deferred boot payload published");
     gBootPayloadPending = false;
@@ -174,237 +183,60 @@ static void publishPendingBootPayloadIfNeeded() {
   }
 }
 
-static bool enqueueTelemetryPublish(const String& topic, const String& payload, time_t sampleEpoch) {
-  if (!gPublishMutex || !xSemaphoreTake(gPublishMutex, pdMS_TO_TICKS(200))) {
-    Serial.println("[MQTT] Telemetry queue busy, dropping sample");
-    return false;
+// Records the newest delivered sample so a reboot resumes the measurement
+// schedule from it. Uses its own handle: the network task must not share
+// the global Preferences with MeasureTask.
+// Backlog samples are older than live ones, so only a newer epoch is saved.
+static void saveLastMeasEpoch(time_t sampleEpoch) {
+  if (sampleEpoch <= gLastSavedMeasEpoch) return;
+  Preferences prefs;
+  if (prefs.begin(NVS_NAMESPACE, false)) {
+    prefs.putULong(NVS_KEY_LAST_MEAS, sampleEpoch);
+    prefs.end();
+    gLastSavedMeasEpoch = sampleEpoch;
   }
-
-  if (pendingTelemetryPublishes.size() >= MAX_PENDING_TELEMETRY) {
-    pendingTelemetryPublishes.erase(pendingTelemetryPublishes.begin());
-    Serial.println("[MQTT] Telemetry queue full, dropped oldest sample");
-  }
-
-  pendingTelemetryPublishes.push_back({ topic, payload, sampleEpoch });
-  size_t queuedCount = pendingTelemetryPublishes.size();
-  xSemaphoreGive(gPublishMutex);
-
-  Serial.printf("[MQTT] Telemetry queued for retry (%u pending)\n", (unsigned)queuedCount);
-  return true;
 }
 
+// Network task only; a few records per loop pass so commands stay responsive.
 static void flushPendingTelemetryIfNeeded() {
-  PubSubClient& mqtt = getMQTTClient();
-  if (!mqtt.connected()) {
+  if (gTelemetryRetry.size() == 0 || !getMQTTClient().connected()) {
     return;
   }
 
-  PendingPublish next;
-  bool hasPending = false;
-  if (gPublishMutex && xSemaphoreTake(gPublishMutex, pdMS_TO_TICKS(200))) {
-    if (!pendingTelemetryPublishes.empty()) {
-      next = pendingTelemetryPublishes.front();
-      hasPending = true;
+  PendingTelemetry next;
+  for (uint8_t i = 0; i < TELEMETRY_FLUSH_PER_PASS && gTelemetryRetry.peek(next); i++) {
+    if (!publishOnce(next.topic.c_str(), next.payload.c_str(), next.payload.length())) {
+      Serial.println("[MQTT] Pending telemetry publish failed, will retry later");
+      return;
     }
-    xSemaphoreGive(gPublishMutex);
+    saveLastMeasEpoch(next.sampleEpoch);
+    gTelemetryRetry.pop();
   }
-
-  if (!hasPending) {
-    return;
-  }
-
-  bool ok = publishData(next.topic, next.payload, 3000);
-  if (!ok) {
-    Serial.println("[MQTT] Pending telemetry publish failed, will retry later");
-    return;
-  }
-
-  if (gPublishMutex && xSemaphoreTake(gPublishMutex, pdMS_TO_TICKS(200))) {
-    if (!pendingTelemetryPublishes.empty() &&
-      pendingTelemetryPublishes.front().topic == next.topic &&
-      pendingTelemetryPublishes.front().payload == next.payload) {
-      pendingTelemetryPublishes.erase(pendingTelemetryPublishes.begin());
-    }
-    xSemaphoreGive(gPublishMutex);
-  }
-
-  if (next.sampleEpoch > 0 && preferences.begin(NVS_NAMESPACE, false)) {
-    preferences.putULong(NVS_KEY_LAST_MEAS, next.sampleEpoch);
-    preferences.end();
-  }
-
-  Serial.println("[MQTT] Pending telemetry published");
-}
-
-// 公共函数：Tank 温度安全检查
-// 如果 Tank 温度无效或过高，强制关闭加热器并阻止自动开启
-// 返回值：true 表示加热被阻止
-// Tank safety guard for invalid or over-limit readings.
-// If tank temperature is invalid or too high, block heating and force the heater off.
-static bool applyTankSafetyCheck(bool tankValid, bool tankOver, bool& targetHeat, String& reason) {
-  bool heatBlocked = false;
-
-  if (!tankValid || tankOver) {
-    if (targetHeat) {
-      reason += " | tank invalid/over-limit: force heater off";
-    }
-    targetHeat = false;
-    heatBlocked = true;
-
-    if (heaterIsOn) {
-      heaterOff();
-      heaterIsOn = false;
-      heaterToggleMs = millis();
-      Serial.println("[SAFETY] Tank temperature invalid or over limit, forcing heater off");
-    }
-  }
-
-  return heatBlocked;
-}
-
-// Tank-to-bath delta safety guard.
-// If the delta is too large, stop heating and force circulation.
-static bool applyTankBathDeltaSafety(bool tankValid, float delta_tank_out,
-  float delta_limit, bool& targetHeat, bool& targetPump, String& reason) {
-  if (!tankValid) return false;
-  if (delta_tank_out < delta_limit) return false;
-
-  if (targetHeat) {
-    reason += " | tank-bath delta too large: stop heating and force pump";
-  }
-  else {
-    reason += " | tank-bath delta too large: force pump";
-  }
-  targetHeat = false;
-  targetPump = true;
-  heaterManualUntilMs = 0;
-
-  if (heaterIsOn) {
-    heaterOff();
-    heaterIsOn = false;
-    heaterToggleMs = millis();
-    Serial.printf("[SAFETY] Tank-bath delta too large (%.1f >= %.1f), forcing heater off\n",
-      delta_tank_out, delta_limit);
-  }
-  return true;
+  Serial.printf("[MQTT] Pending telemetry published (%lu left)\n", (unsigned long)gTelemetryRetry.size());
 }
 
-// Compute adaptive pump on/off deltas from t_in within the configured range.
-static void computePumpDeltas(float t_in, float in_min, float in_max,
-  float& delta_on, float& delta_off) {
-  auto clamp = [](float v, float lo, float hi) {
-    return v < lo ? lo : (v > hi ? hi : v);
-    };
-  const float MAX_ALLOWED = appConfig.pumpDeltaOnMax + appConfig.pumpLearnMax;
-
-  // Convert the nominal hysteresis in C into a ratio relative to delta_on.
-  const float mid_on = 0.5f * (appConfig.pumpDeltaOnMin + appConfig.pumpDeltaOnMax);
-  const float hyst_rat = (mid_on > 0.1f) ? (appConfig.pumpHystNom / mid_on) : 0.2f;
-
-  auto dyn_off = [&](float on) {   // Compute adaptive delta_off from delta_on
-    float hyst = hyst_rat * on;    // hysteresis = ratio * delta_on
-    return fmaxf(0.5f, on - hyst); // Keep delta_off above 0.5 C
-    };
-
-  // Fall back when the normalization range is invalid.
-  if (!isfinite(in_min) || !isfinite(in_max) || in_max <= in_min) {
-    delta_on = clamp(appConfig.pumpDeltaOnMin + gPumpDeltaBoost,
-      appConfig.pumpDeltaOnMin, MAX_ALLOWED);
-    delta_off = dyn_off(delta_on);
+// Completion callback for telemetry, run by the network task.
+static void onTelemetryPublished(const OutboxMessage& msg, bool published) {
+  if (published) {
+    saveLastMeasEpoch(msg.sampleEpoch);
     return;
   }
-
-  // Clamp to the low/high edge outside the configured range.
-  if (t_in < in_min) {
-    delta_on = clamp(appConfig.pumpDeltaOnMin + gPumpDeltaBoost,
-      appConfig.pumpDeltaOnMin, MAX_ALLOWED);
-    delta_off = dyn_off(delta_on);
-    return;
-  }
-  if (t_in > in_max) {
-    delta_on = clamp(appConfig.pumpDeltaOnMax + gPumpDeltaBoost,
-      appConfig.pumpDeltaOnMin, MAX_ALLOWED);
-    delta_off = dyn_off(delta_on);
-    return;
-  }
-
-  // Inside range: smooth n-curve interpolation plus learned compensation.
-  float u = (t_in - in_min) / (in_max - in_min); // 0..1
-  float base_on = lerp_f(appConfig.pumpDeltaOnMin,
-    appConfig.pumpDeltaOnMax,
-    powf(u, appConfig.pumpNCurveGamma));
-
-  delta_on = clamp(base_on + gPumpDeltaBoost,
-    appConfig.pumpDeltaOnMin, MAX_ALLOWED);
-  delta_off = dyn_off(delta_on);
+  gTelemetryRetry.push(msg.topic, msg.payload, msg.sampleEpoch);
+  Serial.printf("[MQTT] Telemetry queued for retry (%lu pending, %lu on flash)\n",
+    (unsigned long)gTelemetryRetry.size(), (unsigned long)gTelemetryRetry.flashCount());
 }
 
-// ========================= Apply heater and pump targets =========================
-// Shared actuator application path used by both setpoint and n-curve modes.
-void applyHeaterPumpTargets(bool targetHeat,
-  bool targetPump,
-  bool hardCool,
-  const String& msgSafety,
-  String& reason) {
-  unsigned long nowMs2 = millis();
-  unsigned long elapsed = nowMs2 - heaterToggleMs;
-
-  if (hardCool) {
-    // Bath temperature above hard limit: force everything off and clear locks.
-    if (heaterIsOn) {
-      heaterOff();
-      heaterIsOn = false;
-      heaterToggleMs = nowMs2;
-    }
-    if (pumpIsOn) {
-      pumpOff();
-      pumpIsOn = false;
-    }
-    heaterManualUntilMs = 0;
-    pumpManualUntilMs = 0;
-    reason = msgSafety;
-    return;
-  }
-
-  // ===== Heater with minimum on/off guard times =====
-  if (targetHeat) {
-    if (!heaterIsOn) {
-      if (elapsed >= appConfig.heaterMinOffMs) {
-        heaterOn();
-        heaterIsOn = true;
-        heaterToggleMs = nowMs2;
-      }
-      else {
-        reason += " | heater start suppressed: min off time not reached";
-      }
-    }
-    // If the heater is already on, keep it running unless another safety rule turns it off.
-  }
-  else {
-    if (heaterIsOn) {
-      if (elapsed >= appConfig.heaterMinOnMs) {
-        heaterOff();
-        heaterIsOn = false;
-        heaterToggleMs = nowMs2;
-      }
-      else {
-        reason += " | heater stop suppressed: min on time not reached";
-      }
-    }
-  }
-
-  // ===== Pump target application =====
-  if (targetPump) {
-    if (!pumpIsOn) {
-      pumpOn();
-      pumpIsOn = true;
-    }
-  }
-  else {
-    if (pumpIsOn) {
-      pumpOff();
-      pumpIsOn = false;
+// Publishes everything MeasureTask has committed, one attempt each. While the
+// broker is down messages move straight to the retry queue, so the outbox
+// never stays full and MeasureTask never waits on the network.
+static void drainTelemetryOutbox() {
+  while (OutboxMessage* msg = gTelemetryOutbox.front()) {
+    bool ok = publishOnce(msg->topic, msg->payload, msg->length);
+    if (ok) {
+      Serial.printf("[MQTT] Telemetry published (%u bytes)\n", (unsigned)msg->length);
     }
+    if (msg->onDone) msg->onDone(*msg, ok);
+    gTelemetryOutbox.pop();
   }
 }
 
@@ -436,6 +268,9 @@ bool updateAppConfigFromJson(JsonObject obj) {
   if (obj["temp_limitout_min"].is<uint32_t>()) appConfig.tempLimitOutMin = obj["temp_limitout_min"].as<uint32_t>();
   if (obj["temp_limitin_max"].is<uint32_t>())  appConfig.tempLimitInMax = obj["temp_limitin_max"].as<uint32_t>();
   if (obj["temp_limitin_min"].is<uint32_t>())  appConfig.tempLimitInMin = obj["temp_limitin_min"].as<uint32_t>();
+  if (obj["heap_report_interval"].is<uint32_t>()) appConfig.heapReportInterval = obj["heap_report_interval"].as<uint32_t>();
+  if (obj["diag_interval"].is<uint32_t>()) appConfig.diagInterval = obj["diag_interval"].as<uint32_t>();
+  if (obj["telemetry_batch"].is<uint8_t>()) appConfig.telemetryBatch = obj["telemetry_batch"].as<uint8_t>();
   if (obj["aeration_timer"].is<JsonObject>()) {
     JsonObject aer = obj["aeration_timer"];
     if (aer["enabled"].is<bool>())      appConfig.aerationTimerEnabled = aer["enabled"].as<bool>();
@@ -452,6 +287,11 @@ bool updateAppConfigFromJson(JsonObject obj) {
     JsonObject hg = obj["heater_guard"];
     if (hg["min_on_ms"].is<uint32_t>())  appConfig.heaterMinOnMs = hg["min_on_ms"].as<uint32_t>();
     if (hg["min_off_ms"].is<uint32_t>()) appConfig.heaterMinOffMs = hg["min_off_ms"].as<uint32_t>();
+    if (hg["window_ms"].is<uint32_t>())  appConfig.heaterWindowMs = hg["window_ms"].as<uint32_t>();
+  }
+  if (obj["pump_pwm"].is<JsonObject>()) {
+    JsonObject pp = obj["pump_pwm"];
+    if (pp["window_ms"].is<uint32_t>()) appConfig.pumpWindowMs = pp["window_ms"].as<uint32_t>();
   }
   if (obj["pump_adaptive"].is<JsonObject>()) {
     JsonObject pa = obj["pump_adaptive"];
@@ -474,206 +314,338 @@ bool updateAppConfigFromJson(JsonObject obj) {
   }
   if (obj["bath_setpoint"].is<JsonObject>()) {
     JsonObject bs = obj["bath_setpoint"];
-    if (bs["enabled"].is<bool>()) appConfig.bathSetEnabled = bs["enabled"].as<bool>();
+    if (bs["enabled"].is<bool>()) {
+      // Legacy switch between setpoint and n-curve; control_mode below wins.
+      appConfig.bathSetEnabled = bs["enabled"].as<bool>();
+      if (appConfig.bathSetEnabled) appConfig.controlMode = CONTROL_MODE_SETPOINT;
+      else if (appConfig.controlMode == CONTROL_MODE_SETPOINT) appConfig.controlMode = CONTROL_MODE_NCURVE;
+    }
     if (bs["target"].is<float>()) appConfig.bathSetTarget = bs["target"].as<float>();
     if (bs["hyst"].is<float>())   appConfig.bathSetHyst = bs["hyst"].as<float>();
   }
+  if (obj["control_mode"].is<const char*>()) {
+    if (!parseControlMode(obj["control_mode"].as<const char*>(), appConfig.controlMode)) {
+      Serial.printf("[Config] Unknown control_mode '%s', ignored\n", obj["control_mode"].as<const char*>());
+    }
+  }
+  appConfig.bathSetEnabled = appConfig.controlMode == CONTROL_MODE_SETPOINT;
+  if (obj["pid"].is<JsonObject>()) {
+    JsonObject pid = obj["pid"];
+    if (pid["kp"].is<float>())  appConfig.pidKp = pid["kp"].as<float>();
+    if (pid["ki"].is<float>())  appConfig.pidKi = pid["ki"].as<float>();
+    if (pid["kd"].is<float>())  appConfig.pidKd = pid["kd"].as<float>();
+    if (pid["kff"].is<float>()) appConfig.pidKff = pid["kff"].as<float>();
+    if (pid["autotune_hyst"].is<float>()) appConfig.pidAutotuneHyst = pid["autotune_hyst"].as<float>();
+  }
+  if (obj["mpc"].is<JsonObject>()) {
+    JsonObject mpc = obj["mpc"];
+    if (mpc["horizon_s"].is<uint32_t>())     appConfig.mpcHorizonS = mpc["horizon_s"].as<uint32_t>();
+    if (mpc["energy_weight"].is<float>())    appConfig.mpcEnergyWeight = mpc["energy_weight"].as<float>();
+    if (mpc["overshoot_weight"].is<float>()) appConfig.mpcOvershootWeight = mpc["overshoot_weight"].as<float>();
+  }
   return true;
 }
 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, payload, length);
-  if (err) {
-    Serial.println(String("[MQTT] JSON 解析错误：") + err.c_str());
-    return;
-  }
+static void handleCommandDocument(JsonDocument& doc) {
   JsonArray cmds = doc["commands"].as<JsonArray>();
   if (cmds.isNull()) return;
 
   for (JsonVariant v : cmds) {
     JsonObject obj = v.as<JsonObject>();
-    String cmd = obj["command"] | "";
-    String action = obj["action"] | "";
+    const char* cmdName = obj["command"] | "";
+    const char* actionName = obj["action"] | "";
     unsigned long duration = obj["duration"] | 0UL;
 
-    // 兼容 fan 和 aeration 命令(实际控制同一设备)
-    if (cmd == "fan") cmd = "aeration";
+    // 命令名只在这里查表一次，之后按枚举分发（fan 是 aeration 的别名）
+    CommandDevice device = COMMAND_DEVICE_NONE;
+    CommandKind kind = parseCommandName(cmdName, device);
+    CommandAction action = parseCommandAction(actionName);
+
+    switch (kind) {
+      // === 紧急停止命令（最高优先级，无需 device 字段检查）===
+      case COMMAND_KIND_EMERGENCY:
+        if (action == COMMAND_ACTION_ON) {
+          Serial.println("[CMD] 收到急停命令");
+          activateEmergencyStop();
+        }
+        else if (action == COMMAND_ACTION_OFF) {
+          Serial.println("[CMD] 收到恢复命令");
+          resumeFromEmergencyStop();
+        }
+        wakeTask(gMeasureTask);   // 定时曝气是否生效随急停状态变化
+        continue;
+
+      // 诊断快照只读，急停状态下同样响应；由 loop 发布，避免在回调里复用 MQTT 缓冲区
+      case COMMAND_KIND_DIAG:
+        Serial.println("[CMD] 收到诊断请求");
+        gDiagRequested = true;
+        continue;
 
-    // === 紧急停止命令（最高优先级，无需 device 字段检查）===
-    if (cmd == "emergency") {
-      if (action == "on") {
-        Serial.println("[CMD] 收到急停命令");
-        activateEmergencyStop();
-      }
-      else if (action == "off") {
-        Serial.println("[CMD] 收到恢复命令");
-        resumeFromEmergencyStop();
-      }
-      continue;
+      default:
+        break;
     }
 
     // 其他命令：急停状态下拒绝执行
     if (isEmergencyStopped()) {
-      Serial.println("[CMD] ⚠️ 急停状态生效中，拒绝执行命令: " + cmd);
+      Serial.printf("[CMD] ⚠️ 急停状态生效中，拒绝执行命令: %s\n", cmdName);
       continue;
     }
 
-    if (cmd == "config_update") {
-      JsonObject cfg = obj["config"].as<JsonObject>();
-      if (!cfg.isNull()) {
-        if (updateAppConfigFromJson(cfg)) {
-          if (saveConfigToSPIFFS("/config.json")) {
-            Serial.println("[CMD] ✅ 配置已远程更新并保存，设备重启以生效");
-            ESP.restart();
+    switch (kind) {
+      case COMMAND_KIND_CONFIG_UPDATE: {
+        JsonObject cfg = obj["config"].as<JsonObject>();
+        if (!cfg.isNull()) {
+          if (updateAppConfigFromJson(cfg)) {
+            if (saveConfigToSPIFFS("/config.json")) {
+              Serial.println("[CMD] ✅ 配置已远程更新并保存，设备重启以生效");
+              ESP.restart();
+            }
+            else {
+              Serial.println("[CMD] ❌ 配置保存失败");
+            }
           }
           else {
-            Serial.println("[CMD] ❌ 配置保存失败");
+            Serial.println("[CMD] ❌ 配置更新失败");
           }
         }
+        break;
+      }
+
+      // 自整定在测量任务的下一个周期开始或取消
+      case COMMAND_KIND_AUTOTUNE:
+        if (action == COMMAND_ACTION_ON) {
+          Serial.println("[CMD] 收到 PID 自整定启动命令");
+          gAutotuneRequest = AUTOTUNE_REQUEST_START;
+        }
+        else if (action == COMMAND_ACTION_OFF) {
+          Serial.println("[CMD] 收到 PID 自整定取消命令");
+          gAutotuneRequest = AUTOTUNE_REQUEST_CANCEL;
+        }
+        else {
+          Serial.printf("[CMD] Unsupported action for autotune, ignored: %s\n", actionName);
+        }
+        break;
+
+      case COMMAND_KIND_PROBE_RESET:
+        if (clearProbeRegistry()) {
+          Serial.println("[CMD] ✅ 探头槽位表已清空，设备重启后按搜索顺序重新登记");
+          ESP.restart();
+        }
         else {
-          Serial.println("[CMD] ❌ 配置更新失败");
+          Serial.println("[CMD] ❌ 探头槽位表清空失败");
         }
+        break;
+
+      case COMMAND_KIND_DEVICE: {
+        if (action == COMMAND_ACTION_UNKNOWN) {
+          Serial.printf("[CMD] Unsupported action for device command, ignored: %s/%s\n", cmdName, actionName);
+          break;
+        }
+        bool locked = gCmdMutex && xSemaphoreTake(gCmdMutex, pdMS_TO_TICKS(200));
+        if (!locked) {
+          Serial.println("[CMDQ] 队列上锁失败，丢弃一条命令");
+          break;
+        }
+        // 同一设备的新命令会替换其待执行命令
+        bool queued = gCommandQueue.push({ device, action, duration, millis() });
+        xSemaphoreGive(gCmdMutex);
+        if (queued) {
+          wakeTask(gCommandTask);
+        }
+        else {
+          Serial.println("[CMDQ] 队列已满，丢弃一条命令");
+        }
+        break;
       }
-      continue;
-    }
 
-    if ((cmd == "heater" || cmd == "pump" || cmd == "aeration") &&
-      !isSupportedActionForDevice(action)) {
-      Serial.println("[CMD] Unsupported action for device command, ignored: " + cmd + "/" + action);
-      continue;
+      default:
+        Serial.printf("[CMD] 未知命令：%s\n", cmdName);
+        break;
     }
+  }
+}
 
-    unsigned long target = millis();
+// Command messages above this size are rejected before parsing; a full
+// config_update is about 1.2 KB.
+static const unsigned int COMMAND_PAYLOAD_MAX = 3072;
+static const uint8_t COMMAND_NESTING_LIMIT = 6;   // root > commands > cmd > config > section, plus one spare
+
+// Only the fields handleCommandDocument reads are stored; everything else is
+// skipped by the parser. Built once, on first use (loop task only).
+static JsonDocument& commandFilter() {
+  static JsonDocument filter;
+  if (filter.isNull()) {
+    JsonObject cmd = filter["commands"].add<JsonObject>();
+    cmd["command"] = true;
+    cmd["action"] = true;
+    cmd["duration"] = true;
+    cmd["config"] = true;
+  }
+  return filter;
+}
 
-    if (gCmdMutex && xSemaphoreTake(gCmdMutex, pdMS_TO_TICKS(200))) {
-      if (cmd == "heater" || cmd == "pump" || cmd == "aeration") {
-        removePendingCommandsForDeviceLocked(cmd);
+static DeserializationError parseCommandPayload(JsonDocument& doc, const byte* payload, unsigned int length) {
+  return deserializeJson(doc, payload, length,
+    DeserializationOption::Filter(commandFilter()),
+    DeserializationOption::NestingLimit(COMMAND_NESTING_LIMIT));
+}
+
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  if (length > COMMAND_PAYLOAD_MAX) {
+    Serial.printf("[MQTT] 命令报文过大（%u > %u 字节），已丢弃\n", length, COMMAND_PAYLOAD_MAX);
+    return;
+  }
+
+  // Commands are parsed in the loop task's arena; only a config_update whose
+  // filtered document does not fit falls back to a heap document, which the
+  // payload cap above bounds.
+  {
+    JsonDocument doc(&mqttJsonArena());
+    DeserializationError err = parseCommandPayload(doc, payload, length);
+    if (err != DeserializationError::NoMemory) {
+      if (err) {
+        Serial.println(String("[MQTT] JSON 解析错误：") + err.c_str());
+        return;
       }
-      pendingCommands.push_back({ cmd, action, duration, target });
-      xSemaphoreGive(gCmdMutex);
-    }
-    else {
-      Serial.println("[CMDQ] 队列上锁失败，丢弃一条命令");
+      handleCommandDocument(doc);
+      return;
     }
   }
+
+  Serial.printf("[MQTT] Command payload (%u bytes) exceeds JSON arena, parsing on heap\n", length);
+  JsonDocument doc;
+  DeserializationError err = parseCommandPayload(doc, payload, length);
+  if (err) {
+    Serial.println(String("[MQTT] JSON 解析错误：") + err.c_str());
+    return;
+  }
+  handleCommandDocument(doc);
 }
 
 // ========================= 非阻塞命令执行 =========================
 void executeCommand(const PendingCommand& pcmd) {
+  const char* deviceName = commandDeviceName(pcmd.device);
+
   // 急停状态下拒绝执行所有手动命令
   if (isEmergencyStopped()) {
-    Serial.println("[CMD] ⚠️ 急停状态生效中，拒绝执行: " + pcmd.cmd);
+    Serial.printf("[CMD] ⚠️ 急停状态生效中，拒绝执行: %s\n", deviceName);
     return;
   }
 
   Serial.printf("[CMD] 执行：%s %s 持续 %lu ms\n",
-    pcmd.cmd.c_str(), pcmd.action.c_str(), pcmd.duration);
+    deviceName, commandActionName(pcmd.action), pcmd.duration);
 
-  auto scheduleOff = [&](const String& what, unsigned long ms) {
+  auto scheduleOff = [&](unsigned long ms) {
     if (ms == 0) return;
-    PendingCommand off;
-    off.cmd = what;
-    off.action = "off";
-    off.duration = 0;
-    off.targetTimeMs = millis() + ms;
+    PendingCommand off = { pcmd.device, COMMAND_ACTION_OFF, 0, millis() + ms };
+    bool queued = false;
     if (gCmdMutex && xSemaphoreTake(gCmdMutex, pdMS_TO_TICKS(200))) {
-      removePendingCommandsForDeviceLocked(what);
-      pendingCommands.push_back(off);
+      queued = gCommandQueue.push(off);
       xSemaphoreGive(gCmdMutex);
     }
-    else {
+    if (!queued) {
       Serial.println("[CMDQ] 无法加入定时关闭命令");
     }
     };
 
-  if (pcmd.cmd == "aeration") {
-    if (pcmd.action == "on") {
-      aerationOn();
-      aerationIsOn = true;
-      aerationManualUntilMs = computeManualLockUntil(pcmd.duration);
-      scheduleOff("aeration", pcmd.duration);
-    }
-    else if (pcmd.action == "auto") {
-      aerationManualUntilMs = 0;
-      clearPendingCommandsForDevice("aeration");
-    }
-    else if (pcmd.action == "off") {
-      aerationOff();
-      aerationIsOn = false;
-      aerationManualUntilMs = 0;
-      clearPendingCommandsForDevice("aeration");
-    }
-    else {
-      Serial.println("[CMD] Unsupported aeration action ignored: " + pcmd.action);
-    }
-  }
-  else if (pcmd.cmd == "heater") {
-    // 手动 heater on 也遵守 Tank 安全：Tank 无效或过温时一律拒绝
-    if (pcmd.action == "on") {
-      if (!gLastTankValid || gLastTankOver) {
-        Serial.println("[SAFETY] 手动加热命令被拦截：Tank 无效或过温");
-        return;
+  switch (pcmd.device) {
+    case COMMAND_DEVICE_AERATION:
+      switch (pcmd.action) {
+        case COMMAND_ACTION_ON:
+          actuatorSetDuty(ACTUATOR_AERATION, 100.0f);
+          aerationIsOn = true;
+          aerationManualUntilMs = computeManualLockUntil(pcmd.duration);
+          scheduleOff(pcmd.duration);
+          break;
+        case COMMAND_ACTION_AUTO:
+          aerationManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_AERATION);
+          break;
+        case COMMAND_ACTION_OFF:
+          actuatorSetDuty(ACTUATOR_AERATION, 0.0f);
+          aerationIsOn = false;
+          aerationManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_AERATION);
+          break;
+        default:
+          break;
       }
-      heaterOn();
-      heaterIsOn = true;
-      heaterToggleMs = millis();
-      heaterManualUntilMs = computeManualLockUntil(pcmd.duration);
-      scheduleOff("heater", pcmd.duration);
-    }
-    else if (pcmd.action == "auto") {
-      heaterManualUntilMs = 0;
-      clearPendingCommandsForDevice("heater");
-    }
-    else if (pcmd.action == "off") {
-      heaterOff();
-      heaterIsOn = false;
-      heaterToggleMs = millis();
-      heaterManualUntilMs = 0;
-      clearPendingCommandsForDevice("heater");
-    }
-    else {
-      Serial.println("[CMD] Unsupported heater action ignored: " + pcmd.action);
-    }
-  }
-  else if (pcmd.cmd == "pump") {
-    if (pcmd.action == "on") {
-      pumpOn();
-      pumpIsOn = true;
-      pumpManualUntilMs = computeManualLockUntil(pcmd.duration);
-      scheduleOff("pump", pcmd.duration);
-    }
-    else if (pcmd.action == "auto") {
-      pumpManualUntilMs = 0;
-      clearPendingCommandsForDevice("pump");
-    }
-    else if (pcmd.action == "off") {
-      pumpOff();
-      pumpIsOn = false;
-      pumpManualUntilMs = 0;
-      clearPendingCommandsForDevice("pump");
-    }
-    else {
-      Serial.println("[CMD] Unsupported pump action ignored: " + pcmd.action);
-    }
-  }
-  else {
-    Serial.println("[CMD] 未知命令：" + pcmd.cmd);
+      wakeTask(gMeasureTask);   // 手动锁变化会移动定时曝气的下一个边沿
+      break;
+
+    case COMMAND_DEVICE_HEATER:
+      switch (pcmd.action) {
+        case COMMAND_ACTION_ON:
+          // 手动 heater on 也遵守 Tank 安全：Tank 无效或过温时一律拒绝
+          if (!gControl.lastTankValid || gControl.lastTankOver) {
+            Serial.println("[SAFETY] 手动加热命令被拦截：Tank 无效或过温");
+            return;
+          }
+          actuatorSetDuty(ACTUATOR_HEATER, 100.0f);
+          gControl.heaterOn = true;
+          gControl.heaterDuty = 100.0f;
+          gControl.heaterToggleMs = millis();
+          gControl.heaterManualUntilMs = computeManualLockUntil(pcmd.duration);
+          scheduleOff(pcmd.duration);
+          break;
+        case COMMAND_ACTION_AUTO:
+          gControl.heaterManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_HEATER);
+          break;
+        case COMMAND_ACTION_OFF:
+          actuatorSetDuty(ACTUATOR_HEATER, 0.0f);
+          gControl.heaterOn = false;
+          gControl.heaterDuty = 0.0f;
+          gControl.heaterToggleMs = millis();
+          gControl.heaterManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_HEATER);
+          break;
+        default:
+          break;
+      }
+      break;
+
+    case COMMAND_DEVICE_PUMP:
+      switch (pcmd.action) {
+        case COMMAND_ACTION_ON:
+          actuatorSetDuty(ACTUATOR_PUMP, 100.0f);
+          gControl.pumpOn = true;
+          gControl.pumpDuty = 100.0f;
+          gControl.pumpManualUntilMs = computeManualLockUntil(pcmd.duration);
+          scheduleOff(pcmd.duration);
+          break;
+        case COMMAND_ACTION_AUTO:
+          gControl.pumpManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_PUMP);
+          break;
+        case COMMAND_ACTION_OFF:
+          actuatorSetDuty(ACTUATOR_PUMP, 0.0f);
+          gControl.pumpOn = false;
+          gControl.pumpDuty = 0.0f;
+          gControl.pumpManualUntilMs = 0;
+          clearPendingCommandsForDevice(COMMAND_DEVICE_PUMP);
+          break;
+        default:
+          break;
+      }
+      break;
+
+    default:
+      break;
   }
 }
 
-// ========================= 定时曝气控制 =========================
 // ========================= Timed aeration control =========================
 void checkAndControlAerationByTimer() {
   if (!appConfig.aerationTimerEnabled) return;
-  if (isManualLockActive(aerationManualUntilMs)) return;
+  if (isManualLockActive(aerationManualUntilMs, millis())) return;
 
   unsigned long nowMs = millis();
   time_t nowEpoch = time(nullptr);
 
   if (!aerationIsOn && (nowMs - preAerationMs >= appConfig.aerationInterval)) {
     Serial.printf("[Aeration] Aeration window started for %lu ms\n", appConfig.aerationDuration);
-    aerationOn();
+    actuatorSetDuty(ACTUATOR_AERATION, 100.0f);
     aerationIsOn = true;
     preAerationMs = nowMs;
     if (preferences.begin(NVS_NAMESPACE, false)) {
@@ -684,7 +656,7 @@ void checkAndControlAerationByTimer() {
 
   if (aerationIsOn && (nowMs - preAerationMs >= appConfig.aerationDuration)) {
     Serial.println("[Aeration] Aeration window completed, stopping aeration");
-    aerationOff();
+    actuatorSetDuty(ACTUATOR_AERATION, 0.0f);
     aerationIsOn = false;
     preAerationMs = nowMs;
     if (preferences.begin(NVS_NAMESPACE, false)) {
@@ -695,13 +667,152 @@ void checkAndControlAerationByTimer() {
 }
 
 // ========================= Telemetry quality helper =========================
-static String getQualityString(float value) {
+static const char* getQualityString(float value) {
   if (isnan(value)) return "NaN";
   if (value < TEMP_VALID_MIN || value > TEMP_VALID_MAX) return "ERR";
   return "ok";
 }
 
 // ========================= Build telemetry channels and publish =========================
+static const char* const TEMP_OUT_CODES[MAX_OUT_SENSORS] = { "TempOut1", "TempOut2", "TempOut3" };
+
+// The channel list of one sample, shared by the single-message and batch formats.
+static uint8_t collectTelemetryChannels(
+  TelemetryChannel* out,
+  float t_in,
+  const std::vector<float>& t_outs,
+  float t_tank,
+  bool tankValid,
+  const HeapStats* heap) {
+  uint8_t n = 0;
+
+  // TempIn channel
+  out[n++] = { "TempIn", "℃", t_in, getQualityString(t_in) };
+
+  // TempOut channels, up to MAX_OUT_SENSORS
+  for (size_t i = 0; i < t_outs.size() && i < MAX_OUT_SENSORS; ++i) {
+    out[n++] = { TEMP_OUT_CODES[i], "℃", t_outs[i], getQualityString(t_outs[i]) };
+  }
+
+  // TankTemp channel
+  out[n++] = { "TankTemp", "℃", tankValid ? t_tank : (float)NAN, tankValid ? "ok" : "ERR" };
+
+  // DS18B20 resolution the temperatures above were converted at
+  out[n++] = { "TempRes", "bit", (float)tempSampleResolution(), "ok" };
+
+  // Actuator and emergency-stop state
+  out[n++] = { "Heater", "", gControl.heaterOn ? 1.0f : 0.0f, "ok" };
+  out[n++] = { "Pump", "", gControl.pumpOn ? 1.0f : 0.0f, "ok" };
+  out[n++] = { "Aeration", "", aerationIsOn ? 1.0f : 0.0f, "ok" };
+  out[n++] = { "EmergencyState", "", (float)getEmergencyState(), "ok" };
+
+  // Commanded duty per actuator; time-proportional for the relays
+  out[n++] = { "HeaterDuty", "%", actuatorDuty(ACTUATOR_HEATER), "ok" };
+  out[n++] = { "PumpDuty", "%", actuatorDuty(ACTUATOR_PUMP), "ok" };
+  out[n++] = { "AerationDuty", "%", actuatorDuty(ACTUATOR_AERATION), "ok" };
+
+  if (heap) {
+    out[n++] = { "HeapFree", "B", (float)heap->freeHeap, "ok" };
+    out[n++] = { "HeapMaxBlock", "B", (float)heap->largestBlock, "ok" };
+    out[n++] = { "HeapMinFree", "B", (float)heap->minFreeHeap, "ok" };
+    out[n++] = { "HeapFrag", "%", (float)heap->fragmentation, "ok" };
+    out[n++] = { "StackMeasure", "B", (float)heap->measureStack, "ok" };
+    out[n++] = { "StackCommand", "B", (float)heap->commandStack, "ok" };
+  }
+  return n;
+}
+
+static void fillTelemetryDoc(JsonDocument& doc, const String& ts, const TelemetryChannel* channels, uint8_t count) {
+  doc["schema_version"] = 2;
+  doc["ts"] = ts;
+
+  JsonArray arr = doc["channels"].to<JsonArray>();
+  for (uint8_t i = 0; i < count; i++) {
+    JsonObject ch = arr.add<JsonObject>();
+    ch["code"] = channels[i].code;
+    ch["value"] = channels[i].value;
+    ch["unit"] = channels[i].unit;
+    ch["quality"] = channels[i].quality;
+  }
+}
+
+// Serialize into an outbox slot; returns the payload length or 0.
+static size_t serializeTelemetryDoc(JsonDocument& doc, OutboxMessage& msg) {
+  if (doc.overflowed() || measureJson(doc) >= sizeof(msg.payload)) {
+    return 0;
+  }
+  return serializeJson(doc, msg.payload, sizeof(msg.payload));
+}
+
+// Publishes the accumulated batch on telemetry/batch through the outbox.
+// The batch is cleared either way; an outbox full of unsent messages means
+// the network task is stuck, and holding samples back would only grow the gap.
+static bool flushTelemetryBatch(const String& modeTag) {
+  if (gTelemetryBatch.size() == 0) return true;
+
+  static const String topic = getTelemetryBatchTopic();
+  uint8_t samples = gTelemetryBatch.size();
+
+  OutboxMessage* msg = gTelemetryOutbox.reserve();
+  if (!msg) {
+    Serial.printf("[MQTT] Outbox full (%u dropped), batch of %u samples dropped (%s mode)\n",
+      (unsigned)gTelemetryOutbox.dropped(), (unsigned)samples, modeTag.c_str());
+    gTelemetryBatch.clear();
+    return false;
+  }
+
+  size_t len = gTelemetryBatch.serialize(msg->payload, sizeof(msg->payload));
+  if (len == 0) {
+    Serial.printf("[JSON] Telemetry batch too large, %u samples dropped\n", (unsigned)samples);
+    gTelemetryBatch.clear();
+    return false;
+  }
+
+  strlcpy(msg->topic, topic.c_str(), sizeof(msg->topic));
+  msg->length = len;
+  msg->sampleEpoch = gTelemetryBatch.newestEpoch();
+  msg->onDone = onTelemetryPublished;
+  gTelemetryOutbox.commit();
+  wakeTask(gNetTask);
+  gTelemetryBatch.clear();
+
+  Serial.printf("[MQTT] Batch of %u samples queued for publish (%u bytes, %s mode)\n",
+    (unsigned)samples, (unsigned)len, modeTag.c_str());
+  return true;
+}
+
+// Adds one sample to the batch and flushes it once telemetry_batch samples
+// are in, or right away when the emergency-stop state changes so the
+// platform does not learn about it minutes late.
+static bool addToTelemetryBatch(
+  const TelemetryChannel* channels,
+  uint8_t channelCount,
+  const String& ts,
+  time_t nowEpoch,
+  const String& modeTag) {
+  static EmergencyState lastState = EMERGENCY_STATE_NORMAL;
+  EmergencyState state = getEmergencyState();
+  bool stateChanged = state != lastState;
+  lastState = state;
+
+  bool ok = true;
+  if (!gTelemetryBatch.add(nowEpoch, ts.c_str(), channels, channelCount)) {
+    ok = flushTelemetryBatch(modeTag);
+    gTelemetryBatch.add(nowEpoch, ts.c_str(), channels, channelCount);
+  }
+
+  uint8_t target = std::min<uint8_t>(appConfig.telemetryBatch, TELEMETRY_BATCH_MAX);
+  if (gTelemetryBatch.size() >= target || stateChanged) {
+    return flushTelemetryBatch(modeTag) && ok;
+  }
+  Serial.printf("[MQTT] Sample %u/%u added to batch (%s mode)\n",
+    (unsigned)gTelemetryBatch.size(), (unsigned)target, modeTag.c_str());
+  return ok;
+}
+
+// Builds the telemetry payload straight into a slot of the outbox and hands
+// it to the network task; returns once queued, without touching the network.
+// With telemetry_batch > 1 the sample goes into the columnar batch instead.
 static bool buildChannelsAndPublish(
   float t_in,
   const std::vector<float>& t_outs,
@@ -710,108 +821,106 @@ static bool buildChannelsAndPublish(
   const String& ts,
   time_t nowEpoch,
   const String& modeTag) {
+  ScopedPhaseTimer publishTimer(gPhasePublish);
 
-  JsonDocument doc;
-  doc["schema_version"] = 2;
-  doc["ts"] = ts;
+  // Heap/stack health channels every heap_report_interval.
+  HeapStats heapStats;
+  const HeapStats* heap = takeHeapStatsIfDue(appConfig.heapReportInterval, heapStats) ? &heapStats : nullptr;
 
-  JsonArray channels = doc["channels"].to<JsonArray>();
+  TelemetryChannel channels[TELEMETRY_MAX_CHANNELS];
+  uint8_t channelCount = collectTelemetryChannels(channels, t_in, t_outs, t_tank, tankValid, heap);
 
-  // TempIn channel
-  JsonObject ch_in = channels.add<JsonObject>();
-  ch_in["code"] = "TempIn";
-  ch_in["value"] = t_in;
-  ch_in["unit"] = "℃";
-  ch_in["quality"] = getQualityString(t_in);
+  if (appConfig.telemetryBatch > 1 || gTelemetryBatch.size() > 0) {
+    return addToTelemetryBatch(channels, channelCount, ts, nowEpoch, modeTag);
+  }
 
-  // TempOut channels, up to MAX_OUT_SENSORS
-  for (size_t i = 0; i < t_outs.size() && i < MAX_OUT_SENSORS; ++i) {
-    char codeBuf[16];
-    snprintf(codeBuf, sizeof(codeBuf), "TempOut%d", (int)(i + 1));
-    JsonObject ch = channels.add<JsonObject>();
-    ch["code"] = codeBuf;
-    ch["value"] = t_outs[i];
-    ch["unit"] = "℃";
-    ch["quality"] = getQualityString(t_outs[i]);
+  // The topic only changes with the config, which restarts the device.
+  static const String topic = getTelemetryTopic();
+
+  OutboxMessage* msg = gTelemetryOutbox.reserve();
+  if (!msg) {
+    Serial.printf("[MQTT] Outbox full (%u dropped), sample dropped (%s mode)\n",
+      (unsigned)gTelemetryOutbox.dropped(), modeTag.c_str());
+    return false;
   }
 
-  // TankTemp channel
-  JsonObject ch_tank = channels.add<JsonObject>();
-  ch_tank["code"] = "TankTemp";
-  ch_tank["value"] = tankValid ? t_tank : (float)NAN;
-  ch_tank["unit"] = "℃";
-  ch_tank["quality"] = tankValid ? "ok" : "ERR";
-
-  // Heater channel
-  JsonObject ch_heat = channels.add<JsonObject>();
-  ch_heat["code"] = "Heater";
-  ch_heat["value"] = heaterIsOn ? 1 : 0;
-  ch_heat["unit"] = "";
-  ch_heat["quality"] = "ok";
-
-  // Pump channel
-  JsonObject ch_pump = channels.add<JsonObject>();
-  ch_pump["code"] = "Pump";
-  ch_pump["value"] = pumpIsOn ? 1 : 0;
-  ch_pump["unit"] = "";
-  ch_pump["quality"] = "ok";
-
-  // Aeration channel
-  JsonObject ch_aer = channels.add<JsonObject>();
-  ch_aer["code"] = "Aeration";
-  ch_aer["value"] = aerationIsOn ? 1 : 0;
-  ch_aer["unit"] = "";
-  ch_aer["quality"] = "ok";
-
-  // EmergencyState channel
-  JsonObject ch_emergency = channels.add<JsonObject>();
-  ch_emergency["code"] = "EmergencyState";
-  ch_emergency["value"] = (int)getEmergencyState();
-  ch_emergency["unit"] = "";
-  ch_emergency["quality"] = "ok";
-
-  String payload;
-  serializeJson(doc, payload);
-  bool ok = publishData(getTelemetryTopic(), payload, 10000);
-  if (ok) {
-    Serial.printf("[MQTT] Data published (%s mode)\n", modeTag.c_str());
-    if (preferences.begin(NVS_NAMESPACE, false)) {
-      preferences.putULong(NVS_KEY_LAST_MEAS, nowEpoch);
-      preferences.end();
+  // Steady state: document in the MeasureTask arena, payload in the slot.
+  size_t len = 0;
+  {
+    JsonDocument doc(&telemetryJsonArena());
+    fillTelemetryDoc(doc, ts, channels, channelCount);
+    len = serializeTelemetryDoc(doc, *msg);
+  }
+  if (len == 0) {
+    Serial.println("[JSON] Telemetry exceeds arena, building on heap");
+    JsonDocument doc;
+    fillTelemetryDoc(doc, ts, channels, channelCount);
+    len = serializeTelemetryDoc(doc, *msg);
+    if (len == 0) {
+      // The slot was never committed, so the next reserve() reuses it.
+      Serial.println("[JSON] Telemetry payload too large, sample dropped");
+      return false;
     }
-    return true;
   }
 
-  bool queued = enqueueTelemetryPublish(getTelemetryTopic(), payload, nowEpoch);
-  if (queued) {
-    Serial.printf("[MQTT] Data buffered for retry (%s mode)\n", modeTag.c_str());
-  }
-  return queued;
+  strlcpy(msg->topic, topic.c_str(), sizeof(msg->topic));
+  msg->length = len;
+  msg->sampleEpoch = nowEpoch;
+  msg->onDone = onTelemetryPublished;
+  gTelemetryOutbox.commit();
+  wakeTask(gNetTask);
+
+  Serial.printf("[MQTT] Data queued for publish (%s mode)\n", modeTag.c_str());
+  return true;
 }
 
 // ========================= Measurement, control, and reporting =========================
+// Both buses convert concurrently; a conversion prefetched by measurementTask
+// is usually complete already, so this mostly just reads the scratchpads.
+static std::vector<float> readProbes(float& t_in, float& t_tank) {
+  ScopedPhaseTimer timer(gPhaseProbes);
+  startTempConversion();
+  std::vector<float> t_outs = readTempOut();
+  readInternalTemps(t_in, t_tank);
+  return t_outs;
+}
+
+// Heater switched within the last two cycles, or tank close to its limit:
+// keep 12-bit conversions so the transient is tracked finely.
+static bool needFullTempResolution(bool prevHeaterOn, bool tankValid, float t_tank) {
+  bool heaterTransition = (gControl.heaterOn != prevHeaterOn) ||
+    (millis() - gControl.heaterToggleMs < 2UL * appConfig.postInterval);
+  bool tankNearLimit = tankValid && (t_tank >= appConfig.tankTempMax - 2.0f);
+  return heaterTransition || tankNearLimit;
+}
+
+static float medianOutTemp(const std::vector<float>& t_outs) {
+  ScopedPhaseTimer timer(gPhaseMedian);
+  return median(t_outs, -20.0f, 100.0f, 5.0f);
+}
+
 bool doMeasurementAndSave() {
+  ScopedPhaseTimer cycleTimer(gPhaseCycle);
   Serial.println("[Measure] Sampling temperatures");
 
   // Emergency-stop mode still reports telemetry, but skips automatic control.
   if (shouldBlockControl()) {
     Serial.println("[Emergency] Emergency stop active, automatic control paused");
 
-    heaterIsOn = false;
-    pumpIsOn = false;
     aerationIsOn = false;
+    controlEmergency(gControl);
+    gAutotuneRequest = AUTOTUNE_REQUEST_NONE;
 
     float t_in = NAN;
-    std::vector<float> t_outs = readTempOut();
     float t_tank = NAN;
-    readInternalTemps(t_in, t_tank);
+    std::vector<float> t_outs = readProbes(t_in, t_tank);
 
     if (t_outs.empty()) {
       Serial.println("[Measure] No external temperature samples, skipping report");
       return false;
     }
 
-    float med_out = median(t_outs, -20.0f, 100.0f, 5.0f);
+    float med_out = medianOutTemp(t_outs);
     if (isnan(med_out)) {
       Serial.println("[Measure] External samples invalid after filtering, skipping report");
       return false;
@@ -820,394 +929,311 @@ bool doMeasurementAndSave() {
     String ts = getTimeString();
     time_t nowEpoch = time(nullptr);
     bool tankValid = !isnan(t_tank) && (t_tank > -10.0f) && (t_tank < 120.0f);
+    selectTempResolution(med_out, NAN, 0.0f, (float)appConfig.tempLimitOutMax, false);
     return buildChannelsAndPublish(t_in, t_outs, t_tank, tankValid, ts, nowEpoch, "Emergency");
   }
 
   float t_in = NAN;                 // Internal loop temperature
-  std::vector<float> t_outs = readTempOut();   // Multiple bath outlet probes
   float t_tank = NAN;               // Tank temperature used for control and reporting
-  readInternalTemps(t_in, t_tank);
+  std::vector<float> t_outs = readProbes(t_in, t_tank);   // Multiple bath outlet probes
 
   if (t_outs.empty()) {
     Serial.println("[Measure] No external temperature samples, skipping control cycle");
     // Safety fallback: stop heater and pump if bath probes fail.
-    if (heaterIsOn) {
-      heaterOff();
-      heaterIsOn = false;
-      heaterToggleMs = millis();
-    }
-    if (pumpIsOn) {
-      pumpOff();
-      pumpIsOn = false;
-    }
-    heaterManualUntilMs = 0;
-    pumpManualUntilMs = 0;
+    controlSafeOff(gControl, millis());
+    applyControlOutputs();
+    selectTempResolution(NAN, NAN, 0.0f, NAN, false);
     return false;
   }
 
-  float med_out = median(t_outs, -20.0f, 100.0f, 5.0f);
+  float med_out = medianOutTemp(t_outs);
   if (isnan(med_out)) {
     Serial.println("[Measure] External samples invalid after filtering, skipping control cycle");
     // Safety fallback: stop heater and pump if filtered bath data is invalid.
-    if (heaterIsOn) {
-      heaterOff();
-      heaterIsOn = false;
-      heaterToggleMs = millis();
-    }
-    if (pumpIsOn) {
-      pumpOff();
-      pumpIsOn = false;
-    }
-    heaterManualUntilMs = 0;
-    pumpManualUntilMs = 0;
+    controlSafeOff(gControl, millis());
+    applyControlOutputs();
+    selectTempResolution(NAN, NAN, 0.0f, NAN, false);
     return false;
   }
 
-  // Capture previous heater/pump state for adaptive learning.
-  bool prevHeaterOn = heaterIsOn;
-  bool prevPumpOn = pumpIsOn;
-
-  // Tank validity and high-limit checks.
-  bool tankValid = !isnan(t_tank) && (t_tank > -10.0f) && (t_tank < 120.0f);
-  bool tankOver = tankValid && (t_tank >= appConfig.tankTempMax);
-  float delta_tank_in = tankValid ? (t_tank - t_in) : 0.0f;    // tank minus internal temperature delta
-  float delta_tank_out = tankValid ? (t_tank - med_out) : 0.0f; // tank minus bath temperature delta
-
-  // Update cached tank safety state for both automatic and manual paths.
-  gLastTankValid = tankValid;
-  gLastTankOver = tankOver;
+  ScopedPhaseTimer controlTimer(gPhaseControl);
+  bool prevHeaterOn = gControl.heaterOn;
 
   String ts = getTimeString();
   time_t nowEpoch = time(nullptr);
 
-  // Cached configuration values used in this cycle.
-  const float out_max = (float)appConfig.tempLimitOutMax;
-  const float in_max = (float)appConfig.tempLimitInMax;   // Used by normalization on the internal temperature axis
-  const float in_min = (float)appConfig.tempLimitInMin;
-  float diff_now = t_in - med_out;
-
-  // ---- Hard bath over-temperature protection ----
-  bool hardCool = false;
-  String msgSafety;
-  if (med_out >= out_max) {
-    hardCool = true;
-    msgSafety = String("[SAFETY] Bath temperature ") + String(med_out, 2) +
-      " >= " + String(out_max, 2) +
-      "; forcing shutdown of heater and pump";
-  }
-
-  // Adaptive learning: update boost only when the previous cycle was pump-only.
-  // Otherwise decay the learned boost slowly back toward zero.
-  if (!isnan(gLastToutMed)) {
-    float dT_out = med_out - gLastToutMed;
-    bool pumpOnlyPrev = (prevPumpOn && !prevHeaterOn);
-    if (pumpOnlyPrev) {
-      if (dT_out < appConfig.pumpProgressMin) {
-        gPumpDeltaBoost = fminf(appConfig.pumpLearnMax,
-          gPumpDeltaBoost + appConfig.pumpLearnStepUp);
-      }
-      else {
-        gPumpDeltaBoost = fmaxf(0.0f,
-          gPumpDeltaBoost - appConfig.pumpLearnStepDown);
-      }
-    }
-    else {
-      gPumpDeltaBoost = fmaxf(0.0f,
-        gPumpDeltaBoost - appConfig.pumpLearnStepDown);
-    }
-  }
-
-  float DELTA_ON = 0.0f;
-  float DELTA_OFF = 0.0f;
-  computePumpDeltas(t_in, in_min, in_max, DELTA_ON, DELTA_OFF);
-
-  // =====================================================================
-  //                          Setpoint mode
-  // =====================================================================
-  if (!hardCool && appConfig.bathSetEnabled) {
-    bool targetHeat = false;
-    bool targetPump = false;
-    String reason;
-
-    float tgt = appConfig.bathSetTarget;
-    float hyst = fmaxf(0.1f, appConfig.bathSetHyst);
-    if (isfinite(out_max)) {
-      tgt = fminf(tgt, out_max - 0.2f);
-    }
-
-    bool bathLow = (med_out < tgt - hyst);
-    bool bathHigh = (med_out > tgt + hyst);
-    bool bathOk = (!bathLow && !bathHigh);
-
-    if (bathLow) {
-      if (!tankValid) {
-        targetHeat = false;
-        targetPump = false;
-        reason = "[SAFETY] Tank reading unavailable; automatic heating blocked until inspected";
-      }
-      else {
-        if (t_tank < tgt + DELTA_ON) {
-          targetHeat = true;
-          if (delta_tank_out > 0.5f) {
-            targetPump = true;
-            reason = String("[Setpoint] t_out_med=") + String(med_out, 1) +
-              " < (" + String(tgt, 1) + "-" + String(hyst, 1) +
-              ") -> heat tank and circulate";
-          }
-          else {
-            targetPump = false;
-            reason = String("[Setpoint] t_out_med=") + String(med_out, 1) +
-              " < (" + String(tgt, 1) + "-" + String(hyst, 1) +
-              ") -> tank cold, heater only";
-          }
-        }
-        else {
-          if (delta_tank_out > DELTA_ON) {
-            targetHeat = true;
-            targetPump = true;
-            reason = String("[Setpoint] t_out_med=") + String(med_out, 1) +
-              " < (" + String(tgt, 1) + "-" + String(hyst, 1) +
-              ") -> surplus tank heat available, heater + pump";
-          }
-          else {
-            targetHeat = true;
-            targetPump = false;
-            reason = String("[Setpoint] t_out_med=") + String(med_out, 1) +
-              " < (" + String(tgt, 1) + "-" + String(hyst, 1) +
-              ") -> prioritize heater";
-          }
-        }
-      }
-    }
-    else if (bathHigh) {
-      targetHeat = false;
-      targetPump = false;
-      reason = String("[Setpoint] t_out_med=") + String(med_out, 1) +
-        " > (" + String(tgt, 1) + "+" + String(hyst, 1) +
-        ") -> cooling down";
-    }
-    else if (bathOk) {
-      targetHeat = false;
-      if (tankValid && (delta_tank_out > DELTA_ON)) {
-        targetPump = true;
-        reason = String("[Setpoint] |t_out_med-") + String(tgt, 1) +
-          "| <= " + String(hyst, 1) +
-          " and tank is warmer -> gentle pump assist";
-      }
-      else {
-        targetPump = false;
-        reason = String("[Setpoint] |t_out_med-") + String(tgt, 1) +
-          "| <= " + String(hyst, 1) + " -> hold temperature";
-      }
-    }
-
-    bool heaterManualActive = isManualLockActive(heaterManualUntilMs);
-    bool pumpManualActive = isManualLockActive(pumpManualUntilMs);
-    if (heaterManualActive) {
-      targetHeat = heaterIsOn;
-      reason += " | heater manual lock active";
-    }
-    if (pumpManualActive) {
-      targetPump = pumpIsOn;
-      reason += " | pump manual lock active";
-    }
-
-    applyTankSafetyCheck(tankValid, tankOver, targetHeat, reason);
-    const float deltaSafetyLimit = fmaxf(5.0f, DELTA_ON * 1.6f + appConfig.pumpHystNom);
-    applyTankBathDeltaSafety(tankValid, delta_tank_out, deltaSafetyLimit,
-      targetHeat, targetPump, reason);
-
-    applyHeaterPumpTargets(targetHeat, targetPump, hardCool, msgSafety, reason);
-    checkAndControlAerationByTimer();
-
-    bool ok = buildChannelsAndPublish(t_in, t_outs, t_tank, tankValid, ts, nowEpoch, "Setpoint");
-    gLastToutMed = med_out;
-    return ok;
-  }
-
-  // =====================================================================
-  //                          n-curve mode
-  // =====================================================================
-  bool targetHeat = false;
-  bool targetPump = false;
-  String reason;
-
-  if (!hardCool) {
-    bool bathWantHeat = false;
-
-    if (t_in < in_min) {
-      bathWantHeat = true;
-      reason = String("t_in ") + String(t_in, 2) +
-        " < " + String(in_min, 2) + " -> heat demand";
-    }
-    else {
-      float u = 0.0f;
-      if (in_max > in_min) {
-        float t_ref = min(max(t_in, in_min), in_max);
-        u = (t_ref - in_min) / (in_max - in_min);
-      }
-      const float diff_max = (float)appConfig.tempMaxDiff;
-      const float diff_min = max(0.1f, diff_max * 0.02f);
-      float DIFF_THR = diff_min + (diff_max - diff_min) *
-        powf(u, appConfig.inDiffNCurveGamma);
-      bathWantHeat = (diff_now > DIFF_THR);
-
-      reason = String("diff_now=") + String(diff_now, 2) +
-        (bathWantHeat ? " > " : " <= ") +
-        "thr " + String(DIFF_THR, 2);
-    }
-
-    targetHeat = bathWantHeat;
-    applyTankSafetyCheck(tankValid, tankOver, targetHeat, reason);
-
-    if (tankValid && !targetHeat && !tankOver && (delta_tank_out < DELTA_ON)) {
-      targetHeat = true;
-      reason += " | tank delta=" + String(delta_tank_out, 1) +
-        " < delta_on=" + String(DELTA_ON, 1) +
-        " -> preheat tank";
-    }
-
-    bool heaterManualActive = isManualLockActive(heaterManualUntilMs);
-    bool pumpManualActive = isManualLockActive(pumpManualUntilMs);
-    if (heaterManualActive) {
-      targetHeat = heaterIsOn;
-      reason += " | heater manual lock active";
-    }
-
-    if (!pumpManualActive) {
-      targetPump = false;
-    }
-    else {
-      targetPump = pumpIsOn;
-      reason += " | pump manual lock active";
-    }
+  // Learning, mode decision and safety guards (control_logic.cpp).
+  AutotuneRequest autotuneRequest = gAutotuneRequest;
+  gAutotuneRequest = AUTOTUNE_REQUEST_NONE;
+  ControlSample sample = { t_in, t_tank, med_out, millis() };
+  ControlResult result;
+  runControlCycle(controlParamsFromConfig(), gControl, sample, autotuneRequest, result);
+  applyControlOutputs();
 
-    if (!pumpManualActive && tankValid && bathWantHeat && !tankOver) {
-      if (delta_tank_out > DELTA_ON) {
-        targetPump = true;
-        targetHeat = true;
-        reason += " | tank delta=" + String(delta_tank_out, 1) +
-          " > delta_on=" + String(DELTA_ON, 1) +
-          " -> heater + pump";
-      }
-      else if (delta_tank_out > DELTA_OFF) {
-        targetPump = pumpIsOn;
-        reason += " | tank delta=" + String(delta_tank_out, 1) +
-          " within delta_off..delta_on -> keep pump state";
-      }
-      else {
-        targetPump = false;
-        reason += " | tank delta=" + String(delta_tank_out, 1) +
-          " < delta_off=" + String(DELTA_OFF, 1) +
-          " -> heater only";
-      }
+  if (result.gainsTuned) {
+    appConfig.pidKp = result.tunedGains.kp;
+    appConfig.pidKi = result.tunedGains.ki;
+    appConfig.pidKd = result.tunedGains.kd;
+    if (!saveConfigToSPIFFS("/config.json")) {
+      Serial.println("[Autotune] Tuned gains active but not saved");
     }
   }
 
-  const float deltaSafetyLimit = fmaxf(5.0f, DELTA_ON * 1.6f + appConfig.pumpHystNom);
-  applyTankBathDeltaSafety(tankValid, delta_tank_out, deltaSafetyLimit,
-    targetHeat, targetPump, reason);
-
-  applyHeaterPumpTargets(targetHeat, targetPump, hardCool, msgSafety, reason);
   checkAndControlAerationByTimer();
+  const float out_max = (float)appConfig.tempLimitOutMax;
+  if (isnan(result.target)) {
+    // No bath setpoint in n-curve mode: stay at full resolution.
+    selectTempResolution(med_out, NAN, 0.0f, out_max, false);
+  }
+  else {
+    selectTempResolution(med_out, result.target, result.hyst, out_max,
+      needFullTempResolution(prevHeaterOn, result.tankValid, t_tank));
+  }
+  controlTimer.stop();
 
-  bool ok = buildChannelsAndPublish(t_in, t_outs, t_tank, tankValid, ts, nowEpoch, "n-curve");
-  gLastToutMed = med_out;
-
-  return ok;
+  return buildChannelsAndPublish(t_in, t_outs, t_tank, result.tankValid, ts, nowEpoch, result.modeTag);
 }
 
 // ========================= Measurement task =========================
+// Next edge of the timed aeration window (or the end of a manual lock, after
+// which the timer takes over again); false when the timer cannot act.
+static bool nextAerationEdgeMs(unsigned long& dueMs) {
+  if (!appConfig.aerationTimerEnabled || shouldBlockControl()) return false;
+  if (isManualLockActive(aerationManualUntilMs, millis())) {
+    if (aerationManualUntilMs == MANUAL_LOCK_FOREVER) return false;
+    dueMs = aerationManualUntilMs;
+    return true;
+  }
+  dueMs = preAerationMs + (aerationIsOn ? appConfig.aerationDuration : appConfig.aerationInterval);
+  return true;
+}
+
+// Sleeps until the next measurement, DS18B20 prefetch or aeration edge,
+// whichever comes first; commands that move those deadlines wake it early.
 void measurementTask(void* pv) {
+  bool prefetched = false;
   while (true) {
-    if (millis() - prevMeasureMs >= appConfig.postInterval) {
-      prevMeasureMs = millis();
+    unsigned long now = millis();
+    if (now - prevMeasureMs >= appConfig.postInterval) {
+      prevMeasureMs = now;
+      prefetched = false;
       doMeasurementAndSave();
+      continue;
     }
-    vTaskDelay(500 / portTICK_PERIOD_MS);
+
+    // Start the DS18B20 conversion ahead of the cycle so it is ready when due.
+    unsigned long measureDueMs = prevMeasureMs + appConfig.postInterval;
+    unsigned long prefetchDueMs = measureDueMs - (tempConversionMs() + TEMP_PREFETCH_SLACK_MS);
+    if (!prefetched && (now - prefetchDueMs) < 0x80000000UL) {
+      startTempConversion();
+      prefetched = true;
+    }
+
+    // Aeration windows open and close on time, not at the next measurement.
+    if (!shouldBlockControl()) {
+      checkAndControlAerationByTimer();
+    }
+
+    NextWake next(millis(), TASK_MAX_SLEEP_MS);
+    next.at(measureDueMs);
+    if (!prefetched) next.at(prefetchDueMs);
+    unsigned long aerationDueMs = 0;
+    if (nextAerationEdgeMs(aerationDueMs)) next.at(aerationDueMs);
+    sleepUntilWake(next);
   }
 }
 
 // ========================= Command scheduler task =========================
+// Sleeps until the earliest pending targetTimeMs; mqttCallback wakes it when
+// a command is queued, so immediate commands run without a poll delay.
 void commandTask(void* pv) {
+  PendingCommand cmd;
   while (true) {
     unsigned long now = millis();
+    NextWake next(now, TASK_MAX_SLEEP_MS);
 
-    // Collect due commands first.
-    std::vector<PendingCommand> readyToExecute;
+    // Pop one due command at a time: executing it may cancel or replace
+    // other pending commands of the same device.
+    bool due = false;
     if (gCmdMutex && xSemaphoreTake(gCmdMutex, pdMS_TO_TICKS(200))) {
-      // Iterate backward so erasing entries does not invalidate later indexes.
-      for (int i = (int)pendingCommands.size() - 1; i >= 0; --i) {
-        if ((now - pendingCommands[i].targetTimeMs) < 0x80000000UL) {
-          readyToExecute.push_back(pendingCommands[i]);
-          pendingCommands.erase(pendingCommands.begin() + i);
-        }
-      }
+      due = gCommandQueue.popDue(now, cmd);
+      unsigned long nextDueMs = 0;
+      if (!due && gCommandQueue.peekDue(nextDueMs)) next.at(nextDueMs);
       xSemaphoreGive(gCmdMutex);
     }
+    else {
+      next.in(200);   // Queue busy: retry shortly
+    }
 
-    // Execute commands outside the mutex to avoid blocking other tasks.
-    std::reverse(readyToExecute.begin(), readyToExecute.end());
-    for (const auto& cmd : readyToExecute) {
+    // Execute outside the mutex to avoid blocking other tasks.
+    if (due) {
       executeCommand(cmd);
+      continue;
     }
-
-    vTaskDelay(200 / portTICK_PERIOD_MS);
+    sleepUntilWake(next);
   }
 }
 
-// ========================= Startup =========================
-void setup() {
-  Serial.begin(115200);
-  Serial.println("[System] Starting...");
-
-  initEmergencyStop();
-
-  if (!initSPIFFS()) {
-    Serial.println("[System] SPIFFS init failed, restarting");
-    delay(1000);
-    ESP.restart();
+// ========================= Diagnostics payload =========================
+static void fillDiagDoc(JsonDocument& doc, const char* reason) {
+  doc["schema_version"] = 2;
+  doc["ts"] = getTimeString();
+  doc["uptime_ms"] = millis();
+  doc["reason"] = reason;
+
+  PhaseStats stats[PHASE_TIMER_MAX_PHASES];
+  size_t phaseCount = snapshotPhaseStats(stats, PHASE_TIMER_MAX_PHASES);
+  JsonArray phases = doc["phases"].to<JsonArray>();
+  for (size_t i = 0; i < phaseCount; i++) {
+    JsonObject p = phases.add<JsonObject>();
+    p["name"] = stats[i].name;
+    p["count"] = stats[i].count;
+    p["last_us"] = stats[i].lastUs;
+    p["min_us"] = stats[i].minUs;
+    p["avg_us"] = stats[i].avgUs();
+    p["max_us"] = stats[i].maxUs;
+  }
+
+  PhaseSample samples[PHASE_TIMER_RING_SIZE];
+  size_t sampleCount = snapshotPhaseSamples(samples, PHASE_TIMER_RING_SIZE);
+  JsonArray recent = doc["recent"].to<JsonArray>();
+  for (size_t i = 0; i < sampleCount; i++) {
+    JsonObject r = recent.add<JsonObject>();
+    r["phase"] = phaseName(samples[i].phase);
+    r["us"] = samples[i].us;
+  }
+
+#if HEAP_MONITOR_ENABLED
+  HeapStats heapStats;
+  sampleHeapStats(heapStats);
+  JsonObject heap = doc["heap"].to<JsonObject>();
+  heap["free"] = heapStats.freeHeap;
+  heap["max_block"] = heapStats.largestBlock;
+  heap["min_free"] = heapStats.minFreeHeap;
+  heap["frag"] = heapStats.fragmentation;
+  heap["stack_measure"] = heapStats.measureStack;
+  heap["stack_command"] = heapStats.commandStack;
+#endif
+
+  JsonObject queue = doc["telemetry_queue"].to<JsonObject>();
+  queue["outbox"] = gTelemetryOutbox.size();
+  queue["outbox_dropped"] = gTelemetryOutbox.dropped();
+  queue["ram"] = gTelemetryRetry.ramCount();
+  queue["flash"] = gTelemetryRetry.flashCount();
+  queue["flash_capacity"] = TELEMETRY_FLASH_SLOTS;
+  queue["evicted"] = gTelemetryRetry.evicted();
+
+  JsonObject aeration = doc["aeration"].to<JsonObject>();
+  aeration["duty"] = aerationDutyPct();
+  aeration["ramp"] = aerationRampStateName(aerationRampState());
+
+  JsonObject pid = doc["pid"].to<JsonObject>();
+  pid["mode"] = controlModeName(appConfig.controlMode);
+  pid["p"] = gControl.pid.p();
+  pid["i"] = gControl.pid.i();
+  pid["d"] = gControl.pid.d();
+  pid["ff"] = gControl.pid.ff();
+  pid["out"] = gControl.pid.output();
+  JsonObject autotune = pid["autotune"].to<JsonObject>();
+  autotune["state"] = autotuneStateName(gControl.autotune.state());
+  autotune["cycles"] = gControl.autotune.cycles();
+  if (gControl.autotune.state() == AUTOTUNE_DONE) {
+    autotune["ku"] = gControl.autotune.ultimateGain();
+    autotune["pu_s"] = gControl.autotune.ultimatePeriodSec();
+  }
+  else if (gControl.autotune.state() == AUTOTUNE_FAILED) {
+    autotune["error"] = gControl.autotune.failReason();
+  }
+
+  const ThermalModel& model = gControl.model;
+  JsonObject mpc = doc["mpc"].to<JsonObject>();
+  mpc["ready"] = model.ready();
+  mpc["samples"] = model.samples();
+  // kHeat, kTankXfer, kTankLoss, kBathXfer, kBathCore, cBath, kCoreBath, cCore
+  JsonArray k = mpc["k"].to<JsonArray>();
+  for (float v : { model.kHeat(), model.kTankXfer(), model.kTankLoss(), model.kBathXfer(),
+    model.kBathCore(), model.cBath(), model.kCoreBath(), model.cCore() }) {
+    k.add(v);
+  }
+  if (gControl.planValid) {
+    JsonObject plan = mpc["plan"].to<JsonObject>();
+    plan["heater"] = gControl.lastPlan.first.heater * 100.0f;
+    plan["pump"] = gControl.lastPlan.first.pump * 100.0f;
+    plan["peak"] = gControl.lastPlan.bathPeak;
+    plan["end"] = gControl.lastPlan.bathAtHorizon;
+    plan["feasible"] = gControl.lastPlan.feasible;
+  }
+
+  JsonObject arenas = doc["json_arena"].to<JsonObject>();
+  for (JsonArena* arena : { &telemetryJsonArena(), &mqttJsonArena() }) {
+    JsonObject a = arenas[arena->name()].to<JsonObject>();
+    a["high_water"] = arena->highWater();
+    a["capacity"] = arena->capacity();
+    a["failures"] = arena->failures();
   }
-  if (!loadConfigFromSPIFFS("/config.json")) {
-    Serial.println("[System] Config unavailable, starting with fallback defaults");
+}
+
+static size_t serializeDiagDoc(JsonDocument& doc) {
+  if (doc.overflowed() || measureJson(doc) >= sizeof(gDiagPayload)) {
+    return 0;
   }
-  printConfig(appConfig);
+  return serializeJson(doc, gDiagPayload, sizeof(gDiagPayload));
+}
 
-  bool wifiReady = connectToWiFi(20000);
-  bool ntpReady = false;
-  if (wifiReady) {
-    ntpReady = multiNTPSetup(30000);
-    if (!ntpReady) {
-      Serial.println("[System] NTP failed, continue with local control and degraded timestamps");
-    }
+// Answers a diag command, or publishes every diag_interval ms when enabled.
+static void publishDiagnosticsIfNeeded() {
+  unsigned long nowMs = millis();
+  const char* reason = nullptr;
+  if (gDiagRequested) {
+    reason = "command";
   }
-  else {
-    Serial.println("[System] WiFi failed, continue with local control mode");
+  else if (appConfig.diagInterval > 0 && nowMs - gLastDiagMs >= appConfig.diagInterval) {
+    reason = "periodic";
   }
-
-  if (wifiReady) {
-    getMQTTClient().setCallback(mqttCallback);
-    if (!connectToMQTT(20000)) {
-      Serial.println("[System] MQTT failed, continue with local control mode");
-    }
+  if (!reason || !getMQTTClient().connected()) {
+    return;
   }
+  gDiagRequested = false;
+  gLastDiagMs = nowMs;
 
-  if (!initSensors(4, 5, 25, 26, 27)) {
-    Serial.println("[System] Sensor init failed, restarting");
-    ESP.restart();
+  size_t len = 0;
+  {
+    JsonDocument doc(&mqttJsonArena());
+    fillDiagDoc(doc, reason);
+    len = serializeDiagDoc(doc);
+  }
+  if (len == 0) {
+    JsonDocument doc;
+    fillDiagDoc(doc, reason);
+    len = serializeDiagDoc(doc);
+    if (len == 0) {
+      Serial.println("[Diag] Diagnostics payload too large, dropped");
+      return;
+    }
   }
 
-  gCmdMutex = xSemaphoreCreateMutex();
-  gPublishMutex = xSemaphoreCreateMutex();
-
-  String nowStr = ntpReady ? getTimeString() : String("1970-01-01 00:00:00");
-  String ipAddress = getPublicIP();
+  static const String topic = getDiagTopic();
+  bool ok = publishOnce(topic.c_str(), gDiagPayload, len);
+  Serial.printf("[Diag] Diagnostics (%s, %u bytes) %s\n",
+    reason, (unsigned)len, ok ? "published" : "publish failed");
+}
 
-  JsonDocument bootDoc;
+// ========================= Boot payload =========================
+static void fillBootDoc(JsonDocument& bootDoc, const String& nowStr, const String& ipAddress) {
   bootDoc["schema_version"] = 2;
   bootDoc["timestamp"] = nowStr;
   bootDoc["ip_address"] = ipAddress;
 
+  // ROM of the probe registered in each slot (in: TempIn, TankTemp; out: TempOut1..3).
+  std::vector<String> inRoms;
+  std::vector<String> outRoms;
+  getProbeRoms(inRoms, outRoms);
+  JsonObject probes = bootDoc["probes"].to<JsonObject>();
+  JsonArray probesIn = probes["in"].to<JsonArray>();
+  for (const auto& rom : inRoms) probesIn.add(rom);
+  JsonArray probesOut = probes["out"].to<JsonArray>();
+  for (const auto& rom : outRoms) probesOut.add(rom);
+
   JsonObject config = bootDoc["config"].to<JsonObject>();
 
   JsonObject wifi = config["wifi"].to<JsonObject>();
@@ -1232,6 +1258,9 @@ void setup() {
   config["temp_limitout_min"] = appConfig.tempLimitOutMin;
   config["temp_limitin_min"] = appConfig.tempLimitInMin;
   config["temp_maxdif"] = appConfig.tempMaxDiff;
+  config["heap_report_interval"] = appConfig.heapReportInterval;
+  config["diag_interval"] = appConfig.diagInterval;
+  config["telemetry_batch"] = appConfig.telemetryBatch;
 
   JsonObject aerationTimer = config["aeration_timer"].to<JsonObject>();
   aerationTimer["enabled"] = appConfig.aerationTimerEnabled;
@@ -1244,6 +1273,8 @@ void setup() {
   JsonObject heaterGuard = config["heater_guard"].to<JsonObject>();
   heaterGuard["min_on_ms"] = appConfig.heaterMinOnMs;
   heaterGuard["min_off_ms"] = appConfig.heaterMinOffMs;
+  heaterGuard["window_ms"] = appConfig.heaterWindowMs;
+  config["pump_pwm"]["window_ms"] = appConfig.pumpWindowMs;
 
   JsonObject pumpAdaptive = config["pump_adaptive"].to<JsonObject>();
   pumpAdaptive["delta_on_min"] = appConfig.pumpDeltaOnMin;
@@ -1265,8 +1296,85 @@ void setup() {
   bathSetpoint["target"] = appConfig.bathSetTarget;
   bathSetpoint["hyst"] = appConfig.bathSetHyst;
 
+  config["control_mode"] = controlModeName(appConfig.controlMode);
+  JsonObject pid = config["pid"].to<JsonObject>();
+  pid["kp"] = appConfig.pidKp;
+  pid["ki"] = appConfig.pidKi;
+  pid["kd"] = appConfig.pidKd;
+  pid["kff"] = appConfig.pidKff;
+  pid["autotune_hyst"] = appConfig.pidAutotuneHyst;
+  JsonObject mpc = config["mpc"].to<JsonObject>();
+  mpc["horizon_s"] = appConfig.mpcHorizonS;
+  mpc["energy_weight"] = appConfig.mpcEnergyWeight;
+  mpc["overshoot_weight"] = appConfig.mpcOvershootWeight;
+}
+
+// ========================= Startup =========================
+void setup() {
+  Serial.begin(115200);
+  Serial.println("[System] Starting...");
+  setControlLogger(logControlLine);
+
+  initEmergencyStop();
+
+  if (!initSPIFFS()) {
+    Serial.println("[System] SPIFFS init failed, restarting");
+    delay(1000);
+    ESP.restart();
+  }
+  if (!loadConfigFromSPIFFS("/config.json")) {
+    Serial.println("[System] Config unavailable, starting with fallback defaults");
+  }
+  printConfig(appConfig);
+  gTelemetryRetry.begin();
+
+  bool wifiReady = connectToWiFi(20000);
+  bool ntpReady = false;
+  if (wifiReady) {
+    ntpReady = multiNTPSetup(30000);
+    if (!ntpReady) {
+      Serial.println("[System] NTP failed, continue with local control and degraded timestamps");
+    }
+  }
+  else {
+    Serial.println("[System] WiFi failed, continue with local control mode");
+  }
+
+  if (wifiReady) {
+    getMQTTClient().setCallback(mqttCallback);
+    if (!connectToMQTT(20000)) {
+      Serial.println("[System] MQTT failed, continue with local control mode");
+    }
+  }
+
+  if (!initSensors(4, 5, 25, 26, 27)) {
+    Serial.println("[System] Sensor init failed, restarting");
+    ESP.restart();
+  }
+  initActuators();
+  actuatorConfigure(ACTUATOR_HEATER, appConfig.heaterWindowMs, appConfig.heaterMinOnMs, appConfig.heaterMinOffMs);
+  actuatorConfigure(ACTUATOR_PUMP, appConfig.pumpWindowMs, PUMP_MIN_SWITCH_MS, PUMP_MIN_SWITCH_MS);
+
+  gCmdMutex = xSemaphoreCreateMutex();
+  gNetTask = xTaskGetCurrentTaskHandle();   // setup() and loop() share the Arduino loop task
+
+  String nowStr = ntpReady ? getTimeString() : String("1970-01-01 00:00:00");
+  String ipAddress = getPublicIP();
+
   String bootMsg;
-  serializeJson(bootDoc, bootMsg);
+  {
+    JsonDocument bootDoc(&mqttJsonArena());
+    fillBootDoc(bootDoc, nowStr, ipAddress);
+    if (!bootDoc.overflowed()) {
+      serializeJson(bootDoc, bootMsg);
+    }
+  }
+  if (bootMsg.length() == 0) {
+    Serial.println("[JSON] Boot payload exceeds arena, building on heap");
+    JsonDocument bootDoc;
+    fillBootDoc(bootDoc, nowStr, ipAddress);
+    serializeJson(bootDoc, bootMsg);
+  }
   gPendingBootPayload = bootMsg;
   gBootPayloadPending = bootMsg.length() > 0;
 
@@ -1288,6 +1396,7 @@ void setup() {
     unsigned long lastSecMea = preferences.getULong(NVS_KEY_LAST_MEAS, 0);
     unsigned long lastSecAera = preferences.getULong(NVS_KEY_LAST_AERATION, 0);
     time_t nowSec = time(nullptr);
+    gLastSavedMeasEpoch = (time_t)lastSecMea;
 
     if (nowSec > 0 && lastSecAera > 0) {
       unsigned long long elapsedAeraMs64 = (unsigned long long)(nowSec - lastSecAera) * 1000ULL;
@@ -1315,17 +1424,30 @@ void setup() {
     preAerationMs = millis() - appConfig.aerationInterval;
   }
 
-  xTaskCreatePinnedToCore(measurementTask, "MeasureTask", 8192, NULL, 1, NULL, 1);
-  xTaskCreatePinnedToCore(commandTask, "CommandTask", 4096, NULL, 1, NULL, 1);
+  gPhaseCycle = registerPhase("cycle");
+  gPhaseProbes = registerPhase("onewire");
+  gPhaseMedian = registerPhase("median");
+  gPhaseControl = registerPhase("control");
+  gPhasePublish = registerPhase("publish");
+
+  xTaskCreatePinnedToCore(measurementTask, "MeasureTask", 8192, NULL, 1, &gMeasureTask, 1);
+  xTaskCreatePinnedToCore(commandTask, "CommandTask", 4096, NULL, 1, &gCommandTask, 1);
+  heapMonitorSetTasks(gMeasureTask, gCommandTask);
 
   Serial.println("[System] Startup complete");
 }
 
 // ========================= 主循环 =========================
+// 网络任务：唯一持有 PubSubClient 的任务。其它任务只往 outbox 里投递，
+// 不会因为 broker 不稳定而被阻塞。
 void loop() {
   // 保持MQTT连接并处理心跳（高频调用）
   maintainMQTT(5000);
+  drainTelemetryOutbox();
   publishPendingBootPayloadIfNeeded();
   flushPendingTelemetryIfNeeded();
-  delay(100);
+  publishDiagnosticsIfNeeded();
+
+  // MeasureTask 投递遥测时立即唤醒，否则按轮询间隔处理心跳与下行命令
+  sleepUntilWake(NextWake(millis(), NET_TASK_POLL_MS));
 }
@@ -0,0 +1,69 @@
+#include "mpc_planner.h"
+#include <math.h>
+
+static const float HEATER_LEVELS[] = { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f };
+static const float PUMP_LEVELS[] = { 0.0f, 0.5f, 1.0f };
+static const float PUMP_ENERGY_SHARE = 0.1f;   // Pump costs a tenth of the heater per % duty
+static const float TANK_MARGIN = 1.0f;         // C below tank_temp_max still treated as a limit
+
+struct Rollout {
+  float cost;
+  float bathEnd;
+  float bathPeak;
+  bool feasible;
+};
+
+static Rollout rollout(const ThermalModel& model, const ThermalState& now, const MpcConfig& cfg,
+  const ThermalInput& first, const ThermalInput& rest, uint8_t firstSteps) {
+  Rollout r = { 0.0f, now.bath, now.bath, true };
+  ThermalState s = now;
+  for (uint8_t k = 0; k < cfg.steps; k++) {
+    const ThermalInput& u = k < firstSteps ? first : rest;
+    s = model.predict(s, u, cfg.stepMin);
+    if (s.tank >= cfg.tankMax - TANK_MARGIN || s.bath >= cfg.bathMax) {
+      r.feasible = false;
+    }
+    float err = s.bath - cfg.target;
+    r.cost += err * err;
+    if (err > 0.0f) r.cost += cfg.overshootWeight * err * err;
+    r.cost += cfg.energyWeight * 100.0f * (u.heater + PUMP_ENERGY_SHARE * u.pump);
+    r.bathPeak = fmaxf(r.bathPeak, s.bath);
+  }
+  r.bathEnd = s.bath;
+  return r;
+}
+
+MpcPlan planHeaterPump(const ThermalModel& model, const ThermalState& now, const MpcConfig& cfg) {
+  MpcConfig c = cfg;
+  if (c.steps < 1) c.steps = 1;
+  if (c.steps > MPC_MAX_STEPS) c.steps = MPC_MAX_STEPS;
+  uint8_t firstSteps = c.steps >= 3 ? c.steps / 3 : 1;
+
+  MpcPlan best;
+  best.first = { 0.0f, 0.0f };
+  best.rest = { 0.0f, 0.0f };
+  best.cost = INFINITY;
+  best.bathAtHorizon = now.bath;
+  best.bathPeak = now.bath;
+  best.feasible = false;
+
+  for (float h1 : HEATER_LEVELS) {
+    for (float p1 : PUMP_LEVELS) {
+      ThermalInput first = { h1, p1 };
+      for (float h2 : HEATER_LEVELS) {
+        for (float p2 : PUMP_LEVELS) {
+          ThermalInput rest = { h2, p2 };
+          Rollout r = rollout(model, now, c, first, rest, firstSteps);
+          if (!r.feasible || r.cost >= best.cost) continue;
+          best.first = first;
+          best.rest = rest;
+          best.cost = r.cost;
+          best.bathAtHorizon = r.bathEnd;
+          best.bathPeak = r.bathPeak;
+          best.feasible = true;
+        }
+      }
+    }
+  }
+  return best;
+}
@@ -0,0 +1,38 @@
+#ifndef MPC_PLANNER_H
+#define MPC_PLANNER_H
+
+#include "thermal_model.h"
+
+// Short-horizon predictive choice of heater and pump duty for control_mode
+// "mpc". Candidate plans hold one heater/pump pair for the first third of
+// the horizon and another for the rest; each is rolled out on the thermal
+// model and scored on bath tracking error, extra weight on overshoot above
+// the target, and heater/pump energy. Plans that push the tank or the bath
+// over their limits are rejected. Only the first block of the best plan is
+// applied; the search repeats every measurement cycle (receding horizon).
+// Plain C++ like thermal_model.h.
+
+static const uint8_t MPC_MAX_STEPS = 60;
+
+struct MpcConfig {
+  float target;           // Bath target (C)
+  float bathMax;          // Bath hard limit (C)
+  float tankMax;          // Tank hard limit (C)
+  float energyWeight;     // Cost per % heater duty per step, in C^2
+  float overshootWeight;  // Extra factor on squared error above the target
+  float stepMin;          // Prediction step (min), the measurement interval
+  uint8_t steps;          // Horizon length in steps, 1..MPC_MAX_STEPS
+};
+
+struct MpcPlan {
+  ThermalInput first;     // Duties to apply now (0..1)
+  ThermalInput rest;      // Duties assumed after the first block
+  float cost;
+  float bathAtHorizon;    // Predicted bath temperature at the horizon end
+  float bathPeak;         // Highest predicted bath temperature
+  bool feasible;          // False when every plan broke a limit (first = all off)
+};
+
+MpcPlan planHeaterPump(const ThermalModel& model, const ThermalState& now, const MpcConfig& cfg);
+
+#endif
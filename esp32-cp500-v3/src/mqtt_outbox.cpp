@@ -0,0 +1,40 @@
+#include "mqtt_outbox.h"
+
+OutboxMessage* MqttOutbox::reserve() {
+  uint32_t tail = _tail.load(std::memory_order_relaxed);
+  uint32_t head = _head.load(std::memory_order_acquire);
+  if (tail - head >= MQTT_OUTBOX_SLOTS) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+  }
+  OutboxMessage* msg = &_slots[tail % MQTT_OUTBOX_SLOTS];
+  msg->topic[0] = '\0';
+  msg->payload[0] = '\0';
+  msg->length = 0;
+  msg->sampleEpoch = 0;
+  msg->onDone = nullptr;
+  return msg;
+}
+
+void MqttOutbox::commit() {
+  // Release: the slot contents become visible before the new tail.
+  _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+OutboxMessage* MqttOutbox::front() {
+  uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+  return &_slots[head % MQTT_OUTBOX_SLOTS];
+}
+
+void MqttOutbox::pop() {
+  // Release: the producer may reuse the slot only after we are done with it.
+  _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+uint8_t MqttOutbox::size() const {
+  // Head first: the tail read afterwards can only be further ahead.
+  uint32_t head = _head.load(std::memory_order_acquire);
+  uint32_t tail = _tail.load(std::memory_order_acquire);
+  return (uint8_t)(tail - head);
+}
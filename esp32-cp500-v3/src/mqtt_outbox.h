@@ -0,0 +1,51 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <Arduino.h>
+#include <atomic>
+#include <time.h>
+#include "json_arena.h"
+
+static const uint8_t MQTT_OUTBOX_SLOTS = 4;
+static const size_t MQTT_TOPIC_MAX = 96;
+
+struct OutboxMessage;
+
+// Called by the network task once it has tried to publish a message.
+// published is false when the broker was unreachable or the write failed.
+typedef void (*OutboxDoneFn)(const OutboxMessage& msg, bool published);
+
+struct OutboxMessage {
+  char topic[MQTT_TOPIC_MAX];
+  char payload[JSON_DOC_SIZE];
+  size_t length;
+  time_t sampleEpoch;       // Passed through to onDone, e.g. for NVS_KEY_LAST_MEAS
+  OutboxDoneFn onDone;      // May be null
+};
+
+// Lock-free single-producer/single-consumer ring of outgoing MQTT messages.
+// The producer fills a slot in place (serializing straight into payload) and
+// commits it; the network task, which alone owns the PubSubClient, publishes
+// and pops. Neither side ever blocks: a full ring makes reserve() fail.
+// Indices are free-running counters, so full and empty need no spare slot.
+class MqttOutbox {
+public:
+  // Producer side.
+  OutboxMessage* reserve();     // Null while the ring is full
+  void commit();                // Publishes the slot returned by reserve()
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+  // Consumer side.
+  OutboxMessage* front();       // Oldest committed message, null when empty
+  void pop();
+
+  uint8_t size() const;
+
+private:
+  OutboxMessage _slots[MQTT_OUTBOX_SLOTS];
+  std::atomic<uint32_t> _head{0};      // Next slot to publish (written by consumer)
+  std::atomic<uint32_t> _tail{0};      // Next slot to fill (written by producer)
+  std::atomic<uint32_t> _dropped{0};   // reserve() calls that found the ring full
+};
+
+#endif
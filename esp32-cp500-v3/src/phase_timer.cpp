@@ -0,0 +1,81 @@
+#include "phase_timer.h"
+
+#if PHASE_TIMER_ENABLED
+
+#include "freertos/FreeRTOS.h"
+
+static portMUX_TYPE gPhaseMux = portMUX_INITIALIZER_UNLOCKED;
+static PhaseStats gPhases[PHASE_TIMER_MAX_PHASES];
+static uint8_t gPhaseCount = 0;
+static PhaseSample gRing[PHASE_TIMER_RING_SIZE];
+static uint8_t gRingHead = 0;     // Next slot to write
+static uint8_t gRingFill = 0;
+
+uint8_t registerPhase(const char* name) {
+  uint8_t id = PHASE_ID_INVALID;
+  portENTER_CRITICAL(&gPhaseMux);
+  for (uint8_t i = 0; i < gPhaseCount; i++) {
+    if (strcmp(gPhases[i].name, name) == 0) {
+      id = i;
+      break;
+    }
+  }
+  if (id == PHASE_ID_INVALID && gPhaseCount < PHASE_TIMER_MAX_PHASES) {
+    id = gPhaseCount++;
+    gPhases[id] = PhaseStats();
+    gPhases[id].name = name;
+  }
+  portEXIT_CRITICAL(&gPhaseMux);
+
+  if (id == PHASE_ID_INVALID) {
+    Serial.printf("[Diag] Phase table full, '%s' not timed\n", name);
+  }
+  return id;
+}
+
+void recordPhase(uint8_t phase, uint32_t us) {
+  portENTER_CRITICAL(&gPhaseMux);
+  if (phase < gPhaseCount) {
+    PhaseStats& s = gPhases[phase];
+    if (s.count == 0 || us < s.minUs) s.minUs = us;
+    if (us > s.maxUs) s.maxUs = us;
+    s.lastUs = us;
+    s.totalUs += us;
+    s.count++;
+
+    gRing[gRingHead].phase = phase;
+    gRing[gRingHead].us = us;
+    gRingHead = (gRingHead + 1) % PHASE_TIMER_RING_SIZE;
+    if (gRingFill < PHASE_TIMER_RING_SIZE) gRingFill++;
+  }
+  portEXIT_CRITICAL(&gPhaseMux);
+}
+
+size_t snapshotPhaseStats(PhaseStats* out, size_t maxCount) {
+  portENTER_CRITICAL(&gPhaseMux);
+  size_t n = gPhaseCount < maxCount ? gPhaseCount : maxCount;
+  for (size_t i = 0; i < n; i++) {
+    out[i] = gPhases[i];
+  }
+  portEXIT_CRITICAL(&gPhaseMux);
+  return n;
+}
+
+size_t snapshotPhaseSamples(PhaseSample* out, size_t maxCount) {
+  portENTER_CRITICAL(&gPhaseMux);
+  size_t n = gRingFill < maxCount ? gRingFill : maxCount;
+  // Skip the oldest entries when the caller asked for fewer than are stored.
+  size_t start = (gRingHead + PHASE_TIMER_RING_SIZE - n) % PHASE_TIMER_RING_SIZE;
+  for (size_t i = 0; i < n; i++) {
+    out[i] = gRing[(start + i) % PHASE_TIMER_RING_SIZE];
+  }
+  portEXIT_CRITICAL(&gPhaseMux);
+  return n;
+}
+
+const char* phaseName(uint8_t phase) {
+  // Names are only appended and never change, so no lock is needed here.
+  return phase < gPhaseCount ? gPhases[phase].name : "";
+}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <Arduino.h>
+
+// Microsecond timing of measurement-cycle phases. Each phase keeps
+// count/last/min/max/total, and the most recent samples of all phases are kept
+// in a fixed ring for the diag payload. Recording takes a spinlock only long
+// enough to update a few counters, so it is safe to call from any task.
+// Build with -DPHASE_TIMER_ENABLED=0 to compile it out.
+#ifndef PHASE_TIMER_ENABLED
+#define PHASE_TIMER_ENABLED 1
+#endif
+
+static const uint8_t PHASE_TIMER_MAX_PHASES = 8;
+static const uint8_t PHASE_TIMER_RING_SIZE = 32;
+static const uint8_t PHASE_ID_INVALID = 0xFF;
+
+struct PhaseStats {
+  const char* name = nullptr;
+  uint32_t count = 0;
+  uint32_t lastUs = 0;
+  uint32_t minUs = 0;
+  uint32_t maxUs = 0;
+  uint64_t totalUs = 0;
+
+  uint32_t avgUs() const { return count ? (uint32_t)(totalUs / count) : 0; }
+};
+
+struct PhaseSample {
+  uint8_t phase = PHASE_ID_INVALID;
+  uint32_t us = 0;
+};
+
+#if PHASE_TIMER_ENABLED
+
+// Registers a phase name (must outlive the program, e.g. a string literal).
+// Registering the same name twice returns the same id.
+uint8_t registerPhase(const char* name);
+void recordPhase(uint8_t phase, uint32_t us);
+// Copies per-phase stats in registration order; returns the number copied.
+size_t snapshotPhaseStats(PhaseStats* out, size_t maxCount);
+// Copies the ring oldest first; returns the number copied.
+size_t snapshotPhaseSamples(PhaseSample* out, size_t maxCount);
+const char* phaseName(uint8_t phase);
+
+// Records the time between construction and stop() (or destruction).
+class ScopedPhaseTimer {
+public:
+  explicit ScopedPhaseTimer(uint8_t phase) : _phase(phase), _startUs(micros()) {}
+  ~ScopedPhaseTimer() { stop(); }
+
+  void stop() {
+    if (_phase == PHASE_ID_INVALID) return;
+    recordPhase(_phase, (uint32_t)(micros() - _startUs));
+    _phase = PHASE_ID_INVALID;
+  }
+
+private:
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+  uint8_t _phase;
+  unsigned long _startUs;
+};
+
+#else
+
+inline uint8_t registerPhase(const char*) { return PHASE_ID_INVALID; }
+inline void recordPhase(uint8_t, uint32_t) {}
+inline size_t snapshotPhaseStats(PhaseStats*, size_t) { return 0; }
+inline size_t snapshotPhaseSamples(PhaseSample*, size_t) { return 0; }
+inline const char* phaseName(uint8_t) { return ""; }
+
+class ScopedPhaseTimer {
+public:
+  explicit ScopedPhaseTimer(uint8_t) {}
+  void stop() {}
+};
+
+#endif
+
+#endif
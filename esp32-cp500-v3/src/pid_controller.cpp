@@ -0,0 +1,167 @@
+#include "pid_controller.h"
+#include <math.h>
+
+static const float PID_OUT_MAX = 100.0f;
+static const float PID_D_SMOOTHING = 0.5f;     // Derivative low-pass per sample (probe quantization noise)
+static const float RELAY_AMPLITUDE = 50.0f;    // Relay swings 0..100 % around a 50 % bias
+
+static float clampf(float v, float lo, float hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// ========================= BathPid =========================
+
+void BathPid::reset() {
+  _p = 0.0f;
+  _i = 0.0f;
+  _prevI = 0.0f;
+  _d = 0.0f;
+  _ff = 0.0f;
+  _out = 0.0f;
+  _prevMeasured = NAN;
+}
+
+float BathPid::update(float setpoint, float measured, float tankSurplus, float dtSec, const PidGains& gains) {
+  float err = setpoint - measured;
+  _p = gains.kp * err;
+  _ff = -gains.kff * fmaxf(0.0f, tankSurplus);
+
+  if (dtSec > 0.0f && !isnan(_prevMeasured)) {
+    float rawD = -gains.kd * (measured - _prevMeasured) / dtSec;
+    _d += (rawD - _d) * PID_D_SMOOTHING;
+  }
+  else {
+    _d = 0.0f;
+  }
+  _prevMeasured = measured;
+
+  _prevI = _i;
+  if (dtSec > 0.0f && gains.ki > 0.0f) {
+    float candidate = _i + gains.ki * err * dtSec;
+    float u = _p + candidate + _d + _ff;
+    // Conditional integration: stop integrating into a saturated output.
+    bool pushingHigh = u > PID_OUT_MAX && err > 0.0f;
+    bool pushingLow = u < 0.0f && err < 0.0f;
+    if (!pushingHigh && !pushingLow) {
+      _i = candidate;
+    }
+  }
+  else if (gains.ki <= 0.0f) {
+    _i = 0.0f;
+  }
+  // Steady state needs I = heater duty - ff, so the upper bound grows with the
+  // feed-forward; below 0 the integral could only hold the heater off longer.
+  _i = clampf(_i, 0.0f, PID_OUT_MAX - _ff);
+
+  _out = clampf(_p + _i + _d + _ff, 0.0f, PID_OUT_MAX);
+  return _out;
+}
+
+void BathPid::holdIntegral() {
+  _i = _prevI;
+}
+
+float BathPid::demand() const {
+  return clampf(_p + _i + _d, 0.0f, PID_OUT_MAX);
+}
+
+// ========================= RelayAutotune =========================
+
+void RelayAutotune::start(float setpoint, float hyst, float measured, unsigned long nowMs) {
+  _state = AUTOTUNE_RUNNING;
+  _failReason = "";
+  _setpoint = setpoint;
+  _hyst = fmaxf(0.05f, hyst);
+  _high = measured < setpoint;
+  _haveRise = false;
+  _startMs = nowMs;
+  _lastRiseMs = nowMs;
+  _max = measured;
+  _min = measured;
+  _cycles = 0;
+  _sumPeriodSec = 0.0f;
+  _sumAmplitude = 0.0f;
+  _ku = 0.0f;
+  _puSec = 0.0f;
+}
+
+void RelayAutotune::cancel() {
+  _state = AUTOTUNE_IDLE;
+  _failReason = "";
+}
+
+void RelayAutotune::fail(const char* reason) {
+  _state = AUTOTUNE_FAILED;
+  _failReason = reason;
+}
+
+float RelayAutotune::update(float measured, unsigned long nowMs) {
+  if (_state != AUTOTUNE_RUNNING) return 0.0f;
+  if (nowMs - _startMs > AUTOTUNE_MAX_MS) {
+    fail("timeout");
+    return 0.0f;
+  }
+
+  _max = fmaxf(_max, measured);
+  _min = fminf(_min, measured);
+
+  if (_high && measured > _setpoint + _hyst) {
+    _high = false;
+  }
+  else if (!_high && measured < _setpoint - _hyst) {
+    // Each switch back to heating closes one oscillation.
+    _high = true;
+    if (_haveRise) {
+      _cycles++;
+      if (_cycles > 1) {
+        _sumPeriodSec += (nowMs - _lastRiseMs) / 1000.0f;
+        _sumAmplitude += 0.5f * (_max - _min);
+      }
+      if (_cycles >= AUTOTUNE_CYCLES) {
+        finish();
+        return 0.0f;
+      }
+    }
+    _haveRise = true;
+    _lastRiseMs = nowMs;
+    _max = measured;
+    _min = measured;
+  }
+  return _high ? PID_OUT_MAX : 0.0f;
+}
+
+void RelayAutotune::finish() {
+  float n = (float)(_cycles - 1);
+  float amplitude = _sumAmplitude / n;
+  _puSec = _sumPeriodSec / n;
+  if (amplitude <= _hyst * 1.05f) {
+    fail("oscillation within hysteresis");
+    return;
+  }
+  _ku = 4.0f * RELAY_AMPLITUDE / ((float)M_PI * sqrtf(amplitude * amplitude - _hyst * _hyst));
+  _state = AUTOTUNE_DONE;
+}
+
+PidGains RelayAutotune::tunedGains(float kff) const {
+  // Tyreus-Luyben: slower than Ziegler-Nichols, little overshoot on lagging
+  // thermal plants.
+  float kp = _ku / 2.2f;
+  float ti = 2.2f * _puSec;
+  float td = _puSec / 6.3f;
+  PidGains g;
+  g.kp = kp;
+  g.ki = ti > 0.0f ? kp / ti : 0.0f;
+  g.kd = kp * td;
+  g.kff = kff;
+  return g;
+}
+
+const char* autotuneStateName(AutotuneState state) {
+  switch (state) {
+    case AUTOTUNE_IDLE:    return "idle";
+    case AUTOTUNE_RUNNING: return "running";
+    case AUTOTUNE_DONE:    return "done";
+    case AUTOTUNE_FAILED:  return "failed";
+    default:               return "unknown";
+  }
+}
@@ -0,0 +1,114 @@
+#ifndef PID_CONTROLLER_H
+#define PID_CONTROLLER_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Bath temperature PID for control_mode "pid", plus the relay-feedback
+// autotune that finds its gains. Both work on the bath heat demand in
+// 0..100 %; control_logic.cpp turns that into heater and pump duties.
+// Not locked: only MeasureTask updates them. Plain C++ for the host simulator.
+
+struct PidGains {
+  float kp;    // % per C of error
+  float ki;    // % per C*s of accumulated error
+  float kd;    // % per C/s of bath temperature change
+  float kff;   // Heater % removed per C the tank is warmer than the bath
+};
+
+// Discrete PID on the bath median temperature.
+// - Derivative on the measurement, so a setpoint change does not kick.
+// - Feed-forward: heat already stored in the tank (tank minus bath) reaches
+//   the bath through the pump, so the heater duty is reduced by kff per C.
+// - Anti-windup: the integral only moves while the output is not saturated at
+//   0 or 100 % in the direction of the error. On samples where a safety rule,
+//   manual lock or heater guard time applied another duty, holdIntegral()
+//   undoes that sample's step, so the integral neither winds up nor is lost.
+class BathPid {
+public:
+  void reset();
+
+  // Returns the heater duty (0..100 %). dtSec is the time since the previous
+  // update; 0 (first sample or after a gap) skips the integral and derivative.
+  float update(float setpoint, float measured, float tankSurplus, float dtSec, const PidGains& gains);
+
+  // Undoes the integral step of the last update(); for samples where the
+  // heater did not run at the PID's output.
+  void holdIntegral();
+
+  // P + I + D without the feed-forward, 0..100 %: how much heat the bath wants.
+  float demand() const;
+
+  float p() const { return _p; }
+  float i() const { return _i; }
+  float d() const { return _d; }
+  float ff() const { return _ff; }
+  float output() const { return _out; }
+
+private:
+  float _p = 0.0f;
+  float _i = 0.0f;
+  float _prevI = 0.0f;   // Integral before the last update()
+  float _d = 0.0f;
+  float _ff = 0.0f;
+  float _out = 0.0f;
+  float _prevMeasured = NAN;
+};
+
+enum AutotuneState : uint8_t {
+  AUTOTUNE_IDLE = 0,
+  AUTOTUNE_RUNNING,
+  AUTOTUNE_DONE,
+  AUTOTUNE_FAILED
+};
+
+static const uint8_t AUTOTUNE_CYCLES = 4;                          // Oscillations; the first one is discarded
+static const unsigned long AUTOTUNE_MAX_MS = 12UL * 3600UL * 1000UL;
+
+// Relay-feedback autotune (Astrom-Hagglund): the bath demand is switched
+// between 0 and 100 % whenever the bath leaves setpoint +/- hyst. The plant
+// settles into a limit cycle whose period is the ultimate period Pu and whose
+// amplitude a gives the ultimate gain Ku = 4d / (pi * sqrt(a^2 - hyst^2)),
+// with d = 50 % the relay amplitude.
+class RelayAutotune {
+public:
+  void start(float setpoint, float hyst, float measured, unsigned long nowMs);
+  void cancel();
+
+  // Relay output (0 or 100 %) for this sample; 0 once no longer running.
+  float update(float measured, unsigned long nowMs);
+
+  AutotuneState state() const { return _state; }
+  bool running() const { return _state == AUTOTUNE_RUNNING; }
+  uint8_t cycles() const { return _cycles; }
+  const char* failReason() const { return _failReason; }
+  float ultimateGain() const { return _ku; }
+  float ultimatePeriodSec() const { return _puSec; }
+
+  // Tyreus-Luyben PID gains from Ku/Pu; kff is carried over unchanged.
+  PidGains tunedGains(float kff) const;
+
+private:
+  void fail(const char* reason);
+  void finish();
+
+  AutotuneState _state = AUTOTUNE_IDLE;
+  const char* _failReason = "";
+  float _setpoint = 0.0f;
+  float _hyst = 0.0f;
+  bool _high = false;
+  bool _haveRise = false;
+  unsigned long _startMs = 0;
+  unsigned long _lastRiseMs = 0;
+  float _max = 0.0f;
+  float _min = 0.0f;
+  uint8_t _cycles = 0;
+  float _sumPeriodSec = 0.0f;
+  float _sumAmplitude = 0.0f;
+  float _ku = 0.0f;
+  float _puSec = 0.0f;
+};
+
+const char* autotuneStateName(AutotuneState state);
+
+#endif
@@ -2,14 +2,55 @@
 #include "sensor.h"
 #include <OneWire.h>
 #include <DallasTemperature.h>
-
-static OneWire* oneWireIn = nullptr;
-static DallasTemperature* sensorIn = nullptr;
-static int numInSensors = 0;
-
-static OneWire* oneWireOut = nullptr;
-static DallasTemperature* sensorOut = nullptr;
-static int numOutSensors = 0;
+#include <Preferences.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+static const uint8_t TEMP_BUS_MAX_SLOTS = 3;
+static const uint8_t PROBE_SEARCH_MAX = 8;     // Unregistered probes considered per bus
+static const char* PROBE_NVS_NAMESPACE = "probes";
+
+// One DS18B20 bus with its conversion state. Conversions run without blocking
+// (setWaitForConversion(false)) so both buses convert concurrently; readers
+// wait for the pending conversion by yielding instead of holding the bus.
+// Only the measurement task touches the buses.
+//
+// Probes are read by ROM address from a slot table rather than by search
+// index. Slot order is persisted in NVS, so each slot keeps its channel
+// (TempIn/TankTemp, TempOut1..3) across reboots and a missing probe reads as
+// NAN in its own slot instead of shifting the probes behind it.
+struct TempBus {
+	const char* name;
+	const char* nvsKey;
+	uint8_t maxSlots;
+	OneWire* oneWire;
+	DallasTemperature* sensors;
+	int count;                  // Probes found by the last search
+	bool parasite;              // Parasite-powered probes cannot report completion
+	bool pending;               // Conversion requested but not yet read
+	unsigned long requestMs;
+	uint16_t conversionMs;
+	uint8_t resolution;         // Bits the probes are currently configured for
+	uint8_t sampleResolution;   // Bits of the conversion last requested (what the next read reports)
+	uint8_t slotCount;          // Slots holding a registered ROM
+	DeviceAddress slots[TEMP_BUS_MAX_SLOTS];
+	bool present[TEMP_BUS_MAX_SLOTS];
+};
+
+static TempBus busIn = { "TempIn", "in", 2, nullptr, nullptr, 0, false, false, 0, 750, 12, 12 };
+static TempBus busOut = { "TempOut", "out", TEMP_BUS_MAX_SLOTS, nullptr, nullptr, 0, false, false, 0, 750, 12, 12 };
+
+// Resolution policy. Both buses use the same resolution; a change is applied
+// right before the next conversion is requested, never while one is pending.
+static const uint8_t TEMP_RES_MIN = 10;
+static const uint8_t TEMP_RES_MAX = 12;
+static const float TEMP_RES_LIMIT_MARGIN = 2.0f;   // Within this of the bath limit: always 12-bit
+static uint8_t g_tempResTarget = TEMP_RES_MAX;
+
+// A prefetched conversion older than this is redone rather than reported.
+static const unsigned long TEMP_CONVERSION_MAX_AGE_MS = 5000;
+static const unsigned long TEMP_CONVERSION_POLL_MS = 10;
 
 static int heaterPinGlobal = -1;
 static int pumpPinGlobal = -1;
@@ -26,6 +67,22 @@ static int g_softOffMs = 800;
 static int g_kickPct = 0;
 static int g_kickMs = 0;
 
+// Aeration ramp engine. aerationOn/aerationOff only set up a kick or ramp and
+// return; an esp_timer ticks it in the background and interpolates the duty
+// from the elapsed time, so a late tick never stretches the ramp. All engine
+// state and LEDC writes are serialized by g_aerMutex; the timer callback only
+// tries the lock, so a caller holding it (e.g. an emergency stop) always wins
+// and the next tick sees the new state.
+static const uint64_t AERATION_RAMP_TICK_US = 10000;
+static SemaphoreHandle_t g_aerMutex = nullptr;
+static esp_timer_handle_t g_aerRampTimer = nullptr;
+static bool g_aerTimerRunning = false;
+static volatile AerationRampState g_aerRampState = AERATION_RAMP_IDLE;
+static int g_rampFromPct = 0;
+static int g_rampToPct = 0;
+static unsigned long g_rampStartMs = 0;
+static unsigned long g_rampDurationMs = 0;
+
 static inline int maxCount() {
 	return (1 << AERATION_LEDC_RES_BITS) - 1;
 }
@@ -38,20 +95,157 @@ static inline int pctToRaw(int pct) {
 	return (int)raw;
 }
 
+static void formatRom(const uint8_t* rom, char* out) {
+	for (int i = 0; i < 8; ++i) {
+		sprintf(out + i * 2, "%02X", rom[i]);
+	}
+}
+
+static int findSlot(const TempBus& bus, const uint8_t* rom) {
+	for (uint8_t i = 0; i < bus.slotCount; ++i) {
+		if (memcmp(bus.slots[i], rom, sizeof(DeviceAddress)) == 0) return i;
+	}
+	return -1;
+}
+
+static void loadProbeSlots(TempBus& bus) {
+	Preferences prefs;
+	if (!prefs.begin(PROBE_NVS_NAMESPACE, true)) return;
+	size_t len = prefs.getBytesLength(bus.nvsKey);
+	if (len > 0 && len % sizeof(DeviceAddress) == 0 && len / sizeof(DeviceAddress) <= bus.maxSlots) {
+		prefs.getBytes(bus.nvsKey, bus.slots, len);
+		bus.slotCount = len / sizeof(DeviceAddress);
+	}
+	prefs.end();
+}
+
+static void saveProbeSlots(const TempBus& bus) {
+	Preferences prefs;
+	if (!prefs.begin(PROBE_NVS_NAMESPACE, false)) {
+		Serial.printf("[%s] Failed to persist probe table\n", bus.name);
+		return;
+	}
+	prefs.putBytes(bus.nvsKey, bus.slots, bus.slotCount * sizeof(DeviceAddress));
+	prefs.end();
+}
+
+// One linear ROM search: mark registered probes present, then give unknown
+// probes a free slot, or the slot of a registered probe that is missing
+// (i.e. a replaced probe takes over its predecessor's channel).
+static void registerProbes(TempBus& bus) {
+	loadProbeSlots(bus);
+
+	DeviceAddress unknown[PROBE_SEARCH_MAX];
+	uint8_t unknownCount = 0;
+	DeviceAddress rom;
+	bus.count = 0;
+	bus.oneWire->reset_search();
+	while (bus.oneWire->search(rom)) {
+		if (OneWire::crc8(rom, 7) != rom[7] || !bus.sensors->validFamily(rom)) continue;
+		bus.count++;
+		int slot = findSlot(bus, rom);
+		if (slot >= 0) {
+			bus.present[slot] = true;
+		}
+		else if (unknownCount < PROBE_SEARCH_MAX) {
+			memcpy(unknown[unknownCount++], rom, sizeof(DeviceAddress));
+		}
+	}
+
+	bool changed = false;
+	char romStr[17];
+	for (uint8_t u = 0; u < unknownCount; ++u) {
+		formatRom(unknown[u], romStr);
+		int slot = -1;
+		if (bus.slotCount < bus.maxSlots) {
+			slot = bus.slotCount++;
+		}
+		else {
+			for (uint8_t i = 0; i < bus.slotCount; ++i) {
+				if (!bus.present[i]) {
+					slot = i;
+					break;
+				}
+			}
+		}
+		if (slot < 0) {
+			Serial.printf("[%s] Probe %s ignored, all %u slots in use\n", bus.name, romStr, (unsigned)bus.maxSlots);
+			continue;
+		}
+		memcpy(bus.slots[slot], unknown[u], sizeof(DeviceAddress));
+		bus.present[slot] = true;
+		changed = true;
+		Serial.printf("[%s] Probe %s registered in slot %d\n", bus.name, romStr, slot + 1);
+	}
+	if (changed) saveProbeSlots(bus);
+
+	for (uint8_t i = 0; i < bus.slotCount; ++i) {
+		formatRom(bus.slots[i], romStr);
+		Serial.printf("[%s] Slot %u: %s%s\n", bus.name, (unsigned)(i + 1), romStr,
+			bus.present[i] ? "" : " (missing)");
+	}
+}
+
+static float readSlot(TempBus& bus, uint8_t slot) {
+	if (slot >= bus.slotCount) return NAN;
+	float t = bus.sensors->getTempC(bus.slots[slot]);
+	bus.present[slot] = (t != DEVICE_DISCONNECTED_C);
+	return bus.present[slot] ? t : NAN;
+}
+
+// Writes the resolution to every registered probe's scratchpad only (no
+// EEPROM copy, since the policy may switch it every few cycles; begin()
+// re-applies it after a power cycle).
+static void applyBusResolution(TempBus& bus, uint8_t bits) {
+	for (uint8_t i = 0; i < bus.slotCount; ++i) {
+		if (bus.present[i]) bus.sensors->setResolution(bus.slots[i], bits, true);
+	}
+	bus.resolution = bits;
+	bus.conversionMs = bus.sensors->millisToWaitForConversion(bits);
+}
+
+static void beginBus(TempBus& bus, int pin) {
+	bus.oneWire = new OneWire(pin);
+	bus.sensors = new DallasTemperature(bus.oneWire);
+	bus.sensors->begin();
+	bus.sensors->requestTemperatures();
+	bus.parasite = bus.sensors->isParasitePowerMode();
+	bus.sensors->setWaitForConversion(false);
+	bus.sensors->setAutoSaveScratchPad(false);
+	registerProbes(bus);
+	applyBusResolution(bus, g_tempResTarget);
+	Serial.printf("[%s] Found %d sensors (conversion %u ms%s)\n",
+		bus.name, bus.count, (unsigned)bus.conversionMs, bus.parasite ? ", parasite power" : "");
+}
+
+static void requestBus(TempBus& bus) {
+	if (!bus.sensors) return;
+	if (bus.pending && millis() - bus.requestMs < TEMP_CONVERSION_MAX_AGE_MS) return;
+	if (bus.resolution != g_tempResTarget) applyBusResolution(bus, g_tempResTarget);
+	bus.sensors->requestTemperatures();
+	bus.sampleResolution = bus.resolution;
+	bus.requestMs = millis();
+	bus.pending = true;
+}
+
+static bool busReady(const TempBus& bus) {
+	if (!bus.pending) return false;
+	if (millis() - bus.requestMs >= bus.conversionMs) return true;
+	return !bus.parasite && bus.sensors->isConversionComplete();
+}
+
+// Ensures the bus holds a finished conversion; starts one if none is pending.
+static void awaitBus(TempBus& bus) {
+	requestBus(bus);
+	while (!busReady(bus)) {
+		vTaskDelay(pdMS_TO_TICKS(TEMP_CONVERSION_POLL_MS));
+	}
+	bus.pending = false;
+}
+
 bool initSensors(int tempInPin, int tempOutPin, int heaterPin, int pumpPin, int aerationPin) {
-	oneWireIn = new OneWire(tempInPin);
-	sensorIn = new DallasTemperature(oneWireIn);
-	sensorIn->begin();
-	sensorIn->requestTemperatures();
-	numInSensors = sensorIn->getDeviceCount();
-	Serial.printf("[TempIn] Found %d sensors\n", numInSensors);
-
-	oneWireOut = new OneWire(tempOutPin);
-	sensorOut = new DallasTemperature(oneWireOut);
-	sensorOut->begin();
-	sensorOut->requestTemperatures();
-	numOutSensors = sensorOut->getDeviceCount();
-	Serial.printf("[TempOut] Found %d sensors\n", numOutSensors);
+	beginBus(busIn, tempInPin);
+	beginBus(busOut, tempOutPin);
 
 	heaterPinGlobal = heaterPin;
 	pumpPinGlobal = pumpPin;
@@ -66,6 +260,19 @@ bool initSensors(int tempInPin, int tempOutPin, int heaterPin, int pumpPin, int
 		digitalWrite(pumpPinGlobal, LOW);
 	}
 
+	if (g_aerMutex == nullptr) {
+		g_aerMutex = xSemaphoreCreateMutex();
+	}
+	if (g_aerRampTimer == nullptr) {
+		esp_timer_create_args_t args = {};
+		args.callback = aerationRampTick;
+		args.name = "aer_ramp";
+		if (esp_timer_create(&args, &g_aerRampTimer) != ESP_OK) {
+			g_aerRampTimer = nullptr;
+			Serial.println("[Aeration] Ramp timer unavailable, duty changes apply immediately");
+		}
+	}
+
 	if (aerationPinGlobal >= 0) {
 		ledcAttach(aerationPinGlobal, AERATION_LEDC_FREQ_HZ, AERATION_LEDC_RES_BITS);
 		ledcWrite(aerationPinGlobal, pctToRaw(0));
@@ -88,11 +295,79 @@ bool initSensors(int tempInPin, int tempOutPin, int heaterPin, int pumpPin, int
 	return true;
 }
 
-static float readTempInByIndex(int index) {
-	if (!sensorIn) return NAN;
-	if (index < 0 || index >= numInSensors) return NAN;
-	float t = sensorIn->getTempCByIndex(index);
-	Serial.printf("[TempInBus idx=%d] %.1f C\n", index, t);
+void startTempConversion() {
+	requestBus(busIn);
+	requestBus(busOut);
+}
+
+bool tempConversionReady() {
+	return (!busIn.sensors || busReady(busIn)) && (!busOut.sensors || busReady(busOut));
+}
+
+uint16_t tempConversionMs() {
+	// A pending resolution change takes effect with the next request, so
+	// report the time that request will need.
+	DallasTemperature* sensors = busIn.sensors ? busIn.sensors : busOut.sensors;
+	return sensors ? sensors->millisToWaitForConversion(g_tempResTarget) : 750;
+}
+
+uint8_t selectTempResolution(float bathTemp, float target, float hyst, float bathMax, bool transition) {
+	uint8_t bits = TEMP_RES_MAX;
+	bool stable = !isnan(bathTemp) && !isnan(target) && hyst > 0.0f && fabsf(bathTemp - target) <= hyst;
+	bool nearLimit = isnan(bathTemp) || (!isnan(bathMax) && bathTemp >= bathMax - TEMP_RES_LIMIT_MARGIN);
+	if (stable && !nearLimit && !transition) {
+		// Coarsest resolution whose step (0.5 C at 9-bit, halved per bit)
+		// still resolves a quarter of the hysteresis band.
+		for (bits = TEMP_RES_MIN; bits < TEMP_RES_MAX; ++bits) {
+			float step = 0.5f / (float)(1 << (bits - 9));
+			if (step <= hyst * 0.25f) break;
+		}
+	}
+	if (bits != g_tempResTarget) {
+		const char* why = nearLimit ? "near limit"
+			: transition ? "transition"
+			: isnan(target) ? "no setpoint"
+			: !stable ? "bath off target"
+			: bits < TEMP_RES_MAX ? "bath stable" : "hysteresis too tight";
+		Serial.printf("[Temp] Resolution %u -> %u bit (%s)\n", (unsigned)g_tempResTarget, (unsigned)bits, why);
+		g_tempResTarget = bits;
+	}
+	return bits;
+}
+
+uint8_t tempSampleResolution() {
+	uint8_t bits = 0;
+	if (busIn.sensors) bits = busIn.sampleResolution;
+	if (busOut.sensors && (bits == 0 || busOut.sampleResolution < bits)) bits = busOut.sampleResolution;
+	return bits;
+}
+
+void getProbeRoms(std::vector<String>& inRoms, std::vector<String>& outRoms) {
+	char romStr[17];
+	inRoms.clear();
+	outRoms.clear();
+	for (uint8_t i = 0; i < busIn.slotCount; ++i) {
+		formatRom(busIn.slots[i], romStr);
+		inRoms.push_back(String(romStr));
+	}
+	for (uint8_t i = 0; i < busOut.slotCount; ++i) {
+		formatRom(busOut.slots[i], romStr);
+		outRoms.push_back(String(romStr));
+	}
+}
+
+bool clearProbeRegistry() {
+	Preferences prefs;
+	if (!prefs.begin(PROBE_NVS_NAMESPACE, false)) return false;
+	bool ok = prefs.clear();
+	prefs.end();
+	return ok;
+}
+
+static float readTempInBySlot(uint8_t slot) {
+	if (!busIn.sensors) return NAN;
+	float t = readSlot(busIn, slot);
+	Serial.printf("[TempInBus slot=%u] %.1f C\n", (unsigned)(slot + 1), t);
 	return t;
 }
 
@@ -100,17 +375,17 @@ void readInternalTemps(float& tempIn, float& tempTank) {
 	tempIn = NAN;
 	tempTank = NAN;
 
-	if (!sensorIn) return;
+	if (!busIn.sensors) return;
 
-	sensorIn->requestTemperatures();
-	tempIn = readTempInByIndex(0);
+	awaitBus(busIn);
+	tempIn = readTempInBySlot(0);
 
-	if (numInSensors < 2) {
+	if (busIn.slotCount < 2) {
 		Serial.println("[Tank] Not found (need 2nd sensor on internal bus).");
 		return;
 	}
 
-	tempTank = readTempInByIndex(1);
+	tempTank = readTempInBySlot(1);
 }
 
 float readTempIn() {
@@ -129,11 +404,11 @@ float readTempTank() {
 
 std::vector<float> readTempOut() {
 	std::vector<float> temps;
-	if (!sensorOut) return temps;
+	if (!busOut.sensors) return temps;
 
-	sensorOut->requestTemperatures();
-	for (int i = 0; i < numOutSensors && i < 3; ++i) {
-		float t = sensorOut->getTempCByIndex(i);
+	awaitBus(busOut);
+	for (uint8_t i = 0; i < busOut.slotCount; ++i) {
+		float t = readSlot(busOut, i);
 		Serial.printf("[TempOut-%d] %.1f C\n", i, t);
 		temps.push_back(t);
 	}
@@ -168,29 +443,123 @@ void pumpOff() {
 	}
 }
 
+// Caller holds g_aerMutex (or runs before the engine exists).
 static inline void writeDutyPctImmediate(int pct) {
 	if (pct < 0) pct = 0;
 	if (pct > g_aerMaxDutyPct) pct = g_aerMaxDutyPct;
 	g_aerCurrentDutyPct = pct;
 
 	if (aerationPinGlobal >= 0) {
-		int raw = pctToRaw(pct);
-		ledcWrite(aerationPinGlobal, raw);
-		Serial.printf("[Aeration] duty=%d%% -> raw=%d/%d\n", pct, raw, maxCount());
+		ledcWrite(aerationPinGlobal, pctToRaw(pct));
+	}
+}
+
+static void startRampTimerLocked() {
+	if (!g_aerTimerRunning && g_aerRampTimer &&
+		esp_timer_start_periodic(g_aerRampTimer, AERATION_RAMP_TICK_US) == ESP_OK) {
+		g_aerTimerRunning = true;
 	}
 }
 
+static void stopRampTimerLocked() {
+	if (g_aerTimerRunning) {
+		esp_timer_stop(g_aerRampTimer);
+		g_aerTimerRunning = false;
+	}
+}
+
+// Cancels any kick or ramp and holds the duty where it is.
+static void cancelRampLocked() {
+	stopRampTimerLocked();
+	g_aerRampState = AERATION_RAMP_IDLE;
+}
+
+static void startRampLocked(int to, int durationMs, AerationRampState state) {
+	if (to > g_aerMaxDutyPct) to = g_aerMaxDutyPct;
+	if (durationMs <= 0 || to == g_aerCurrentDutyPct || !g_aerRampTimer) {
+		cancelRampLocked();
+		writeDutyPctImmediate(to);
+		return;
+	}
+	g_rampFromPct = g_aerCurrentDutyPct;
+	g_rampToPct = to;
+	g_rampStartMs = millis();
+	g_rampDurationMs = (unsigned long)durationMs;
+	g_aerRampState = state;
+	startRampTimerLocked();
+}
+
+static void aerationRampTick(void*) {
+	if (xSemaphoreTake(g_aerMutex, 0) != pdTRUE) return;
+
+	unsigned long elapsed = millis() - g_rampStartMs;
+	switch (g_aerRampState) {
+		case AERATION_RAMP_KICK:
+			if (elapsed >= (unsigned long)g_kickMs) {
+				startRampLocked(g_aerMaxDutyPct, g_softOnMs, AERATION_RAMP_UP);
+			}
+			break;
+
+		case AERATION_RAMP_UP:
+		case AERATION_RAMP_DOWN:
+			if (elapsed >= g_rampDurationMs) {
+				writeDutyPctImmediate(g_rampToPct);
+				cancelRampLocked();
+			} else {
+				long span = (long)g_rampToPct - g_rampFromPct;
+				int pct = g_rampFromPct + (int)(span * (long)elapsed / (long)g_rampDurationMs);
+				if (pct != g_aerCurrentDutyPct) writeDutyPctImmediate(pct);
+			}
+			break;
+
+		default:
+			cancelRampLocked();
+			break;
+	}
+	xSemaphoreGive(g_aerMutex);
+}
+
+static bool lockAeration() {
+	return g_aerMutex && xSemaphoreTake(g_aerMutex, portMAX_DELAY) == pdTRUE;
+}
+
+static void unlockAeration() {
+	xSemaphoreGive(g_aerMutex);
+}
+
 bool aerationIsActive() { return g_aerCurrentDutyPct > 0; }
 
+int aerationDutyPct() { return g_aerCurrentDutyPct; }
+
+AerationRampState aerationRampState() { return g_aerRampState; }
+
+const char* aerationRampStateName(AerationRampState state) {
+	switch (state) {
+		case AERATION_RAMP_KICK: return "kick";
+		case AERATION_RAMP_UP:   return "ramp_up";
+		case AERATION_RAMP_DOWN: return "ramp_down";
+		default:                 return "idle";
+	}
+}
+
 void aerationSetDutyPct(int pct) {
+	if (!lockAeration()) {
+		writeDutyPctImmediate(pct);
+		return;
+	}
+	cancelRampLocked();
 	writeDutyPctImmediate(pct);
+	unlockAeration();
 }
 
 void aerationSetMaxDutyPct(int pctLimit) {
 	if (pctLimit < 10) pctLimit = 10;
 	if (pctLimit > 100) pctLimit = 100;
+	bool locked = lockAeration();
 	g_aerMaxDutyPct = pctLimit;
+	if (g_rampToPct > g_aerMaxDutyPct) g_rampToPct = g_aerMaxDutyPct;
 	if (g_aerCurrentDutyPct > g_aerMaxDutyPct) writeDutyPctImmediate(g_aerMaxDutyPct);
+	if (locked) unlockAeration();
 	Serial.printf("[Aeration] MaxDuty=%d%%\n", g_aerMaxDutyPct);
 }
 
@@ -204,63 +573,42 @@ void aerationConfigSoft(int onMs, int offMs, int kickPct, int kickMs) {
 }
 
 void aerationOn() {
-	const int target = g_aerMaxDutyPct;
-	int from = g_aerCurrentDutyPct;
-
-	if (g_kickPct > 0 && g_kickMs > 0 && from == 0) {
-		int kp = g_kickPct;
-		if (kp > g_aerMaxDutyPct) kp = g_aerMaxDutyPct;
-		writeDutyPctImmediate(kp);
-		delay(g_kickMs);
-		from = g_aerCurrentDutyPct;
+	if (!lockAeration()) {
+		writeDutyPctImmediate(g_aerMaxDutyPct);
+		return;
 	}
-
-	if (g_softOnMs <= 0 || target == from) {
-		writeDutyPctImmediate(target);
+	if (g_kickPct > 0 && g_kickMs > 0 && g_aerCurrentDutyPct == 0 && g_aerRampTimer) {
+		// Kick: jump to kickPct to break the blower loose, then ramp from there.
+		cancelRampLocked();
+		writeDutyPctImmediate(g_kickPct);
+		g_rampStartMs = millis();
+		g_aerRampState = AERATION_RAMP_KICK;
+		startRampTimerLocked();
 	} else {
-		int steps = abs(target - from);
-		int stepDelay = g_softOnMs / steps;
-		if (stepDelay <= 0) stepDelay = 1;
-		int dir = (target > from) ? 1 : -1;
-		unsigned long last = millis();
-		int pct = from;
-		while (pct != target) {
-			writeDutyPctImmediate(pct);
-			pct += dir;
-			while ((millis() - last) < (unsigned long)stepDelay) {
-				delayMicroseconds(1000);
-				yield();
-			}
-			last += stepDelay;
-		}
-		writeDutyPctImmediate(target);
+		startRampLocked(g_aerMaxDutyPct, g_softOnMs, AERATION_RAMP_UP);
 	}
-	Serial.printf("[Aeration] ON soft -> %d%%\n", g_aerCurrentDutyPct);
+	unlockAeration();
+	Serial.printf("[Aeration] ON soft -> %d%% (%s)\n", g_aerMaxDutyPct, aerationRampStateName(g_aerRampState));
 }
 
 void aerationOff() {
-	int from = g_aerCurrentDutyPct;
-	int to = 0;
-
-	if (g_softOffMs <= 0 || from == to) {
+	if (!lockAeration()) {
 		writeDutyPctImmediate(0);
-	} else {
-		int steps = abs(from - to);
-		int stepDelay = g_softOffMs / steps;
-		if (stepDelay <= 0) stepDelay = 1;
-		int dir = -1;
-		unsigned long last = millis();
-		int pct = from;
-		while (pct != to) {
-			writeDutyPctImmediate(pct);
-			pct += dir;
-			while ((millis() - last) < (unsigned long)stepDelay) {
-				delayMicroseconds(1000);
-				yield();
-			}
-			last += stepDelay;
-		}
+		return;
+	}
+	startRampLocked(0, g_softOffMs, AERATION_RAMP_DOWN);
+	unlockAeration();
+	Serial.printf("[Aeration] OFF soft -> 0%% (%s)\n", aerationRampStateName(g_aerRampState));
+}
+
+void aerationStopNow() {
+	if (!lockAeration()) {
 		writeDutyPctImmediate(0);
+		return;
 	}
-	Serial.println("[Aeration] OFF soft -> 0%");
+	AerationRampState was = g_aerRampState;
+	cancelRampLocked();
+	writeDutyPctImmediate(0);
+	unlockAeration();
+	Serial.printf("[Aeration] STOP -> 0%% (preempted %s)\n", aerationRampStateName(was));
 }
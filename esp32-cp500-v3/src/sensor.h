@@ -6,10 +6,25 @@
 bool initSensors(int tempInPin, int tempOutPin, int heaterPin, int pumpPin, int aerationPin);
 
 // ========== 温度读取 ==========
-float readTempIn();                           // 内部核心温度（内总线 index=0）
-float readTempTank();                         // 水箱温度（内总线 index=1；不足则返回 NAN）
+// 两条总线异步转换：startTempConversion 同时启动、立即返回；
+// 下面的读取函数会等待本总线未完成的转换（没有则先启动一次），等待期间让出 CPU。
+// 只能在测量任务中调用。
+void startTempConversion();                   // 两条总线同时开始转换（已有新鲜的待读转换则跳过）
+bool tempConversionReady();                   // 两条总线的转换都已完成
+uint16_t tempConversionMs();                  // 下一次转换所需时间（ms，按目标分辨率）
+// 分辨率策略：浴温稳定在 target±hyst 内时降到 10/11 位（约 188/375 ms），
+// 接近浴温上限（bathMax-2℃）、浴温偏离设定点或 transition（加热器刚切换、水箱接近上限等）时回到 12 位（750 ms）。
+// 新分辨率在下一次启动转换时生效；target 传 NAN 表示没有设定点，固定 12 位。返回目标分辨率。
+uint8_t selectTempResolution(float bathTemp, float target, float hyst, float bathMax, bool transition);
+uint8_t tempSampleResolution();               // 最近一次读取的样本所用分辨率（位）
+// 探头按 ROM 地址登记在槽位表里（NVS 命名空间 probes），槽位即通道：
+// 内总线槽 1/2 = TempIn/TankTemp，外总线槽 1~3 = TempOut1~3。掉线的探头读作 NAN，不会挤占其它通道。
+float readTempIn();                           // 内部核心温度（内总线槽 1）
+float readTempTank();                         // 水箱温度（内总线槽 2；未登记则返回 NAN）
 void readInternalTemps(float& tempIn, float& tempTank); // 批量读取内部总线，避免重复转换
-std::vector<float> readTempOut();             // 外浴多个探头（最多取前三个）
+std::vector<float> readTempOut();             // 外浴探头，每个已登记槽位一个值（最多三个）
+void getProbeRoms(std::vector<String>& inRoms, std::vector<String>& outRoms); // 各槽位 ROM（16 位十六进制）
+bool clearProbeRegistry();                    // 清空槽位表，重启后按搜索顺序重新登记
 
 // ========== 加热 / 循环泵（数字开关） ==========
 void heaterOn();
@@ -18,9 +33,22 @@ void pumpOn();
 void pumpOff();
 
 // ========== 曝气（PWM，内置软启停） ==========
+// 软启停由后台定时器推进：aerationOn/aerationOff 只设置 kick / 渐变目标后立即返回，不阻塞调用任务。
+// 重复调用会从当前占空比重新开始渐变；aerationStopNow 打断进行中的渐变并立即关断（急停用）。
+enum AerationRampState : uint8_t {
+	AERATION_RAMP_IDLE = 0,
+	AERATION_RAMP_KICK,       // 以 kick 占空比起转，结束后接软启动
+	AERATION_RAMP_UP,
+	AERATION_RAMP_DOWN
+};
+
 void aerationOn();
 void aerationOff();
+void aerationStopNow();
 bool aerationIsActive();
+int aerationDutyPct();                        // 当前输出占空比（%）
+AerationRampState aerationRampState();
+const char* aerationRampStateName(AerationRampState state);
 void aerationSetDutyPct(int pct);
 void aerationSetMaxDutyPct(int pctLimit);     // 10~100
 void aerationConfigSoft(int onMs, int offMs, int kickPct, int kickMs);
@@ -0,0 +1,18 @@
+#include "slow_pwm.h"
+
+SlowPwmSlice slowPwmSlice(float dutyPct, float carryMs, uint32_t windowMs, uint32_t minOnMs, uint32_t minOffMs) {
+  float want = dutyPct * 0.01f * windowMs + carryMs;
+  SlowPwmSlice s;
+  if (want < (float)minOnMs) {
+    s.onMs = 0;
+  } else if ((float)windowMs - want < (float)minOffMs) {
+    s.onMs = windowMs;
+  } else {
+    s.onMs = (uint32_t)want;
+  }
+
+  s.carryMs = want - (float)s.onMs;
+  if (s.carryMs > (float)windowMs) s.carryMs = (float)windowMs;
+  if (s.carryMs < -(float)windowMs) s.carryMs = -(float)windowMs;
+  return s;
+}
@@ -0,0 +1,20 @@
+#ifndef SLOW_PWM_H
+#define SLOW_PWM_H
+
+#include <stdint.h>
+
+// Window math of the time-proportional relays in actuator.cpp, kept free of
+// Arduino headers so the host simulator in sim/ switches its relays the same way.
+
+struct SlowPwmSlice {
+  uint32_t onMs;     // On-slice of this window, 0..windowMs
+  float carryMs;     // Carry for the next window
+};
+
+// On-slice for dutyPct given the carry (on-time owed + or overpaid - by
+// earlier windows). A slice shorter than minOnMs is skipped and one leaving
+// less than minOffMs off is stretched to the whole window; the difference is
+// carried, bounded to one window so it cannot turn into a burst later.
+SlowPwmSlice slowPwmSlice(float dutyPct, float carryMs, uint32_t windowMs, uint32_t minOnMs, uint32_t minOffMs);
+
+#endif
@@ -0,0 +1,11 @@
+#include "task_wake.h"
+
+bool sleepUntilWake(const NextWake& next) {
+  TickType_t ticks = pdMS_TO_TICKS(next.sleepMs());
+  if (ticks == 0) ticks = 1;
+  return ulTaskNotifyTake(pdTRUE, ticks) > 0;
+}
+
+void wakeTask(TaskHandle_t task) {
+  if (task) xTaskNotifyGive(task);
+}
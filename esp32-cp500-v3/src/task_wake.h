@@ -0,0 +1,44 @@
+#ifndef TASK_WAKE_H
+#define TASK_WAKE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Deadline-driven task sleeping. A task collects the due times it cares
+// about in a NextWake, then blocks on its task notification until the
+// earliest one. Producers call wakeTask() after adding work that may be due
+// sooner (a queued command, an emergency change), so nothing polls.
+class NextWake {
+public:
+  // maxSleepMs bounds the sleep when no deadline is closer.
+  NextWake(unsigned long nowMs, unsigned long maxSleepMs) : _nowMs(nowMs), _sleepMs(maxSleepMs) {}
+
+  // Considers a deadline in millis(); rollover-safe, past deadlines mean "now".
+  void at(unsigned long dueMs) {
+    unsigned long left = dueMs - _nowMs;
+    if (left >= 0x80000000UL) left = 0;
+    if (left < _sleepMs) _sleepMs = left;
+  }
+
+  // Considers a deadline relative to nowMs.
+  void in(unsigned long delayMs) {
+    if (delayMs < _sleepMs) _sleepMs = delayMs;
+  }
+
+  unsigned long sleepMs() const { return _sleepMs; }
+
+private:
+  unsigned long _nowMs;
+  unsigned long _sleepMs;
+};
+
+// Blocks the calling task until wakeTask() or the earliest deadline.
+// Always yields for at least one tick. Returns true when woken early.
+bool sleepUntilWake(const NextWake& next);
+
+// Wakes a task blocked in sleepUntilWake(); a no-op for a null handle.
+// A notification sent while the task is busy makes its next sleep return at once.
+void wakeTask(TaskHandle_t task);
+
+#endif
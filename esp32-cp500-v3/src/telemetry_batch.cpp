@@ -0,0 +1,90 @@
+#include "telemetry_batch.h"
+#include <math.h>
+#include <stdarg.h>
+
+int TelemetryBatch::findChannel(const char* code) const {
+  for (uint8_t i = 0; i < _channelCount; i++) {
+    if (_codes[i] == code || strcmp(_codes[i], code) == 0) return i;
+  }
+  return -1;
+}
+
+bool TelemetryBatch::add(time_t epoch, const char* ts, const TelemetryChannel* channels, uint8_t count) {
+  if (_count >= TELEMETRY_BATCH_MAX) return false;
+
+  uint8_t added = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (findChannel(channels[i].code) < 0) added++;
+  }
+  if (_channelCount + added > TELEMETRY_MAX_CHANNELS) return false;
+
+  float* row = _values[_count];
+  for (uint8_t c = 0; c < TELEMETRY_MAX_CHANNELS; c++) row[c] = NAN;
+
+  for (uint8_t i = 0; i < count; i++) {
+    int c = findChannel(channels[i].code);
+    if (c < 0) {
+      // New channel: earlier samples already hold NaN in its column.
+      c = _channelCount++;
+      _codes[c] = channels[i].code;
+      _units[c] = channels[i].unit;
+      for (uint8_t s = 0; s < _count; s++) _values[s][c] = NAN;
+    }
+    row[c] = channels[i].value;
+  }
+  if (_count == 0) strlcpy(_firstTs, ts, sizeof(_firstTs));
+  _epochs[_count++] = epoch;
+  return true;
+}
+
+void TelemetryBatch::clear() {
+  _count = 0;
+  _channelCount = 0;
+}
+
+// Bounded appender over the caller's buffer; overflow sticks once hit.
+struct BatchWriter {
+  char* buf;
+  size_t capacity;
+  size_t len;
+  bool overflow;
+
+  void append(const char* fmt, ...) {
+    if (overflow) return;
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(buf + len, capacity - len, fmt, args);
+    va_end(args);
+    if (n < 0 || (size_t)n >= capacity - len) {
+      overflow = true;
+      return;
+    }
+    len += n;
+  }
+};
+
+size_t TelemetryBatch::serialize(char* buf, size_t capacity) const {
+  if (_count == 0 || capacity == 0) return 0;
+
+  BatchWriter w{ buf, capacity, 0, false };
+  w.append("{\"schema_version\":2,\"ts\":\"%s\",\"t0\":%lu,\"dt\":[", _firstTs, (unsigned long)_epochs[0]);
+  for (uint8_t s = 0; s < _count; s++) {
+    w.append(s ? ",%ld" : "%ld", (long)(_epochs[s] - _epochs[0]));
+  }
+  w.append("],\"channels\":[");
+  for (uint8_t c = 0; c < _channelCount; c++) {
+    w.append("%s{\"code\":\"%s\",\"unit\":\"%s\",\"values\":[", c ? "," : "", _codes[c], _units[c]);
+    for (uint8_t s = 0; s < _count; s++) {
+      float v = _values[s][c];
+      const char* sep = s ? "," : "";
+      if (isnan(v) || isinf(v)) {
+        w.append("%snull", sep);
+      } else {
+        w.append("%s%.7g", sep, (double)v);
+      }
+    }
+    w.append("]}");
+  }
+  w.append("]}");
+  return w.overflow ? 0 : w.len;
+}
@@ -0,0 +1,50 @@
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include <Arduino.h>
+#include <time.h>
+
+static const uint8_t TELEMETRY_MAX_CHANNELS = 19;   // Core channels, 3 outlet probes, 3 duties and 6 heap channels
+static const uint8_t TELEMETRY_BATCH_MAX = 16;      // Worst-case batch still fits an outbox slot
+
+// One telemetry channel of a sample. code and unit must outlive the batch
+// (string literals or static tables); quality is only used by single messages.
+struct TelemetryChannel {
+  const char* code;
+  const char* unit;
+  float value;
+  const char* quality;
+};
+
+// Accumulates samples for the telemetry/batch topic in columnar form: the
+// channel header (code, unit) is stored once and each channel keeps one value
+// per sample. A channel missing from some samples (e.g. the heap channels,
+// only present every heap_report_interval) is null in those samples.
+// Not locked: only MeasureTask uses it.
+class TelemetryBatch {
+public:
+  // False when the batch is full or the sample brings more channels than fit;
+  // flush and add again.
+  // ts is the local time string of the sample; the first one heads the batch.
+  bool add(time_t epoch, const char* ts, const TelemetryChannel* channels, uint8_t count);
+  void clear();
+
+  uint8_t size() const { return _count; }
+  time_t newestEpoch() const { return _count ? _epochs[_count - 1] : 0; }
+
+  // Writes the batch JSON into buf; returns its length, or 0 if it does not fit.
+  size_t serialize(char* buf, size_t capacity) const;
+
+private:
+  int findChannel(const char* code) const;
+
+  const char* _codes[TELEMETRY_MAX_CHANNELS];
+  const char* _units[TELEMETRY_MAX_CHANNELS];
+  uint8_t _channelCount = 0;
+  float _values[TELEMETRY_BATCH_MAX][TELEMETRY_MAX_CHANNELS];
+  time_t _epochs[TELEMETRY_BATCH_MAX];
+  char _firstTs[24];
+  uint8_t _count = 0;
+};
+
+#endif
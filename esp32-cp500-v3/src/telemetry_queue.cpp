@@ -0,0 +1,214 @@
+#include "telemetry_queue.h"
+#include <SPIFFS.h>
+#include "json_arena.h"
+
+static const char* RECORD_PREFIX = "tq_";
+static const uint16_t RECORD_MAGIC = 0x7E1A;
+static const uint16_t RECORD_TOPIC_MAX = 128;
+
+// Record file: header, then the topic and payload bytes (no terminators).
+struct TelemetryRecordHeader {
+  uint16_t magic;
+  uint16_t topicLen;
+  uint32_t seq;
+  uint32_t sampleEpoch;
+  uint32_t payloadLen;
+  uint32_t checksum;      // FNV-1a over topic then payload
+};
+static_assert(sizeof(TelemetryRecordHeader) == 20, "TelemetryRecordHeader layout must stay stable on flash");
+
+// Read buffers; the queue is only used by the network task.
+static char gRecordTopic[RECORD_TOPIC_MAX + 1];
+static char gRecordPayload[JSON_DOC_SIZE];
+
+static uint32_t fnv1a(uint32_t hash, const char* data, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (uint8_t)data[i];
+    hash *= 16777619UL;
+  }
+  return hash;
+}
+
+static uint32_t recordChecksum(const char* topic, size_t topicLen, const char* payload, size_t payloadLen) {
+  return fnv1a(fnv1a(2166136261UL, topic, topicLen), payload, payloadLen);
+}
+
+static String recordPath(uint32_t seq) {
+  char path[20];
+  snprintf(path, sizeof(path), "/%s%08lx", RECORD_PREFIX, (unsigned long)seq);
+  return String(path);
+}
+
+// Accepts "tq_0000002a" with or without the leading '/', depending on the core.
+static bool parseRecordName(const char* name, uint32_t& seq) {
+  if (!name) return false;
+  if (name[0] == '/') name++;
+  size_t prefixLen = strlen(RECORD_PREFIX);
+  if (strncmp(name, RECORD_PREFIX, prefixLen) != 0) return false;
+  char* end = nullptr;
+  unsigned long value = strtoul(name + prefixLen, &end, 16);
+  if (end == name + prefixLen || *end != '\0') return false;
+  seq = (uint32_t)value;
+  return true;
+}
+
+bool TelemetryQueue::begin() {
+  _flashReady = false;
+  File root = SPIFFS.open("/");
+  if (!root || !root.isDirectory()) {
+    Serial.println("[Queue] SPIFFS root unavailable, telemetry retry kept in RAM only");
+    return false;
+  }
+
+  bool found = false;
+  uint32_t minSeq = 0;
+  uint32_t maxSeq = 0;
+  for (File f = root.openNextFile(); f; f = root.openNextFile()) {
+    uint32_t seq = 0;
+    TelemetryRecordHeader h;
+    if (parseRecordName(f.name(), seq) &&
+      f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+      h.magic == RECORD_MAGIC && h.seq == seq) {
+      if (!found || seq < minSeq) minSeq = seq;
+      if (!found || seq > maxSeq) maxSeq = seq;
+      found = true;
+    }
+    f.close();
+  }
+  root.close();
+
+  _flashHead = found ? minSeq : 0;
+  _flashTail = found ? maxSeq + 1 : 0;
+
+  // A backlog larger than the ring (e.g. left by a build with more slots)
+  // keeps only its newest records.
+  while (flashCount() > TELEMETRY_FLASH_SLOTS) {
+    evictFlashHead();
+  }
+
+  _flashReady = true;
+  Serial.printf("[Queue] Telemetry backlog on flash: %lu records\n", (unsigned long)flashCount());
+  return true;
+}
+
+void TelemetryQueue::push(const char* topic, const char* payload, time_t sampleEpoch) {
+  if (_ramCount == TELEMETRY_RAM_SLOTS) {
+    spillOldestRam();
+  }
+  PendingTelemetry& slot = _ram[(_ramHead + _ramCount) % TELEMETRY_RAM_SLOTS];
+  slot.topic = topic;
+  slot.payload = payload;
+  slot.sampleEpoch = sampleEpoch;
+  _ramCount++;
+}
+
+bool TelemetryQueue::peek(PendingTelemetry& out) {
+  while (_flashHead != _flashTail) {
+    if (readRecord(_flashHead, out)) return true;
+    Serial.printf("[Queue] Flash record %lu unreadable, skipped\n", (unsigned long)_flashHead);
+    evictFlashHead();
+  }
+  if (_ramCount == 0) return false;
+  out = _ram[_ramHead];
+  return true;
+}
+
+void TelemetryQueue::pop() {
+  if (_flashHead != _flashTail) {
+    SPIFFS.remove(recordPath(_flashHead));
+    _flashHead++;
+    return;
+  }
+  if (_ramCount == 0) return;
+  PendingTelemetry& oldest = _ram[_ramHead];
+  oldest.topic = String();
+  oldest.payload = String();
+  _ramHead = (_ramHead + 1) % TELEMETRY_RAM_SLOTS;
+  _ramCount--;
+}
+
+void TelemetryQueue::spillOldestRam() {
+  PendingTelemetry& oldest = _ram[_ramHead];
+  bool spilled = false;
+  if (_flashReady) {
+    if (flashCount() >= TELEMETRY_FLASH_SLOTS) {
+      evictFlashHead();
+    }
+    size_t need = sizeof(TelemetryRecordHeader) + oldest.topic.length() + oldest.payload.length();
+    while (flashCount() > 0 && SPIFFS.totalBytes() - SPIFFS.usedBytes() < need + TELEMETRY_FLASH_RESERVE) {
+      evictFlashHead();
+    }
+    if (SPIFFS.totalBytes() - SPIFFS.usedBytes() >= need + TELEMETRY_FLASH_RESERVE &&
+      writeRecord(_flashTail, oldest)) {
+      _flashTail++;
+      spilled = true;
+    }
+  }
+  if (!spilled) {
+    _evicted++;
+    Serial.println("[Queue] Telemetry could not be spilled to flash, oldest sample dropped");
+  }
+
+  oldest.topic = String();
+  oldest.payload = String();
+  _ramHead = (_ramHead + 1) % TELEMETRY_RAM_SLOTS;
+  _ramCount--;
+}
+
+void TelemetryQueue::evictFlashHead() {
+  SPIFFS.remove(recordPath(_flashHead));
+  _flashHead++;
+  _evicted++;
+}
+
+bool TelemetryQueue::writeRecord(uint32_t seq, const PendingTelemetry& rec) {
+  if (rec.topic.length() > RECORD_TOPIC_MAX || rec.payload.length() >= sizeof(gRecordPayload)) {
+    return false;
+  }
+
+  TelemetryRecordHeader h;
+  h.magic = RECORD_MAGIC;
+  h.topicLen = rec.topic.length();
+  h.seq = seq;
+  h.sampleEpoch = (uint32_t)rec.sampleEpoch;
+  h.payloadLen = rec.payload.length();
+  h.checksum = recordChecksum(rec.topic.c_str(), h.topicLen, rec.payload.c_str(), h.payloadLen);
+
+  String path = recordPath(seq);
+  File f = SPIFFS.open(path, "w");
+  if (!f) {
+    Serial.printf("[Queue] Cannot create %s\n", path.c_str());
+    return false;
+  }
+  bool ok = f.write((const uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+    f.write((const uint8_t*)rec.topic.c_str(), h.topicLen) == h.topicLen &&
+    f.write((const uint8_t*)rec.payload.c_str(), h.payloadLen) == h.payloadLen;
+  f.close();
+  if (!ok) {
+    Serial.printf("[Queue] Short write to %s\n", path.c_str());
+    SPIFFS.remove(path);
+  }
+  return ok;
+}
+
+bool TelemetryQueue::readRecord(uint32_t seq, PendingTelemetry& rec) {
+  File f = SPIFFS.open(recordPath(seq), "r");
+  if (!f) return false;
+
+  TelemetryRecordHeader h;
+  bool ok = f.read((uint8_t*)&h, sizeof(h)) == sizeof(h) &&
+    h.magic == RECORD_MAGIC && h.seq == seq &&
+    h.topicLen <= RECORD_TOPIC_MAX && h.payloadLen < sizeof(gRecordPayload) &&
+    f.read((uint8_t*)gRecordTopic, h.topicLen) == h.topicLen &&
+    f.read((uint8_t*)gRecordPayload, h.payloadLen) == h.payloadLen &&
+    recordChecksum(gRecordTopic, h.topicLen, gRecordPayload, h.payloadLen) == h.checksum;
+  f.close();
+  if (!ok) return false;
+
+  gRecordTopic[h.topicLen] = '\0';
+  gRecordPayload[h.payloadLen] = '\0';
+  rec.topic = gRecordTopic;
+  rec.payload = gRecordPayload;
+  rec.sampleEpoch = (time_t)h.sampleEpoch;
+  return true;
+}
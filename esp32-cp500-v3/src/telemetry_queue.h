@@ -0,0 +1,57 @@
+#ifndef TELEMETRY_QUEUE_H
+#define TELEMETRY_QUEUE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+static const uint8_t TELEMETRY_RAM_SLOTS = 4;        // Newest failures, kept off flash for short blips
+static const uint32_t TELEMETRY_FLASH_SLOTS = 360;   // 6 h of backlog at the default 60 s post_interval
+static const size_t TELEMETRY_FLASH_RESERVE = 65536; // SPIFFS space always left for config.json etc.
+
+struct PendingTelemetry {
+  String topic;
+  String payload;
+  time_t sampleEpoch = 0;
+};
+
+// Retry queue for telemetry the network task could not publish.
+// A small RAM ring holds the newest failures; when it is full the oldest is
+// spilled to a flash ring of one SPIFFS file per record (/tq_<seq>), so a
+// long outage or a reboot does not lose the backlog. Records leave in age
+// order: every flash record is older than every RAM record. Evicting the
+// oldest record, from either ring, is O(1). The flash ring is recovered on
+// boot from the sequence numbers in the record headers.
+// Not locked: only the network task uses it.
+class TelemetryQueue {
+public:
+  // Scans SPIFFS for a backlog left by the previous boot; call after initSPIFFS().
+  bool begin();
+
+  // Never fails: when both rings are full the oldest record is evicted.
+  void push(const char* topic, const char* payload, time_t sampleEpoch);
+  // Oldest record; unreadable flash records are skipped and deleted.
+  bool peek(PendingTelemetry& out);
+  // Removes the record returned by the last peek().
+  void pop();
+
+  uint32_t size() const { return flashCount() + _ramCount; }
+  uint32_t flashCount() const { return _flashTail - _flashHead; }
+  uint8_t ramCount() const { return _ramCount; }
+  uint32_t evicted() const { return _evicted; }
+
+private:
+  void spillOldestRam();
+  void evictFlashHead();
+  bool writeRecord(uint32_t seq, const PendingTelemetry& rec);
+  bool readRecord(uint32_t seq, PendingTelemetry& rec);
+
+  PendingTelemetry _ram[TELEMETRY_RAM_SLOTS];
+  uint8_t _ramHead = 0;
+  uint8_t _ramCount = 0;
+  uint32_t _flashHead = 0;      // Sequence number of the oldest flash record
+  uint32_t _flashTail = 0;      // Sequence number the next spill gets
+  bool _flashReady = false;
+  uint32_t _evicted = 0;        // Records dropped because the queue or flash was full
+};
+
+#endif
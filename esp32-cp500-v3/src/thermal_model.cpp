@@ -0,0 +1,64 @@
+#include "thermal_model.h"
+#include <math.h>
+
+void ThermalModel::reset() {
+  _tank.reset(THERMAL_P0);
+  _bath.reset(THERMAL_P0);
+  _core.reset(THERMAL_P0);
+  _samples = 0;
+  _heaterSamples = 0;
+  _pumpSamples = 0;
+}
+
+static bool finiteState(const ThermalState& s) {
+  return isfinite(s.tank) && isfinite(s.bath) && isfinite(s.core);
+}
+
+bool ThermalModel::observe(const ThermalState& from, const ThermalInput& u, const ThermalState& to, float dtMin) {
+  if (!(dtMin > 0.0f) || !finiteState(from) || !finiteState(to)) return false;
+
+  float dTank = (to.tank - from.tank) / dtMin;
+  float dBath = (to.bath - from.bath) / dtMin;
+  float dCore = (to.core - from.core) / dtMin;
+  if (fabsf(dTank) > THERMAL_MAX_RATE || fabsf(dBath) > THERMAL_MAX_RATE ||
+    fabsf(dCore) > THERMAL_MAX_RATE) {
+    return false;
+  }
+
+  // Regressors at the start of the step, matching the Euler step in predict().
+  float tankPhi[3] = { u.heater, -u.pump * (from.tank - from.bath), -(from.tank - from.core) };
+  float bathPhi[3] = { u.pump * (from.tank - from.bath), from.core - from.bath, 1.0f };
+  float corePhi[2] = { from.bath - from.core, 1.0f };
+  _tank.update(tankPhi, dTank, THERMAL_FORGETTING, THERMAL_P0);
+  _bath.update(bathPhi, dBath, THERMAL_FORGETTING, THERMAL_P0);
+  _core.update(corePhi, dCore, THERMAL_FORGETTING, THERMAL_P0);
+
+  if (_samples < 0xFFFF) _samples++;
+  if (u.heater > 0.0f && _heaterSamples < 0xFFFF) _heaterSamples++;
+  if (u.pump > 0.0f && _pumpSamples < 0xFFFF) _pumpSamples++;
+  return true;
+}
+
+ThermalState ThermalModel::predict(const ThermalState& s, const ThermalInput& u, float dtMin) const {
+  // Transfer and loss coefficients are physically non-negative; a noisy
+  // negative estimate would make the prediction run away over the horizon.
+  float tankXfer = fmaxf(0.0f, kTankXfer());
+  float tankLoss = fmaxf(0.0f, kTankLoss());
+  float bathXfer = fmaxf(0.0f, kBathXfer());
+  float bathCore = fmaxf(0.0f, kBathCore());
+  float coreBath = fmaxf(0.0f, kCoreBath());
+
+  ThermalState n;
+  n.tank = s.tank + dtMin * (kHeat() * u.heater - tankXfer * u.pump * (s.tank - s.bath) -
+    tankLoss * (s.tank - s.core));
+  n.bath = s.bath + dtMin * (bathXfer * u.pump * (s.tank - s.bath) + bathCore * (s.core - s.bath) + cBath());
+  n.core = s.core + dtMin * (coreBath * (s.bath - s.core) + cCore());
+  return n;
+}
+
+bool ThermalModel::ready() const {
+  return _samples >= THERMAL_MIN_SAMPLES &&
+    _heaterSamples >= THERMAL_MIN_ACTIVE &&
+    _pumpSamples >= THERMAL_MIN_ACTIVE &&
+    kHeat() > 0.0f && kBathXfer() > 0.0f;
+}
@@ -0,0 +1,114 @@
+#ifndef THERMAL_MODEL_H
+#define THERMAL_MODEL_H
+
+#include <stdint.h>
+
+// Online thermal model used by control_mode "mpc". Plain C++ (no Arduino
+// headers) so the host simulator in sim/ builds the same code.
+//
+// Three lumped nodes, each a first-order balance that is linear in its
+// coefficients (rates in C per minute, heater/pump as 0..1 duty):
+//   tank: dTk = kHeat*h - kTankXfer*p*(Tk - Tb) - kTankLoss*(Tk - Ti)
+//   bath: dTb = kBathXfer*p*(Tk - Tb) + kBathCore*(Ti - Tb) + cBath
+//   core: dTi = kCoreBath*(Tb - Ti) + cCore
+// Tk is TankTemp, Tb the bath median, Ti the internal loop (core) probe.
+// cBath lumps losses to ambient at the current ambient temperature, cCore
+// the compost's own heat. Each node is identified by its own recursive least
+// squares estimator with exponential forgetting, from consecutive
+// measurement cycles and the duties applied in between.
+
+struct ThermalState {
+  float tank;
+  float bath;
+  float core;
+};
+
+struct ThermalInput {
+  float heater;   // 0..1
+  float pump;     // 0..1
+};
+
+static const uint16_t THERMAL_MIN_SAMPLES = 30;    // Steps before the model is trusted
+static const uint16_t THERMAL_MIN_ACTIVE = 5;      // Steps with heater and with pump running
+static const float THERMAL_FORGETTING = 0.995f;    // ~200 steps memory
+static const float THERMAL_P0 = 100.0f;            // Initial covariance
+static const float THERMAL_MAX_RATE = 2.0f;        // C/min; faster changes are probe glitches
+
+// Recursive least squares for y = theta . phi with forgetting factor.
+template <uint8_t N>
+class Rls {
+public:
+  void reset(float p0) {
+    for (uint8_t i = 0; i < N; i++) {
+      theta[i] = 0.0f;
+      for (uint8_t j = 0; j < N; j++) P[i][j] = (i == j) ? p0 : 0.0f;
+    }
+  }
+
+  void update(const float* phi, float y, float lambda, float pMax) {
+    float pPhi[N];
+    float denom = lambda;
+    for (uint8_t i = 0; i < N; i++) {
+      pPhi[i] = 0.0f;
+      for (uint8_t j = 0; j < N; j++) pPhi[i] += P[i][j] * phi[j];
+      denom += phi[i] * pPhi[i];
+    }
+    float err = y;
+    for (uint8_t i = 0; i < N; i++) err -= theta[i] * phi[i];
+    float trace = 0.0f;
+    for (uint8_t i = 0; i < N; i++) {
+      theta[i] += pPhi[i] / denom * err;
+      for (uint8_t j = 0; j < N; j++) {
+        P[i][j] = (P[i][j] - pPhi[i] * pPhi[j] / denom) / lambda;
+      }
+      trace += P[i][i];
+    }
+    // Forgetting inflates P in directions the data does not excite (pump
+    // off for hours); cap it so one later sample cannot swing the estimate.
+    if (trace > N * pMax) {
+      float scale = N * pMax / trace;
+      for (uint8_t i = 0; i < N; i++) {
+        for (uint8_t j = 0; j < N; j++) P[i][j] *= scale;
+      }
+    }
+  }
+
+  float theta[N];
+  float P[N][N];
+};
+
+class ThermalModel {
+public:
+  ThermalModel() { reset(); }
+  void reset();
+
+  // Learns from one step of dtMin minutes under input u. False when the
+  // step is rejected (invalid readings or an implausible rate).
+  bool observe(const ThermalState& from, const ThermalInput& u, const ThermalState& to, float dtMin);
+
+  // One Euler step of dtMin minutes with the identified coefficients.
+  ThermalState predict(const ThermalState& s, const ThermalInput& u, float dtMin) const;
+
+  bool ready() const;
+  uint16_t samples() const { return _samples; }
+
+  // Identified coefficients (1/min, C/min for kHeat and the offsets).
+  float kHeat() const { return _tank.theta[0]; }
+  float kTankXfer() const { return _tank.theta[1]; }
+  float kTankLoss() const { return _tank.theta[2]; }
+  float kBathXfer() const { return _bath.theta[0]; }
+  float kBathCore() const { return _bath.theta[1]; }
+  float cBath() const { return _bath.theta[2]; }
+  float kCoreBath() const { return _core.theta[0]; }
+  float cCore() const { return _core.theta[1]; }
+
+private:
+  Rls<3> _tank;
+  Rls<3> _bath;
+  Rls<2> _core;
+  uint16_t _samples;
+  uint16_t _heaterSamples;
+  uint16_t _pumpSamples;
+};
+
+#endif
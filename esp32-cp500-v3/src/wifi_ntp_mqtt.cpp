@@ -238,6 +238,11 @@ void maintainMQTT(unsigned long timeoutMs) {
 }
 
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs) {
+	return publishData(topic, payload.c_str(), timeoutMs);
+}
+
+// Publishes a payload that already sits in a fixed buffer, without copying it to a String.
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs) {
 	unsigned long start = millis();
 	unsigned long retryDelay = 300;
 	int retryCount = 0;
@@ -265,7 +270,7 @@ bool publishData(const String& topic, const String& payload, unsigned long timeo
 	}
 
 	while (millis() - start < timeoutMs) {
-		if (mqttClient.publish(topic.c_str(), payload.c_str(), false)) {
+		if (mqttClient.publish(topic.c_str(), payload, false)) {
 			Serial.println("[MQTT] Publish success");
 			lastMQTTPublishSuccess = millis();
 			consecutiveMQTTFailures = 0;
@@ -300,3 +305,25 @@ bool publishData(const String& topic, const String& payload, unsigned long timeo
 		timeoutMs, retryCount);
 	return false;
 }
+
+bool publishOnce(const char* topic, const char* payload, size_t length) {
+	if (!mqttClient.connected()) {
+		return false;
+	}
+	if (mqttClient.publish(topic, (const uint8_t*)payload, length, false)) {
+		lastMQTTPublishSuccess = millis();
+		consecutiveMQTTFailures = 0;
+		return true;
+	}
+
+	consecutiveMQTTFailures++;
+	Serial.printf("[MQTT] Publish fail (%u bytes), state=%d\n", (unsigned)length, mqttClient.state());
+	if (consecutiveMQTTFailures >= MAX_CONSECUTIVE_FAILURES) {
+		// maintainMQTT() reconnects on the next loop pass.
+		Serial.printf("[MQTT] Too many consecutive failures (%lu), dropping connection\n",
+			consecutiveMQTTFailures);
+		mqttClient.disconnect();
+		consecutiveMQTTFailures = 0;
+	}
+	return false;
+}
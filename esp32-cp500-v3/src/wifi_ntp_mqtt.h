@@ -18,5 +18,8 @@ String getPublicIP();
 bool connectToMQTT(unsigned long timeoutMs);
 void maintainMQTT(unsigned long timeoutMs);
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs);
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs);
+// One publish attempt, no reconnect or retry delay; for the network task.
+bool publishOnce(const char* topic, const char* payload, size_t length);
 
 #endif
@@ -16,6 +16,7 @@
 #include "sensor.h"
 #include <Preferences.h>
 #include <vector>
+#include <algorithm>
 
 Preferences preferences;
 static const char* NVS_NAMESPACE = "temps";
@@ -93,11 +94,15 @@ static void mqttCallback(char* topic, byte* payload, unsigned int length) {
 
 // ========== 采集 + 上报 ==========
 static bool doMeasurementAndPost() {
-  // 读取两路
+  // 读取两路：先同时启动转换，两路共用一次约 750 ms 的等待
+  startConversions();
   std::vector<float> t4 = readTemps4();
   std::vector<float> t5 = readTemps5();
 
-  if (t4.empty() && t5.empty()) {
+  // 掉线槽位为 NAN，仍占位以保持与 key 的对应关系
+  uint32_t valid4 = std::count_if(t4.begin(), t4.end(), [](float t) { return !isnan(t); });
+  uint32_t valid5 = std::count_if(t5.begin(), t5.end(), [](float t) { return !isnan(t); });
+  if (valid4 == 0 && valid5 == 0) {
     Serial.println("[Measure] no temps on both buses");
     return false;
   }
@@ -139,6 +144,10 @@ static bool doMeasurementAndPost() {
   JsonArray data = doc.createNestedArray("data");
 
   for (size_t i = 0; i < n; ++i) {
+    if (isnan(temps[i])) {
+      Serial.printf("[Measure] probe %u (%s) unavailable, skipped\n", (unsigned)(i + 1), keys[i].c_str());
+      continue;
+    }
     JsonObject obj = data.createNestedObject();
     obj["key"] = keys[i];        // ✅ 必须是服务器那套 key（例如 "OpYeXW..."）
     obj["value"] = temps[i];
@@ -148,8 +157,8 @@ static bool doMeasurementAndPost() {
   // info 可扩展，放设备编号等
   JsonObject info = doc.createNestedObject("info");
   info["device"] = appConfig.equipmentKey;  // ✅ 放在 info 里
-  info["count4"] = (uint32_t)t4.size();
-  info["count5"] = (uint32_t)t5.size();
+  info["count4"] = valid4;
+  info["count5"] = valid5;
   info["timestamp"] = ts;
 
   String payload;
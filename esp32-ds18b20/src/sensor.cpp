@@ -2,41 +2,144 @@
 #include <OneWire.h>
 #include <DallasTemperature.h>
 #include <Arduino.h>
+#include <Preferences.h>
 
-static OneWire* ow4 = nullptr;
-static OneWire* ow5 = nullptr;
-static DallasTemperature* ds4 = nullptr;
-static DallasTemperature* ds5 = nullptr;
-static int cnt4 = 0, cnt5 = 0;
+static const uint8_t PROBE_MAX_SLOTS = 8;
+static const char* PROBE_NVS_NAMESPACE = "probes";
 
-static void beginBus(OneWire*& ow, DallasTemperature*& ds, int& cnt, int pin) {
+// 单条 DS18B20 总线及其转换状态。转换不阻塞（setWaitForConversion(false)），
+// 两条总线同时转换，读取时再等待本总线的转换完成，等待期间让出 CPU。
+// 探头按 ROM 地址登记在槽位表里（持久化到 NVS），按地址读取：
+// 槽位顺序即 keys.temp4 / keys.temp5 的顺序，某个探头掉线时该槽位读作 NAN，后面的探头不会前移。
+struct TempBus {
+	const char* nvsKey;
+	OneWire* ow;
+	DallasTemperature* ds;
+	int cnt;                // 槽位数
+	bool parasite;          // 寄生供电时无法查询转换是否完成，只能按时间等
+	bool pending;           // 已启动转换、尚未读取
+	unsigned long requestMs;
+	uint16_t conversionMs;
+	DeviceAddress slots[PROBE_MAX_SLOTS];
+	bool present[PROBE_MAX_SLOTS];
+};
+
+static TempBus bus4 = { "bus4", nullptr, nullptr, 0, false, false, 0, 750 };
+static TempBus bus5 = { "bus5", nullptr, nullptr, 0, false, false, 0, 750 };
+
+static int findSlot(const TempBus& bus, const uint8_t* rom) {
+	for (int i = 0; i < bus.cnt; ++i) {
+		if (memcmp(bus.slots[i], rom, sizeof(DeviceAddress)) == 0) return i;
+	}
+	return -1;
+}
+
+// 读出持久化的槽位表，做一次线性 ROM 搜索：已登记的标记为在线，
+// 新探头优先占空槽位，槽位满时接替掉线探头的槽位（更换探头沿用原 key）。
+static void registerProbes(TempBus& bus, int pin) {
+	Preferences prefs;
+	if (prefs.begin(PROBE_NVS_NAMESPACE, true)) {
+		size_t len = prefs.getBytesLength(bus.nvsKey);
+		if (len > 0 && len % sizeof(DeviceAddress) == 0 && len / sizeof(DeviceAddress) <= PROBE_MAX_SLOTS) {
+			prefs.getBytes(bus.nvsKey, bus.slots, len);
+			bus.cnt = len / sizeof(DeviceAddress);
+		}
+		prefs.end();
+	}
+
+	DeviceAddress unknown[PROBE_MAX_SLOTS];
+	int unknownCount = 0;
+	DeviceAddress rom;
+	bus.ow->reset_search();
+	while (bus.ow->search(rom)) {
+		if (OneWire::crc8(rom, 7) != rom[7] || !bus.ds->validFamily(rom)) continue;
+		int slot = findSlot(bus, rom);
+		if (slot >= 0) bus.present[slot] = true;
+		else if (unknownCount < PROBE_MAX_SLOTS) memcpy(unknown[unknownCount++], rom, sizeof(DeviceAddress));
+	}
+
+	bool changed = false;
+	for (int u = 0; u < unknownCount; ++u) {
+		int slot = -1;
+		if (bus.cnt < PROBE_MAX_SLOTS) {
+			slot = bus.cnt++;
+		}
+		else {
+			for (int i = 0; i < bus.cnt; ++i) {
+				if (!bus.present[i]) {
+					slot = i;
+					break;
+				}
+			}
+		}
+		if (slot < 0) continue;
+		memcpy(bus.slots[slot], unknown[u], sizeof(DeviceAddress));
+		bus.present[slot] = true;
+		changed = true;
+		Serial.printf("[Sensors] GPIO%d new probe registered in slot %d\n", pin, slot + 1);
+	}
+
+	if (changed && prefs.begin(PROBE_NVS_NAMESPACE, false)) {
+		prefs.putBytes(bus.nvsKey, bus.slots, bus.cnt * sizeof(DeviceAddress));
+		prefs.end();
+	}
+	for (int i = 0; i < bus.cnt; ++i) {
+		if (!bus.present[i]) Serial.printf("[Sensors] GPIO%d slot %d probe missing\n", pin, i + 1);
+	}
+}
+
+static void beginBus(TempBus& bus, int pin) {
 	if (pin < 0) return;
-	ow = new OneWire(pin);
-	ds = new DallasTemperature(ow);
-	ds->begin();
-	ds->setResolution(12);
-	ds->requestTemperatures();
-	cnt = ds->getDeviceCount();
-	Serial.printf("[Sensors] GPIO%d found %d DS18B20\n", pin, cnt);
+	bus.ow = new OneWire(pin);
+	bus.ds = new DallasTemperature(bus.ow);
+	bus.ds->begin();
+	bus.ds->setResolution(12);
+	bus.ds->requestTemperatures();
+	bus.parasite = bus.ds->isParasitePowerMode();
+	bus.conversionMs = bus.ds->millisToWaitForConversion(12);
+	bus.ds->setWaitForConversion(false);
+	registerProbes(bus, pin);
+	Serial.printf("[Sensors] GPIO%d found %d DS18B20\n", pin, (int)bus.ds->getDeviceCount());
 }
 
 bool initSensors(int pin4, int pin5) {
-	if (pin4 >= 0) beginBus(ow4, ds4, cnt4, pin4);
-	if (pin5 >= 0) beginBus(ow5, ds5, cnt5, pin5);
-	return (cnt4 > 0 || cnt5 > 0);
+	beginBus(bus4, pin4);
+	beginBus(bus5, pin5);
+	return (bus4.cnt > 0 || bus5.cnt > 0);
+}
+
+static void requestBus(TempBus& bus) {
+	if (!bus.ds || bus.pending) return;
+	bus.ds->requestTemperatures();
+	bus.requestMs = millis();
+	bus.pending = true;
+}
+
+static void awaitBus(TempBus& bus) {
+	requestBus(bus);
+	while (millis() - bus.requestMs < bus.conversionMs &&
+		(bus.parasite || !bus.ds->isConversionComplete())) {
+		delay(10);
+	}
+	bus.pending = false;
+}
+
+void startConversions() {
+	requestBus(bus4);
+	requestBus(bus5);
 }
 
-static std::vector<float> readBus(DallasTemperature* ds, int& cnt) {
+static std::vector<float> readBus(TempBus& bus) {
 	std::vector<float> temps;
-	if (!ds) return temps;
-	ds->requestTemperatures();
-	cnt = ds->getDeviceCount();
-	for (int i = 0; i < cnt; ++i) {
-		float t = ds->getTempCByIndex(i);
-		if (!isnan(t) && t > -55 && t < 125) temps.push_back(t);
+	if (!bus.ds) return temps;
+	awaitBus(bus);
+	for (int i = 0; i < bus.cnt; ++i) {
+		float t = bus.ds->getTempC(bus.slots[i]);
+		bus.present[i] = (t != DEVICE_DISCONNECTED_C);
+		temps.push_back(!isnan(t) && t > -55 && t < 125 ? t : NAN);
 	}
 	return temps;
 }
 
-std::vector<float> readTemps4() { return readBus(ds4, cnt4); }
-std::vector<float> readTemps5() { return readBus(ds5, cnt5); }
+std::vector<float> readTemps4() { return readBus(bus4); }
+std::vector<float> readTemps5() { return readBus(bus5); }
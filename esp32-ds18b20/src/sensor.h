@@ -2,5 +2,8 @@
 #include <vector>
 
 bool initSensors(int pin4, int pin5);
+// 两路同时开始转换（不阻塞）；readTemps4/5 会等待各自的转换完成，未启动时先启动
+void startConversions();
+// 每个已登记槽位一个值，探头掉线或读数越界时为 NAN
 std::vector<float> readTemps4();
 std::vector<float> readTemps5();
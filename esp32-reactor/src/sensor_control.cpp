@@ -1,9 +1,87 @@
 #include "sensor_control.h"
 #include "config_manager.h"
+#include <SPIFFS.h>
 
 OneWire oneWire(4);  // DS18B20 数据线连接 D4（GPIO4）
 DallasTemperature sensors(&oneWire);
-DeviceAddress deviceAddresses[6];  // 最多6个地址
+
+// 探头槽位表：槽位 i 对应 config 里的 ds[i] / rank[i]。
+// 首次启动按 ROM 搜索顺序登记并保存到 SPIFFS，之后按地址读取，
+// 探头掉线不会让后面的探头挪到它的位置上；新探头接替掉线探头的槽位。
+static const int PROBE_SLOTS = 6;
+static const char* PROBE_TABLE_FILE = "/probes.bin";
+DeviceAddress deviceAddresses[PROBE_SLOTS];
+static int probeCount = 0;
+
+static int findProbeSlot(const uint8_t* rom) {
+	for (int i = 0; i < probeCount; ++i) {
+		if (memcmp(deviceAddresses[i], rom, sizeof(DeviceAddress)) == 0) return i;
+	}
+	return -1;
+}
+
+static void loadProbeTable() {
+	File file = SPIFFS.open(PROBE_TABLE_FILE, "r");
+	if (!file) return;
+	size_t len = file.size();
+	if (len % sizeof(DeviceAddress) == 0 && len / sizeof(DeviceAddress) <= PROBE_SLOTS) {
+		probeCount = file.read((uint8_t*)deviceAddresses, len) / sizeof(DeviceAddress);
+	}
+	file.close();
+}
+
+static void saveProbeTable() {
+	File file = SPIFFS.open(PROBE_TABLE_FILE, FILE_WRITE);
+	if (!file) {
+		Serial.println("[Temp] Failed to save probe table");
+		return;
+	}
+	file.write((const uint8_t*)deviceAddresses, probeCount * sizeof(DeviceAddress));
+	file.close();
+}
+
+// 一次线性 ROM 搜索：已登记的标记在线，新探头占空槽位或接替掉线的槽位
+static void registerProbes() {
+	loadProbeTable();
+
+	bool present[PROBE_SLOTS] = { false };
+	DeviceAddress unknown[PROBE_SLOTS];
+	int unknownCount = 0;
+	DeviceAddress rom;
+	oneWire.reset_search();
+	while (oneWire.search(rom)) {
+		if (OneWire::crc8(rom, 7) != rom[7] || !sensors.validFamily(rom)) continue;
+		int slot = findProbeSlot(rom);
+		if (slot >= 0) present[slot] = true;
+		else if (unknownCount < PROBE_SLOTS) memcpy(unknown[unknownCount++], rom, sizeof(DeviceAddress));
+	}
+
+	bool changed = false;
+	for (int u = 0; u < unknownCount; ++u) {
+		int slot = -1;
+		if (probeCount < PROBE_SLOTS) {
+			slot = probeCount++;
+		}
+		else {
+			for (int i = 0; i < probeCount; ++i) {
+				if (!present[i]) {
+					slot = i;
+					break;
+				}
+			}
+		}
+		if (slot < 0) continue;
+		memcpy(deviceAddresses[slot], unknown[u], sizeof(DeviceAddress));
+		present[slot] = true;
+		changed = true;
+		Serial.printf("[Temp] New probe registered in slot %d\n", slot + 1);
+	}
+	if (changed) saveProbeTable();
+
+	for (int i = 0; i < probeCount; ++i) {
+		if (!present[i]) Serial.printf("[Temp] Slot %d probe missing\n", i + 1);
+	}
+}
 
 Adafruit_SGP30 sgp30;
 
@@ -16,11 +94,7 @@ void initSensors() {
 	int count = sensors.getDeviceCount();
 	Serial.printf("[Temp] Found %d DS18B20 sensors\n", count);
 
-	int index = 0;
-	OneWire romReader(4);
-	while (romReader.search(deviceAddresses[index]) && index < 6) {
-		++index;
-	}
+	registerProbes();
 
 	if (!sgp30.begin()) {
 		Serial.println("[SGP30] Initialization failed!");
@@ -41,7 +115,7 @@ bool readTemperatures(std::vector<float>& temps, std::vector<String>& keys) {
 	keys.resize(6, "");
 
 	for (int i = 0; i < 6; ++i) {
-		float tempC = sensors.getTempCByIndex(i);
+		float tempC = i < probeCount ? sensors.getTempC(deviceAddresses[i]) : DEVICE_DISCONNECTED_C;
 		if (tempC == DEVICE_DISCONNECTED_C) {
 			Serial.printf("[Temp] Sensor %d disconnected\n", i);
 			return false;
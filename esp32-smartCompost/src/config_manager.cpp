@@ -42,6 +42,8 @@ bool loadConfigFromSPIFFS(const char* path) {
 		appConfig.ntpServers = {"ntp.aliyun.com", "cn.ntp.org.cn"};
 		appConfig.pumpRunTime = 60000;
 		appConfig.readInterval = 60000;
+		appConfig.cacheUploadBatch = 10;
+		appConfig.heapReportInterval = 3600000;
 
 		return true;
 	}
@@ -105,6 +107,9 @@ bool loadConfigFromSPIFFS(const char* path) {
 	appConfig.pumpRunTime = doc["pump_run_time"] | 60000;
 	// Default 60s; 600000 was easy to mistake for "no data for a long time" when key is missing.
 	appConfig.readInterval = doc["read_interval"] | 60000;
+	appConfig.cacheUploadBatch = doc["cache_upload_batch"] | 10;
+	if (appConfig.cacheUploadBatch < 1) appConfig.cacheUploadBatch = 1;
+	appConfig.heapReportInterval = doc["heap_report_interval"] | 3600000;
 
 	return true;
 }
@@ -137,6 +142,8 @@ bool saveConfigToSPIFFS(const char* path) {
 	// 控制参数
 	doc["pump_run_time"] = appConfig.pumpRunTime;
 	doc["read_interval"] = appConfig.readInterval;
+	doc["cache_upload_batch"] = appConfig.cacheUploadBatch;
+	doc["heap_report_interval"] = appConfig.heapReportInterval;
 
 	// 写回文件
 	File file = SPIFFS.open(path, FILE_WRITE);
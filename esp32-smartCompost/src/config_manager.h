@@ -41,6 +41,10 @@ struct AppConfig {
 
 	uint32_t pumpRunTime;
 	uint32_t readInterval;
+	// Number of cached samples published back-to-back per drain batch (1 = one by one).
+	uint16_t cacheUploadBatch;
+	// 堆/栈健康通道附加到遥测的间隔（毫秒，0 表示不附加）。
+	uint32_t heapReportInterval;
 };
 
 extern AppConfig appConfig;
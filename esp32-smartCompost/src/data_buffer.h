@@ -1,13 +1,28 @@
 // data_buffer.h
 // 断网数据缓存模块
 // 功能：断网时将数据暂存到SPIFFS，网络恢复后自动上传
-// 使用单个JSON文件存储所有缓存数据
+// 使用追加写的分段日志存储缓存数据（/dcache_NNNNNN.seg + /dcache.cur 游标）
 
 #ifndef DATA_BUFFER_H
 #define DATA_BUFFER_H
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <vector>
+
+// 记录在日志中的位置（段号 + 段内偏移），按写入顺序单调递增
+struct CacheRecordPos {
+    uint32_t seg = 0;
+    uint32_t offset = 0;
+};
+
+// 一条待上传的缓存数据
+struct PendingData {
+    String topic;
+    String payload;
+    String timestamp;
+    CacheRecordPos pos;  // 补传后按位置确认
+};
 
 // ========== 初始化与配置 ==========
 
@@ -35,6 +50,54 @@ void cleanExpiredCache();
  */
 bool savePendingData(const String& topic, const String& payload, const String& timestamp = "");
 
+// ========== 紧凑样本 ==========
+
+// 样本通道编号（决定渲染时的 code / unit / 小数位数）
+enum CacheChannelId : uint8_t {
+    CACHE_CH_CO2 = 0,
+    CACHE_CH_CO,
+    CACHE_CH_H2S,
+    CACHE_CH_O2,
+    CACHE_CH_CH4,
+    CACHE_CH_AIR_TEMP,
+    CACHE_CH_AIR_HUMIDITY,
+    CACHE_CH_ROOM_TEMP,
+    CACHE_CH_COUNT
+};
+
+// 通道质量标记，渲染为 "OK" / "ERR" / "UNSTABLE"
+enum CacheQuality : uint8_t {
+    CACHE_QUALITY_OK = 0,
+    CACHE_QUALITY_ERR,
+    CACHE_QUALITY_UNSTABLE
+};
+
+static const uint8_t CACHE_MAX_CHANNELS = 8;
+
+struct CachedChannel {
+    uint8_t id;       // CacheChannelId
+    uint8_t quality;  // CacheQuality
+    float value;
+};
+
+// 一次采样的紧凑表示，补传时渲染成与实时上报相同的 JSON
+struct CachedSample {
+    uint32_t epoch = 0;               // 采样时间（0 表示使用当前时间）
+    uint8_t pointId = 0;              // 点位号，0 表示 payload 不带 point_id
+    bool withControllerCode = false;  // payload 是否带 controller_device_code
+    uint8_t channelCount = 0;
+    CachedChannel channels[CACHE_MAX_CHANNELS];
+};
+
+/**
+ * @brief 以紧凑二进制格式保存一条待上传样本
+ * topic 以 topic_registry 编号保存，通道值以 float 保存，单条约 70 字节
+ * @param topicId topic 编号（见 topic_registry.h）
+ * @param sample 样本
+ * @return true 成功 false 失败（调用方可退回 savePendingData）
+ */
+bool savePendingSample(uint8_t topicId, const CachedSample& sample);
+
 // ========== 数据读取与标记 ==========
 
 /**
@@ -52,6 +115,21 @@ int getPendingDataCount();
  */
 bool getFirstPendingData(String& outTopic, String& outPayload, String& outTimestamp);
 
+/**
+ * @brief 按顺序读取最旧的若干条待上传数据（同一段只打开一次文件）
+ * @param out 输出数据（会先清空）
+ * @param maxCount 最多读取条数
+ * @return 实际读取条数
+ */
+int getPendingDataBatch(std::vector<PendingData>& out, int maxCount);
+
+/**
+ * @brief 把位置不晚于 pos 的待上传记录全部标记为已上传（只写一次游标）
+ * 发布期间队首记录可能因缓存满被淘汰，按位置确认不会误删后面尚未送达的记录
+ * @return 实际标记条数
+ */
+int markPendingDataAsUploadedThrough(const CacheRecordPos& pos);
+
 /**
  * @brief 标记当前第一条数据为已上传
  * @return true 成功 false 失败
@@ -59,9 +137,10 @@ bool getFirstPendingData(String& outTopic, String& outPayload, String& outTimest
 bool markFirstDataAsUploaded();
 
 /**
- * @brief 清理已上传的数据（只保留最近N条）
- * @param keepCount 保留条数（默认1条）
- * @return 清理的条数
+ * @brief 汇报随数据段回收的已上传数据
+ * 已上传数据所在段全部确认后即被删除，无需逐条清理
+ * @param keepCount 兼容旧接口，已不再使用
+ * @return 自上次调用以来回收的条数
  */
 int cleanUploadedData(int keepCount = 1);
 
@@ -74,7 +153,7 @@ bool clearAllPendingData();
 // ========== 工具函数 ==========
 
 /**
- * @brief 获取缓存文件路径
+ * @brief 获取缓存游标文件路径
  */
 const char* getCacheFilePath();
 
@@ -0,0 +1,47 @@
+// heap_monitor.cpp
+// 堆与任务栈健康监测实现
+
+#include "heap_monitor.h"
+
+#if HEAP_MONITOR_ENABLED
+
+static TaskHandle_t g_measureTask = nullptr;
+static TaskHandle_t g_commandTask = nullptr;
+static bool g_reported = false;
+static unsigned long g_lastReportMs = 0;
+
+void heapMonitorSetTasks(TaskHandle_t measureTask, TaskHandle_t commandTask) {
+    g_measureTask = measureTask;
+    g_commandTask = commandTask;
+}
+
+void sampleHeapStats(HeapStats& stats) {
+    stats.freeHeap = ESP.getFreeHeap();
+    stats.largestBlock = ESP.getMaxAllocHeap();
+    stats.minFreeHeap = ESP.getMinFreeHeap();
+    stats.fragmentation = stats.freeHeap > 0
+        ? (uint8_t)(100 - (uint64_t)stats.largestBlock * 100 / stats.freeHeap)
+        : 0;
+    // ESP-IDF 的栈高水位以字节为单位
+    stats.measureStack = g_measureTask ? uxTaskGetStackHighWaterMark(g_measureTask) : 0;
+    stats.commandStack = g_commandTask ? uxTaskGetStackHighWaterMark(g_commandTask) : 0;
+}
+
+bool takeHeapStatsIfDue(uint32_t intervalMs, HeapStats& stats) {
+    if (intervalMs == 0) {
+        return false;
+    }
+    unsigned long now = millis();
+    if (g_reported && now - g_lastReportMs < intervalMs) {
+        return false;
+    }
+    g_reported = true;
+    g_lastReportMs = now;
+    sampleHeapStats(stats);
+    Serial.printf("[Heap] free=%u largest=%u min=%u frag=%u%% stack(measure=%u command=%u)\n",
+        (unsigned)stats.freeHeap, (unsigned)stats.largestBlock, (unsigned)stats.minFreeHeap,
+        (unsigned)stats.fragmentation, (unsigned)stats.measureStack, (unsigned)stats.commandStack);
+    return true;
+}
+
+#endif
@@ -0,0 +1,54 @@
+// heap_monitor.h
+// 堆与任务栈健康监测
+// 功能：采样空闲堆、最大可分配块、历史最低空闲堆和测量/命令任务的栈余量，
+// 按配置的间隔附加到遥测 payload 里，用于排查长时间运行后的内存碎片问题。
+// 编译时加 -DHEAP_MONITOR_ENABLED=0 可整体去掉。
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef HEAP_MONITOR_ENABLED
+#define HEAP_MONITOR_ENABLED 1
+#endif
+
+struct HeapStats {
+    uint32_t freeHeap = 0;       // 当前空闲堆（字节）
+    uint32_t largestBlock = 0;   // 最大可分配块（字节）
+    uint32_t minFreeHeap = 0;    // 启动以来最低空闲堆（字节）
+    uint8_t fragmentation = 0;   // 碎片率 = 100 - 最大块 / 空闲堆（%）
+    uint32_t measureStack = 0;   // 测量任务栈最小余量（字节）
+    uint32_t commandStack = 0;   // 命令任务栈最小余量（字节）
+};
+
+#if HEAP_MONITOR_ENABLED
+
+/**
+ * @brief 登记需要监测栈余量的任务
+ */
+void heapMonitorSetTasks(TaskHandle_t measureTask, TaskHandle_t commandTask);
+
+/**
+ * @brief 立即采样一次
+ */
+void sampleHeapStats(HeapStats& stats);
+
+/**
+ * @brief 距上次上报已满 intervalMs 时采样并记为已上报
+ * @param intervalMs 上报间隔（毫秒），0 表示不上报
+ * @return true 本次需要附加堆通道
+ */
+bool takeHeapStatsIfDue(uint32_t intervalMs, HeapStats& stats);
+
+#else
+
+inline void heapMonitorSetTasks(TaskHandle_t, TaskHandle_t) {}
+inline void sampleHeapStats(HeapStats&) {}
+inline bool takeHeapStatsIfDue(uint32_t, HeapStats&) { return false; }
+
+#endif
+
+#endif
@@ -33,6 +33,10 @@
 #include "wifi_ntp_mqtt.h"
 #include "sensor.h"
 #include "data_buffer.h"
+#include "topic_registry.h"
+#include "telemetry_writer.h"
+#include "command_filter.h"
+#include "heap_monitor.h"
 
 // ======================= Persistence =======================
 Preferences preferences;
@@ -78,7 +82,7 @@ static time_t parseScheduleOrNow(const String& schedule) {
 
 // =====================================================
 // Build the full configuration JSON used by register and reply payloads.
-// Format: { "wifi": [...], "mqtt": {...}, "ntp_servers": [...], "pump_run_time": ..., "read_interval": ... }
+// Format: { "wifi": [...], "mqtt": {...}, "ntp_servers": [...], "pump_run_time": ..., "read_interval": ..., "cache_upload_batch": ..., "heap_report_interval": ... }
 // =====================================================
 static void fillConfigJson(JsonObject cfg) {
   // WiFi
@@ -105,6 +109,8 @@ static void fillConfigJson(JsonObject cfg) {
   // Control parameters
   cfg["pump_run_time"] = appConfig.pumpRunTime;
   cfg["read_interval"] = appConfig.readInterval;
+  cfg["cache_upload_batch"] = appConfig.cacheUploadBatch;
+  cfg["heap_report_interval"] = appConfig.heapReportInterval;
 }
 
 // =====================================================
@@ -124,6 +130,12 @@ static void publishOnlineWithConfig() {
   JsonObject cfg = doc["config"].to<JsonObject>();
   fillConfigJson(cfg);
 
+  // Offline cache backlog and drain counters as of this registration.
+  JsonObject cache = doc["cache"].to<JsonObject>();
+  cache["pending"] = getPendingDataCount();
+  cache["uploaded_total"] = getCacheUploadTotal();
+  cache["upload_rate"] = getCacheUploadRate();
+
   String out;
   serializeJson(doc, out);
   Serial.printf("[Register] Payload size: %d bytes\n", out.length());
@@ -164,6 +176,17 @@ static bool updateAppConfigFromJson(JsonObject cfg) {
     Serial.printf("[CFG] read_interval(post_interval) = %u\n", (unsigned)appConfig.readInterval);
   }
 
+  if (cfg["cache_upload_batch"].is<uint16_t>()) {
+    uint16_t batch = cfg["cache_upload_batch"].as<uint16_t>();
+    appConfig.cacheUploadBatch = batch > 0 ? batch : 1;
+    Serial.printf("[CFG] cache_upload_batch = %u\n", (unsigned)appConfig.cacheUploadBatch);
+  }
+
+  if (cfg["heap_report_interval"].is<uint32_t>()) {
+    appConfig.heapReportInterval = cfg["heap_report_interval"].as<uint32_t>();
+    Serial.printf("[CFG] heap_report_interval = %u\n", (unsigned)appConfig.heapReportInterval);
+  }
+
   // -------- WiFi --------
   if (cfg["wifi"].is<JsonArray>()) {
     JsonArray wifi = cfg["wifi"].as<JsonArray>();
@@ -300,9 +323,9 @@ static void executeCommand(const PendingCommand& pcmd) {
 // =====================================================
 static void mqttCallback(char* topic, byte* payload, unsigned int length) {
   Serial.println("[MQTT] 收到指令");
-
+  // Only the fields the commands use are kept (see shared/CommandFilter).
   JsonDocument doc;
-  DeserializationError err = deserializeJson(doc, payload, length);
+  DeserializationError err = parseCommandPayload(doc, payload, length);
   if (err) {
     Serial.print("[MQTT] JSON 解析失败: ");
     Serial.println(err.c_str());
@@ -442,57 +465,59 @@ static bool doMeasurementAndSave() {
     };
 
   // 新格式：{ "schema_version": 2, "ts": "...", "channels": [ { "code": "...", "value": ..., "unit": "...", "quality": "..." }, ... ] }
-  String payload = "{";
-  payload += "\"schema_version\":2,";
-  payload += "\"ts\":\"" + ts + "\",";
-  payload += "\"channels\":[";
-
-  // CO2 (%VOL)
-  payload += "{";
-  payload += "\"code\":\"CO2\",";
-  payload += "\"value\":" + String(co2pct, 2) + ",";
-  payload += "\"unit\":\"%VOL\",";
-  payload += "\"quality\":\"" + String(getQuality(co2pct)) + "\"";
-  payload += "},";
-
-  // O2 (%VOL)
-  payload += "{";
-  payload += "\"code\":\"O2\",";
-  payload += "\"value\":" + String(o2, 2) + ",";
-  payload += "\"unit\":\"%VOL\",";
-  payload += "\"quality\":\"" + String(getQuality(o2)) + "\"";
-  payload += "}";  // O2 现为最后一个通道，去掉尾逗号
-
-  // RoomTemp (℃) —— 已临时移除传感器
-  // payload += "{";
-  // payload += "\"code\":\"RoomTemp\",";
-  // payload += "\"value\":" + String(t_ds, 1) + ",";
-  // payload += "\"unit\":\"℃\",";
-  // payload += "\"quality\":\"" + String(getQuality(t_ds)) + "\"";
-  // payload += "},";
-
-  // AirTemp (℃) —— 已临时移除传感器
-  // payload += "{";
-  // payload += "\"code\":\"AirTemp\",";
-  // payload += "\"value\":" + String(t_air, 1) + ",";
-  // payload += "\"unit\":\"℃\",";
-  // payload += "\"quality\":\"" + String(getQuality(t_air)) + "\"";
-  // payload += "},";
-
-  // AirHumidity (%RH) —— 已临时移除传感器
-  // payload += "{";
-  // payload += "\"code\":\"AirHumidity\",";
-  // payload += "\"value\":" + String(h_air, 1) + ",";
-  // payload += "\"unit\":\"%RH\",";
-  // payload += "\"quality\":\"" + String(getQuality(h_air)) + "\"";
-  // payload += "}";
-
-  payload += "]}";
-
-  bool uploaded = publishData(appConfig.mqttPostTopic(), payload, 10000);
+  // payload 直接写进栈上的固定缓冲区，避免逐段 String 拼接反复申请堆内存
+  char payloadBuf[TELEMETRY_PAYLOAD_MAX];
+  TelemetryWriter payload(payloadBuf, sizeof(payloadBuf));
+  payload.begin(ts.c_str());
+  payload.beginChannels();
+  payload.channel("CO2", co2pct, 2, "%VOL", getQuality(co2pct));
+  payload.channel("O2", o2, 2, "%VOL", getQuality(o2));
+  // 以下传感器已临时移除，恢复时按原顺序补上
+  // payload.channel("RoomTemp", t_ds, 1, "℃", getQuality(t_ds));
+  // payload.channel("AirTemp", t_air, 1, "℃", getQuality(t_air));
+  // payload.channel("AirHumidity", h_air, 1, "%RH", getQuality(h_air));
+
+  // Heap/stack health channels every heap_report_interval (live only, not cached).
+  HeapStats heap;
+  if (takeHeapStatsIfDue(appConfig.heapReportInterval, heap)) {
+    payload.channel("HeapFree", heap.freeHeap, 0, "B", "OK");
+    payload.channel("HeapMaxBlock", heap.largestBlock, 0, "B", "OK");
+    payload.channel("HeapMinFree", heap.minFreeHeap, 0, "B", "OK");
+    payload.channel("HeapFrag", heap.fragmentation, 0, "%", "OK");
+    payload.channel("StackMeasure", heap.measureStack, 0, "B", "OK");
+    payload.channel("StackCommand", heap.commandStack, 0, "B", "OK");
+  }
+  if (!payload.end()) {
+    Serial.println("[Measure] Payload buffer overflow, data dropped");
+    return false;
+  }
+
+  // Compact form of the same sample; cached on failure and re-rendered at upload time.
+  auto toCacheQuality = [](float val) -> uint8_t {
+    return val < 0 ? CACHE_QUALITY_ERR : CACHE_QUALITY_OK;
+    };
+  CachedSample sample;
+  sample.epoch = nowEpoch > 0 ? (uint32_t)nowEpoch : 0;
+  sample.channels[sample.channelCount++] = { CACHE_CH_CO2, toCacheQuality(co2pct), co2pct };
+  sample.channels[sample.channelCount++] = { CACHE_CH_O2, toCacheQuality(o2), o2 };
+  // 传感器恢复时同步补上对应通道
+  // sample.channels[sample.channelCount++] = { CACHE_CH_ROOM_TEMP, toCacheQuality(t_ds), t_ds };
+  // sample.channels[sample.channelCount++] = { CACHE_CH_AIR_TEMP, toCacheQuality(t_air), t_air };
+  // sample.channels[sample.channelCount++] = { CACHE_CH_AIR_HUMIDITY, toCacheQuality(h_air), h_air };
+
+  // topic 启动时已注册，这里只取编号；注册失败时才临时拼接
+  uint8_t topicId = telemetryTopicId();
+  String fallbackTopic;
+  if (topicId == TOPIC_ID_INVALID) {
+    fallbackTopic = appConfig.mqttPostTopic();
+  }
+  const String& postTopic = topicId == TOPIC_ID_INVALID ? fallbackTopic : topicById(topicId);
+
+  bool uploaded = publishData(postTopic, payload.c_str(), 10000);
   if (!uploaded) {
     Serial.println("[Measure] Live upload failed, trying local cache...");
-    if (!savePendingData(appConfig.mqttPostTopic(), payload, ts)) {
+    if (!savePendingSample(topicId, sample) &&
+        !savePendingData(postTopic, String(payload.c_str()), ts)) {
       Serial.println("[Measure] Cache save failed");
       return false;
     }
@@ -603,14 +628,24 @@ void setup() {
     ESP.restart();
   }
 
-  // 2) 初始化数据缓存模块
-  if (!initDataBuffer(200, 7)) {
+  // 2) 注册遥测 topic（断网缓存按编号引用，需在缓存模块之前）
+  if (!initTopicRegistry()) {
+    Serial.println("[System] topic 注册失败，遥测退回完整 topic");
+  }
+
+  // 初始化数据缓存模块
+  if (!initDataBuffer(1000, 7)) {
     Serial.println("[System] 数据缓存模块初始化失败，继续运行...");
   }
   else {
     Serial.println("[System] 数据缓存模块初始化成功");
   }
 
+  // 缓存为空时没有记录引用旧编号，顺带清掉注册表里不再使用的 topic
+  if (getPendingDataCount() == 0 && !compactTopicRegistry()) {
+    Serial.println("[System] topic 注册表重建失败，遥测退回完整 topic");
+  }
+
   // 3) WiFi + NTP
   if (!connectToWiFi(20000) || !multiNTPSetup(20000)) {
     Serial.println("[System] WiFi/NTP 失败，重启");
@@ -706,8 +741,11 @@ void setup() {
   }
 
   // 9) 启动任务
-  xTaskCreatePinnedToCore(measurementTask, "Measure", 16384, NULL, 1, NULL, 1);
-  xTaskCreatePinnedToCore(commandTask, "Command", 8192, NULL, 1, NULL, 1);
+  TaskHandle_t measureHandle = nullptr;
+  TaskHandle_t commandHandle = nullptr;
+  xTaskCreatePinnedToCore(measurementTask, "Measure", 16384, NULL, 1, &measureHandle, 1);
+  xTaskCreatePinnedToCore(commandTask, "Command", 8192, NULL, 1, &commandHandle, 1);
+  heapMonitorSetTasks(measureHandle, commandHandle);
 
   Serial.println("[System] 初始化完成");
 }
@@ -725,7 +763,7 @@ void loop() {
   unsigned long now = millis();
   if (now - lastCacheUploadMs >= CACHE_UPLOAD_INTERVAL) {
     lastCacheUploadMs = now;
-    int uploaded = uploadCachedData(1);
+    int uploaded = uploadCachedData(20);
     if (uploaded > 0) {
       Serial.printf("[Loop] Uploaded %d cached data items\n", uploaded);
     }
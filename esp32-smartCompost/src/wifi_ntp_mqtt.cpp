@@ -8,6 +8,8 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <esp_task_wdt.h>
+#include "data_buffer.h"
+#include "telemetry_writer.h"
 
 // Arduino loopTask is subscribed to the Task WDT (~5s). Long WiFi/MQTT waits
 // must reset it or the chip reboots (often mistaken for "random" restarts).
@@ -271,7 +273,7 @@ String getTimeString() {
 
 bool connectToMQTT(unsigned long timeoutMs) {
 	mqttClient.setServer(appConfig.mqttServer.c_str(), appConfig.mqttPort);
-	mqttClient.setBufferSize(1024);
+	mqttClient.setBufferSize(TELEMETRY_MQTT_BUFFER_SIZE);
 	// Cap blocking TCP time per attempt so loopTask can satisfy the TWDT.
 	espClient.setTimeout(4000);
 
@@ -350,6 +352,25 @@ void maintainMQTT(unsigned long timeoutMs) {
 }
 
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs) {
+	return publishData(topic, payload.c_str(), timeoutMs);
+}
+
+size_t mqttPayloadLimit(const String& topic) {
+	size_t overhead = TELEMETRY_MQTT_HEADER_MAX + topic.length();
+	return overhead < TELEMETRY_MQTT_BUFFER_SIZE ? TELEMETRY_MQTT_BUFFER_SIZE - overhead : 0;
+}
+
+// Same as above for a payload in a fixed buffer; no heap copy of the payload.
+// PubSubClient only returns false for a message larger than its buffer, so
+// report that here and give up instead of retrying until the timeout.
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs) {
+	size_t payloadLen = strlen(payload);
+	if (payloadLen > mqttPayloadLimit(topic)) {
+		Serial.printf("[MQTT] publishData: %u-byte payload exceeds the %u-byte MQTT buffer on %s\n",
+			(unsigned)payloadLen, (unsigned)TELEMETRY_MQTT_BUFFER_SIZE, topic.c_str());
+		return false;
+	}
+
 	ensureMqttMutex();
 	maintainWiFi();
 
@@ -373,7 +394,7 @@ bool publishData(const String& topic, const String& payload, unsigned long timeo
 
 	while (millis() - start < timeoutMs) {
 		mqttClient.loop();
-		if (mqttClient.publish(topic.c_str(), payload.c_str())) {
+		if (mqttClient.publish(topic.c_str(), payload)) {
 			Serial.println("[MQTT] Publish success:");
 			Serial.println(payload);
 			ok = true;
@@ -403,7 +424,6 @@ bool publishDataOrCache(const String& topic, const String& payload, const String
 	}
 
 	Serial.println("[MQTT] Publish failed, caching locally...");
-	extern bool savePendingData(const String&, const String&, const String&);
 
 	if (savePendingData(topic, payload, timestamp)) {
 		Serial.println("[MQTT] Data cached successfully");
@@ -415,42 +435,97 @@ bool publishDataOrCache(const String& topic, const String& payload, const String
 	}
 }
 
-// Attempt to upload pending cached samples in small batches.
-int uploadCachedData(int maxUpload) {
-	extern int getPendingDataCount();
-	extern bool getFirstPendingData(String&, String&, String&);
-	extern bool markFirstDataAsUploaded();
-	extern bool deferFirstPendingDataAfterFailure();
-	extern int cleanUploadedData(int keepCount);
+// Cache drain statistics.
+static uint32_t g_cacheUploadTotal = 0;
+static float g_cacheUploadRate = 0.0f;
+
+uint32_t getCacheUploadTotal() {
+	return g_cacheUploadTotal;
+}
+
+float getCacheUploadRate() {
+	return g_cacheUploadRate;
+}
+
+// Publish a batch of cached samples back-to-back under a single MQTT mutex hold.
+// Returns how many items (from the front of the batch) were handed to the broker.
+static int publishBatch(const std::vector<PendingData>& batch, unsigned long timeoutMs) {
+	ensureMqttMutex();
+	maintainWiFi();
+
+	if (xSemaphoreTake(g_mqttMutex, pdMS_TO_TICKS(timeoutMs)) != pdTRUE) {
+		Serial.printf("[MQTT] publishBatch: mutex timeout >%lu ms\n", timeoutMs);
+		return 0;
+	}
+
+	unsigned long start = millis();
+	while (!mqttClient.connected()) {
+		if (millis() - start > timeoutMs) {
+			Serial.printf("[MQTT] publishBatch: connect timeout >%lu ms\n", timeoutMs);
+			xSemaphoreGive(g_mqttMutex);
+			return 0;
+		}
+		maintainWiFi();
+		connectToMQTT(timeoutMs - (millis() - start));
+	}
+	mqttClient.loop();
+
+	int sent = 0;
+	for (const auto& item : batch) {
+		if (!mqttClient.publish(item.topic.c_str(), item.payload.c_str())) {
+			Serial.printf("[MQTT] Batch publish stopped at #%d, state=%d\n", sent, mqttClient.state());
+			break;
+		}
+		sent++;
+	}
+
+	xSemaphoreGive(g_mqttMutex);
+	feedTaskWatchdog();
+	return sent;
+}
 
+// Attempt to upload pending cached samples in batches of appConfig.cacheUploadBatch:
+// one cache read per batch, back-to-back publishes, one cursor write for the acks.
+int uploadCachedData(int maxUpload) {
 	int pendingCount = getPendingDataCount();
 	if (pendingCount <= 0) {
 		return 0;
 	}
 
-	Serial.printf("[Cache] Found %d pending data items, uploading up to %d...\n", pendingCount, maxUpload);
+	int batchSize = appConfig.cacheUploadBatch > 0 ? appConfig.cacheUploadBatch : 1;
+	Serial.printf("[Cache] Found %d pending data items, uploading up to %d (batch %d)...\n",
+		pendingCount, maxUpload, batchSize);
 
 	const int maxFailuresPerRun = 2;
 	int uploadedCount = 0;
 	int failureCount = 0;
-	for (int i = 0; i < maxUpload; i++) {
-		String topic, payload, timestamp;
-
-		if (!getFirstPendingData(topic, payload, timestamp)) {
+	unsigned long startMs = millis();
+	std::vector<PendingData> batch;
+
+	while (uploadedCount < maxUpload) {
+		int want = min(batchSize, maxUpload - uploadedCount);
+		if (getPendingDataBatch(batch, want) <= 0) {
+			// The head record could not be read; let the defer path skip it.
+			if (getPendingDataCount() > 0) {
+				deferFirstPendingDataAfterFailure();
+				failureCount++;
+				if (failureCount >= maxFailuresPerRun) break;
+				continue;
+			}
 			Serial.println("[Cache] No more pending data");
 			break;
 		}
 
-		Serial.printf("[Cache] Uploading cached data (timestamp: %s)...\n", timestamp.c_str());
-
-		if (publishData(topic, payload, 5000)) {
-			Serial.println("[Cache] Cached data uploaded successfully");
-			markFirstDataAsUploaded();
-			uploadedCount++;
+		int sent = publishBatch(batch, 5000);
+		if (sent > 0) {
+			// Ack by position: MeasureTask may evict head records while the batch
+			// is being published, so a count would also drop unsent ones.
+			markPendingDataAsUploadedThrough(batch[sent - 1].pos);
+			uploadedCount += sent;
 			failureCount = 0;
-			delay(200);
 		}
-		else {
+
+		if (sent < (int)batch.size()) {
 			Serial.println("[Cache] Upload failed, keeping cached data for next retry");
 			deferFirstPendingDataAfterFailure();
 			failureCount++;
@@ -459,16 +534,21 @@ int uploadCachedData(int maxUpload) {
 				break;
 			}
 			delay(200);
+			feedTaskWatchdog();
 		}
 	}
 
 	if (uploadedCount > 0) {
-		Serial.printf("[Cache] Uploaded %d cached data items\n", uploadedCount);
+		unsigned long elapsedMs = millis() - startMs;
+		g_cacheUploadTotal += uploadedCount;
+		g_cacheUploadRate = uploadedCount * 1000.0f / (float)(elapsedMs > 0 ? elapsedMs : 1);
+		Serial.printf("[Cache] Uploaded %d cached data items in %lu ms (%.1f items/s)\n",
+			uploadedCount, elapsedMs, g_cacheUploadRate);
 
-		// Keep the latest uploaded record for basic auditability.
+		// Uploaded records are recycled together with their log segment.
 		int cleaned = cleanUploadedData(1);
 		if (cleaned > 0) {
-			Serial.printf("[Cache] Cleaned %d old uploaded items (kept latest 1)\n", cleaned);
+			Serial.printf("[Cache] Recycled %d uploaded items\n", cleaned);
 		}
 	}
 	else {
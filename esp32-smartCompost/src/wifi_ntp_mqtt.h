@@ -16,8 +16,15 @@ String getTimeString();
 // ========== MQTT 核心操作 ==========
 bool connectToMQTT(unsigned long timeoutMs);
 void maintainMQTT(unsigned long timeoutMs);
+// topic 上一条 PUBLISH 能带的最大 payload 字节数（MQTT 缓冲区扣除报文头与 topic）
+size_t mqttPayloadLimit(const String& topic);
 bool publishData(const String& topic, const String& payload, unsigned long timeoutMs);
+bool publishData(const String& topic, const char* payload, unsigned long timeoutMs);
 bool publishDataOrCache(const String& topic, const String& payload, const String& timestamp, unsigned long timeoutMs);
 int uploadCachedData(int maxUpload = 10);
 
+// ========== 缓存补传统计 ==========
+uint32_t getCacheUploadTotal();  // 启动以来补传成功的缓存条数
+float getCacheUploadRate();      // 最近一次补传的吞吐（条/秒）
+
 #endif
@@ -0,0 +1,24 @@
+// command_filter.cpp
+// 命令报文过滤解析实现
+
+#include "command_filter.h"
+
+static JsonDocument& commandFilter() {
+    static JsonDocument filter;   // 只在 MQTT 回调（loop 任务）里用，首次调用时构建
+    if (filter.isNull()) {
+        filter["device"] = true;
+        JsonObject cmd = filter["commands"].add<JsonObject>();
+        cmd["command"] = true;
+        cmd["action"] = true;
+        cmd["duration"] = true;
+        cmd["schedule"] = true;
+        cmd["config"] = true;
+    }
+    return filter;
+}
+
+DeserializationError parseCommandPayload(JsonDocument& doc, const byte* payload, unsigned int length) {
+    return deserializeJson(doc, payload, length,
+        DeserializationOption::Filter(commandFilter()),
+        DeserializationOption::NestingLimit(COMMAND_NESTING_LIMIT));
+}
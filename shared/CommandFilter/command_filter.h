@@ -0,0 +1,25 @@
+// command_filter.h
+// 命令报文过滤解析
+// 功能：用 ArduinoJson 过滤文档只保留 device 与 commands[] 里用到的字段，其余内容解析时直接跳过，不占内存。
+// 报文长度不另设上限：超过 PubSubClient 缓冲区（见 telemetry_writer.h）的报文在回调之前就被丢弃。
+// MMCGS 与 smartCompost 通过 platformio.ini 的 lib_extra_dirs 共用这一份。
+
+#ifndef COMMAND_FILTER_H
+#define COMMAND_FILTER_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+// 根 > commands > 命令 > config 三层，再留一层余量
+static const uint8_t COMMAND_NESTING_LIMIT = 7;
+
+/**
+ * @brief 按过滤文档解析一条命令报文
+ * @param doc 解析结果，只含 device 与 commands[] 的 command / action / duration / schedule / config
+ * @param payload MQTT 回调收到的报文
+ * @param length 报文长度
+ * @return ArduinoJson 的解析结果，嵌套过深时为 TooDeep
+ */
+DeserializationError parseCommandPayload(JsonDocument& doc, const byte* payload, unsigned int length);
+
+#endif
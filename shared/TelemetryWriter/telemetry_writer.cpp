@@ -0,0 +1,111 @@
+// telemetry_writer.cpp
+// schema_version 2 遥测 payload 写入器实现
+
+#include "telemetry_writer.h"
+#include <math.h>
+
+TelemetryWriter::TelemetryWriter(char* buf, size_t capacity)
+    : _buf(buf), _cap(capacity), _len(0), _overflow(capacity == 0), _firstChannel(true) {
+    if (_cap > 0) {
+        _buf[0] = '\0';
+    }
+}
+
+void TelemetryWriter::append(const char* s) {
+    append(s, strlen(s));
+}
+
+void TelemetryWriter::append(const char* s, size_t n) {
+    if (_overflow) {
+        return;
+    }
+    if (_len + n >= _cap) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_buf + _len, s, n);
+    _len += n;
+    _buf[_len] = '\0';
+}
+
+void TelemetryWriter::appendQuoted(const char* s) {
+    append("\"");
+    // 设备编号等来自配置，需要转义；UTF-8 多字节字符（如 ℃）原样写入
+    const char* run = s;
+    for (const char* p = s; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        append(run, p - run);
+        char esc[8];
+        if (c == '"' || c == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)c;
+            esc[2] = '\0';
+        }
+        else {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+        }
+        append(esc);
+        run = p + 1;
+    }
+    append(run);
+    append("\"");
+}
+
+void TelemetryWriter::begin(const char* ts) {
+    _len = 0;
+    _overflow = _cap == 0;
+    _firstChannel = true;
+    if (_cap > 0) {
+        _buf[0] = '\0';
+    }
+    append("{\"schema_version\":2,\"ts\":");
+    appendQuoted(ts);
+}
+
+void TelemetryWriter::pointId(unsigned id) {
+    char num[12];
+    snprintf(num, sizeof(num), "%u", id);
+    append(",\"point_id\":");
+    append(num);
+}
+
+void TelemetryWriter::controllerCode(const char* code) {
+    append(",\"controller_device_code\":");
+    appendQuoted(code);
+}
+
+void TelemetryWriter::beginChannels() {
+    append(",\"channels\":[");
+    _firstChannel = true;
+}
+
+void TelemetryWriter::channel(const char* code, float value, uint8_t decimals, const char* unit, const char* quality) {
+    // 与 String(float, decimals) 使用同一个 dtostrf，保证数值格式不变；
+    // dtostrf 会把 NaN / inf 写成 nan / inf，那不是合法的 JSON 数值
+    char num[48];
+    if (isfinite(value)) {
+        dtostrf(value, decimals + 2, decimals, num);
+    }
+    else {
+        strcpy(num, "null");
+    }
+
+    append(_firstChannel ? "{\"code\":" : ",{\"code\":");
+    _firstChannel = false;
+    appendQuoted(code);
+    append(",\"value\":");
+    append(num);
+    append(",\"unit\":");
+    appendQuoted(unit);
+    append(",\"quality\":");
+    appendQuoted(quality);
+    append("}");
+}
+
+bool TelemetryWriter::end() {
+    append("]}");
+    return !_overflow;
+}
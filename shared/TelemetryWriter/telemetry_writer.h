@@ -0,0 +1,83 @@
+// telemetry_writer.h
+// schema_version 2 遥测 payload 写入器
+// 功能：在调用方提供的固定缓冲区里按通道拼出遥测 JSON，全程不申请堆内存。
+// 输出与原先 String 拼接的结果逐字节一致，缓冲区不足时标记溢出而不是截断成非法 JSON。
+// 例外只有原先会拼出非法 JSON 的输入：NaN / inf 写成 null，字符串里的引号、反斜杠和控制字符转义。
+// MMCGS 与 smartCompost 通过 platformio.ini 的 lib_extra_dirs 共用这一份；主机测试见 test/。
+
+#ifndef TELEMETRY_WRITER_H
+#define TELEMETRY_WRITER_H
+
+#include <Arduino.h>
+
+// 共用本写入器的固件都按这个大小调用 PubSubClient::setBufferSize。
+// 一条 PUBLISH 要整条放进该缓冲区，否则 PubSubClient 直接拒发、不报原因。
+static const size_t TELEMETRY_MQTT_BUFFER_SIZE = 2048;
+// 固定头最多 5 字节 + topic 长度 2 字节 + QoS1 报文编号 2 字节
+static const size_t TELEMETRY_MQTT_HEADER_MAX = 9;
+// compostlab/v2/{device_code}/telemetry，device_code 最长约 100 字节
+static const size_t TELEMETRY_TOPIC_MAX = 128;
+
+// 单条遥测 payload 的缓冲区上限（含结尾 '\0'），由 MQTT 缓冲区扣除报文头与 topic 得出：
+// 放得进写入器的 payload 一定发得出去，超长在 end() 处报告，而不是被 PubSubClient 静默丢弃。
+// MMCGS 7 个测量通道 + 6 个堆通道约 1000 字节。
+static const size_t TELEMETRY_PAYLOAD_MAX =
+    TELEMETRY_MQTT_BUFFER_SIZE - TELEMETRY_MQTT_HEADER_MAX - TELEMETRY_TOPIC_MAX;
+
+class TelemetryWriter {
+public:
+    TelemetryWriter(char* buf, size_t capacity);
+
+    /**
+     * @brief 开始一条 payload，写入 schema_version 与 ts
+     */
+    void begin(const char* ts);
+
+    /**
+     * @brief 写入 point_id（需在 beginChannels 之前）
+     */
+    void pointId(unsigned id);
+
+    /**
+     * @brief 写入 controller_device_code（需在 beginChannels 之前）
+     */
+    void controllerCode(const char* code);
+
+    /**
+     * @brief 开始 channels 数组
+     */
+    void beginChannels();
+
+    /**
+     * @brief 追加一个通道
+     * @param code 通道编码
+     * @param value 数值，NaN / inf 写成 null
+     * @param decimals 小数位数
+     * @param unit 单位
+     * @param quality 质量标记
+     */
+    void channel(const char* code, float value, uint8_t decimals, const char* unit, const char* quality);
+
+    /**
+     * @brief 结束 channels 数组与整个对象
+     * @return true 完整写入 false 缓冲区不足
+     */
+    bool end();
+
+    bool overflowed() const { return _overflow; }
+    const char* c_str() const { return _buf; }
+    size_t length() const { return _len; }
+
+private:
+    void append(const char* s);
+    void append(const char* s, size_t n);
+    void appendQuoted(const char* s);
+
+    char* _buf;
+    size_t _cap;
+    size_t _len;
+    bool _overflow;
+    bool _firstChannel;
+};
+
+#endif
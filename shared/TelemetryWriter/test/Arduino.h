@@ -0,0 +1,103 @@
+// Arduino.h（主机测试用）
+// 只提供 TelemetryWriter 与测试里旧版 String 拼接需要的部分。
+// dtostrf 照搬 arduino-esp32 cores/esp32/stdlib_noniso.c，String(float, n) 与设备上一样走它。
+
+// Minimal host stand-in for <Arduino.h>, used only by telemetry_writer_test.cpp.
+
+#ifndef TELEMETRY_WRITER_TEST_ARDUINO_H
+#define TELEMETRY_WRITER_TEST_ARDUINO_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+static inline char* dtostrf(double number, signed int width, unsigned int prec, char* s) {
+    bool negative = false;
+
+    if (isnan(number)) {
+        strcpy(s, "nan");
+        return s;
+    }
+    if (isinf(number)) {
+        strcpy(s, "inf");
+        return s;
+    }
+
+    char* out = s;
+    int fillme = width;   // 整数部分要占的宽度
+    if (prec > 0) {
+        fillme -= (prec + 1);
+    }
+    if (number < 0.0) {
+        negative = true;
+        fillme--;
+        number = -number;
+    }
+
+    // 四舍五入：print(1.999, 2) 输出 "2.00"
+    double rounding = 2.0;
+    for (unsigned int i = 0; i < prec; ++i) {
+        rounding *= 10.0;
+    }
+    rounding = 1.0 / rounding;
+    number += rounding;
+
+    double tenpow = 1.0;
+    int digitcount = 1;
+    while (number >= 10.0 * tenpow) {
+        tenpow *= 10.0;
+        digitcount++;
+    }
+    number /= tenpow;
+    fillme -= digitcount;
+
+    // 宽度不足时左侧补空格
+    while (fillme-- > 0) {
+        *out++ = ' ';
+    }
+    if (negative) {
+        *out++ = '-';
+    }
+
+    digitcount += prec;
+    int8_t digit = 0;
+    while (digitcount-- > 0) {
+        digit = (int8_t)number;
+        if (digit > 9) {
+            digit = 9;
+        }
+        *out++ = (char)('0' | digit);
+        if ((digitcount == (int)prec) && (prec > 0)) {
+            *out++ = '.';
+        }
+        number -= digit;
+        number *= 10.0;
+    }
+    *out = 0;
+    return s;
+}
+
+class String {
+public:
+    String() {}
+    String(const char* s) : _s(s ? s : "") {}
+    String(unsigned v) : _s(std::to_string(v)) {}
+    String(float v, unsigned decimals = 2) {
+        char buf[48];
+        _s = dtostrf(v, decimals + 2, decimals, buf);
+    }
+
+    const char* c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.size(); }
+    String& operator+=(const String& o) { _s += o._s; return *this; }
+    String& operator+=(const char* o) { _s += o; return *this; }
+    friend String operator+(const String& a, const String& b) { return String((a._s + b._s).c_str()); }
+
+private:
+    std::string _s;
+};
+
+#endif
@@ -0,0 +1,255 @@
+// telemetry_writer_test.cpp
+// TelemetryWriter 主机测试：与原先 MMCGS / smartCompost 的 String 拼接逐字节比对，
+// 并检查 dtostrf 宽度与小数位、NaN / inf、字符串转义和缓冲区溢出。
+//
+// 编译运行（在 shared/TelemetryWriter 目录下）：
+//   g++ -std=c++11 -Wall -Itest -I. test/telemetry_writer_test.cpp telemetry_writer.cpp -o /tmp/telemetry_writer_test
+//   /tmp/telemetry_writer_test
+
+#include "telemetry_writer.h"
+#include <random>
+
+static int g_failures = 0;
+
+static void expectEqual(const char* what, const char* got, const char* want) {
+    if (strcmp(got, want) != 0) {
+        printf("FAIL %s\n  got:  %s\n  want: %s\n", what, got, want);
+        g_failures++;
+    }
+}
+
+static void expectTrue(const char* what, bool ok) {
+    if (!ok) {
+        printf("FAIL %s\n", what);
+        g_failures++;
+    }
+}
+
+// ========== 原先的 String 拼接（基线版本原样搬来） ==========
+
+static const char* qualityOf(float value) {
+    return value < 0 ? "ERR" : "OK";
+}
+
+// esp32-MMCGS/src/main.cpp appendChannel
+static void appendChannel(String& payload, bool& firstChannel, const char* code, float value,
+    int decimals, const char* unit, const char* qualityOverride = nullptr) {
+    if (!firstChannel) {
+        payload += ",";
+    }
+    firstChannel = false;
+
+    payload += "{";
+    payload += "\"code\":\"" + String(code) + "\",";
+    payload += "\"value\":" + String(value, decimals) + ",";
+    payload += "\"unit\":\"" + String(unit) + "\",";
+    payload += "\"quality\":\"" + String(qualityOverride ? qualityOverride : qualityOf(value)) + "\"";
+    payload += "}";
+}
+
+static String legacyPointPayload(const String& ts, unsigned pointId, const String& deviceCode, const float v[7]) {
+    String payload = "{";
+    payload += "\"schema_version\":2,";
+    payload += "\"ts\":\"" + ts + "\",";
+    payload += "\"point_id\":" + String(pointId) + ",";
+    payload += "\"controller_device_code\":\"" + deviceCode + "\",";
+    payload += "\"channels\":[";
+    bool firstChannel = true;
+    appendChannel(payload, firstChannel, "CO2", v[0], 2, "%VOL", "UNSTABLE");
+    appendChannel(payload, firstChannel, "CO", v[1], 1, "ppm");
+    appendChannel(payload, firstChannel, "H2S", v[2], 1, "ppm");
+    appendChannel(payload, firstChannel, "O2", v[3], 2, "%VOL");
+    appendChannel(payload, firstChannel, "CH4", v[4], 1, "%LEL");
+    appendChannel(payload, firstChannel, "AirTemp", v[5], 1, "℃");
+    appendChannel(payload, firstChannel, "AirHumidity", v[6], 1, "%RH");
+    payload += "]}";
+    return payload;
+}
+
+// esp32-smartCompost/src/main.cpp doMeasurementAndSave
+static String legacyCompostPayload(const String& ts, float co2pct, float o2) {
+    String payload = "{";
+    payload += "\"schema_version\":2,";
+    payload += "\"ts\":\"" + ts + "\",";
+    payload += "\"channels\":[";
+    payload += "{";
+    payload += "\"code\":\"CO2\",";
+    payload += "\"value\":" + String(co2pct, 2) + ",";
+    payload += "\"unit\":\"%VOL\",";
+    payload += "\"quality\":\"" + String(qualityOf(co2pct)) + "\"";
+    payload += "},";
+    payload += "{";
+    payload += "\"code\":\"O2\",";
+    payload += "\"value\":" + String(o2, 2) + ",";
+    payload += "\"unit\":\"%VOL\",";
+    payload += "\"quality\":\"" + String(qualityOf(o2)) + "\"";
+    payload += "}";
+    payload += "]}";
+    return payload;
+}
+
+// ========== 测试 ==========
+
+static void testMatchesLegacyBuilders() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-5.0f, 1000.0f);
+    const String ts = "2026-10-16 12:00:00";
+    const String deviceCode = "MMCGS001";
+    char buf[TELEMETRY_PAYLOAD_MAX];
+
+    for (int iter = 0; iter < 20000; iter++) {
+        float v[7];
+        for (float& x : v) {
+            x = (iter % 5 == 0) ? -1.0f : dist(rng);
+        }
+        if (iter % 89 == 0) v[3] = 0.125f;   // 刚好落在舍入边界上
+
+        unsigned pointId = 1 + iter % 6;
+        TelemetryWriter w(buf, sizeof(buf));
+        w.begin(ts.c_str());
+        w.pointId(pointId);
+        w.controllerCode(deviceCode.c_str());
+        w.beginChannels();
+        w.channel("CO2", v[0], 2, "%VOL", "UNSTABLE");
+        w.channel("CO", v[1], 1, "ppm", qualityOf(v[1]));
+        w.channel("H2S", v[2], 1, "ppm", qualityOf(v[2]));
+        w.channel("O2", v[3], 2, "%VOL", qualityOf(v[3]));
+        w.channel("CH4", v[4], 1, "%LEL", qualityOf(v[4]));
+        w.channel("AirTemp", v[5], 1, "℃", qualityOf(v[5]));
+        w.channel("AirHumidity", v[6], 1, "%RH", qualityOf(v[6]));
+        expectTrue("MMCGS payload fits", w.end());
+        if (strcmp(buf, legacyPointPayload(ts, pointId, deviceCode, v).c_str()) != 0) {
+            expectEqual("MMCGS payload", buf, legacyPointPayload(ts, pointId, deviceCode, v).c_str());
+            return;
+        }
+
+        w.begin(ts.c_str());
+        w.beginChannels();
+        w.channel("CO2", v[0], 2, "%VOL", qualityOf(v[0]));
+        w.channel("O2", v[3], 2, "%VOL", qualityOf(v[3]));
+        expectTrue("smartCompost payload fits", w.end());
+        if (strcmp(buf, legacyCompostPayload(ts, v[0], v[3]).c_str()) != 0) {
+            expectEqual("smartCompost payload", buf, legacyCompostPayload(ts, v[0], v[3]).c_str());
+            return;
+        }
+    }
+}
+
+// 单个通道的 value 字段
+static void expectValue(float value, uint8_t decimals, const char* want) {
+    char buf[160];
+    char expected[160];
+    TelemetryWriter w(buf, sizeof(buf));
+    w.begin("t");
+    w.beginChannels();
+    w.channel("X", value, decimals, "u", "OK");
+    w.end();
+    snprintf(expected, sizeof(expected),
+        "{\"schema_version\":2,\"ts\":\"t\",\"channels\":[{\"code\":\"X\",\"value\":%s,\"unit\":\"u\",\"quality\":\"OK\"}]}", want);
+    char what[48];
+    snprintf(what, sizeof(what), "value %g with %u decimals", value, (unsigned)decimals);
+    expectEqual(what, buf, expected);
+}
+
+static void testDtostrfWidthAndDecimals() {
+    // 宽度为 decimals + 2：位数不够时 dtostrf 左侧补空格，与 String(float, n) 相同
+    expectValue(5.0f, 0, " 5");
+    expectValue(42.0f, 0, "42");
+    expectValue(154320.0f, 0, "154320");
+    expectValue(0.0f, 1, "0.0");
+    expectValue(21.26f, 1, "21.3");
+    expectValue(0.125f, 2, "0.13");
+    expectValue(1.999f, 2, "2.00");
+    expectValue(-1.0f, 2, "-1.00");
+    expectValue(-0.04f, 1, "-0.0");
+    expectValue(987.65f, 1, "987.7");
+}
+
+static void testNonFiniteValues() {
+    expectValue(NAN, 1, "null");
+    expectValue(INFINITY, 2, "null");
+    expectValue(-INFINITY, 0, "null");
+}
+
+static void testEscaping() {
+    char buf[256];
+    TelemetryWriter w(buf, sizeof(buf));
+    w.begin("2026-10-16 12:00:00");
+    w.pointId(2);
+    w.controllerCode("A\"B\\C\nD\x01");
+    w.beginChannels();
+    w.channel("AirTemp", 20.0f, 1, "℃", "OK");
+    expectTrue("escaped payload fits", w.end());
+    expectEqual("escaping", buf,
+        "{\"schema_version\":2,\"ts\":\"2026-10-16 12:00:00\",\"point_id\":2,"
+        "\"controller_device_code\":\"A\\\"B\\\\C\\u000aD\\u0001\","
+        "\"channels\":[{\"code\":\"AirTemp\",\"value\":20.0,\"unit\":\"℃\",\"quality\":\"OK\"}]}");
+}
+
+// 最长的实时 payload（MMCGS 全部通道取最宽的数值）放得进写入器，
+// 写入器的上限加上报文头和最长 topic 不超过 MQTT 缓冲区
+static void testWorstCasePayloadFitsMqttBuffer() {
+    char buf[TELEMETRY_PAYLOAD_MAX];
+    TelemetryWriter w(buf, sizeof(buf));
+    w.begin("2026-10-16 12:00:00");
+    w.pointId(6);
+    w.controllerCode("MMCGS-0000000000000000");
+    w.beginChannels();
+    w.channel("CO2", -99999.0f, 2, "%VOL", "UNSTABLE");
+    w.channel("CO", -99999.0f, 1, "ppm", "UNSTABLE");
+    w.channel("H2S", -99999.0f, 1, "ppm", "UNSTABLE");
+    w.channel("O2", -99999.0f, 2, "%VOL", "UNSTABLE");
+    w.channel("CH4", -99999.0f, 1, "%LEL", "UNSTABLE");
+    w.channel("AirTemp", -99999.0f, 1, "℃", "UNSTABLE");
+    w.channel("AirHumidity", -99999.0f, 1, "%RH", "UNSTABLE");
+    w.channel("HeapFree", 4294967040.0f, 0, "B", "OK");
+    w.channel("HeapMaxBlock", 4294967040.0f, 0, "B", "OK");
+    w.channel("HeapMinFree", 4294967040.0f, 0, "B", "OK");
+    w.channel("HeapFrag", 100.0f, 0, "%", "OK");
+    w.channel("StackMeasure", 4294967040.0f, 0, "B", "OK");
+    w.channel("StackCommand", 4294967040.0f, 0, "B", "OK");
+    expectTrue("worst-case payload fits", w.end());
+    expectTrue("writer limit fits the MQTT buffer",
+        TELEMETRY_PAYLOAD_MAX - 1 + TELEMETRY_TOPIC_MAX + TELEMETRY_MQTT_HEADER_MAX <= TELEMETRY_MQTT_BUFFER_SIZE);
+}
+
+static void testOverflow() {
+    char buf[48];
+    memset(buf, 'x', sizeof(buf));
+    TelemetryWriter w(buf, sizeof(buf));
+    w.begin("2026-10-16 12:00:00");
+    w.beginChannels();
+    w.channel("CO2", 1.0f, 2, "%VOL", "OK");
+    expectTrue("overflow reported", !w.end());
+    expectTrue("overflow flag", w.overflowed());
+    expectTrue("stays terminated", strlen(buf) < sizeof(buf));
+
+    // 刚好放得下（含结尾 '\0'）
+    const char* exact = "{\"schema_version\":2,\"ts\":\"t\",\"channels\":[]}";
+    char fit[64];
+    TelemetryWriter w2(fit, strlen(exact) + 1);
+    w2.begin("t");
+    w2.beginChannels();
+    expectTrue("exact fit", w2.end());
+    expectEqual("exact fit payload", fit, exact);
+
+    TelemetryWriter w3(fit, strlen(exact));
+    w3.begin("t");
+    w3.beginChannels();
+    expectTrue("one byte short", !w3.end());
+}
+
+int main() {
+    testMatchesLegacyBuilders();
+    testDtostrfWidthAndDecimals();
+    testNonFiniteValues();
+    testEscaping();
+    testWorstCasePayloadFitsMqttBuffer();
+    testOverflow();
+    if (g_failures > 0) {
+        printf("%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    printf("telemetry_writer_test: OK\n");
+    return 0;
+}